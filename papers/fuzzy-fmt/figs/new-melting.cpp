@@ -22,18 +22,22 @@
 #include "new/SFMTFluidVeffFast.h"
 #include "new/HomogeneousSFMTFluidFast.h"
 #include "new/Minimize.h"
+#include "new/Sweep.h"
 #include "version-identifier.h"
 
 const bool use_veff = true;
 
-static void took(const char *name) {
-  static clock_t last_time = clock();
-  clock_t t = clock();
-  assert(name); // so it'll count as being used...
+// thread_seconds gives the CPU time used by the calling thread, which
+// unlike clock() doesn't count the other threads of a sweep.
+static double thread_seconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+static void took(SweepWorker *w, const char *name, double start) {
   double peak = peak_memory()/1024.0/1024;
-  printf("\t\t%s took %g seconds and %g M memory\n", name, (t-last_time)/double(CLOCKS_PER_SEC), peak);
-  fflush(stdout);
-  last_time = t;
+  w->report("\t\t%s took %g seconds and %g M memory\n", name, thread_seconds() - start, peak);
 }
 
 double inhomogeneity(Vector n) {
@@ -46,35 +50,42 @@ double inhomogeneity(Vector n) {
   return (maxn - minn)/fabs(minn);
 }
 
-void run_solid(double lattice_constant, double reduced_density, double kT,
-               SFMTFluidVeff *fveff, SFMTFluid *f,
-               double homogeneous_free_energy) {
+// run_solid minimizes the free energy of the solid, and returns its
+// free energy, the homogeneous free energy, and the number of
+// iterations.
+std::vector<double> run_solid(double lattice_constant, double reduced_density, double kT,
+                              SFMTFluidVeff *fveff, SFMTFluid *f,
+                              double homogeneous_free_energy, Verbosity v, SweepWorker *w) {
+  const double start = thread_seconds();
   Minimize min = (use_veff) ? Minimize(fveff) : Minimize(f);
   min.set_relative_precision(1e-12);
   min.set_maxiter(10000);
   min.set_miniter(9);
   min.precondition(true);
 
-  printf("========================================\n");
-  printf("| Working on rho* = %4g and kT = %4g and a = %g |\n", reduced_density, kT, lattice_constant);
-  printf("========================================\n");
-  while (min.improve_energy(verbose)) {
+  w->report("========================================\n"
+            "| Working on rho* = %4g and kT = %4g and a = %g |\n"
+            "========================================\n", reduced_density, kT, lattice_constant);
+  while (min.improve_energy(v)) {
     //f->run_finite_difference_test("SFMT");
-    printf("Compare with homogeneous free energy: %.15g\n", homogeneous_free_energy);
     Vector n = (use_veff) ? fveff->get_n() : f->n();
     double inh = inhomogeneity(n);
-    printf("Inhomogeneity is %g\n", inh);
-    double Ntot = n.sum()*f->get_dV();
-    printf("Ntot = %g\n", Ntot);
-    printf("n*bar = %g\n", Ntot/f->get_volume());
-    printf("\n");
+    if (v >= verbose) {
+      w->report("Compare with homogeneous free energy: %.15g\n", homogeneous_free_energy);
+      w->report("Inhomogeneity is %g\n", inh);
+      double Ntot = n.sum()*f->get_dV();
+      w->report("Ntot = %g\n", Ntot);
+      w->report("n*bar = %g\n\n", Ntot/f->get_volume());
+    }
     if (inh < 1) {
-      printf("It is flat enough for me!\n");
+      w->report("It is flat enough for me!\n");
       break;
     }
   }
-  took("Doing the minimization");
-  min.print_info();
+  if (v >= verbose) {
+    took(w, "Doing the minimization", start);
+    min.print_info();
+  }
 
   char *fname = new char[5000];
   mkdir("papers/fuzzy-fmt/figs/new-data", 0777); // make sure the directory exists
@@ -93,162 +104,236 @@ void run_solid(double lattice_constant, double reduced_density, double kT,
     fprintf(o, "%g\t%g\n", rz[i], n[i]);
   }
   fclose(o);
+  if (v < verbose) {
+    w->report("Finished a = %g, rho* = %g, kT = %g with F = %.15g (liquid %.15g)\n",
+              lattice_constant, reduced_density, kT, min.energy(), homogeneous_free_energy);
+  }
+  return {min.energy(), homogeneous_free_energy, double(min.get_iteration_count())};
 }
 
-int main(int argc, char **argv) {
-  double lattice_constant, reduced_density, temp;
-  if (argc != 4) {
-    printf("usage: %s reduced-lattice-constant nliquid-reduced kT\n", argv[0]);
-    return 1;
+// A MeltingWorker computes the free energy of the solid for one state
+// point at a time, so that we can run a whole scan in parallel.
+class MeltingWorker : public SweepWorker {
+public:
+  MeltingWorker() : fveff(0), f(0), homogeneous_free_energy(0), v(verbose) {}
+  ~MeltingWorker() {
+    delete fveff;
+    delete f;
   }
-  printf("git version: %s\n", version_identifier());
-  sscanf(argv[1], "%lg", &lattice_constant);
-  sscanf(argv[2], "%lg", &reduced_density);
-  sscanf(argv[3], "%lg", &temp);
-
-  HomogeneousSFMTFluid hf;
-  hf.sigma() = 1;
-  hf.epsilon() = 1;
-  hf.kT() = temp;
-  hf.n() = reduced_density;
-  hf.mu() = 0;
-  hf.mu() = hf.d_by_dn(); // set mu based on derivative of hf
-
-  const double homogeneous_free_energy = hf.energy()*lattice_constant*lattice_constant*lattice_constant;
-  printf("bulk energy is %g\n", hf.energy());
-  printf("liquid cell free energy should be %g\n", homogeneous_free_energy);
-
-  const double dx = 0.05;
-  SFMTFluidVeff fveff(lattice_constant, lattice_constant, lattice_constant, dx);
-  SFMTFluid f(lattice_constant, lattice_constant, lattice_constant, dx);
-  f.sigma() = hf.sigma();
-  f.epsilon() = hf.epsilon();
-  f.kT() = hf.kT();
-  f.mu() = hf.mu();
-  f.Vext() = 0;
-  f.n() = hf.n();
-
-  fveff.sigma() = hf.sigma();
-  fveff.epsilon() = hf.epsilon();
-  fveff.kT() = hf.kT();
-  fveff.mu() = hf.mu();
-  fveff.Vext() = 0;
-  fveff.Veff() = 0;
-
-  {
-    const int Ntot = f.Nx()*f.Ny()*f.Nz();
-    const Vector rrx = f.get_rx();
-    const Vector rry = f.get_ry();
-    const Vector rrz = f.get_rz();
-    const double gwidth = 0.1;
-    const double norm = 1.2*pow(sqrt(2*M_PI)*gwidth, 3); // the prefactor is a safety factor
-    Vector setn = (use_veff) ? fveff.Veff() : f.n();
-    for (int i=0; i<Ntot; i++) {
-      const double rx = rrx[i];
-      const double ry = rry[i];
-      const double rz = rrz[i];
-      setn[i] = 0.0000001*hf.n();
-      {
-        double dist = sqrt(rx*rx + ry*ry+rz*rz);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-      }
-      {
-        double dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
-                           (ry-lattice_constant/2)*(ry-lattice_constant/2) +
-                           rz*rz);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
-                    (ry-lattice_constant/2)*(ry-lattice_constant/2) +
-                    rz*rz);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
-                    (ry+lattice_constant/2)*(ry+lattice_constant/2) +
-                    rz*rz);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
-                    (ry+lattice_constant/2)*(ry+lattice_constant/2) +
-                    rz*rz);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-      }
-      {
-        double dist = sqrt((rz-lattice_constant/2)*(rz-lattice_constant/2) +
-                           (ry-lattice_constant/2)*(ry-lattice_constant/2) +
-                           rx*rx);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rz+lattice_constant/2)*(rz+lattice_constant/2) +
-                    (ry-lattice_constant/2)*(ry-lattice_constant/2) +
-                    rx*rx);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rz-lattice_constant/2)*(rz-lattice_constant/2) +
-                    (ry+lattice_constant/2)*(ry+lattice_constant/2) +
-                    rx*rx);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rz+lattice_constant/2)*(rz+lattice_constant/2) +
-                    (ry+lattice_constant/2)*(ry+lattice_constant/2) +
-                    rx*rx);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+  void set_up(const std::vector<double> &params) {
+    const double lattice_constant = params[0], reduced_density = params[1], temp = params[2];
+    HomogeneousSFMTFluid hf;
+    hf.sigma() = 1;
+    hf.epsilon() = 1;
+    hf.kT() = temp;
+    hf.n() = reduced_density;
+    hf.mu() = 0;
+    hf.mu() = hf.d_by_dn(); // set mu based on derivative of hf
+
+    homogeneous_free_energy = hf.energy()*lattice_constant*lattice_constant*lattice_constant;
+    report("bulk energy at rho* = %g and kT = %g is %g\n", reduced_density, temp, hf.energy());
+    report("liquid cell free energy should be %g\n", homogeneous_free_energy);
+
+    const double dx = 0.05;
+    delete fveff;
+    delete f;
+    fveff = new SFMTFluidVeff(lattice_constant, lattice_constant, lattice_constant, dx);
+    f = new SFMTFluid(lattice_constant, lattice_constant, lattice_constant, dx);
+    f->sigma() = hf.sigma();
+    f->epsilon() = hf.epsilon();
+    f->kT() = hf.kT();
+    f->mu() = hf.mu();
+    f->Vext() = 0;
+    f->n() = hf.n();
+
+    fveff->sigma() = hf.sigma();
+    fveff->epsilon() = hf.epsilon();
+    fveff->kT() = hf.kT();
+    fveff->mu() = hf.mu();
+    fveff->Vext() = 0;
+    fveff->Veff() = 0;
+
+    {
+      const int Ntot = f->Nx()*f->Ny()*f->Nz();
+      const Vector rrx = f->get_rx();
+      const Vector rry = f->get_ry();
+      const Vector rrz = f->get_rz();
+      const double gwidth = 0.1;
+      const double norm = 1.2*pow(sqrt(2*M_PI)*gwidth, 3); // the prefactor is a safety factor
+      Vector setn = (use_veff) ? fveff->Veff() : f->n();
+      for (int i=0; i<Ntot; i++) {
+        const double rx = rrx[i];
+        const double ry = rry[i];
+        const double rz = rrz[i];
+        setn[i] = 0.0000001*hf.n();
+        {
+          double dist = sqrt(rx*rx + ry*ry+rz*rz);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+        }
+        {
+          double dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
+                             (ry-lattice_constant/2)*(ry-lattice_constant/2) +
+                             rz*rz);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
+                      (ry-lattice_constant/2)*(ry-lattice_constant/2) +
+                      rz*rz);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
+                      (ry+lattice_constant/2)*(ry+lattice_constant/2) +
+                      rz*rz);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
+                      (ry+lattice_constant/2)*(ry+lattice_constant/2) +
+                      rz*rz);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+        }
+        {
+          double dist = sqrt((rz-lattice_constant/2)*(rz-lattice_constant/2) +
+                             (ry-lattice_constant/2)*(ry-lattice_constant/2) +
+                             rx*rx);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rz+lattice_constant/2)*(rz+lattice_constant/2) +
+                      (ry-lattice_constant/2)*(ry-lattice_constant/2) +
+                      rx*rx);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rz-lattice_constant/2)*(rz-lattice_constant/2) +
+                      (ry+lattice_constant/2)*(ry+lattice_constant/2) +
+                      rx*rx);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rz+lattice_constant/2)*(rz+lattice_constant/2) +
+                      (ry+lattice_constant/2)*(ry+lattice_constant/2) +
+                      rx*rx);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+        }
+        {
+          double dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
+                             (rz-lattice_constant/2)*(rz-lattice_constant/2) +
+                             ry*ry);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
+                      (rz-lattice_constant/2)*(rz-lattice_constant/2) +
+                      ry*ry);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
+                      (rz+lattice_constant/2)*(rz+lattice_constant/2) +
+                      ry*ry);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+
+          dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
+                      (rz+lattice_constant/2)*(rz+lattice_constant/2) +
+                      ry*ry);
+          setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+        }
       }
-      {
-        double dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
-                           (rz-lattice_constant/2)*(rz-lattice_constant/2) +
-                           ry*ry);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
-                    (rz-lattice_constant/2)*(rz-lattice_constant/2) +
-                    ry*ry);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx-lattice_constant/2)*(rx-lattice_constant/2) +
-                    (rz+lattice_constant/2)*(rz+lattice_constant/2) +
-                    ry*ry);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
-
-        dist = sqrt((rx+lattice_constant/2)*(rx+lattice_constant/2) +
-                    (rz+lattice_constant/2)*(rz+lattice_constant/2) +
-                    ry*ry);
-        setn[i] += exp(-0.5*dist*dist/gwidth/gwidth)/norm;
+      if (use_veff) {
+        for (int i=0; i<Ntot; i++) {
+          fveff->Veff()[i] = -temp*log(fveff->Veff()[i]); // convert from density to effective potential
+        }
       }
     }
-    if (use_veff) {
-      for (int i=0; i<Ntot; i++) {
-        fveff.Veff()[i] = -temp*log(fveff.Veff()[i]); // convert from density to effective potential
+
+    {
+      char *fname = new char[5000];
+      mkdir("papers/fuzzy-fmt/figs/new-data", 0777); // make sure the directory exists
+      snprintf(fname, 5000, "papers/fuzzy-fmt/figs/new-data/initial-melting-%04.2f-%04.2f-%04.2f.dat",
+               lattice_constant, reduced_density, temp);
+      FILE *o = fopen(fname, "w");
+      if (!o) {
+        fprintf(stderr, "error creating file %s\n", fname);
+        exit(1);
+      }
+      delete[] fname;
+      const int Nz = f->Nz();
+      Vector rz = f->get_rz();
+      Vector n = (use_veff) ? fveff->get_n() : f->n();
+      for (int i=0;i<Nz/2;i++) {
+        fprintf(o, "%g\t%g\n", rz[i], n[i]);
       }
+      fclose(o);
     }
-  }
 
-  {
-    char *fname = new char[5000];
-    mkdir("papers/fuzzy-fmt/figs/new-data", 0777); // make sure the directory exists
-    snprintf(fname, 5000, "papers/fuzzy-fmt/figs/new-data/initial-melting-%04.2f-%04.2f-%04.2f.dat",
-             lattice_constant, reduced_density, temp);
-    FILE *o = fopen(fname, "w");
-    if (!o) {
-      fprintf(stderr, "error creating file %s\n", fname);
+    report("my initial energy is %g\n", f->energy());
+    if (f->energy() != f->energy()) {
+      printf("FAIL!  nan for initial energy is bad!\n");
       exit(1);
     }
-    delete[] fname;
-    const int Nz = f.Nz();
-    Vector rz = f.get_rz();
-    Vector n = (use_veff) ? fveff.get_n() : f.n();
-    for (int i=0;i<Nz/2;i++) {
-      fprintf(o, "%g\t%g\n", rz[i], n[i]);
-    }
-    fclose(o);
+  }
+  Vector field() {
+    return (use_veff) ? fveff->Veff() : f->n();
+  }
+  void get_grid(int *Nx, int *Ny, int *Nz) {
+    *Nx = f->Nx();
+    *Ny = f->Ny();
+    *Nz = f->Nz();
+  }
+  std::vector<double> solve(const std::vector<double> &params) {
+    return run_solid(params[0], params[1], params[2], fveff, f, homogeneous_free_energy, v, this);
   }
 
-  printf("my initial energy is %g\n", f.energy());
-  if (f.energy() != f.energy()) {
-    printf("FAIL!  nan for initial energy is bad!\n");
-    exit(1);
+  SFMTFluidVeff *fveff;
+  SFMTFluid *f;
+  double homogeneous_free_energy;
+  Verbosity v;
+};
+
+static Verbosity worker_verbosity = verbose;
+SweepWorker *make_melting_worker() {
+  MeltingWorker *w = new MeltingWorker();
+  w->v = worker_verbosity;
+  return w;
+}
+
+// parse_range reads either a single number, or a range given as
+// start:stop:step, and returns the number of values.
+int parse_range(const char *arg, double *start, double *step) {
+  double stop;
+  *step = 1;
+  if (sscanf(arg, "%lg:%lg:%lg", start, &stop, step) == 3 && *step > 0) {
+    return 1 + int(floor((stop - *start)/(*step) + 1e-6));
+  }
+  if (sscanf(arg, "%lg", start) == 1) return 1;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  double a0, da, rho0, drho, kT0, dkT;
+  int na = 0, nrho = 0, nkT = 0;
+  if (argc == 4) {
+    na = parse_range(argv[1], &a0, &da);
+    nrho = parse_range(argv[2], &rho0, &drho);
+    nkT = parse_range(argv[3], &kT0, &dkT);
+  }
+  if (na < 1 || nrho < 1 || nkT < 1) {
+    printf("usage: %s reduced-lattice-constant nliquid-reduced kT\n", argv[0]);
+    printf("       where any argument may be a range start:stop:step\n");
+    return 1;
   }
+  printf("git version: %s\n", version_identifier());
 
-  run_solid(lattice_constant, reduced_density, temp, &fveff, &f, homogeneous_free_energy);
+  Sweep sweep("a rho* kT", "F_solid F_liquid iterations");
+  for (int ia=0; ia<na; ia++) {
+    for (int irho=0; irho<nrho; irho++) {
+      for (int ikT=0; ikT<nkT; ikT++) {
+        sweep.add_point({a0 + ia*da, rho0 + irho*drho, kT0 + ikT*dkT});
+      }
+    }
+  }
+  // With more than one point, we only print a summary of each
+  // minimization, rather than every iteration.
+  if (sweep.num_points() > 1) worker_verbosity = quiet;
+  sweep.run(make_melting_worker);
+  if (sweep.num_points() > 1) {
+    mkdir("papers/fuzzy-fmt/figs/new-data", 0777); // make sure the directory exists
+    sweep.write_table("papers/fuzzy-fmt/figs/new-data/melting-sweep.dat");
+  }
   return 0;
 }
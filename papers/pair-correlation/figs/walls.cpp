@@ -25,6 +25,7 @@
 #include "handymath.h"
 #include "errno.h"
 #include "sys/stat.h" // for mkdir
+#include "PairCorrelationTable.h"
 
 #include "ghs-analytics.h" // generated by plot-ghs.py
 #include "short-range-ghs-analytics.h"
@@ -32,7 +33,6 @@
 int count = 0;
 double radial_distribution(double gsigma, double r);
 double py_rdf (double eta, double r);
-double mc (double local_eta, double r, double r_step, double g[]);
 
 const double sigma = 2.0;
 // Maximum and spacing values for plotting
@@ -40,12 +40,10 @@ const double zmax = 6;
 const double xmax = 4;
 const double dx = 0.1;
 
-double mc_r_step;
 const int num_eta = 10;
 const double eta_step = 0.5/num_eta;
-const int num_r_in_gmc = 1300;
-const int gsize = num_r_in_gmc*(num_eta+1);
-double * g = new double[gsize];
+// The Monte Carlo g(r), which read_mc loads.
+PairCorrelationTable *gmc = 0;
 
 // The functions for different ways of computing the pair distribution function.
 double pairdist_this_work(const Grid &gsigma, const Grid &density, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
@@ -65,35 +63,41 @@ double pairdist_this_work_mc(const Grid &gsigma, const Grid &density, const Grid
   const double r = sqrt(r01.dot(r01));
   const double eta0 = gsigma_to_eta(gsigma(r0));
   const double eta1 = gsigma_to_eta(gsigma(r1));
-  return (mc(eta0, r, mc_r_step, g) + mc(eta1, r, mc_r_step, g))/2.0;
+  return ((*gmc)(eta0, r) + (*gmc)(eta1, r))/2.0;
 }
 double pairdist_gloor(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
   const Cartesian r01 = Cartesian(r0 - r1);
   const double r = sqrt(r01.dot(r01));
   const double eta = 4.0/3.0*M_PI*1*1*1*(n(r0) + n(r1))/2.0;
-  return mc(eta, r,mc_r_step,g);
+  return (*gmc)(eta, r);
 }
-double pairdist_fischer(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
+// The methods of Fischer and of Sokolowski look g up in the Monte
+// Carlo table at a packing fraction that depends on where the pair
+// is, which eta_fischer and eta_sokolowski give, so that
+// pairdist_plane can look up a whole plane at once.
+double eta_fischer(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
   // This implements the pair distribution function of Fischer and
   // Methfessel from the 1980 paper.  The mc below should be the
   // true radial distribution function for a homogeneous hard-sphere
   // fluid with packing fraction eta.
+  return n3(Cartesian(0.5*(r0+r1)));
+}
+double pairdist_fischer(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
   const Cartesian r01 = Cartesian(r0 - r1);
   const double r = sqrt(r01.dot(r01));
-  const double eta = n3(Cartesian(0.5*(r0+r1)));
-  return mc(eta, r, mc_r_step, g);
+  return (*gmc)(eta_fischer(gsigma, n, nA, n3, nbar_sokolowski, r0, r1), r);
 }
-double pairdist_sokolowski(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
+double eta_sokolowski(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
   // This implements the pair distribution function of Sokolowski and
   // Fischer from the 1992 paper.
-  const Cartesian r01 = Cartesian(r0 - r1);
-  const double r = sqrt(r01.dot(r01));
-
   const double eta0 = nbar_sokolowski(r0)*(4.0/3.0*M_PI);
   const double eta1 = nbar_sokolowski(r1)*(4.0/3.0*M_PI);
-  const double eta = (eta0 + eta1)/2.0;
-
-  return mc(eta, r, mc_r_step, g);
+  return (eta0 + eta1)/2.0;
+}
+double pairdist_sokolowski(const Grid &gsigma, const Grid &n, const Grid &nA, const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0, Cartesian r1) {
+  const Cartesian r01 = Cartesian(r0 - r1);
+  const double r = sqrt(r01.dot(r01));
+  return (*gmc)(eta_sokolowski(gsigma, n, nA, n3, nbar_sokolowski, r0, r1), r);
 }
 
 const char *fun[] = {
@@ -112,90 +116,45 @@ double (*pairdists[])(const Grid &gsigma, const Grid &density, const Grid &nA, c
 };
 const int numplots = sizeof fun/sizeof fun[0];
 
+// pairdist_plane finds the pair distribution between r0 and each of
+// the points r1 by method number version.  The methods that look g up
+// in the Monte Carlo table do the whole plane with one batched lookup.
+void pairdist_plane(int version, const Grid &gsigma, const Grid &density, const Grid &nA,
+                    const Grid &n3, const Grid &nbar_sokolowski, Cartesian r0,
+                    const std::vector<Cartesian> &r1, double *g2) {
+  const int num = r1.size();
+  decltype(&eta_fischer) eta = 0;
+  if (pairdists[version] == pairdist_fischer) eta = eta_fischer;
+  if (pairdists[version] == pairdist_sokolowski) eta = eta_sokolowski;
+  if (!eta || num == 0) {
+    for (int i=0; i<num; i++) {
+      g2[i] = pairdists[version](gsigma, density, nA, n3, nbar_sokolowski, r0, r1[i]);
+    }
+    return;
+  }
+  std::vector<double> etas(num), rs(num);
+  for (int i=0; i<num; i++) {
+    etas[i] = eta(gsigma, density, nA, n3, nbar_sokolowski, r0, r1[i]);
+    const Cartesian r01 = Cartesian(r0 - r1[i]);
+    rs[i] = sqrt(r01.dot(r01));
+  }
+  gmc->lookup(&etas[0], &rs[0], g2, num);
+}
+
 // Here we set up the lattice.
 static double width = 30;
 const double dw = 0.0001;
 const double spacing = 3; // space on each side
 
 void read_mc() {
-  char *fname = new char[4096];
-  sprintf(fname, "papers/pair-correlation/figs/gr-0.10.dat");
-  FILE *in = fopen(fname, "r");
-  if (!in) {
-    fprintf(stderr, "Unable to open file %s!!!!\n", fname);
-    delete[] fname;
-    fclose(in);
+  // We keep the Monte Carlo data in a binary table, which we remake
+  // whenever the gr-*.dat files change.
+  const char *table = "papers/pair-correlation/figs/gr.table";
+  if (!update_pair_correlation_table(table, "papers/pair-correlation/figs/gr-%2.2f.dat",
+                                     num_eta, eta_step)) {
     exit(1);
   }
-  double num1;
-  double num2;
-  if (fscanf(in, " %lg %*g %lg", &num1, &num2) != 2) {
-    printf("Error reading file...\n");
-    delete[] fname;
-    fclose(in);
-    exit(1);
-  }
-  mc_r_step = 2*(num2 - num1);
-  delete[] fname;
-  fclose(in);
-  for (int i=0; i<num_r_in_gmc; i++) {
-    g[i] = 1.0;
-  }
-  for (double eta = eta_step; eta < 0.5001; eta += eta_step) {
-    char *fname = new char[4096];
-    sprintf(fname, "papers/pair-correlation/figs/gr-%2.2f.dat", eta);
-    FILE *in = fopen(fname, "r");
-    if (!in) {
-      fprintf(stderr, "Unable to open file %s!!!!\n", fname);
-      delete[] fname;
-      exit(1);
-    }
-    int i=0;
-    while (fscanf(in, " %*g %lg", &num1) == 1) {
-      g[int(floor(num_r_in_gmc*(eta/eta_step)))+i] = num1/eta;
-      i++;
-    }
-    if (i!=num_r_in_gmc) {
-      printf("There  are not num_r_in_gmc lines in papers/pair-correlation/figs/gr-%2.2f.dat which is a problem in walls.cpp\n", eta);
-      exit(1);
-    }
-    delete[] fname;
-    fclose(in);
-  }
-}
-
-double mc(double local_eta, double r, double r_step, double g[]) {
-  int low_eta_i = floor(local_eta/eta_step);
-  int high_eta_i = low_eta_i + 1;
-  double g_low_eta;
-  double g_high_eta;
-  double fac;
-  int j=0;
-  double r_floor;
-  if (r < 2) {
-    return 0;
-  }
-  if (high_eta_i > num_eta) {
-    //fprintf(stderr, "Error. Trying to interpolate to eta = %g, but our max is %g\n", local_eta, num_eta*eta_step);
-    return NAN;
-  }
-  if (r < 2 +(r_step/2.0)) {
-    fac = (r-2.0)/(0.5*r_step);
-    g_low_eta = (1-fac)*g[low_eta_i*num_r_in_gmc]+fac*g[low_eta_i*num_r_in_gmc + 1];
-    g_high_eta = (1-fac)*g[high_eta_i*num_r_in_gmc]+fac*g[high_eta_i*num_r_in_gmc + 1];
-  } else if (r > 14.985) {
-    return 1.0;
-  } else {
-    j = floor((r-2.0+0.5*r_step)/r_step);
-    r_floor = 2+(j-0.5)*r_step;
-    fac = (r-r_floor)/r_step;
-    g_low_eta = (1-fac)*g[low_eta_i*num_r_in_gmc+j] + fac*g[low_eta_i*num_r_in_gmc+j+1];
-    g_high_eta = (1-fac)*g[high_eta_i*num_r_in_gmc+j] + fac*g[high_eta_i*num_r_in_gmc+j+1];
-  }
-  //printf("low_eta_i = %d and high_eta_i = %d\n", low_eta_i*num_r_in_gmc+j, high_eta_i*num_r_in_gmc+j);
-  //fflush(stdout);
-  fac = (local_eta-(low_eta_i)*eta_step)/eta_step;
-  return (1-fac)*g_low_eta + fac*g_high_eta;
+  gmc = new PairCorrelationTable(table);
 }
 
 double notinwall(Cartesian r) {
@@ -374,11 +333,18 @@ void run_walls(double eta, const char *name, Functional fhs, bool run_dadz) {
       // is at z = 0, to match with the monte carlo data
       const Cartesian r0(0,0,z0);
       const double resolution_2d = 0.05;
+      std::vector<Cartesian> r1;
+      for (double x = 0; x < xmax + resolution_2d/2; x += resolution_2d) {
+        for (double z1 = spacing; z1 < zmax + spacing - resolution_2d/2; z1 += resolution_2d) {
+          r1.push_back(Cartesian(x,0,z1));
+        }
+      }
+      std::vector<double> g2(r1.size());
+      pairdist_plane(version, gsigma, density, nA, n3, nbar_sokolowski, r0, r1, &g2[0]);
+      int i = 0;
       for (double x = 0; x < xmax + resolution_2d/2; x += resolution_2d) {
         for (double z1 = spacing; z1 < zmax + spacing - resolution_2d/2; z1 += resolution_2d) {
-          const Cartesian r1(x,0,z1);
-          double g2 = pairdists[version](gsigma, density, nA, n3, nbar_sokolowski, r0, r1);
-          fprintf(out, "%g\t", g2);
+          fprintf(out, "%g\t", g2[i++]);
           fprintf(xfile, "%g\t", x);
           fprintf(zfile, "%g\t", z1-spacing); // set z=0 at contact with wall
         }
@@ -0,0 +1,137 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include "LineMinimizer.h"
+#include "handymath.h"
+#include <stdio.h>
+#include <vector>
+
+// AndersonType solves the Euler-Lagrange equation dF/dn = 0 for a
+// functional of Veff by Picard iteration, Veff += mixing*dF/dn, which
+// for mixing = 1 sets Veff to Vext + dF_ex/dn - mu.  Anderson mixing
+// extrapolates from the last few iterations, which usually needs far
+// fewer gradients than a line minimization.  Whenever a step fails
+// to lower the energy, we forget the history and take a conjugate
+// gradient step instead.
+class AndersonType : public MinimizerInterface {
+protected:
+  int depth, fallbacks;
+  double mixing, orig_mixing;
+  Minimizer cg;
+  VectorXd residual, last_step;
+  std::vector<VectorXd> dr, dx; // the recent changes in residual and Veff
+public:
+  AndersonType(Functional f, const GridDescription &gdin, double kT, VectorXd *data,
+               LineMinimizer lm, double stepsize, int mixing_depth, double mixing_in)
+    : MinimizerInterface(f, gdin, kT, data), depth(mixing_depth), fallbacks(0),
+      mixing(mixing_in), orig_mixing(mixing_in),
+      cg(ConjugateGradient(f, gdin, kT, data, lm, stepsize)) {}
+  void minimize(Functional newf, const GridDescription &gdnew, VectorXd *newx = 0) {
+    MinimizerInterface::minimize(newf, gdnew, newx);
+    cg.minimize(newf, gdnew, newx);
+    mixing = orig_mixing;
+    forget_history();
+  }
+
+  bool improve_energy(bool verbose = false);
+  void print_info(const char *prefix="") const;
+private:
+  void forget_history() {
+    residual.resize(0);
+    dr.clear();
+    dx.clear();
+  }
+};
+
+bool AndersonType::improve_energy(bool verbose) {
+  iter++;
+  const double E0 = energy();
+  if (E0 != E0) {
+    // There is no point continuing, since we're starting with a NaN!
+    // So we may as well quit here.
+    if (verbose) {
+      printf("The initial energy is a NaN, so I'm quitting early from AndersonType::improve_energy.\n");
+      f.print_summary("has nan:", E0);
+      fflush(stdout);
+    }
+    return false;
+  }
+  // The gradient with respect to Veff is -n dV/kT times dF/dn, which
+  // is the residual we want.
+  VectorXd r = grad();
+  invalidate_cache();
+  for (int i=0; i<r.size(); i++) {
+    const double n = exp(-(*x)[i]/kT);
+    // Where the density underflows (e.g. inside a hard wall) there is
+    // nothing to be gained by changing Veff, so we leave it be.
+    r[i] = (n > 0 && r[i] != 0) ? -kT*r[i]/(n*gd.dvolume) : 0;
+  }
+  if (residual.size()) {
+    dr.push_back(r - residual);
+    dx.push_back(last_step);
+    if (int(dr.size()) > depth) {
+      dr.erase(dr.begin());
+      dx.erase(dx.begin());
+    }
+  }
+  residual = r;
+
+  // Find the combination of the recent changes in the residual that
+  // best cancels the current residual, and step as though we had
+  // taken those changes back.
+  const int m = dr.size();
+  std::vector<double> overlaps(m*m + 1), gamma(m + 1);
+  for (int i=0; i<m; i++) {
+    for (int j=0; j<=i; j++) overlaps[i*m+j] = overlaps[j*m+i] = dr[i].dot(dr[j]);
+    gamma[i] = dr[i].dot(r);
+  }
+  anderson_coefficients(m, &overlaps[0], &gamma[0]);
+  VectorXd step = mixing*r;
+  for (int j=0; j<m; j++) step -= gamma[j]*(dx[j] + mixing*dr[j]);
+  *x += step;
+  invalidate_cache();
+  const double E1 = energy();
+  if (E1 <= E0) { // which is false for a NaN
+    last_step = step;
+    mixing = min(1.1*mixing, orig_mixing);
+    if (verbose) print_info();
+    return E1 < E0;
+  }
+  if (verbose) {
+    printf("Anderson step with %d previous steps raised the energy by %g, so trying conjugate gradient\n",
+           m, E1 - E0);
+  }
+  *x -= step;
+  invalidate_cache();
+  forget_history();
+  // If even a plain Picard step went uphill, it was too big.
+  // Otherwise the history was leading us astray, and forgetting it is
+  // enough.
+  if (m == 0) mixing *= 0.5;
+  fallbacks++;
+  cg.minimize(f, gd, x); // start the conjugate gradient afresh
+  return cg.improve_energy(verbose);
+}
+
+void AndersonType::print_info(const char *prefix) const {
+  MinimizerInterface::print_info(prefix);
+  printf("%smixing = %g (with %d fallbacks to conjugate gradient)\n", prefix, mixing, fallbacks);
+}
+
+Minimizer Anderson(Functional f, const GridDescription &gdin, double kT, VectorXd *data,
+                   LineMinimizer lm, double stepsize, int depth, double mixing) {
+  return Minimizer(new AndersonType(f, gdin, kT, data, lm, stepsize, depth, mixing));
+}
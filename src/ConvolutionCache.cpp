@@ -0,0 +1,121 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include "ConvolutionCache.h"
+#include "Grid.h"
+#include <string.h>
+#include <stdint.h>
+
+struct CachedInput {
+  uint64_t hash;
+  VectorXd x;
+  VectorXcd fft;
+  bool have_fft;
+};
+
+struct CachedConvolution {
+  int input;
+  ConvolutionCache::Kernel kernel;
+  double parameter;
+  VectorXd out;
+};
+
+// Each thread has its own cache, so that threads evaluating
+// functionals at the same time don't see each other's work (or
+// clear it out from under each other).
+static thread_local int depth = 0;
+static thread_local std::vector<CachedInput> inputs;
+static thread_local std::vector<CachedConvolution> convolutions;
+
+thread_local long ConvolutionCache::hits = 0, ConvolutionCache::misses = 0;
+
+ConvolutionCache::Scope::Scope() {
+  depth++;
+}
+
+ConvolutionCache::Scope::~Scope() {
+  depth--;
+  if (depth == 0) {
+    inputs.clear();
+    convolutions.clear();
+  }
+}
+
+bool ConvolutionCache::active() {
+  return depth > 0;
+}
+
+// We hash the bits of the input with FNV-1a, which is much cheaper
+// than an FFT, and then check for an exact match.
+static uint64_t hash_of(const VectorXd &x) {
+  uint64_t h = 14695981039346656037ULL;
+  const uint64_t *bits = (const uint64_t *)x.data();
+  for (int i=0; i<x.rows(); i++) {
+    h ^= bits[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+int ConvolutionCache::find_input(const VectorXd &x, bool create) {
+  const uint64_t h = hash_of(x);
+  for (unsigned i=0; i<inputs.size(); i++) {
+    if (inputs[i].hash == h && inputs[i].x.rows() == x.rows() &&
+        memcmp(inputs[i].x.data(), x.data(), x.rows()*sizeof(double)) == 0) {
+      return i;
+    }
+  }
+  if (!create) return -1;
+  CachedInput in;
+  in.hash = h;
+  in.x = x;
+  in.have_fft = false;
+  inputs.push_back(in);
+  return inputs.size() - 1;
+}
+
+const VectorXd *ConvolutionCache::convolved(Kernel k, double parameter, const VectorXd &x) {
+  const int i = find_input(x, false);
+  if (i >= 0) {
+    for (unsigned c=0; c<convolutions.size(); c++) {
+      if (convolutions[c].input == i && convolutions[c].kernel == k &&
+          convolutions[c].parameter == parameter) {
+        hits++;
+        return &convolutions[c].out;
+      }
+    }
+  }
+  misses++;
+  return 0;
+}
+
+void ConvolutionCache::remember(Kernel k, double parameter, const VectorXd &x, const VectorXd &out) {
+  CachedConvolution c;
+  c.input = find_input(x, true);
+  c.kernel = k;
+  c.parameter = parameter;
+  c.out = out;
+  convolutions.push_back(c);
+}
+
+const VectorXcd &ConvolutionCache::fft(const GridDescription &gd, const VectorXd &x) {
+  CachedInput &in = inputs[find_input(x, true)];
+  if (!in.have_fft) {
+    in.fft = ::fft(gd, x);
+    in.have_fft = true;
+  }
+  return in.fft;
+}
@@ -0,0 +1,48 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include "ReciprocalGrid.h"
+#include <vector>
+
+// The ConvolutionCache lets the convolutions in a Functional (see
+// ConvolveWith in Functional.h) share their work.  A typical
+// functional built out of StepConvolve, ShellConvolve, xShellConvolve
+// and friends asks for the same convolution of the same density many
+// times in one energy or gradient calculation, and asks for many
+// different convolutions of that density, each of which starts with
+// the same FFT.  While a ConvolutionCache::Scope exists, we remember
+// the FFT of each distinct input and the result of each distinct
+// convolution, so each is only computed once.
+
+// Inputs are identified by their contents, not by where they came
+// from, so this is correct regardless of how the functional tree was
+// built.  The price is memory: everything remembered is kept until
+// the outermost Scope ends.  See memoize() in Functional.h for the
+// usual way to turn this on.  Each thread has a cache of its own,
+// which its own Scopes turn on and off.
+
+class ConvolutionCache {
+public:
+  class Scope {
+  public:
+    Scope();
+    ~Scope();
+  };
+  static bool active();
+
+  typedef void (*Kernel)();
+  // convolved returns the remembered convolution of x with the given
+  // kernel (identified by a function pointer and its parameter), or
+  // null if we haven't computed it yet.
+  static const VectorXd *convolved(Kernel k, double parameter, const VectorXd &x);
+  static void remember(Kernel k, double parameter, const VectorXd &x, const VectorXd &out);
+  // fft returns the FFT of x, only computing it once.
+  static const VectorXcd &fft(const GridDescription &gd, const VectorXd &x);
+
+  // The following count how much work this thread saved, for the
+  // curious.
+  static thread_local long hits, misses;
+private:
+  static int find_input(const VectorXd &x, bool create);
+};
@@ -836,3 +836,75 @@ private:
 Functional constrain(const Grid &g, Functional f) {
   return Functional(new Constraint(g, f));
 }
+
+class Memoized : public FunctionalInterface {
+public:
+  Memoized(const Functional &y) : f(y) {};
+  bool I_am_local() const {
+    return f.I_am_local();
+  }
+  bool I_am_constant_wrt_x() const {
+    return f.I_am_constant_wrt_x();
+  }
+  bool I_preserve_homogeneous() const {
+    return f.I_preserve_homogeneous();
+  }
+  bool I_am_homogeneous() const {
+    return f.I_am_homogeneous();
+  }
+  bool I_am_zero() const {
+    return f.I_am_zero();
+  }
+  bool I_am_one() const {
+    return f.I_am_one();
+  }
+  bool I_give_zero_for_zero() const {
+    return f.I_give_zero_for_zero();
+  }
+
+  double integral(const GridDescription &gd, double kT, const VectorXd &x) const {
+    ConvolutionCache::Scope memoizing;
+    return f.integral(gd, kT, x);
+  }
+  VectorXd transform(const GridDescription &gd, double kT, const VectorXd &data) const {
+    ConvolutionCache::Scope memoizing;
+    return f(gd, kT, data);
+  }
+  double transform(double kT, double n) const {
+    return f(kT, n);
+  }
+  double derive(double kT, double n) const {
+    return f.derive(kT, n);
+  }
+  double d_by_dT(double kT, double n) const {
+    return f.d_by_dT(kT, n);
+  }
+  Functional grad(const Functional &ingrad, const Functional &x, bool ispgrad) const {
+    return memoize(f.grad(ingrad, x, ispgrad));
+  }
+  Functional grad_T(const Functional &ingrad) const {
+    return memoize(f.grad_T(ingrad));
+  }
+  void pgrad(const GridDescription &gd, double kT, const VectorXd &data,
+             const VectorXd &ingrad, VectorXd *outpgrad) const {
+    ConvolutionCache::Scope memoizing;
+    f.pgrad(gd, kT, data, ingrad, outpgrad);
+  }
+  void grad(const GridDescription &gd, double kT, const VectorXd &data,
+            const VectorXd &ingrad, VectorXd *outgrad, VectorXd *outpgrad) const {
+    ConvolutionCache::Scope memoizing;
+    f.grad(gd, kT, data, ingrad, outgrad, outpgrad);
+  }
+  void print_summary(const char *prefix, double e, std::string name) const {
+    f.print_summary(prefix, e, name);
+  }
+  bool I_have_analytic_grad() const {
+    return f.I_have_analytic_grad();
+  }
+private:
+  Functional f;
+};
+
+Functional memoize(const Functional &f) {
+  return Functional(new Memoized(f), f.get_name());
+}
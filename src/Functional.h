@@ -3,6 +3,9 @@
 #pragma once
 
 #include "ReciprocalGrid.h"
+#include "ConvolutionCache.h"
+#include "profiling.h"
+#include <atomic>
 
 class Functional;
 
@@ -106,16 +109,18 @@ public:
   Functional operator/(const Functional &) const;
   Functional operator*(const Functional &) const;
   VectorXd justMe(const GridDescription &gd, double kT, const VectorXd &data) const {
+    profile_scope profile(itsCounter->name.c_str());
     return itsCounter->ptr->transform(gd, kT, data);
   }
   double justMeIntegral(const GridDescription &gd, double kT, const VectorXd &data) const {
+    profile_scope profile(itsCounter->name.c_str());
     return itsCounter->ptr->integral(gd, kT, data);
   }
   VectorXd operator()(double kT, const GridDescription &gd, const VectorXd &data) const {
     return (*this)(gd, kT, data);
   }
   VectorXd operator()(const GridDescription &gd, double kT, const VectorXd &data) const {
-    VectorXd out = itsCounter->ptr->transform(gd, kT, data);
+    VectorXd out = justMe(gd, kT, data);
     if (mynext) out += (*mynext)(gd, kT, data);
     return out;
   }
@@ -130,11 +135,11 @@ public:
   }
   double integral(const GridDescription &gd, double kT, const VectorXd &data) const {
     // This takes care to save the energies of each term in the sum.
-    double e = itsCounter->ptr->integral(gd, kT, data);
+    double e = justMeIntegral(gd, kT, data);
     set_last_energy(e);
     Functional *nxt = next();
     while (nxt) {
-      double enext = nxt->itsCounter->ptr->integral(gd, kT, data);
+      double enext = nxt->justMeIntegral(gd, kT, data);
       nxt->set_last_energy(enext);
       e += enext;
       nxt = nxt->next();
@@ -183,7 +188,10 @@ public:
   }
   void grad(const GridDescription &gd, double kT, const VectorXd &data,
             const VectorXd &ingrad, VectorXd *outgrad, VectorXd *outpgrad) const {
-    itsCounter->ptr->grad(gd, kT, data, ingrad, outgrad, outpgrad);
+    {
+      profile_scope profile(itsCounter->name.c_str(), " grad");
+      itsCounter->ptr->grad(gd, kT, data, ingrad, outgrad, outpgrad);
+    }
     if (mynext) mynext->grad(gd, kT, data, ingrad, outgrad, outpgrad);
   }
   void pgrad(double kT, const GridDescription &gd, const VectorXd &data, const VectorXd &ingrad,
@@ -192,7 +200,10 @@ public:
   }
   void pgrad(const GridDescription &gd, double kT, const VectorXd &data,
              const VectorXd &ingrad, VectorXd *outpgrad) const {
-    itsCounter->ptr->pgrad(gd, kT, data, ingrad, outpgrad);
+    {
+      profile_scope profile(itsCounter->name.c_str(), " pgrad");
+      itsCounter->ptr->pgrad(gd, kT, data, ingrad, outpgrad);
+    }
     if (mynext) mynext->pgrad(gd, kT, data, ingrad, outpgrad);
   }
   double derive(double kT, double data) const {
@@ -220,7 +231,10 @@ public:
   Functional *next() const {
     return mynext;
   }
-  Functional set_last_energy(double e) const { itsCounter->last_energy = e; return *this; }
+  // set_last_energy remembers the energy of this term for
+  // print_iteration and print_summary.  When several threads evaluate
+  // the same functional, we remember whichever finished last.
+  void set_last_energy(double e) const { itsCounter->last_energy = e; }
 
   void print_summary(const char *prefix, double energy, std::string name="") const;
   // The following utility methods do not need to be overridden.  Its
@@ -310,13 +324,16 @@ private:
     mynext = 0;
   }
   Functional *mynext;
+  // The counter is shared by every copy of a Functional, and copies
+  // may be made and dropped by different threads at once, so the
+  // count (and the energy saved by each evaluation) are atomic.
   struct counter {
-    counter(FunctionalInterface* p = 0, unsigned c = 1) : ptr(p), count(c) {}
+    counter(FunctionalInterface* p = 0, unsigned c = 1) : ptr(p), count(c), last_energy(0) {}
     FunctionalInterface* ptr;
-    unsigned count;
+    std::atomic<unsigned> count;
     std::string name;
     Functional *next;
-    double last_energy;
+    std::atomic<double> last_energy;
   };
   counter *itsCounter;
   void acquire(counter* c) {
@@ -350,6 +367,14 @@ Functional abs(const Functional &);
 Functional sqr(const Functional &);
 Functional sqrt(const Functional &);
 Functional constrain(const Grid &, Functional);
+// memoize returns a functional equal to f, which shares the work of
+// identical convolutions (and of FFTs of identical inputs) within
+// each energy or gradient calculation (see ConvolutionCache.h).  This
+// costs memory, since each distinct convolution is kept until the
+// calculation is done: for HardSpheresWBnotensor on the grid of
+// tests/memory.cpp it roughly halves the time of a gradient, but
+// raises its peak memory from 87M to 357M, so it is up to you.
+Functional memoize(const Functional &f);
 
 Functional dV();
 
@@ -374,10 +399,7 @@ public:
   }
 
   EIGEN_STRONG_INLINE VectorXd transform(const GridDescription &gd, double, const VectorXd &x) const {
-    Grid out(gd, x);
-    ReciprocalGrid recip = out.fft();
-    recip.cwise() *= Eigen::CwiseNullaryOp<Derived, VectorXcd>(gd.NxNyNzOver2, 1, f(gd, data));
-    return recip.ifft();
+    return convolve(gd, x);
   }
   double gzero() const {
     Lattice lat(Cartesian(1,0,0), Cartesian(0,1,0), Cartesian(0,0,1));
@@ -406,16 +428,64 @@ public:
   }
   EIGEN_STRONG_INLINE void grad(const GridDescription &gd, double, const VectorXd &,
                                 const VectorXd &ingrad, VectorXd *outgrad, VectorXd *outpgrad) const {
-    Grid out(gd, ingrad);
-    ReciprocalGrid recip = out.fft();
-    recip.cwise() *= Eigen::CwiseNullaryOp<Derived, VectorXcd>(gd.NxNyNzOver2, 1, f(gd, data));
-    if (iseven) out = recip.ifft();
-    else out = -recip.ifft();
+    Grid out(gd, convolve(gd, ingrad));
+    if (!iseven) out = -out;
     *outgrad += out;
     // FIXME: we will want to propogate preexisting preconditioning
     if (outpgrad) *outpgrad += out;
   }
 private:
+  VectorXd convolve(const GridDescription &gd, const VectorXd &x) const {
+    // When memoizing, we first look for this very convolution, and
+    // otherwise share the FFT of x with the other convolutions of it.
+    const bool memoizing = ConvolutionCache::active();
+    const ConvolutionCache::Kernel k = reinterpret_cast<ConvolutionCache::Kernel>(f);
+    if (memoizing) {
+      const VectorXd *known = ConvolutionCache::convolved(k, data, x);
+      if (known) return *known;
+    }
+    const Derived kernel = f(gd, data);
+    const int parity = mirror_z_parity(gd, x);
+    const int kernel_parity = parity ? kernel_z_parity(gd, kernel) : 0;
+    VectorXd out;
+    if (kernel_parity) {
+      VectorXcd recip = mirror_z_fft(gd, x, parity);
+      for (int i=0; i<recip.rows(); i++) recip[i] *= kernel(mirror_z_index(gd, i), 0);
+      out = mirror_z_ifft(gd, recip, parity*kernel_parity);
+    } else if (memoizing) {
+      VectorXcd recip = ConvolutionCache::fft(gd, x);
+      recip.cwise() *= Eigen::CwiseNullaryOp<Derived, VectorXcd>(gd.NxNyNzOver2, 1, kernel);
+      out = ifft(gd, &recip);
+    } else {
+      Grid g(gd, x);
+      ReciprocalGrid recip = g.fft();
+      recip.cwise() *= Eigen::CwiseNullaryOp<Derived, VectorXcd>(gd.NxNyNzOver2, 1, kernel);
+      return recip.ifft();
+    }
+    if (memoizing) ConvolutionCache::remember(k, data, x, out);
+    return out;
+  }
+  // kernel_z_parity tells whether the kernel is even (+1) or odd (-1)
+  // under a reflection along a3, or neither (0).  Our kernels are all
+  // simple functions of k, so it is enough to look at a few points.
+  static int kernel_z_parity(const GridDescription &gd, const Derived &kernel) {
+    const Vector3d n = gd.Lat.a3()/gd.Lat.a3().norm();
+    const RelativeReciprocal samples[3] = { RelativeReciprocal(1,2,3),
+                                            RelativeReciprocal(-2,1,1),
+                                            RelativeReciprocal(3,-1,2) };
+    bool even = true, odd = true;
+    for (int i=0; i<3; i++) {
+      const Reciprocal k = gd.Lat.toReciprocal(samples[i]);
+      const complex here = kernel.func(k);
+      const complex there = kernel.func(Reciprocal(k - 2*k.dot(n)*n));
+      const double eps = 1e-12*(std::abs(here) + std::abs(there));
+      if (std::abs(here - there) > eps) even = false;
+      if (std::abs(here + there) > eps) odd = false;
+    }
+    if (even) return 1;
+    if (odd) return -1;
+    return 0;
+  }
   Derived (*f)(const GridDescription &, extra);
   extra data;
   bool iseven;
@@ -3,6 +3,9 @@
 #include "handymath.h"
 #include "Functionals.h"
 #include <fftw3.h>
+#include "profiling.h"
+#include "tracing.h"
+#include <string.h>
 
 double Grid::operator()(const Relative &r) const {
   double rx = r(0)*gd.Nx, ry = r(1)*gd.Ny, rz = r(2)*gd.Nz;
@@ -468,15 +471,136 @@ ReciprocalGrid Grid::fft() const {
 }
 
 ReciprocalGrid fft(const GridDescription &gd, const VectorXd &g) {
+  trace_span trace("fft", "fft");
   ReciprocalGrid out(gd);
   const double *mydata = g.data();
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
   fftw_plan p = fftw_plan_dft_r2c_3d(gd.Nx, gd.Ny, gd.Nz, (double *)mydata, (fftw_complex *)out.data(), FFTW_MEASURE);
+  planning.unlock();
   fftw_execute(p);
+  profile_scope::count_ffts(1);
+  planning.lock();
   fftw_destroy_plan(p);
+  planning.unlock();
   out *= gd.dvolume;
   return out;
 }
 
+void fft_many(const GridDescription &gd, int howmany,
+              const VectorXd *const in[], VectorXcd *const out[]) {
+  trace_span trace("fft_many", "fft");
+  for (int j=0; j<howmany; j++) *out[j] = fft(gd, *in[j]);
+}
+
+int mirror_z_parity(const GridDescription &gd, const VectorXd &g) {
+  if (gd.boundary != mirror_z_boundary || gd.Nz < 8 || gd.Nz % 4) return 0;
+  const Cartesian a1 = gd.Lat.a1(), a2 = gd.Lat.a2(), a3 = gd.Lat.a3();
+  if (fabs(a1.dot(a3)) > 1e-12*a1.norm()*a3.norm() ||
+      fabs(a2.dot(a3)) > 1e-12*a2.norm()*a3.norm()) return 0;
+  // We allow for roundoff error, which costs us nothing, since the
+  // result of a mirror_z_ifft is exactly even or odd.
+  const double eps = 1e-12*g.cwise().abs().maxCoeff();
+  const int M = gd.Nz/2;
+  bool even = true, odd = true;
+  for (int xy=0; xy<gd.Nx*gd.Ny && (even || odd); xy++) {
+    const double *line = g.data() + xy*gd.Nz;
+    if (fabs(line[0]) > eps || fabs(line[M]) > eps) odd = false;
+    for (int z=1; z<M; z++) {
+      if (fabs(line[z] - line[gd.Nz-z]) > eps) even = false;
+      if (fabs(line[z] + line[gd.Nz-z]) > eps) odd = false;
+    }
+  }
+  if (even) return 1;
+  if (odd) return -1;
+  return 0;
+}
+
+void mirror_z_r2r(const GridDescription &gd, double *r, int parity) {
+  // FFTW computes REDFT00 and RODFT00 from a real transform of twice
+  // the length, which makes them no cheaper than the full FFT.  So we
+  // fold each line into M points, do a real transform of those, and
+  // unfold the result with a running sum, as in the cosft1 and sinft
+  // of Numerical Recipes.
+  const int M = gd.Nz/2, NxNy = gd.Nx*gd.Ny;
+  double *y = (double *)fftw_malloc(M*sizeof(double));
+  fftw_complex *Y = (fftw_complex *)fftw_malloc((M/2 + 1)*sizeof(fftw_complex));
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+  fftw_plan p = fftw_plan_many_dft_r2c(1, &M, 1, y, 0, 1, M, Y, 0, 1, M/2 + 1, FFTW_MEASURE);
+  planning.unlock();
+  double *sine = new double[M/2 + 1], *cosine = new double[M/2 + 1];
+  for (int j=0; j<=M/2; j++) {
+    sine[j] = sin(M_PI*j/M);
+    cosine[j] = cos(M_PI*j/M);
+  }
+  for (int xy=0; xy<NxNy; xy++) {
+    double *x = r + xy*gd.NzOver2;
+    if (parity > 0) {
+      double odd = 0.5*(x[0] - x[M]); // this sums up to the k = 1 output
+      y[0] = 0.5*(x[0] + x[M]);
+      for (int j=1; j<M/2; j++) {
+        const double plus = 0.5*(x[j] + x[M-j]), minus = x[j] - x[M-j];
+        y[j] = plus - sine[j]*minus;
+        y[M-j] = plus + sine[j]*minus;
+        odd += cosine[j]*minus;
+      }
+      y[M/2] = x[M/2];
+      fftw_execute_dft_r2c(p, y, Y);
+      for (int k=0; k<=M/2; k++) x[2*k] = 2*Y[k][0];
+      x[1] = 2*odd;
+      for (int k=1; k<M/2; k++) x[2*k+1] = x[2*k-1] - 2*Y[k][1];
+    } else {
+      y[0] = 0;
+      for (int j=1; j<M/2; j++) {
+        const double plus = sine[j]*(x[j] + x[M-j]), minus = 0.5*(x[j] - x[M-j]);
+        y[j] = plus + minus;
+        y[M-j] = plus - minus;
+      }
+      y[M/2] = 2*x[M/2];
+      fftw_execute_dft_r2c(p, y, Y);
+      for (int k=1; k<M/2; k++) x[2*k] = -2*Y[k][1];
+      x[1] = Y[0][0];
+      for (int k=1; k<M/2; k++) x[2*k+1] = x[2*k-1] + 2*Y[k][0];
+    }
+  }
+  delete[] sine;
+  delete[] cosine;
+  planning.lock();
+  fftw_destroy_plan(p);
+  planning.unlock();
+  fftw_free(y);
+  fftw_free(Y);
+}
+
+VectorXcd mirror_z_fft(const GridDescription &gd, const VectorXd &g, int parity) {
+  trace_span trace("mirror_z_fft", "fft");
+  // An even field is determined by its values at z = 0 ... Nz/2, and
+  // its transform along z is a type-I cosine transform of them.  An
+  // odd field vanishes at z = 0 and z = Nz/2, and its transform is -i
+  // times the type-I sine transform of the points in between.  We do
+  // that in place, and then do ordinary r2c transforms in x and y.
+  const int NxNy = gd.Nx*gd.Ny, nxy[2] = { gd.Nx, gd.Ny };
+  double *r = (double *)fftw_malloc(NxNy*gd.NzOver2*sizeof(double));
+  VectorXcd out(gd.Nx*(gd.Ny/2 + 1)*gd.NzOver2);
+  // Plan before copying in the data, since FFTW_MEASURE trashes it.
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+  fftw_plan pxy = fftw_plan_many_dft_r2c(2, nxy, gd.NzOver2, r, 0, gd.NzOver2, 1,
+                                         (fftw_complex *)out.data(), 0, gd.NzOver2, 1,
+                                         FFTW_MEASURE);
+  planning.unlock();
+  for (int xy=0; xy<NxNy; xy++) {
+    memcpy(r + xy*gd.NzOver2, g.data() + xy*gd.Nz, gd.NzOver2*sizeof(double));
+  }
+  mirror_z_r2r(gd, r, parity);
+  fftw_execute(pxy);
+  profile_scope::count_ffts(1);
+  planning.lock();
+  fftw_destroy_plan(pxy);
+  planning.unlock();
+  fftw_free(r);
+  out *= (parity > 0) ? complex(gd.dvolume, 0) : complex(0, -gd.dvolume);
+  return out;
+}
+
 void Grid::ShellProjection(const VectorXd &R, VectorXd *output) const {
   output->setZero();
   VectorXd norm(*output);
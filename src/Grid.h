@@ -11,6 +11,33 @@ static const double default_eps_size = 1000.0;
 class ReciprocalGrid;
 
 ReciprocalGrid fft(const GridDescription &gd, const VectorXd &g);
+// fft_many does several transforms of the same grid.  It does them
+// one at a time, since batching them into one FFTW plan would mean
+// copying them all into one array and back, which costs more than it
+// saves.
+void fft_many(const GridDescription &gd, int howmany,
+              const VectorXd *const in[], VectorXcd *const out[]);
+
+// With a mirror_z_boundary grid, a field that is even or odd under
+// z -> -z can be transformed using a cosine (or sine) transform along
+// z.  mirror_z_parity gives +1 for an even field, -1 for an odd one,
+// and 0 if it is neither (or the grid isn't mirror_z_boundary), in
+// which case you need fft.  mirror_z_fft gives the same values as fft,
+// but only for ky >= 0 rather than kz >= 0, since along z we only need
+// half the points.  Element i corresponds to element mirror_z_index(gd,
+// i) of the usual ReciprocalGrid.
+int mirror_z_parity(const GridDescription &gd, const VectorXd &g);
+VectorXcd mirror_z_fft(const GridDescription &gd, const VectorXd &g, int parity);
+// mirror_z_r2r does in place, on each of the Nx*Ny lines of NzOver2
+// values in r, what FFTW's REDFT00 (for parity > 0) or RODFT00 of
+// the Nz/2 - 1 values after the first (for parity < 0) would do.  It
+// needs Nz to be a multiple of four.
+void mirror_z_r2r(const GridDescription &gd, double *r, int parity);
+inline int mirror_z_index(const GridDescription &gd, int i) {
+  const int z = i % gd.NzOver2, xy = i/gd.NzOver2;
+  const int y = xy % (gd.Ny/2 + 1), x = xy/(gd.Ny/2 + 1);
+  return (x*gd.Ny + y)*gd.NzOver2 + z;
+}
 
 class Grid : public VectorXd {
 public:
@@ -5,7 +5,8 @@
 
 GridDescription::GridDescription(Lattice lat, int nx, int ny, int nz)
   : Lat(lat), fineLat(Cartesian(lat.a1()/nx), Cartesian(lat.a2()/ny),
-                      Cartesian(lat.a3()/nz)) {
+                      Cartesian(lat.a3()/nz)),
+    boundary(periodic_boundary) {
   Nx = nx; Ny = ny; Nz = nz;
   NyNz = Ny*Nz; NxNyNz = Nx*NyNz;
   NzOver2 = Nz/2 + 1; NyNzOver2 = Ny*NzOver2; NxNyNzOver2 = Nx*NyNzOver2;
@@ -16,6 +17,7 @@ GridDescription::GridDescription(Lattice lat, int nx, int ny, int nz)
   // for later...
   Grid rspace(*this);
   ReciprocalGrid kspace(*this);
+  std::lock_guard<std::mutex> planning(fftw_planner_mutex());
   fftw_destroy_plan(fftw_plan_dft_r2c_3d(Nx, Ny, Nz, rspace.data(),
                                          (fftw_complex *)kspace.data(),
                                          FFTW_MEASURE));
@@ -24,12 +26,25 @@ GridDescription::GridDescription(Lattice lat, int nx, int ny, int nz)
                                          rspace.data(), FFTW_MEASURE));
 }
 
-GridDescription::GridDescription(Lattice lat, double delta)
-  : Nx(1+int(exp(1)/100+lat.a1().norm()/delta)),
-    Ny(1+int(exp(1)/100+lat.a2().norm()/delta)),
-    Nz(1+int(exp(1)/100+lat.a3().norm()/delta)),
+// With multiple_of_four, we round up to a multiple of four, which
+// mirror_z_boundary needs.
+static int grid_points(double length, double delta, GridSizing sizing,
+                       bool multiple_of_four = false) {
+  const int n = 1+int(exp(1)/100+length/delta);
+  if (sizing == exact_grid_sizes) return multiple_of_four ? 4*((n + 3)/4) : n;
+  int m = fft_grid_size(n, sizing);
+  while (multiple_of_four && m % 4) m = fft_grid_size(m + 1, sizing);
+  return m;
+}
+
+GridDescription::GridDescription(Lattice lat, double delta, GridSizing sizing,
+                                 BoundaryCondition bc)
+  : Nx(grid_points(lat.a1().norm(), delta, sizing)),
+    Ny(grid_points(lat.a2().norm(), delta, sizing)),
+    Nz(grid_points(lat.a3().norm(), delta, sizing, bc == mirror_z_boundary)),
     Lat(lat), fineLat(Cartesian(lat.a1()/Nx), Cartesian(lat.a2()/Ny),
-                      Cartesian(lat.a3()/Nz)) {
+                      Cartesian(lat.a3()/Nz)),
+    boundary(bc) {
   NyNz = Ny*Nz; NxNyNz = Nx*NyNz;
   NzOver2 = Nz/2 + 1; NyNzOver2 = Ny*NzOver2; NxNyNzOver2 = Nx*NyNzOver2;
   dx = 1.0/Nx; dy = 1.0/Ny; dz = 1.0/Nz;
@@ -39,6 +54,7 @@ GridDescription::GridDescription(Lattice lat, double delta)
   // for later...
   Grid rspace(*this);
   ReciprocalGrid kspace(*this);
+  std::lock_guard<std::mutex> planning(fftw_planner_mutex());
   fftw_destroy_plan(fftw_plan_dft_r2c_3d(Nx, Ny, Nz, rspace.data(),
                                          (fftw_complex *)kspace.data(),
                                          FFTW_MEASURE));
@@ -4,18 +4,41 @@
 
 #include "lattice.h"
 #include "Eigen/Eigen"
+#include "fft-sizes.h"
 
 typedef std::complex<double> complex;
 
+enum BoundaryCondition {
+  periodic_boundary, // the usual
+  // Fields are even or odd under z -> -z, as in a slit pore with its
+  // walls (or its center) at z = 0.  This requires a3 to be orthogonal
+  // to a1 and a2, and Nz to be a multiple of four.  Convolutions of
+  // such fields use cosine and sine transforms along z (see
+  // mirror_z_fft in Grid.h), which do less work than a full FFT and
+  // need half its reciprocal-space scratch.  The fields themselves
+  // are still stored on the full grid.  Only the hand-written
+  // Functional convolutions use this; the generated *Fast functionals
+  // always call fft and ifft.
+  mirror_z_boundary
+};
+
 class GridDescription {
 public:
   explicit GridDescription(Lattice lat, int nx, int ny, int nz);
-  explicit GridDescription(Lattice lat, double dx);
+  // By default the number of grid points is just enough to give a
+  // spacing no larger than dx, so that existing calculations are
+  // reproducible.  Pass fft_friendly_grid_sizes (or
+  // timed_grid_sizes) for a slightly finer grid with faster FFTs.
+  // With mirror_z_boundary we always use a multiple of four points
+  // along z, since the cosine transforms need that.
+  explicit GridDescription(Lattice lat, double dx, GridSizing sizing = exact_grid_sizes,
+                           BoundaryCondition bc = periodic_boundary);
   // Default copy constructor is just fine!
 
   double dx, dy, dz, dvolume;
   int Nx, Ny, Nz, NyNz, NxNyNz, NzOver2, NyNzOver2, NxNyNzOver2;
   Lattice Lat, fineLat;
+  BoundaryCondition boundary; // periodic_boundary unless you set it
 private:
   void initme();
 };
@@ -19,3 +19,11 @@ Minimizer ConjugateGradient(Functional f, const GridDescription &gdin, double kT
                             LineMinimizer lm, double stepsize = 10.0);
 Minimizer PreconditionedConjugateGradient(Functional f, const GridDescription &gdin, double kT, VectorXd *data,
                                           LineMinimizer lm, double stepsize = 10.0);
+
+// Anderson solves the Euler-Lagrange equation of a functional of
+// Veff by Picard iteration with Anderson mixing of the last depth
+// steps, falling back to conjugate gradient (using lm and stepsize)
+// when that fails to lower the energy.  A mixing of 1 would be
+// undamped Picard iteration.
+Minimizer Anderson(Functional f, const GridDescription &gdin, double kT, VectorXd *data,
+                   LineMinimizer lm, double stepsize = 10.0, int depth = 5, double mixing = 0.1);
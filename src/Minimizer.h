@@ -3,6 +3,7 @@
 #pragma once
 
 #include "Functional.h"
+#include "tracing.h"
 #include <stdio.h>
 #include <math.h>
 
@@ -49,9 +50,15 @@ public:
   virtual void print_info(const char *prefix = "") const;
 
   // energy returns the current energy.
-  double energy() const { return f.integral(kT, gd, *x); }
+  double energy() const {
+    trace_span trace("energy", "minimize");
+    const double e = f.integral(kT, gd, *x);
+    trace_counter("energy", e, "minimize");
+    return e;
+  }
   const VectorXd &grad() const {
     if (!last_grad) {
+      trace_span trace("gradient", "minimize");
       last_grad = new VectorXd(*x); // hokey
       last_grad->setZero(); // Have to remember to zero it out first!
       f.integralgrad(kT, gd, *x, last_grad);
@@ -60,6 +67,7 @@ public:
   }
   const VectorXd &pgrad() const {
     if (!last_pgrad) {
+      trace_span trace("gradient and preconditioner", "minimize");
       last_pgrad = new VectorXd(*x); // hokey
       last_pgrad->setZero(); // Have to remember to zero it out first!
       if (!last_grad) last_grad = new VectorXd(*x); // hokey
@@ -105,6 +113,8 @@ public:
     itsCounter->ptr->minimize(newf, gdnew, newx);
   }
   bool improve_energy(bool verbose = false) {
+    profile_scope profile("Minimizer::improve_energy");
+    trace_span trace("iteration", "minimize");
     return itsCounter->ptr->improve_energy(verbose);
   }
   void print_info(const char *prefix = "") const {
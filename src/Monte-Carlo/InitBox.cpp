@@ -17,7 +17,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 	
 	ATOM::ATOM(double a, double b, double c, double sig, double lam) { x = a; y = b; z = c; sigma = sig; lambda = lam; };
 	//ATOM::ATOM() { ; };
-	double ATOM::distanceToAtom(ATOM &atom) {
+	double ATOM::distanceToAtom(const ATOM &atom) {
 		double distance = (atom.x - x)*(atom.x - x) + (atom.y - y)*(atom.y - y) + (atom.z - z)*(atom.z - z);
 		return distance;//must work with r^2 now...
 	}
@@ -35,9 +35,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		lambda = 1.5;
 		dStep = sigma / 5.0*3.0;
 		maxStep = lx*2;//have to double check lx? or use int conversion and multiply? hmm
-		binSizeX = lx/sigma/lambda;
-		binSizeY = ly/sigma/lambda;
-		binSizeZ = lz/sigma/lambda;
+		setUpBins();
 		resetNumberOfBonds();
 		numAtoms=0;
 		numAvailableInAtomList=500;
@@ -54,9 +52,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		lambda = 1.5;
 		dStep = sigma / 5.0*3.0;
 		maxStep = lx*2;//have to double check lx? or use int conversion and multiply? hmm
-		binSizeX = lx/sigma/lambda;
-		binSizeY = ly/sigma/lambda;
-		binSizeZ = lz/sigma/lambda;
+		setUpBins();
 		resetNumberOfBonds();
 		list=new ATOM[2];
 		for(int count=0;count<10 && numAtoms!=N;count++){
@@ -80,20 +76,39 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		lambda = 1.5;
 		dStep = sigma / 5.0*3.0;
 		maxStep = lx*2;//have to double check lx? or use int conversion and multiply? hmm
-		binSizeX = lx/sigma/lambda;
-		binSizeY = ly/sigma/lambda;
-		binSizeZ = lz/sigma/lambda;
+		setUpBins();
 		resetNumberOfBonds();
 		numAtoms=0;
 		numAvailableInAtomList=500;
 		list=new ATOM[numAvailableInAtomList];
 		for(int n=0;n<numAvailableInAtomList;n++) list[n].id=n;
-		for (int nx = 0; nx < 30; nx++)
-			for (int ny = 0; ny < 30; ny++)
-				for (int nz = 0; nz < 30; nz++) {
-					bins[nx][ny][nz] = -1;
-					numInBins[nx][ny][nz] = 0;
-				}
+	}
+	void INITBOX::setUpBins(void) {
+		//each bin is at least as wide as the well, so only neighboring bins interact
+		binSizeX = lx/sigma/lambda;
+		binSizeY = ly/sigma/lambda;
+		binSizeZ = lz/sigma/lambda;
+		if (binSizeX < 1) binSizeX = 1;
+		if (binSizeY < 1) binSizeY = 1;
+		if (binSizeZ < 1) binSizeZ = 1;
+		binCapacity = 8;//grows as needed
+		numInBins.assign(binSizeX*binSizeY*binSizeZ, 0);
+		std::vector<ATOM>(numInBins.size()*binCapacity).swap(binAtoms);
+	}
+	void INITBOX::growBins(void) {
+		//doubles the room in every bin, keeping each bin's atoms side by side
+		int newCapacity = 2*binCapacity;
+		std::vector<ATOM> newAtoms(numInBins.size()*newCapacity);
+		for (unsigned int b = 0; b < numInBins.size(); b++)
+			for (int i = 0; i < numInBins[b]; i++) newAtoms[b*newCapacity + i] = binAtoms[b*binCapacity + i];
+		binAtoms.swap(newAtoms);
+		binCapacity = newCapacity;
+	}
+	int INITBOX::binOfAtom(const ATOM &atom) const {
+		int nx = (atom.x / lx)*binSizeX;
+		int ny = (atom.y / ly)*binSizeY;
+		int nz = (atom.z / lz)*binSizeZ;
+		return binIndex(nx, ny, nz);
 	}
 	void INITBOX::resetNumberOfBonds(void) {
 		for (unsigned int i = 0; i < sizeof(numberOfBonds) / sizeof(*numberOfBonds); i++) {
@@ -107,11 +122,9 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 			list2=new ATOM[numAtoms+501];
 			for(int n=0;n<numAtoms;n++) list2[n]=list[n];//save old list
 			for(int n=0;n<numAtoms+501;n++) list2[n].id=n;//make sure new list has id's initialized
-			for(int n=0;n<numAtoms;n++) removeAtomFromBins(list[n]);//take old list out of the bins
-			numAvailableInAtomList=501;
+			numAvailableInAtomList=501;//the bins hold ids, so they need no change
 			delete[] list;
 			list=list2;
-			for(int n=0;n<numAtoms;n++) addAtomToBins(list[n]);//put new list back into the bins
 		}
 		numAtoms++;
 		numAvailableInAtomList--;
@@ -193,14 +206,8 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		double energy = 0.0;
 		for (int ny = 0; ny < binSizeY; ny++) {
 			for (int nz = 0; nz < binSizeZ; nz++) {
-				if (numInBins[nx][ny][nz] <= 0) continue;
-				int n = bins[nx][ny][nz];
-				energy += atomWallEnergy(n);
-				ATOM *current = &list[n];
-				while (current->next != NULL) {
-					current = current->next;
-					energy += atomWallEnergy(current->id);
-				}
+				const int bin = binIndex(nx, ny, nz);
+				for (int i = 0; i < numInBins[bin]; i++) energy += atomWallEnergy(binAtoms[bin*binCapacity + i].id);
 			}
 		}
 		return energy;
@@ -210,14 +217,8 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		double energy = 0.0;
 		for (int nx = 0; nx < binSizeX; nx++) {
 			for (int nz = 0; nz < binSizeZ; nz++) {
-				if (numInBins[nx][ny][nz] <= 0) continue;
-				int n = bins[nx][ny][nz];
-				energy += atomWallEnergyYplane(n);
-				ATOM *current = &list[n];
-				while (current->next != NULL) {
-					current = current->next;
-					energy += atomWallEnergyYplane(current->id);
-				}
+				const int bin = binIndex(nx, ny, nz);
+				for (int i = 0; i < numInBins[bin]; i++) energy += atomWallEnergyYplane(binAtoms[bin*binCapacity + i].id);
 			}
 		}
 		return energy;
@@ -262,14 +263,13 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
-						if (current->y <= y0) {
-							current = current->next;
-							continue;
-						}
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
+						if (current->y <= y0) continue;
 						
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -283,7 +283,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;//###########################this needs to be in loop iteration
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -322,10 +321,12 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -337,7 +338,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -359,14 +359,8 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		double energy = 0.0;
 		for (int nx = 0; nx < binSizeX; nx++) {
 			for (int ny = 0; ny < binSizeY; ny++) {
-				if (numInBins[nx][ny][nz] <= 0) continue;
-				int n = bins[nx][ny][nz];
-				energy += atomWallEnergyZplane(n);
-				ATOM *current = &list[n];
-				while (current->next != NULL) {
-					current = current->next;
-					energy += atomWallEnergyZplane(current->id);
-				}
+				const int bin = binIndex(nx, ny, nz);
+				for (int i = 0; i < numInBins[bin]; i++) energy += atomWallEnergyZplane(binAtoms[bin*binCapacity + i].id);
 			}
 		}
 		return energy;
@@ -410,15 +404,14 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
 					z0 += modNz*lz;//keep boundary relative to atom
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
-						if (current->z <= z0) {
-							current = current->next;
-							continue;
-						}
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
+						if (current->z <= z0) continue;
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -432,7 +425,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 					z0 -= modNz*lz;
@@ -471,10 +463,12 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -486,7 +480,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -536,14 +529,13 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
-						if (current->x <= x0) {
-							current = current->next;
-							continue;
-						}
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
+						if (current->x <= x0) continue;
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -557,7 +549,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -596,10 +587,12 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 						if (current->id == atom->id) r = (sigma*sigma + 1)*lambda*lambda;//no self interactions
@@ -611,7 +604,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							return -1.0;//bad hard shell impact
 						}
 						if (r < sigma*sigma*lambda*lambda) energy += wellDepth;
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -706,14 +698,9 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		for (int nx = 0; nx < binSizeX; nx++) {
 			for (int ny = 0; ny < binSizeY; ny++) {
 				for (int nz = 0; nz < binSizeZ; nz++) {
-					totalAtoms += numInBins[nx][ny][nz];
-					if (bins[nx][ny][nz] < 0) continue;
-					//cout << nx << " " << ny << " " << nz <<" numInBins="<<numInBins[nx][ny][nz]<< " n=" << bins[nx][ny][nz] << endl;
-					ATOM *current = &list[bins[nx][ny][nz]];
-					for (int n = 1; n <= numInBins[nx][ny][nz]; n++) {
-						atomNumber[current->id]++;
-						current = current->next;
-					}
+					const int bin = binIndex(nx, ny, nz);
+					totalAtoms += numInBins[bin];
+					for (int n = 0; n < numInBins[bin]; n++) atomNumber[binAtoms[bin*binCapacity + n].id]++;
 				}
 			}
 		}
@@ -725,20 +712,13 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		//I assume the coordinates will work without checking
 		//will crash for bad coordinates
 		for (int n = 0; n < numAtoms; n++) {
-			int nx, ny, nz;
-			ATOM *atom = &list[n];
-			nx = (atom->x / lx)*binSizeX;
-			ny = (atom->y / ly)*binSizeY;
-			nz = (atom->z / lz)*binSizeZ;
-			//the atom should be at bin [nx,ny,nz]...
+			//the atom should be in the bin its coordinates give...
+			const int bin = binOfAtom(list[n]);
 			bool testIfInBox = false;//starts off as not verified
-			if (bins[nx][ny][nz] < 0) return false;//none in the box.... failed
-			ATOM *current = &list[bins[nx][ny][nz]];
-			for (int i = 0; i < numInBins[nx][ny][nz]; i++) {
-				if (current->id == n) {
+			for (int i = 0; i < numInBins[bin]; i++) {
+				if (binAtoms[bin*binCapacity + i].id == n) {
 					testIfInBox = true; break;
 				}
-				current = current->next;
 			}
 			if (testIfInBox == false) return false;
 			//cout << "verified: " << n << endl;
@@ -771,10 +751,12 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 																  //if (current->id == atom->id) r=(sigma+1)*lambda;//no self interactions
@@ -795,7 +777,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 							radiusBonds[numBonds] = sqrt(r);
 							numBonds++;
 						}
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -835,10 +816,12 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 					int modNz = -(nz + dk >= binSizeZ);//shift in Z dir
 					modNz += (nz + dk < 0);
 					int NZ = nz + dk + binSizeZ*modNz;
-					if (numInBins[NX][NY][NZ] <= 0) continue;//verify there is work to be done
+					const int bin = binIndex(NX, NY, NZ);
+					if (numInBins[bin] <= 0) continue;//verify there is work to be done
 					atom->z += modNz*lz;
-					ATOM *current = &list[bins[NX][NY][NZ]];//grab first on bin stack
-					for (int i = 1; i <= numInBins[NX][NY][NZ]; i++) {//start summing up energies
+					const ATOM *inBin = &binAtoms[bin*binCapacity];//copies of the atoms in this bin, side by side
+					for (int i = 0; i < numInBins[bin]; i++) {//start summing up energies
+						const ATOM *current = &inBin[i];
 
 						double r = atom->distanceToAtom(*current);//code changed to work with r^2
 																  //if (current->id == atom->id) r=(sigma+1)*lambda;//no self interactions
@@ -852,7 +835,6 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 						}
 						//if (r < sigma*lambda) energy += wellDepth;
 						energy += wellDepth*(r < sigma*sigma*lambda*lambda);
-						current = current->next;
 					}
 					atom->z -= modNz*lz;//unshift atom z
 				}
@@ -940,12 +922,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 			//cout<<list[n].x<<endl;
 			//cout<<lx<<endl;
 		}
-		for (int nx = 0; nx < 30; nx++)
-			for (int ny = 0; ny < 30; ny++)
-				for (int nz = 0; nz < 30; nz++) {
-					bins[nx][ny][nz] = -1;
-					numInBins[nx][ny][nz] = 0;
-				}
+		setUpBins();
 		std::normal_distribution<double>randStepX(0.0, lx/2.0/3.0);
 		std::normal_distribution<double>randStepY(0.0, ly/2.0/3.0);
 		std::normal_distribution<double>randStepZ(0.0, lz/2.0/3.0);
@@ -1191,12 +1168,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		numAtoms=N;
 		list=new ATOM[N];
 		numAvailableInAtomList=0;
-		for (int nx = 0; nx < 30; nx++)
-			for (int ny = 0; ny < 30; ny++)
-				for (int nz = 0; nz < 30; nz++) {
-					bins[nx][ny][nz] = -1;
-					numInBins[nx][ny][nz] = 0;
-				}
+		setUpBins();
 		
 		double lScale=sqrt(2.0)*2+1e-14;
 		double L=lx;
@@ -1312,12 +1284,7 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 
 		//memset(bins, -1, sizeof(bins));
 		//memset(numInBins, 0, sizeof(numInBins));
-		for (int nx = 0; nx < 30; nx++)
-			for (int ny = 0; ny < 30; ny++)
-				for (int nz = 0; nz < 30; nz++) {
-					bins[nx][ny][nz] = -1;
-					numInBins[nx][ny][nz] = 0;
-				}
+		setUpBins();
 		for (int n = 0; n < N; n++) {
 			list[n].x = lxRand(generator);
 			list[n].y = lyRand(generator);
@@ -1571,28 +1538,19 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 
 	void INITBOX::removeAtomFromBins(ATOM &atom) {
 		//assumes the atom was already in the bins
-		int nx, ny, nz;
-		nx = (atom.x / lx)*binSizeX;
-		ny = (atom.y / ly)*binSizeY;
-		nz = (atom.z / lz)*binSizeZ;
-		numInBins[nx][ny][nz]--;
-		//if (numInBins[nx][ny][nz] < 0) cout << "detected critical error in removeAtoms" << endl;
-		if (numInBins[nx][ny][nz] <=0) {
-			bins[nx][ny][nz] = -1;
-			return;
-		}
-		if (bins[nx][ny][nz] == atom.id) {
-			atom.next->prev = NULL;
-			bins[nx][ny][nz] = atom.next->id;
-			return;
+		const int bin = binOfAtom(atom);
+		ATOM *inBin = &binAtoms[bin*binCapacity];
+		for (int i = 0; i < numInBins[bin]; i++) {
+			if (inBin[i].id == atom.id) {
+				inBin[i] = inBin[numInBins[bin] - 1];//keep the bin contiguous
+				numInBins[bin]--;
+				return;
+			}
 		}
-		atom.prev->next = atom.next;
-		if (atom.next == NULL) return;
-		atom.next->prev = atom.prev;
+		//if we get here the atom was not in its bin
 		return;
 	}
 	void INITBOX::addAtomToBins(ATOM &atom) {
-		int nx, ny, nz;
 		atom.x += (atom.x < 0)*lx;
 		atom.y += (atom.y < 0)*ly;
 		atom.z += (atom.z < 0)*lz;
@@ -1607,23 +1565,9 @@ std::uniform_int_distribution<int> myIntRand(0, 9);
 		atom.y -= (atom.y >= ly)*ly;
 		atom.z -= (atom.z >= lz)*lz;
 
-		nx = (atom.x / lx)*binSizeX;
-		ny = (atom.y / ly)*binSizeY;
-		nz = (atom.z / lz)*binSizeZ;
-		if (bins[nx][ny][nz] == -1) {
-			bins[nx][ny][nz] = atom.id;
-			atom.prev = NULL;
-			atom.next = NULL;
-			numInBins[nx][ny][nz]=1;
-			return;
-		}
-		ATOM *current = &list[bins[nx][ny][nz]];
-		for (int i = 1; i < numInBins[nx][ny][nz]; i++) {
-			current = current->next;
-		}
-		current->next = &atom;
-		atom.prev = current;
-		atom.next = NULL;
-		numInBins[nx][ny][nz]++;
+		const int bin = binOfAtom(atom);
+		if (numInBins[bin] >= binCapacity) growBins();
+		binAtoms[bin*binCapacity + numInBins[bin]] = atom;//a copy, which must be updated whenever the atom moves
+		numInBins[bin]++;
 		return;
 	}
@@ -1,16 +1,16 @@
 //#include "stdafx.h"
+#include <vector>
 
 
 
 //###########################
 class ATOM { 
 public:
-	class ATOM *prev, *next;
 	int id;
 	double x, y, z,sigma,lambda;
 	ATOM(double a, double b, double c, double sig, double lam) ;
 	ATOM() { ; };
-	double distanceToAtom(ATOM &atom) ;
+	double distanceToAtom(const ATOM &atom) ;
 };
 //############################
 
@@ -18,9 +18,12 @@ class INITBOX {
 public:
 
 	class ATOM *list;
-	int numAtoms,numInBins[30][30][30];
-	int binSizeX, binSizeY, binSizeZ;
-	int bins[30][30][30];//hard coded for now, contains the atom id of the first atom
+	int numAtoms;
+	int binSizeX, binSizeY, binSizeZ;//number of bins along each side of the box
+	std::vector<int> numInBins;//how many atoms are in each bin
+	std::vector<ATOM> binAtoms;//copies of the atoms in each bin, binCapacity slots per bin
+	int binCapacity;
+	int binIndex(int nx, int ny, int nz) const { return (nx*binSizeY + ny)*binSizeZ + nz; }
 	double lx, ly, lz;
 	double sigma, lambda,dStep,maxStep;
 	double wellDepth;
@@ -75,6 +78,9 @@ public:
 	void simulate(int iterations);
 
 private:
+	void setUpBins(void);
+	void growBins(void);
+	int binOfAtom(const ATOM &atom) const;
 	void removeAtomFromBins(ATOM &atom);
 	void addAtomToBins(ATOM &atom);
 	int numAvailableInAtomList;
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include "handymath.h"
+#include "vector3d.h"
+#include "Monte-Carlo/square-well.h"
+
+// A contact_tracker keeps track of the smallest ratio, over all pairs
+// of balls, of the distance between them to the sum of their radii.
+// If every position (and the cell) were scaled by a factor s, two
+// balls would overlap exactly when s times their ratio is less than
+// one, so this one number tells us whether the configuration would
+// fit in a cell shrunk by any scaling factor.
+//
+// The tracker must be told about every accepted move.  It keeps its
+// own neighbor tables, which (like those in square-well.h) are only
+// rebuilt for a ball once it has moved far from where they were last
+// built, with a cutoff large enough that every pair that matters for
+// scaling factors down to min_scaling_factor is included.  The
+// smallest ratio of each ball is kept in a tournament tree, so the
+// overall minimum is always at the root.
+
+struct contact_tracker {
+  contact_tracker(const ball *balls, int N, const double len[3], int walls,
+                  double min_scaling_factor);
+
+  // fits tells whether the configuration would have no overlaps if
+  // scaled down by scaling_factor, which must be at least the
+  // min_scaling_factor we were constructed with.
+  bool fits(double scaling_factor) {
+    return scaling_factor*min_ratio() >= 1;
+  }
+  // smallest_scaling_factor is the smallest scaling factor at which
+  // the configuration fits, or min_scaling_factor if it fits there.
+  double smallest_scaling_factor() {
+    return 1/min_ratio();
+  }
+  double min_ratio();
+
+  // moved must be called after ball id has been moved.
+  void moved(int id);
+
+private:
+  const ball *p;
+  int N;
+  double len[3];
+  int walls;
+  double max_ratio, skin;
+  std::vector<vector3d> center;
+  std::vector< std::vector<int> > neighbors;
+  std::vector<double> ratio; // the smallest ratio for each ball
+  std::vector<int> partner; // which ball it is with, or -1 if none
+  int leaves;
+  std::vector<int> tree; // tree[1] is the ball with the smallest ratio
+
+  double pair_ratio(int i, int j) const {
+    return periodic_diff(p[i].pos, p[j].pos, len, walls).norm()/(p[i].R + p[j].R);
+  }
+  bool are_neighbors(int i, int j) const {
+    return periodic_diff(center[i], center[j], len, walls).normsquared()
+      < sqr((p[i].R + p[j].R)*max_ratio + 2*skin);
+  }
+  void rebuild_neighbors(int id);
+  void recompute(int i);
+  void update_tree(int i);
+};
+
+inline contact_tracker::contact_tracker(const ball *balls, int num, const double l[3],
+                                        int w, double min_scaling_factor)
+  : p(balls), N(num), walls(w), max_ratio(1/min_scaling_factor),
+    center(num), neighbors(num), ratio(num), partner(num) {
+  for (int i=0; i<3; i++) len[i] = l[i];
+  skin = p[0].R;
+  for (int i=0; i<N; i++) skin = min(skin, 0.5*p[i].R);
+  for (int i=0; i<N; i++) center[i] = p[i].pos;
+  for (int i=0; i<N; i++) {
+    for (int j=i+1; j<N; j++) {
+      if (are_neighbors(i, j)) {
+        neighbors[i].push_back(j);
+        neighbors[j].push_back(i);
+      }
+    }
+  }
+  leaves = 1;
+  while (leaves < N) leaves *= 2;
+  tree.assign(2*leaves, -1);
+  for (int i=0; i<N; i++) {
+    recompute(i);
+    update_tree(i);
+  }
+}
+
+inline void contact_tracker::rebuild_neighbors(int id) {
+  for (unsigned n=0; n<neighbors[id].size(); n++) {
+    std::vector<int> &theirs = neighbors[neighbors[id][n]];
+    for (unsigned k=0; k<theirs.size(); k++) {
+      if (theirs[k] == id) {
+        theirs[k] = theirs.back();
+        theirs.pop_back();
+        break;
+      }
+    }
+  }
+  neighbors[id].clear();
+  center[id] = p[id].pos;
+  for (int j=0; j<N; j++) {
+    if (j != id && are_neighbors(id, j)) {
+      neighbors[id].push_back(j);
+      neighbors[j].push_back(id);
+    }
+  }
+}
+
+inline void contact_tracker::recompute(int i) {
+  // Pairs that are not neighbors are always further apart than
+  // max_ratio, so that is as large as our answer needs to be.
+  ratio[i] = max_ratio;
+  partner[i] = -1;
+  for (unsigned n=0; n<neighbors[i].size(); n++) {
+    const double r = pair_ratio(i, neighbors[i][n]);
+    if (r < ratio[i]) {
+      ratio[i] = r;
+      partner[i] = neighbors[i][n];
+    }
+  }
+}
+
+inline void contact_tracker::update_tree(int i) {
+  int k = leaves + i;
+  tree[k] = i;
+  for (k /= 2; k >= 1; k /= 2) {
+    const int a = tree[2*k], b = tree[2*k+1];
+    tree[k] = (b < 0 || (a >= 0 && ratio[a] <= ratio[b])) ? a : b;
+  }
+}
+
+inline void contact_tracker::moved(int id) {
+  if (periodic_diff(center[id], p[id].pos, len, walls).normsquared() > sqr(skin)) {
+    rebuild_neighbors(id);
+  }
+  recompute(id);
+  update_tree(id);
+  for (unsigned n=0; n<neighbors[id].size(); n++) {
+    const int j = neighbors[id][n];
+    const double r = pair_ratio(id, j);
+    if (r <= ratio[j]) {
+      ratio[j] = r;
+      partner[j] = id;
+      update_tree(j);
+    } else if (partner[j] == id) {
+      recompute(j);
+      update_tree(j);
+    }
+  }
+}
+
+inline double contact_tracker::min_ratio() {
+  // A ball whose partner has moved out of its neighbor table may have
+  // an out-of-date ratio, which can only be too small.  So we check
+  // the ball at the root, and only fix it if need be.
+  int i = tree[1];
+  while (partner[i] >= 0 && pair_ratio(i, partner[i]) != ratio[i]) {
+    recompute(i);
+    update_tree(i);
+    i = tree[1];
+  }
+  return ratio[i];
+}
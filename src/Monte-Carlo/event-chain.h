@@ -0,0 +1,255 @@
+#pragma once
+
+#include <math.h>
+#include <cassert>
+#include <vector>
+#include "Monte-Carlo/monte-carlo.h"
+
+// An event_chain moves hard spheres using event-chain Monte Carlo
+// (Bernard, Krauth and Wilson, PRE 80, 056704 (2009)).  Rather than
+// proposing a small random displacement of one sphere, which is
+// nearly always rejected at high packing fraction, a chain picks a
+// sphere and a direction and slides that sphere until it touches
+// another, which then continues the motion, and so on until the
+// chain's total displacement is used up.  Every move is accepted, and
+// the configuration decorrelates far faster than with single-sphere
+// moves once the packing fraction is above 0.4 or so.
+//
+// Positions are those of the driver's spheres array, which is
+// modified in place, so the usual shell and histogram accumulation
+// works unchanged.  The cell is centered on the origin.  Along each
+// axis it is either periodic with the given length, bounded by hard
+// walls at +/- len/2 (which, as in the drivers, constrain the sphere
+// centers), or unbounded.  There may also be a spherical hard wall
+// inside which the centers must stay (outer_radius), and one outside
+// of which they must stay (inner_radius).  When a sphere reaches a
+// wall, the chain continues in the mirror-image direction.
+
+// default_chain_length is the chain length the drivers use unless
+// given a chainlength argument.  It has nothing to do with the step
+// size of single-sphere moves: a chain only beats those once it has
+// carried the motion through several collisions, which at high
+// packing fraction takes a few sphere diameters.
+inline double default_chain_length(double R) {
+  return 3*2*R;
+}
+
+class event_chain {
+public:
+  event_chain(Vector3d *spheres, long N, double R, const double len[3],
+              const bool periodic[3], const bool wall[3],
+              double inner_radius = 0, double outer_radius = 0);
+
+  // chain moves a randomly chosen sphere in a random direction along
+  // one of the axes (either way, so that the chains satisfy detailed
+  // balance even with walls), for a total displacement of length.
+  void chain(double length);
+
+  // The following count how many collisions we have handled, and how
+  // many chains we have run.
+  long collisions, chains;
+
+private:
+  Vector3d *s;
+  long N;
+  double R, inner_radius, outer_radius;
+  double len[3];
+  bool periodic[3], wall[3];
+  double lo[3], cell_width[3];
+  int num_cells[3];
+  double max_step; // the furthest a sphere may go between cell list searches
+  std::vector< std::vector<long> > cells;
+  std::vector<long> cell_of;
+
+  int find_cell(const Vector3d &v) const;
+  void move_to_cell(long i, int c);
+  Vector3d displacement(const Vector3d &a, const Vector3d &b) const;
+  // wall_time returns how far sphere i can go in direction d before
+  // hitting a wall (or HUGE_VAL), and the normal to that wall.
+  double wall_time(const Vector3d &v, const Vector3d &d, Vector3d *normal) const;
+};
+
+inline event_chain::event_chain(Vector3d *spheres, long num, double radius,
+                                const double l[3], const bool p[3], const bool w[3],
+                                double inner, double outer)
+  : collisions(0), chains(0), s(spheres), N(num), R(radius),
+    inner_radius(inner), outer_radius(outer), cell_of(num) {
+  // A cell needs to be at least a sphere diameter wide so that we
+  // only need to look at neighboring cells.  Whatever it has to
+  // spare sets how far we can move before looking again.
+  const double min_width = 3*R;
+  int total_cells = 1;
+  max_step = HUGE_VAL;
+  for (int k=0; k<3; k++) {
+    len[k] = l[k];
+    periodic[k] = p[k];
+    wall[k] = w[k];
+    double extent = len[k];
+    if (!periodic[k] && !wall[k]) {
+      assert(outer_radius > 0); // we must be bounded somehow!
+      extent = 2*outer_radius;
+    }
+    lo[k] = -extent/2;
+    num_cells[k] = int(extent/min_width);
+    if (num_cells[k] < 1) num_cells[k] = 1;
+    cell_width[k] = extent/num_cells[k];
+    if (num_cells[k] >= 3) max_step = fmin(max_step, cell_width[k] - 2*R);
+    total_cells *= num_cells[k];
+  }
+  if (max_step == HUGE_VAL) max_step = R;
+  cells.resize(total_cells);
+  for (long i=0; i<N; i++) {
+    cell_of[i] = find_cell(s[i]);
+    cells[cell_of[i]].push_back(i);
+  }
+}
+
+inline int event_chain::find_cell(const Vector3d &v) const {
+  int c = 0;
+  for (int k=0; k<3; k++) {
+    int ck = int(floor((v[k] - lo[k])/cell_width[k]));
+    if (ck < 0) ck = 0;
+    if (ck >= num_cells[k]) ck = num_cells[k] - 1;
+    c = c*num_cells[k] + ck;
+  }
+  return c;
+}
+
+inline void event_chain::move_to_cell(long i, int c) {
+  if (c == cell_of[i]) return;
+  std::vector<long> &old = cells[cell_of[i]];
+  for (unsigned n=0; n<old.size(); n++) {
+    if (old[n] == i) {
+      old[n] = old.back();
+      old.pop_back();
+      break;
+    }
+  }
+  cells[c].push_back(i);
+  cell_of[i] = c;
+}
+
+inline Vector3d event_chain::displacement(const Vector3d &a, const Vector3d &b) const {
+  Vector3d v = b - a;
+  for (int k=0; k<3; k++) {
+    if (periodic[k]) {
+      if (v[k] > len[k]/2) v[k] -= len[k];
+      else if (v[k] < -len[k]/2) v[k] += len[k];
+    }
+  }
+  return v;
+}
+
+inline double event_chain::wall_time(const Vector3d &v, const Vector3d &d,
+                                     Vector3d *normal) const {
+  double t = HUGE_VAL;
+  for (int k=0; k<3; k++) {
+    if (wall[k] && d[k] != 0) {
+      const double tk = ((d[k] > 0 ? len[k]/2 : -len[k]/2) - v[k])/d[k];
+      if (tk < t) {
+        t = fmax(tk, 0);
+        *normal = Vector3d(0,0,0);
+        (*normal)[k] = 1;
+      }
+    }
+  }
+  const double b = v.dot(d), r2 = v.dot(v);
+  if (inner_radius > 0 && b < 0) {
+    const double disc = b*b - (r2 - inner_radius*inner_radius);
+    if (disc >= 0 && -b - sqrt(disc) < t) {
+      t = fmax(-b - sqrt(disc), 0);
+      *normal = v + t*d;
+    }
+  }
+  if (outer_radius > 0) {
+    const double disc = b*b - (r2 - outer_radius*outer_radius);
+    if (disc >= 0 && -b + sqrt(disc) < t) {
+      t = fmax(-b + sqrt(disc), 0);
+      *normal = v + t*d;
+    }
+  }
+  return t;
+}
+
+inline void event_chain::chain(double length) {
+  long i = long(ran()*N);
+  if (i >= N) i = N-1;
+  const int axis = int(ran()*3) % 3;
+  Vector3d d(0,0,0);
+  d[axis] = (ran() < 0.5) ? 1 : -1;
+  chains++;
+  double remaining = length;
+  while (remaining > 0) {
+    const double step = fmin(remaining, max_step);
+    Vector3d normal(0,0,0);
+    double t = wall_time(s[i], d, &normal);
+    bool hit_wall = (t <= step);
+    long hit = -1;
+    if (!hit_wall) t = step;
+    // Now look for the first sphere we would hit in the neighboring
+    // cells.  A sphere already in contact (t == 0) is hit at once.
+    int c[3];
+    for (int k=2, ci=cell_of[i]; k>=0; k--) {
+      c[k] = ci % num_cells[k];
+      ci /= num_cells[k];
+    }
+    const int width[3] = { num_cells[0] < 3 ? num_cells[0] : 3,
+                           num_cells[1] < 3 ? num_cells[1] : 3,
+                           num_cells[2] < 3 ? num_cells[2] : 3 };
+    for (int a=0; a<width[0]; a++) {
+      for (int b=0; b<width[1]; b++) {
+        for (int e=0; e<width[2]; e++) {
+          int n[3] = { c[0] + a - (width[0] == 3), c[1] + b - (width[1] == 3),
+                       c[2] + e - (width[2] == 3) };
+          if (width[0] < 3) n[0] = a;
+          if (width[1] < 3) n[1] = b;
+          if (width[2] < 3) n[2] = e;
+          bool outside = false;
+          for (int k=0; k<3; k++) {
+            if (n[k] < 0 || n[k] >= num_cells[k]) {
+              if (!periodic[k]) outside = true;
+              n[k] = (n[k] + num_cells[k]) % num_cells[k];
+            }
+          }
+          if (outside) continue;
+          const std::vector<long> &here = cells[(n[0]*num_cells[1] + n[1])*num_cells[2] + n[2]];
+          for (unsigned m=0; m<here.size(); m++) {
+            const long j = here[m];
+            if (j == i) continue;
+            const Vector3d rel = displacement(s[i], s[j]);
+            const double along = rel.dot(d);
+            if (along <= 0) continue; // it is behind us
+            const double disc = along*along - (rel.dot(rel) - 4*R*R);
+            if (disc < 0) continue; // we will miss it
+            const double tj = fmax(along - sqrt(disc), 0);
+            if (tj < t) {
+              t = tj;
+              hit = j;
+              hit_wall = false;
+            }
+          }
+        }
+      }
+    }
+    s[i] += t*d;
+    for (int k=0; k<3; k++) {
+      if (periodic[k]) {
+        if (s[i][k] >= len[k]/2) s[i][k] -= len[k];
+        else if (s[i][k] < -len[k]/2) s[i][k] += len[k];
+      }
+    }
+    move_to_cell(i, find_cell(s[i]));
+    remaining -= t;
+    if (hit >= 0) {
+      i = hit; // the rest of the chain goes to the sphere we hit
+      collisions++;
+    } else if (hit_wall) {
+      normal *= 1/normal.norm();
+      const double dn = d.dot(normal);
+      // A sphere grazing the outer wall would reflect into the same
+      // direction forever, so we simply end the chain there.
+      if (dn == 0) break;
+      d -= 2*dn*normal; // reflect off the wall
+    }
+  }
+}
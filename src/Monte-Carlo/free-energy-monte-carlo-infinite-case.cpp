@@ -389,9 +389,7 @@ int main(int argc, const char *argv[]) {
   // ----------------------------------------------------------------------------
 
   {
-    int most_neighbors =
-      initialize_neighbor_tables(sw.balls, sw.N, sw.neighbor_R,
-                                 sw.max_neighbors, sw.len, sw.walls);
+    int most_neighbors = sw.initialize_neighbor_tables();
     if (most_neighbors < 0) {
       fprintf(stderr, "The guess of %i max neighbors was too low. Exiting.\n",
               sw.max_neighbors);
@@ -523,9 +521,7 @@ int main(int argc, const char *argv[]) {
   // END OF MAIN PROGRAM LOOP
   // ----------------------------------------------------------------------------
 
-  for (int i=0; i<sw.N; i++) {
-    delete[] sw.balls[i].neighbors;
-  }
+  sw.free_neighbor_tables();
   delete[] sw.balls;
   delete[] sw.ln_energy_weights;
   delete[] sw.energy_histogram;
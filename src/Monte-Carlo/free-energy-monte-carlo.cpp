@@ -9,6 +9,7 @@
 #include "vector3d.h"
 #include "Monte-Carlo/square-well.h"
 #include "Monte-Carlo/InitBox.h"
+#include "Monte-Carlo/contact-tracker.h"
 #include "version-identifier.h"
 
 // ------------------------------------------------------------------------------
@@ -50,7 +51,8 @@ const int z = 2;
 // Functions
 // ------------------------------------------------------------------------------
 
-// Tests validity of a shrunken version of the cell
+// Tests validity of a shrunken version of the cell the slow way, to
+// check the contact_tracker when debugging.
 static bool overlap_in_small_cell(sw_simulation &sw, double scaling_factor);
 
 // States how long it's been since last took call.
@@ -544,9 +546,7 @@ int main(int argc, const char *argv[]) {
   // ----------------------------------------------------------------------------
 
   {
-    int most_neighbors =
-      initialize_neighbor_tables(sw.balls, sw.N, sw.neighbor_R,
-                                 sw.max_neighbors, sw.len, sw.walls);
+    int most_neighbors = sw.initialize_neighbor_tables();
     if (most_neighbors < 0) {
       fprintf(stderr, "The guess of %i max neighbors was too low. Exiting.\n",
               sw.max_neighbors);
@@ -634,6 +634,17 @@ int main(int argc, const char *argv[]) {
   double average_valid_run = 0;
   double average_failed_run = 0;
 
+  // The contact tracker tells us at each check the smallest scaling
+  // factor at which the configuration would fit, so we histogram that
+  // for scaling factors between ours and 1.
+  const double min_sf = min(scaling_factor, 1.0);
+  contact_tracker contacts(sw.balls, sw.N, sw.len, sw.walls, min_sf);
+  const int sf_bins = 100;
+  long *smallest_sf_histogram = new long[sf_bins + 1]();
+  int *moved = new int[sw.N];
+  char *sf_fname = new char[1024];
+  sprintf(sf_fname, "%s/%s-scaling.dat", data_dir, filename);
+
   // Reset energy histogram and sample counts
   for(int i = 0; i < sw.energy_levels; i++){
     sw.energy_histogram[i] = 0;
@@ -646,15 +657,28 @@ int main(int argc, const char *argv[]) {
     // Move each ball once, add to energy histogram
     // ---------------------------------------------------------------
     for(int i = 0; i < sw.N; i++){
-      sw.move_a_ball();
+      const int num_moved = sw.move_a_ball(false, moved);
+      for (int k = 0; k < num_moved; k++) contacts.moved(moved[k]);
     }
 
     // just hacking stuff in to see what works
     // do the small bit every 100 n^2 iterations for now
     if (sw.iteration % small_cell_check_period == 0) {
       total_checks_of_small_cell++;
+      const double smallest_sf = contacts.smallest_scaling_factor();
+      if (min_sf < 1) {
+        int bin = int(ceil((smallest_sf - min_sf)/(1 - min_sf)*sf_bins));
+        if (bin < 0) bin = 0;
+        if (bin > sf_bins) bin = sf_bins;
+        smallest_sf_histogram[bin]++;
+      }
+      const bool fits = contacts.fits(scaling_factor);
+      if (debug && fits == overlap_in_small_cell(sw, scaling_factor)) {
+        printf("Contact tracker disagrees with overlap_in_small_cell!\n");
+        return 1;
+      }
 
-      if(overlap_in_small_cell(sw,  scaling_factor)){
+      if(!fits){
         total_failed_small_checks++;
         
         if (current_failed_run == 0){
@@ -731,6 +755,21 @@ int main(int argc, const char *argv[]) {
         fprintf(g_out, "%s", headerinfo);
         fprintf(g_out, "%s", countinfo);
         fclose(g_out);
+
+        if (min_sf < 1) {
+          // The fraction of checks that would have been valid at each
+          // scaling factor.
+          FILE *sf_out = fopen((const char *)sf_fname, "w");
+          fprintf(sf_out, "%s", headerinfo);
+          fprintf(sf_out, "# scaling factor\tfraction valid\n");
+          long valid = 0;
+          for (int i = 0; i <= sf_bins; i++) {
+            valid += smallest_sf_histogram[i];
+            fprintf(sf_out, "%g\t%g\n", min_sf + (1 - min_sf)*i/sf_bins,
+                    double(valid)/total_checks_of_small_cell);
+          }
+          fclose(sf_out);
+        }
       }
 
       delete[] countinfo;
@@ -740,9 +779,7 @@ int main(int argc, const char *argv[]) {
   // END OF MAIN PROGRAM LOOP
   // ----------------------------------------------------------------------------
 
-  for (int i=0; i<sw.N; i++) {
-    delete[] sw.balls[i].neighbors;
-  }
+  sw.free_neighbor_tables();
   delete[] sw.balls;
   delete[] sw.ln_energy_weights;
   delete[] sw.energy_histogram;
@@ -757,6 +794,9 @@ int main(int argc, const char *argv[]) {
 
   delete[] headerinfo;
   delete[] g_fname;
+  delete[] sf_fname;
+  delete[] smallest_sf_histogram;
+  delete[] moved;
 
   delete[] data_dir;
   delete[] filename;
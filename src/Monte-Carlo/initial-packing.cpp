@@ -0,0 +1,301 @@
+#include <math.h>
+#include <vector>
+#include "Monte-Carlo/initial-packing.h"
+
+// A packing_grid is a cell list covering the region the sphere
+// centers may occupy, with cells at least min_width wide, so that we
+// only need to look in neighboring cells for anything closer than
+// min_width.
+struct packing_grid {
+  packing_grid(const packing_cell &c, double min_width, int N);
+
+  void add(int i, const vector3d &v);
+  void move(int i, const vector3d &v);
+  // room gives how large a sphere centered at v could be without
+  // overlapping any of the others (except skip), or min_width/2 if it
+  // could be at least that large.  The radii must be no more than
+  // min_width/2.
+  double room(const vector3d *spheres, const double *radii,
+              const vector3d &v, int skip) const;
+
+  const packing_cell &cell;
+  double lo[3], width[3], min_width;
+  int n[3];
+  std::vector< std::vector<int> > cells;
+  std::vector<int> cell_of;
+
+  int find(const vector3d &v) const;
+  vector3d diff(const vector3d &a, const vector3d &b) const;
+};
+
+static double extent(const packing_cell &cell, int k) {
+  if (!cell.periodic[k] && !cell.wall[k] && cell.outer_radius > 0) {
+    return 2*cell.outer_radius;
+  }
+  return cell.len[k];
+}
+
+static bool valid_center(const packing_cell &cell, const vector3d &v) {
+  for (int k=0; k<3; k++) {
+    if (!cell.periodic[k] && fabs(v[k]) > extent(cell, k)/2) return false;
+  }
+  const double r2 = v.normsquared();
+  if (cell.inner_radius > 0 && r2 < cell.inner_radius*cell.inner_radius) return false;
+  if (cell.outer_radius > 0 && r2 > cell.outer_radius*cell.outer_radius) return false;
+  return true;
+}
+
+static vector3d random_point(const packing_cell &cell) {
+  vector3d v;
+  do {
+    for (int k=0; k<3; k++) v[k] = (random::ran() - 0.5)*extent(cell, k);
+  } while (!valid_center(cell, v));
+  return v;
+}
+
+static void wrap(const packing_cell &cell, vector3d *v) {
+  for (int k=0; k<3; k++) {
+    if (cell.periodic[k]) {
+      while ((*v)[k] >= cell.len[k]/2) (*v)[k] -= cell.len[k];
+      while ((*v)[k] < -cell.len[k]/2) (*v)[k] += cell.len[k];
+    }
+  }
+}
+
+packing_grid::packing_grid(const packing_cell &c, double mw, int N)
+  : cell(c), min_width(mw), cell_of(N, -1) {
+  int total = 1;
+  for (int k=0; k<3; k++) {
+    const double e = extent(cell, k);
+    lo[k] = -e/2;
+    n[k] = int(e/min_width);
+    if (n[k] < 1) n[k] = 1;
+    width[k] = e/n[k];
+    total *= n[k];
+  }
+  cells.resize(total);
+}
+
+int packing_grid::find(const vector3d &v) const {
+  int c = 0;
+  for (int k=0; k<3; k++) {
+    int ck = int(floor((v[k] - lo[k])/width[k]));
+    if (ck < 0) ck = 0;
+    if (ck >= n[k]) ck = n[k] - 1;
+    c = c*n[k] + ck;
+  }
+  return c;
+}
+
+vector3d packing_grid::diff(const vector3d &a, const vector3d &b) const {
+  vector3d v = b - a;
+  for (int k=0; k<3; k++) {
+    if (cell.periodic[k]) {
+      if (v[k] > cell.len[k]/2) v[k] -= cell.len[k];
+      else if (v[k] < -cell.len[k]/2) v[k] += cell.len[k];
+    }
+  }
+  return v;
+}
+
+void packing_grid::add(int i, const vector3d &v) {
+  cell_of[i] = find(v);
+  cells[cell_of[i]].push_back(i);
+}
+
+void packing_grid::move(int i, const vector3d &v) {
+  const int c = find(v);
+  if (c == cell_of[i]) return;
+  std::vector<int> &old = cells[cell_of[i]];
+  for (unsigned m=0; m<old.size(); m++) {
+    if (old[m] == i) {
+      old[m] = old.back();
+      old.pop_back();
+      break;
+    }
+  }
+  cells[c].push_back(i);
+  cell_of[i] = c;
+}
+
+double packing_grid::room(const vector3d *spheres, const double *radii,
+                          const vector3d &v, int skip) const {
+  double best = min_width/2;
+  int c[3];
+  for (int k=2, ci=find(v); k>=0; k--) {
+    c[k] = ci % n[k];
+    ci /= n[k];
+  }
+  // Along an axis with fewer than three cells we just look at all of
+  // them, so as not to see any cell twice.
+  int first[3], count[3];
+  for (int k=0; k<3; k++) {
+    first[k] = (n[k] < 3) ? 0 : c[k] - 1;
+    count[k] = (n[k] < 3) ? n[k] : 3;
+  }
+  for (int a=0; a<count[0]; a++) {
+    for (int b=0; b<count[1]; b++) {
+      for (int e=0; e<count[2]; e++) {
+        int m[3] = { first[0] + a, first[1] + b, first[2] + e };
+        bool outside = false;
+        for (int k=0; k<3; k++) {
+          if (m[k] < 0 || m[k] >= n[k]) {
+            if (!cell.periodic[k]) outside = true;
+            m[k] = (m[k] + n[k]) % n[k];
+          }
+        }
+        if (outside) continue;
+        const std::vector<int> &here = cells[(m[0]*n[1] + m[1])*n[2] + m[2]];
+        for (unsigned h=0; h<here.size(); h++) {
+          const int j = here[h];
+          if (j == skip) continue;
+          const double r = diff(v, spheres[j]).norm() - radii[j];
+          if (r < best) best = r;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+double packing_volume(const packing_cell &cell) {
+  double box = 1;
+  for (int k=0; k<3; k++) box *= extent(cell, k);
+  if (cell.inner_radius == 0 && cell.outer_radius == 0) return box;
+  // The spherical walls may cut the box in awkward ways, so we just
+  // sample it.
+  const long samples = 100000;
+  long inside = 0;
+  for (long s=0; s<samples; s++) {
+    vector3d v;
+    for (int k=0; k<3; k++) v[k] = (random::ran() - 0.5)*extent(cell, k);
+    if (valid_center(cell, v)) inside++;
+  }
+  return box*inside/samples;
+}
+
+bool random_sequential_packing(vector3d *spheres, int N, double R,
+                               const packing_cell &cell, long max_attempts) {
+  packing_grid grid(cell, 2*R, N);
+  const std::vector<double> radii(N, R);
+  int placed = 0;
+  for (long attempt=0; attempt<max_attempts && placed<N; attempt++) {
+    const vector3d v = random_point(cell);
+    if (grid.room(spheres, &radii[0], v, -1) >= R) {
+      spheres[placed] = v;
+      grid.add(placed, v);
+      placed++;
+    }
+  }
+  return placed == N;
+}
+
+bool lattice_packing(vector3d *spheres, int N, double R, const packing_cell &cell) {
+  const double basis[4][3] = {{0,0,0}, {0.5,0.5,0}, {0.5,0,0.5}, {0,0.5,0.5}};
+  // Nearest neighbors on an fcc lattice are a/sqrt(2) apart.
+  const double min_a = 2*sqrt(2.0)*R;
+  double a = cbrt(4*packing_volume(cell)/N);
+  if (a < min_a) a = min_a;
+  std::vector<vector3d> sites;
+  while (true) {
+    sites.clear();
+    // Along periodic axes the lattice must fit the cell, so we
+    // stretch it a little.  Elsewhere we center it on the origin and
+    // keep whichever sites are valid.
+    int from[3], to[3];
+    double ak[3], origin[3];
+    for (int k=0; k<3; k++) {
+      if (cell.periodic[k]) {
+        const int m = (cell.len[k] >= a) ? int(cell.len[k]/a) : 1;
+        ak[k] = cell.len[k]/m;
+        origin[k] = -cell.len[k]/2;
+        from[k] = 0;
+        to[k] = m;
+      } else {
+        ak[k] = a;
+        origin[k] = 0;
+        to[k] = int(ceil(extent(cell, k)/(2*a))) + 1;
+        from[k] = -to[k];
+      }
+    }
+    for (int i=from[0]; i<to[0]; i++) {
+      for (int j=from[1]; j<to[1]; j++) {
+        for (int l=from[2]; l<to[2]; l++) {
+          for (int b=0; b<4; b++) {
+            const vector3d v(origin[0] + (i + basis[b][0])*ak[0],
+                             origin[1] + (j + basis[b][1])*ak[1],
+                             origin[2] + (l + basis[b][2])*ak[2]);
+            if (valid_center(cell, v)) sites.push_back(v);
+          }
+        }
+      }
+    }
+    if (int(sites.size()) >= N) break;
+    if (a == min_a) return false;
+    a = 0.99*a;
+    if (a < min_a) a = min_a;
+  }
+  // Pick N of the sites at random.
+  for (int i=0; i<N; i++) {
+    int j = i + int(random::ran()*(sites.size() - i));
+    if (j >= int(sites.size())) j = sites.size() - 1;
+    const vector3d tmp = sites[i];
+    sites[i] = sites[j];
+    sites[j] = tmp;
+    spheres[i] = sites[i];
+  }
+  return true;
+}
+
+bool grow_packing(vector3d *spheres, int N, double R, const packing_cell &cell,
+                  long max_sweeps) {
+  packing_grid grid(cell, 2*R, N);
+  std::vector<double> radii(N, 0);
+  for (int i=0; i<N; i++) {
+    spheres[i] = random_point(cell);
+    grid.add(i, spheres[i]);
+  }
+  // Each sphere has its own radius, which grows whenever its
+  // neighbors leave it room, so no one tight spot holds up the rest.
+  double step = 0.5*cbrt(packing_volume(cell)/N);
+  for (long sweep=0; sweep<max_sweeps; sweep++) {
+    int grown = 0;
+    long accepted = 0;
+    for (int i=0; i<N; i++) {
+      vector3d v = spheres[i] + vector3d::ran(step);
+      wrap(cell, &v);
+      if (valid_center(cell, v) && grid.room(spheres, &radii[0], v, i) >= radii[i]) {
+        spheres[i] = v;
+        grid.move(i, v);
+        accepted++;
+      }
+      // Growing only halfway into the room available leaves the
+      // neighbors space to rearrange, which helps at high density.
+      // Once there is room for R itself we take it outright, since
+      // halving the gap would otherwise stall within roundoff of R.
+      const double room = grid.room(spheres, &radii[0], spheres[i], i);
+      radii[i] = (room >= R) ? R : 0.5*(radii[i] + room);
+      if (radii[i] == R) grown++;
+    }
+    if (grown == N) return true;
+    // Keep the acceptance rate near one half, which is about where
+    // the crowded spheres make room fastest.
+    if (accepted < 0.4*N) step *= 0.8;
+    else if (accepted > 0.6*N && step < 2*R) step *= 1.25;
+  }
+  return false;
+}
+
+const char *initial_packing(vector3d *spheres, int N, double R, const packing_cell &cell) {
+  const double volume = packing_volume(cell);
+  if (N < 1 || volume <= 0) return 0;
+  const double eta = N*(4*M_PI/3)*R*R*R/volume;
+  if (eta < 0.25 && random_sequential_packing(spheres, N, R, cell, 1000L*N)) {
+    return "random sequential addition";
+  }
+  if (eta < 0.53 && grow_packing(spheres, N, R, cell, 10000)) {
+    return "sphere growth";
+  }
+  if (lattice_packing(spheres, N, R, cell)) return "fcc lattice";
+  return 0;
+}
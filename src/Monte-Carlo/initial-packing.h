@@ -0,0 +1,48 @@
+#pragma once
+
+#include "vector3d.h"
+
+// These functions find an overlap-free starting configuration of N
+// hard spheres of radius R.  The cell is centered on the origin.
+// Along each axis it is either periodic with length len, or the
+// sphere centers are kept within +/- len/2, either by hard walls or,
+// if there are no walls along that axis and there is an outer
+// spherical wall, by that sphere.  As in the hard-sphere drivers,
+// walls constrain the sphere centers: a center must lie outside of
+// inner_radius and inside of outer_radius (when these are nonzero).
+struct packing_cell {
+  double len[3];
+  bool periodic[3];
+  bool wall[3];
+  double inner_radius;
+  double outer_radius;
+};
+
+// The volume available to the sphere centers.
+double packing_volume(const packing_cell &cell);
+
+// random_sequential_packing inserts spheres one at a time at random
+// valid positions.  This is very fast at low packing fractions, but
+// jams somewhere below a packing fraction of 0.38.  It returns false
+// if it gives up after max_attempts insertions.
+bool random_sequential_packing(vector3d *spheres, int N, double R,
+                               const packing_cell &cell, long max_attempts);
+
+// lattice_packing places the spheres on the sites of an fcc lattice,
+// compressing the lattice until it has at least N sites in the cell,
+// and then leaving randomly chosen sites empty.  This works up to
+// nearly close packing, but gives a crystalline start.
+bool lattice_packing(vector3d *spheres, int N, double R, const packing_cell &cell);
+
+// grow_packing starts from random points and alternates sweeps of
+// Monte Carlo moves with growing the spheres to the largest radius
+// that their closest pair allows, in the spirit of the
+// Lubachevsky-Stillinger algorithm, until they reach radius R.  This
+// gives a disordered start at liquid packing fractions.
+bool grow_packing(vector3d *spheres, int N, double R, const packing_cell &cell,
+                  long max_sweeps);
+
+// initial_packing uses whichever of the above should work best for
+// the packing fraction, falling back to the others if need be.  It
+// returns the name of the method that worked, or 0 if none did.
+const char *initial_packing(vector3d *spheres, int N, double R, const packing_cell &cell);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include "vector3d.h"
+
+// A neighbor_grid is a uniform cell list of the neighbor_center of
+// each ball (or polyhedron), with cells at least as wide as the
+// largest distance at which two objects can be neighbors.  Finding
+// the neighbors of something then only means looking at the centers
+// in the 27 cells around it, rather than at all N of them.
+//
+// Since the neighbor tables are built from neighbor_center rather
+// than pos, the grid only needs to be told when an object's
+// neighbor_center changes, which is when its neighbor table is
+// rebuilt.
+//
+// Along each axis with period[k] > 0 the cell is periodic with that
+// length.  Along any other axis, the grid spans the centers at the
+// time of init, and anything that later wanders outside of that span
+// is simply counted in the outermost cells.
+
+struct neighbor_grid {
+  neighbor_grid() : total(0) {}
+
+  // init bins the N objects p, which need to have neighbor_center and
+  // R.  Two objects are neighbors if their centers are closer than
+  // the sum of their radii plus neighborR.
+  template <typename T>
+  void init(const T *p, int N, double neighborR, const double period[3]);
+
+  // move must be called whenever the neighbor_center of object i
+  // changes.
+  void move(int i, const vector3d &center);
+
+  // near fills in the indices of the (distinct) cells that could hold
+  // a center within reach of v, and returns how many there are.
+  int near(const vector3d &v, int cells_near[27]) const;
+
+  int find(const vector3d &v) const;
+
+  double lo[3], width[3];
+  bool periodic[3];
+  int n[3], total;
+  std::vector< std::vector<int> > cells;
+  std::vector<int> cell_of;
+};
+
+template <typename T>
+void neighbor_grid::init(const T *p, int N, double neighborR, const double period[3]) {
+  double maxR = 0;
+  for (int i=0; i<N; i++) maxR = fmax(maxR, p[i].R);
+  const double min_width = 2*maxR + neighborR;
+  total = 1;
+  for (int k=0; k<3; k++) {
+    periodic[k] = (period[k] > 0);
+    double extent = period[k];
+    lo[k] = 0;
+    if (!periodic[k] && N > 0) {
+      double hi = p[0].neighbor_center[k];
+      lo[k] = hi;
+      for (int i=1; i<N; i++) {
+        lo[k] = fmin(lo[k], p[i].neighbor_center[k]);
+        hi = fmax(hi, p[i].neighbor_center[k]);
+      }
+      extent = hi - lo[k];
+    }
+    n[k] = int(extent/min_width);
+    if (n[k] < 1) n[k] = 1;
+    width[k] = (n[k] > 1) ? extent/n[k] : HUGE_VAL;
+    total *= n[k];
+  }
+  cells.assign(total, std::vector<int>());
+  cell_of.assign(N, -1);
+  for (int i=0; i<N; i++) {
+    cell_of[i] = find(p[i].neighbor_center);
+    cells[cell_of[i]].push_back(i);
+  }
+}
+
+inline int neighbor_grid::find(const vector3d &v) const {
+  int c = 0;
+  for (int k=0; k<3; k++) {
+    int ck = 0;
+    if (n[k] > 1) {
+      const double x = floor((v[k] - lo[k])/width[k]);
+      ck = (x < 0) ? 0 : (x >= n[k]) ? n[k] - 1 : int(x);
+    }
+    c = c*n[k] + ck;
+  }
+  return c;
+}
+
+inline void neighbor_grid::move(int i, const vector3d &center) {
+  const int c = find(center);
+  if (c == cell_of[i]) return;
+  std::vector<int> &old = cells[cell_of[i]];
+  for (unsigned m=0; m<old.size(); m++) {
+    if (old[m] == i) {
+      old[m] = old.back();
+      old.pop_back();
+      break;
+    }
+  }
+  cells[c].push_back(i);
+  cell_of[i] = c;
+}
+
+inline int neighbor_grid::near(const vector3d &v, int cells_near[27]) const {
+  int c[3];
+  for (int k=2, ci=find(v); k>=0; k--) {
+    c[k] = ci % n[k];
+    ci /= n[k];
+  }
+  // Along an axis with fewer than three cells we just look at all of
+  // them, so as not to see any cell twice.
+  int first[3], count[3];
+  for (int k=0; k<3; k++) {
+    first[k] = (n[k] < 3) ? 0 : c[k] - 1;
+    count[k] = (n[k] < 3) ? n[k] : 3;
+  }
+  int num = 0;
+  for (int a=0; a<count[0]; a++) {
+    for (int b=0; b<count[1]; b++) {
+      for (int e=0; e<count[2]; e++) {
+        int m[3] = { first[0] + a, first[1] + b, first[2] + e };
+        bool outside = false;
+        for (int k=0; k<3; k++) {
+          if (m[k] < 0 || m[k] >= n[k]) {
+            if (!periodic[k]) outside = true;
+            m[k] = (m[k] + n[k]) % n[k];
+          }
+        }
+        if (!outside) cells_near[num++] = (m[0]*n[1] + m[1])*n[2] + m[2];
+      }
+    }
+  }
+  return num;
+}
@@ -501,8 +501,9 @@ periodicity/dimensions are not set by default and are required.\n");
   save_locations(polyhedra, N, vertices_fname, len);
   delete[] vertices_fname;
 
+  neighbor_grid grid;
   int most_neighbors =
-    initialize_neighbor_tables(polyhedra, N, neighborR + 2*dr, max_neighbors, periodic);
+    initialize_neighbor_tables(polyhedra, N, neighborR + 2*dr, max_neighbors, periodic, &grid);
   if (most_neighbors < 0) {
     fprintf(stderr, "The guess of %i max neighbors was too low. Exiting.\n", max_neighbors);
     return 1;
@@ -545,7 +546,7 @@ periodicity/dimensions are not set by default and are required.\n");
     // ---------------------------------------------------------------
     for(int i=0; i<N; i++) {
       count += move_one_polyhedron(i, polyhedra, N, periodic, walls, real_walls,
-                                        neighborR, scale, theta_scale, max_neighbors, dr);
+                                        neighborR, scale, theta_scale, max_neighbors, dr, &grid);
     }
     // ---------------------------------------------------------------
     // fine-tune scale so that the acceptance rate will reach the goal
@@ -653,7 +654,7 @@ periodicity/dimensions are not set by default and are required.\n");
     // ---------------------------------------------------------------
     for(int i=0; i<N; i++) {
       count += move_one_polyhedron(i, polyhedra, N, periodic, walls, real_walls,
-                                         neighborR, scale, theta_scale, max_neighbors, dr);
+                                         neighborR, scale, theta_scale, max_neighbors, dr, &grid);
     }
     // ---------------------------------------------------------------
     // Add data to historams
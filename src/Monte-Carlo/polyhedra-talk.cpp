@@ -45,12 +45,13 @@ int main(int argc, const char *argv[]) {
   for(int i=0; i<N; i++) {
     p[i].pos = vector3d(random::ran(), random::ran(), random::ran())*3;
   }
-  initialize_neighbor_tables(p, N, neighborR, max_neighbors, periodic);
+  neighbor_grid grid;
+  initialize_neighbor_tables(p, N, neighborR, max_neighbors, periodic, &grid);
 
   for(int j=0; j<100; j++) {
     for(int i=0; i<N; i++) {
       move_one_polyhedron(i, p, N, periodic, walls, real_walls,
-                          neighborR, scale, theta_scale, max_neighbors, 0);
+                          neighborR, scale, theta_scale, max_neighbors, 0, &grid);
     }
   }
   for(int i=0; i<N; i++) {
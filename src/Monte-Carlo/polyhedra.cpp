@@ -1,21 +1,29 @@
 #include <stdlib.h>
+#include <algorithm>
 #include "Monte-Carlo/polyhedra.h"
 #include "handymath.h"
 
 const poly_shape empty_shape;
 
 
-void update_neighbors(polyhedron &a, int n, const polyhedron *bs, int N,
+void update_neighbors(polyhedron &a, int n, const polyhedron *bs, const neighbor_grid &grid,
                       double neighborR, const double periodic[3]) {
   a.num_neighbors = 0;
-  for(int i=0; i<N; i++) {
-    if ((i!=n) &&
-        (periodic_diff(a.pos, bs[i].neighbor_center, periodic).normsquared()
-         < sqr(a.R + bs[i].R + neighborR))) {
-      a.neighbors[a.num_neighbors] = i;
-      a.num_neighbors ++;
+  int cells[27];
+  const int num_cells = grid.near(a.pos, cells);
+  for(int c=0; c<num_cells; c++) {
+    const std::vector<int> &here = grid.cells[cells[c]];
+    for(unsigned k=0; k<here.size(); k++) {
+      const int i = here[k];
+      if ((i!=n) &&
+          (periodic_diff(a.pos, bs[i].neighbor_center, periodic).normsquared()
+           < sqr(a.R + bs[i].R + neighborR))) {
+        a.neighbors[a.num_neighbors] = i;
+        a.num_neighbors ++;
+      }
     }
   }
+  std::sort(a.neighbors, a.neighbors + a.num_neighbors);
 }
 
 inline void add_new_neighbor(int new_n, polyhedron *p, int id) {
@@ -251,7 +259,8 @@ polyhedron random_move(const polyhedron &original, double size,
 
 counter move_one_polyhedron(int id, polyhedron *p, int N, const double periodic[3],
                          const double walls[3], bool real_walls, double neighborR,
-                        double dist, double angwidth, int max_neighbors, double dr) {
+                        double dist, double angwidth, int max_neighbors, double dr,
+                        neighbor_grid *grid) {
   const double len[3] = {periodic[0]+walls[0], periodic[1]+walls[1], periodic[2]+walls[2]};
   polyhedron temp = random_move(p[id], dist, angwidth, len);
   counter move;
@@ -268,7 +277,7 @@ counter move_one_polyhedron(int id, polyhedron *p, int N, const double periodic[
         // If we still don't overlap, then we'll have to update the tables
         // of our neighbors that have changed.
         temp.neighbors = new int[max_neighbors];
-        update_neighbors(temp, id, p, N, neighborR + 2*dr, periodic);
+        update_neighbors(temp, id, p, *grid, neighborR + 2*dr, periodic);
         move.updates ++;
         // However, for this check (and this check only), we don't need to
         // look at all of our neighbors, only our new ones.
@@ -281,6 +290,7 @@ counter move_one_polyhedron(int id, polyhedron *p, int N, const double periodic[
           // keeping this move and need to tell our neighbors where we are now.
           temp.neighbor_center = temp.pos;
           inform_neighbors(temp, p[id], id, p);
+          grid->move(id, temp.neighbor_center);
           move.informs ++;
           delete[] p[id].neighbors;
         }
@@ -297,25 +307,35 @@ counter move_one_polyhedron(int id, polyhedron *p, int N, const double periodic[
 }
 
 int initialize_neighbor_tables(polyhedron *p, int N, double neighborR,
-                               int max_neighbors, const double periodic[3]) {
+                               int max_neighbors, const double periodic[3],
+                               neighbor_grid *grid) {
   int most_neighbors = 0;
   for(int i=0; i<N; i++) {
     p[i].neighbor_center = p[i].pos;
   }
+  grid->init(p, N, neighborR, periodic);
   for(int i=0; i<N; i++) {
     p[i].neighbors = new int[max_neighbors];
     p[i].num_neighbors = 0;
-    for(int j=0; j<N; j++) {
-      const bool is_neighbor = (i != j) &&
-        (periodic_diff(p[i].pos, p[j].pos, periodic).normsquared() <
-         uipow(p[i].R + p[j].R + neighborR, 2));
-      if (is_neighbor) {
-        const int index = p[i].num_neighbors;
-        p[i].num_neighbors ++;
-        if (p[i].num_neighbors > max_neighbors) return -1;
-        p[i].neighbors[index] = j;
+    int cells[27];
+    const int num_cells = grid->near(p[i].pos, cells);
+    for(int c=0; c<num_cells; c++) {
+      const std::vector<int> &here = grid->cells[cells[c]];
+      for(unsigned k=0; k<here.size(); k++) {
+        const int j = here[k];
+        const bool is_neighbor = (i != j) &&
+          (periodic_diff(p[i].pos, p[j].pos, periodic).normsquared() <
+           uipow(p[i].R + p[j].R + neighborR, 2));
+        if (is_neighbor) {
+          const int index = p[i].num_neighbors;
+          p[i].num_neighbors ++;
+          if (p[i].num_neighbors > max_neighbors) return -1;
+          p[i].neighbors[index] = j;
+        }
       }
     }
+    // inform_neighbors relies on the tables being sorted.
+    std::sort(p[i].neighbors, p[i].neighbors + p[i].num_neighbors);
     most_neighbors = max(most_neighbors, p[i].num_neighbors);
   }
   return most_neighbors;
@@ -1,4 +1,5 @@
 #include "vector3d.h"
+#include "Monte-Carlo/neighbor-grid.h"
 #pragma once
 
 #define DISALLOW_COPY_AND_ASSIGN(TypeName) \
@@ -73,15 +74,20 @@ struct counter {
 
 // struct polyhedron; fixme: forward declare
 
-// Create and initialize the neighbor tables for polyhedra p.  Returns
-// the maximum number of neighbors that any polyhedron has, or -1 if
-// that number is larger than max_neighbors.
+// Create and initialize the neighbor tables for polyhedra p, and the
+// grid that update_neighbors uses to find them later.  Returns the
+// maximum number of neighbors that any polyhedron has, or -1 if that
+// number is larger than max_neighbors.
 int initialize_neighbor_tables(polyhedron *p, int N, double neighborR,
-                               int max_neighbors, const double periodic[3]);
+                               int max_neighbors, const double periodic[3],
+                               neighbor_grid *grid);
 
 // Find's the neighbors of a by comparing a's position to the center of
 // everyone else's neighborsphere, where id is the index of a in p.
-void update_neighbors(polyhedron &a, int id, const polyhedron *p, int N, double neighborR, const double periodic[3]);
+// Only the polyhedra in the grid cells around a are considered, and
+// the neighbors are kept sorted.
+void update_neighbors(polyhedron &a, int id, const polyhedron *p, const neighbor_grid &grid,
+                      double neighborR, const double periodic[3]);
 
 // Removes n from the neighbor table of anyone neighboring oldp but not newp.
 // Adds n to the neighbor table of anyone neighboring newp but not oldp.
@@ -130,4 +136,5 @@ polyhedron random_move(const polyhedron &original, double dist, double angwidth,
 //   if, after updating the neighbor table, neighbors were informed
 counter move_one_polyhedron(int id, polyhedron *p, int N, const double periodic[3],
                          const double walls[3], bool real_walls, double neighborR,
-                        double dist, double angwidth, int max_neighbors, double dr);
+                        double dist, double angwidth, int max_neighbors, double dr,
+                        neighbor_grid *grid);
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <time.h>
 #include "Monte-Carlo/monte-carlo.h"
+#include "Monte-Carlo/initial-packing.h"
+#include "Monte-Carlo/event-chain.h"
 #include <cassert>
 #include <math.h>
 #include <stdlib.h>
@@ -22,10 +24,13 @@ const Vector3d latz = Vector3d(0,0,lenz);
 const Vector3d lat[3] = {latx,laty,latz};
 
 int main(int argc, char *argv[]){
-  if (argc != 5) {
-    printf("usage:  %s packing-fraction uncertainty_goal dr filename\n", argv[0]);
+  if (argc < 5 || argc > 7 || (argc > 5 && strcmp(argv[5], "eventchain") != 0)) {
+    printf("usage:  %s packing-fraction uncertainty_goal dr filename [eventchain [chain-length]]\n",
+           argv[0]);
     return 1;
   }
+  const bool use_event_chain = (argc > 5);
+  const double chain_length = (argc == 7) ? atof(argv[6]) : default_chain_length(R);
   const char *outfilename = argv[4];
   const double packing_fraction = atof(argv[1]);
   const double mean_density = packing_fraction/(4*M_PI/3*R*R*R);
@@ -35,22 +40,6 @@ int main(int argc, char *argv[]){
   const double dr = atof(argv[3]);
   Vector3d *spheres = new Vector3d[N];
 
-  //////////////////////////////////////////////////////////////////////////////////////////
-  // We start with randomly-placed spheres, and then gradually wiggle
-  // them around until they are all within bounds and are not
-  // overlapping.  We do this by creating an "overlap" value which we
-  // constrain to never increase.  Note that this may not work at all
-  // for high filling fractions, since we could get stuck in a local
-  // minimum.
-  for(long i=0; i<N; i++) {
-    spheres[i]=10*lenx*ran3();
-  }
-  clock_t start = clock();
-  long num_to_time = 100*N;
-  long num_timed = 0;
-  long i = 0;
-  double scale = .005;
-
   // At this stage, we'll set up our output grid...
   long div = long((lenx/2 - innerRad)/dr);
   if (div < 10) div = 10;
@@ -67,49 +56,27 @@ int main(int argc, char *argv[]){
   fflush(stdout);
 
 
-  // Let's move each sphere once, so they'll all start within our
-  // periodic cell!
-  for (i=0;i<N;i++) spheres[i] = move(spheres[i], scale);
+  //////////////////////////////////////////////////////////////////////////////////////////
+  // We start with an overlap-free packing (see initial-packing.h),
+  // which the moves below then equilibrate.
+  clock_t start = clock();
+  long num_to_time = 100*N;
+  long num_timed = 0;
+  double scale = .005;
 
   clock_t starting_initial_state = clock();
-  printf("Initial countOverLaps is %g\n", countOverLaps(spheres, N, R));
-  while (countOverLaps(spheres, N, R)>0){
-    for (int movethis=0;movethis < 100*N; movethis++) {
-      if (num_timed++ > num_to_time) {
-        clock_t now = clock();
-        //printf("took %g seconds per initialising iteration\n",
-        //       (now - double(start))/CLOCKS_PER_SEC/num_to_time);
-        num_timed = 0;
-        start = now;
-      }
-      Vector3d old =spheres[i%N];
-      double oldoverlap = countOneOverLap(spheres, N, i%N, R);
-      spheres[i%N]=move(spheres[i%N],scale);
-      double newoverlap = countOneOverLap(spheres, N, i%N, R);
-      if(newoverlap>oldoverlap){
-        spheres[i%N]=old;
-      }
-      i++;
-      if (i%(100*N) == 0) {
-        if (i>iterations/4) {
-          for(long i=0; i<N; i++) {
-            printf("%g\t%g\t%g\n", spheres[i][0],spheres[i][1],spheres[i][2]);
-          }
-          printf("couldn't find good state\n");
-          exit(1);
-        }
-        char *debugname = new char[10000];
-        sprintf(debugname, "%s.debug", outfilename);
-        FILE *spheredebug = fopen(debugname, "w");
-        for(long i=0; i<N; i++) {
-          fprintf(spheredebug, "%g\t%g\t%g\n", spheres[i][0],spheres[i][1],spheres[i][2]);
-        }
-        fclose(spheredebug);
-        printf("numOverLaps=%g (debug file: %s)\n",countOverLaps(spheres,N,R), debugname);
-        delete[] debugname;
-        fflush(stdout);
-      }
+  {
+    const packing_cell cell = { {lenx, leny, lenz}, {true, true, true}, {false, false, false},
+                                innerRad, 0 };
+    vector3d *packed = new vector3d[N];
+    const char *method = initial_packing(packed, N, R, cell);
+    if (!method) {
+      printf("couldn't find good state\n");
+      exit(1);
     }
+    printf("Initial state from %s\n", method);
+    for (long i=0; i<N; i++) spheres[i] = Vector3d(packed[i].x, packed[i].y, packed[i].z);
+    delete[] packed;
   }
   assert(countOverLaps(spheres, N, R) == 0);
   {
@@ -129,6 +96,14 @@ int main(int argc, char *argv[]){
     scale = 0.1;
   }
   printf("Using scale of %g\n", scale);
+  event_chain *ecmc = 0;
+  if (use_event_chain) {
+    const double len[3] = {lenx, leny, lenz};
+    const bool periodic[3] = {true, true, true};
+    const bool walls[3] = {false, false, false};
+    ecmc = new event_chain(spheres, N, R, len, periodic, walls, innerRad);
+    printf("Using event chains of length %g\n", chain_length);
+  }
   long count = 0;
   long *shells = new long[div];
   for (long l=0; l<div; l++) shells[l] = 0;
@@ -250,6 +225,13 @@ int main(int argc, char *argv[]){
       delete[] debugname;
       fflush(stdout);
     }
+    if (ecmc) {
+      // Every event chain is accepted, so there is nothing to reject.
+      ecmc->chain(chain_length);
+      count++;
+      workingmoves++;
+      continue;
+    }
     Vector3d temp = move(spheres[j%N],scale);
     count++;
     if(!overlap(spheres, temp, N, R, j%N)){
@@ -263,6 +245,10 @@ int main(int argc, char *argv[]){
   printf("Total number of attempted moves = %ld\n",count);
   printf("Total number of successful moves = %ld\n",workingmoves);
   printf("Acceptance rate = %g\n", workingmoves/double(count));
+  if (ecmc) {
+    printf("Collisions per event chain = %g\n", ecmc->collisions/double(ecmc->chains));
+    delete ecmc;
+  }
   fflush(stdout);
   delete[] shells;
   delete[] density;
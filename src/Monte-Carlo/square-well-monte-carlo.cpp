@@ -10,6 +10,7 @@
 #include "handymath.h"
 #include "vector3d.h"
 #include "Monte-Carlo/square-well.h"
+#include "tracing.h"
 
 #include "version-identifier.h"
 
@@ -108,6 +109,8 @@ int main(int argc, const char *argv[]) {
   // Tuning factors
   int oe_update_factor = 2;
   int flat_update_factor = 2;
+  int num_windows = 1;
+  double window_overlap = 0.5;
   sw.min_important_energy = 0;
 
   /* Do not change these here! They are taken directly from the WL paper.
@@ -209,6 +212,12 @@ int main(int argc, const char *argv[]) {
     {"translation_scale", '\0', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT,
      &sw.translation_scale, 0, "Standard deviation for translations of balls, "
      "relative to ball radius", "DOUBLE"},
+    {"avb", '\0', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &sw.avb_fraction, 0,
+     "Fraction of moves that are aggregation-volume-bias moves, which move a ball "
+     "into or out of the well of another", "DOUBLE"},
+    {"cluster_moves", '\0', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT,
+     &sw.cluster_fraction, 0, "Fraction of moves that translate a whole cluster "
+     "of balls", "DOUBLE"},
     {"acceptance_goal", '\0', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT,
      &acceptance_goal, 0, "Goal to set the acceptance rate", "DOUBLE"},
 
@@ -276,6 +285,11 @@ int main(int argc, const char *argv[]) {
      "Update scaling for the optimized ensemble method", "INT"},
     {"flat_update_factor", '\0', POPT_ARG_INT, &flat_update_factor, 0,
      "Update scaling for the simple flat method", "INT"},
+    {"windows", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &num_windows, 0,
+     "Number of overlapping energy windows in which to initialize at once, "
+     "each on its own thread", "INT"},
+    {"window_overlap", '\0', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &window_overlap, 0,
+     "Fraction of each energy window that overlaps with the next", "DOUBLE"},
     {"min_important_energy", '\0', POPT_ARG_INT, &sw.min_important_energy, 0,
      "Fix a minimum important energy at a given value", "INT"},
 
@@ -365,6 +379,14 @@ int main(int argc, const char *argv[]) {
     printf("Exactly one histogram method must be selected!\n");
     return 254;
   }
+  if (num_windows < 1 || window_overlap <= 0 || window_overlap >= 1) {
+    printf("We need at least one window, and an overlap between zero and one!\n");
+    return 254;
+  }
+  if (num_windows > 1 && vanilla_wang_landau) {
+    printf("Vanilla Wang-Landau fixes its own energy range, so cannot use windows!\n");
+    return 254;
+  }
   // Check that no more than one secondary method is used
   if(bool(optimized_ensemble) + bool(transition_override) > 1){
     printf("Cannot use more than one secondary histogram method!\n");
@@ -459,6 +481,11 @@ int main(int argc, const char *argv[]) {
     fprintf(stderr, "\nAll parameters must be positive.\n");
     return 1;
   }
+  if (sw.avb_fraction < 0 || sw.cluster_fraction < 0 ||
+      sw.avb_fraction + sw.cluster_fraction > 1) {
+    fprintf(stderr, "\nThe fractions of avb and cluster moves must add up to at most one.\n");
+    return 1;
+  }
 
   // Choose necessary but unspecified parameters
   if(tmmc || oetmmc | tmi | toe){
@@ -752,9 +779,7 @@ int main(int argc, const char *argv[]) {
   // ----------------------------------------------------------------------------
 
   {
-    int most_neighbors =
-      initialize_neighbor_tables(sw.balls, sw.N, sw.neighbor_R,
-                                 sw.max_neighbors, sw.len, sw.walls);
+    int most_neighbors = sw.initialize_neighbor_tables();
     if (most_neighbors < 0) {
       fprintf(stderr, "The guess of %i max neighbors was too low. Exiting.\n",
               sw.max_neighbors);
@@ -814,24 +839,32 @@ int main(int argc, const char *argv[]) {
     }
   }
 
+  // The flat-histogram methods can either run as is, or in several
+  // energy windows at once.
+  std::function<void(sw_simulation &)> initialize;
+  if (wang_landau || vanilla_wang_landau) {
+    initialize = [&](sw_simulation &s) {
+      s.initialize_wang_landau(wl_factor, wl_fmod, wl_threshold, wl_cutoff,
+                               vanilla_wang_landau);
+    };
+  } else if (simple_flat) {
+    initialize = [&](sw_simulation &s) { s.initialize_simple_flat(flat_update_factor); };
+  } else if (tmi) {
+    initialize = [](sw_simulation &s) { s.initialize_tmi(); };
+  } else if (toe) {
+    initialize = [](sw_simulation &s) { s.initialize_toe(); };
+  } else if (tmmc || oetmmc) {
+    initialize = [](sw_simulation &s) { s.initialize_transitions(); };
+  }
+
   if (reading_in_transition_matrix){
     sw.initialize_transitions_file(transitions_input_filename);
   } else if (fix_kT) {
     sw.initialize_canonical(fix_kT);
-  } else if (wang_landau || vanilla_wang_landau) {
-    sw.initialize_wang_landau(wl_factor, wl_fmod, wl_threshold, wl_cutoff,
-                              vanilla_wang_landau);
-  } else if (simple_flat) {
-    sw.initialize_simple_flat(flat_update_factor);
-  } else if (tmi) {
-    sw.initialize_tmi();
-  } else if (toe) {
-    sw.initialize_toe();
-  } else if (tmmc) {
-    sw.initialize_transitions();
-  } else if (oetmmc) {
-    sw.initialize_transitions();
-    sw.optimize_weights_using_transitions();
+  } else if (initialize) {
+    if (num_windows > 1) sw.initialize_in_windows(num_windows, window_overlap, initialize);
+    else initialize(sw);
+    if (oetmmc) sw.optimize_weights_using_transitions();
   }
 
   // If we wish to optimize the ensemble or set transition matrix weights, do so
@@ -847,7 +880,13 @@ int main(int argc, const char *argv[]) {
     //   optimized ensemble initialization
     int first_update_iterations = sw.N*sw.energy_levels;
 
-    sw.initialize_optimized_ensemble(first_update_iterations, oe_update_factor);
+    if (num_windows > 1) {
+      sw.initialize_in_windows(num_windows, window_overlap, [&](sw_simulation &s) {
+          s.initialize_optimized_ensemble(first_update_iterations, oe_update_factor);
+        });
+    } else {
+      sw.initialize_optimized_ensemble(first_update_iterations, oe_update_factor);
+    }
     delete[] sw.compute_walker_density_using_transitions(); // to print the sample rate
   } else if(transition_override){
     printf("\nOptimizing the weight array using the transition matrix!\n");
@@ -1071,6 +1110,7 @@ int main(int argc, const char *argv[]) {
         || (sw.iteration >= simulation_iterations
             && (simulation_round_trips == 0
                 || sw.pessimistic_samples[sw.min_important_energy] >= simulation_round_trips))) {
+      trace_span trace("save data", "save");
       last_output = now;
       assert(last_output);
       output_period *= 2;
@@ -1230,15 +1270,16 @@ int main(int argc, const char *argv[]) {
       }
 
       delete[] countinfo;
+      // Save what we have of the trace, too, so a run that is killed
+      // still leaves a useful one.
+      flush_trace();
     }
   }
   // ----------------------------------------------------------------------------
   // END OF MAIN PROGRAM LOOP
   // ----------------------------------------------------------------------------
 
-  for (int i=0; i<sw.N; i++) {
-    delete[] sw.balls[i].neighbors;
-  }
+  sw.free_neighbor_tables();
   delete[] sw.balls;
   delete[] sw.ln_energy_weights;
   delete[] sw.energy_histogram;
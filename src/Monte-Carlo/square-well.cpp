@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <float.h>
+#include <algorithm>
+#include <vector>
+#include <thread>
 #include "Monte-Carlo/square-well.h"
 #include "handymath.h"
+#include "tracing.h"
 #include <sys/stat.h> // for seeing if the movie data file already exists.
 
 #include "version-identifier.h"
@@ -38,6 +42,8 @@ move_info::move_info(){
   working_old = 0;
   updates = 0;
   informs = 0;
+  avb_total = avb_working = 0;
+  cluster_total = cluster_working = 0;
 }
 
 // Modulates v to within the periodic boundaries of the cell
@@ -76,45 +82,64 @@ vector3d periodic_diff(const vector3d &a, const vector3d  &b, const double len[3
 }
 
 int initialize_neighbor_tables(ball *p, int N, double neighbor_R, int max_neighbors,
-                               const double len[3], int walls){
+                               const double len[3], int walls, neighbor_grid *grid,
+                               int *neighbor_arena){
   int most_neighbors = 0;
   for (int i = 0; i < N; i++){
     p[i].neighbor_center = p[i].pos;
   }
+  double period[3];
+  for (int k = 0; k < 3; k++) period[k] = (k >= walls) ? len[k] : 0;
+  grid->init(p, N, neighbor_R, period);
   for(int i = 0; i < N; i++){
-    p[i].neighbors = new int[max_neighbors];
+    p[i].neighbors = neighbor_arena + i*max_neighbors;
     p[i].num_neighbors = 0;
-    for (int j = 0; j < N; j++){
-      const bool is_neighbor = (i != j) &&
-        (periodic_diff(p[i].pos, p[j].pos, len, walls).normsquared() <
-         sqr(p[i].R + p[j].R + neighbor_R));
-      if (is_neighbor){
-        const int index = p[i].num_neighbors;
-        p[i].num_neighbors++;
-        if (p[i].num_neighbors > max_neighbors) {
-          printf("Found too many neighbors: %d > %d\n", p[i].num_neighbors, max_neighbors);
-          return -1;
+    int cells[27];
+    const int num_cells = grid->near(p[i].pos, cells);
+    for (int c = 0; c < num_cells; c++){
+      const std::vector<int> &here = grid->cells[cells[c]];
+      for (unsigned n = 0; n < here.size(); n++){
+        const int j = here[n];
+        const bool is_neighbor = (i != j) &&
+          (periodic_diff(p[i].pos, p[j].pos, len, walls).normsquared() <
+           sqr(p[i].R + p[j].R + neighbor_R));
+        if (is_neighbor){
+          const int index = p[i].num_neighbors;
+          p[i].num_neighbors++;
+          if (p[i].num_neighbors > max_neighbors) {
+            printf("Found too many neighbors: %d > %d\n", p[i].num_neighbors, max_neighbors);
+            return -1;
+          }
+          p[i].neighbors[index] = j;
         }
-        p[i].neighbors[index] = j;
       }
     }
+    // inform_neighbors relies on the tables being sorted.
+    std::sort(p[i].neighbors, p[i].neighbors + p[i].num_neighbors);
     most_neighbors = max(most_neighbors, p[i].num_neighbors);
   }
   return most_neighbors;
 }
 
-void update_neighbors(ball &a, int n, const ball *bs, int N,
+void update_neighbors(ball &a, int n, const ball *bs, const neighbor_grid &grid,
                       double neighbor_R, const double len[3], int walls, int max_neighbors){
   a.num_neighbors = 0;
-  for (int i = 0; i < N; i++){
-    if ((i != n) &&
-        (periodic_diff(a.pos, bs[i].neighbor_center, len, walls).normsquared()
-         < sqr(a.R + bs[i].R + neighbor_R))){
-      a.neighbors[a.num_neighbors] = i;
-      a.num_neighbors++;
-      assert(a.num_neighbors < max_neighbors);
+  int cells[27];
+  const int num_cells = grid.near(a.pos, cells);
+  for (int c = 0; c < num_cells; c++){
+    const std::vector<int> &here = grid.cells[cells[c]];
+    for (unsigned k = 0; k < here.size(); k++){
+      const int i = here[k];
+      if ((i != n) &&
+          (periodic_diff(a.pos, bs[i].neighbor_center, len, walls).normsquared()
+           < sqr(a.R + bs[i].R + neighbor_R))){
+        a.neighbors[a.num_neighbors] = i;
+        a.num_neighbors++;
+        assert(a.num_neighbors < max_neighbors);
+      }
     }
   }
+  std::sort(a.neighbors, a.neighbors + a.num_neighbors);
 }
 
 inline void add_neighbor(int new_n, ball *p, int id, int max_neighbors){
@@ -140,25 +165,27 @@ inline void remove_neighbor(int old_n, ball *p, int id){
   p[id].num_neighbors --;
 }
 
-void inform_neighbors(const ball &new_p, const ball &old_p, ball *p, int n, int max_neighbors){
+void inform_neighbors(const int *new_neighbors, int new_num,
+                      const int *old_neighbors, int old_num,
+                      ball *p, int n, int max_neighbors){
   int new_index = 0, old_index = 0;
   while (true){
-    if (new_index == new_p.num_neighbors){
-      for(int i = old_index; i < old_p.num_neighbors; i++)
-        remove_neighbor(n, p, old_p.neighbors[i]);
+    if (new_index == new_num){
+      for(int i = old_index; i < old_num; i++)
+        remove_neighbor(n, p, old_neighbors[i]);
       return;
     }
-    if (old_index == old_p.num_neighbors){
-      for(int i = new_index; i < new_p.num_neighbors; i++) {
-        add_neighbor(n, p, new_p.neighbors[i], max_neighbors);
+    if (old_index == old_num){
+      for(int i = new_index; i < new_num; i++) {
+        add_neighbor(n, p, new_neighbors[i], max_neighbors);
       }
       return;
     }
-    if (new_p.neighbors[new_index] < old_p.neighbors[old_index]){
-      add_neighbor(n, p, new_p.neighbors[new_index], max_neighbors);
+    if (new_neighbors[new_index] < old_neighbors[old_index]){
+      add_neighbor(n, p, new_neighbors[new_index], max_neighbors);
       new_index ++;
-    } else if (old_p.neighbors[old_index] < new_p.neighbors[new_index]){
-      remove_neighbor(n, p, old_p.neighbors[old_index]);
+    } else if (old_neighbors[old_index] < new_neighbors[new_index]){
+      remove_neighbor(n, p, old_neighbors[old_index]);
       old_index ++;
     } else {
       new_index ++;
@@ -262,58 +289,249 @@ void sw_simulation::reset_histograms(){
   }
 }
 
-void sw_simulation::move_a_ball(bool use_transition_matrix) {
+int sw_simulation::initialize_neighbor_tables() {
+  free_neighbor_tables(); // in case we are starting over
+  // Otherwise no drift is small enough to keep the tables complete.
+  assert(neighbor_drift() > 0);
+  neighbor_arena = new int[(N+1)*max_neighbors];
+  spare_neighbors = neighbor_arena + N*max_neighbors;
+  const int most_neighbors =
+    ::initialize_neighbor_tables(balls, N, neighbor_R, max_neighbors, len, walls,
+                                 &grid, neighbor_arena);
+  if (most_neighbors < 0) return most_neighbors;
+  interactions = new int[N];
+  for (int i = 0; i < N; i++) {
+    interactions[i] = count_interactions(i, balls, interaction_distance, len, walls, sticky_wall);
+  }
+  return most_neighbors;
+}
+
+void sw_simulation::free_neighbor_tables() {
+  delete[] neighbor_arena;
+  delete[] interactions;
+  neighbor_arena = spare_neighbors = 0;
+  interactions = 0;
+}
+
+int sw_simulation::move_a_ball(bool use_transition_matrix, int *moved) {
+  if (avb_fraction > 0 || cluster_fraction > 0) {
+    const double r = random::ran();
+    if (r < avb_fraction) return move_avb(use_transition_matrix, moved);
+    if (r < avb_fraction + cluster_fraction) return move_cluster(use_transition_matrix, moved);
+  }
   int id = moves.total % N;
   moves.total++;
-  const int old_interaction_count =
-    count_interactions(id, balls, interaction_distance, len, walls, sticky_wall);
+  // Because we always call sw_fix_periodic, we need not worry about
+  // moving out of the cell.
+  if (!try_move(id, sw_fix_periodic(balls[id].pos + vector3d::ran(translation_scale), len),
+                1, use_transition_matrix)) return 0;
+  if (moved) moved[0] = id;
+  return 1;
+}
+
+int sw_simulation::move_avb(bool use_transition_matrix, int *moved) {
+  moves.total++;
+  moves.avb_total++;
+  if (N < 2) {
+    transitions(energy, 0) += 1;
+    end_move_updates();
+    return 0;
+  }
+  // We pick a ball, and a partner for it, and with equal probability
+  // either put the ball anywhere in the well of its partner, or
+  // anywhere else in the cell.  Seen from the partner, that is a
+  // proposal that doesn't depend on where the ball was, with a density
+  // of 1/(2*in_volume) within the well and 1/(2*cell_volume) outside
+  // of it, so the bias is the ratio of the density where the ball is
+  // to that where it would go.
+  const int id = std::min(int(random::ran()*N), N-1);
+  int partner = std::min(int(random::ran()*(N-1)), N-2);
+  if (partner >= id) partner++;
+  const vector3d center = balls[partner].pos;
+  const double d2 = sqr(interaction_distance);
+  const double in_density = 1/(4*M_PI/3*d2*interaction_distance);
+  const double out_density = 1/(len[0]*len[1]*len[2]);
+  const bool was_in = periodic_diff(center, balls[id].pos, len, walls).normsquared() <= d2;
+  const bool go_in = random::ran() < 0.5;
+  vector3d pos;
+  if (go_in) {
+    vector3d offset;
+    do {
+      offset = interaction_distance*vector3d(2*random::ran() - 1, 2*random::ran() - 1,
+                                             2*random::ran() - 1);
+    } while (offset.normsquared() > d2);
+    pos = sw_fix_periodic(center + offset, len);
+  } else {
+    pos = vector3d(len[0]*random::ran(), len[1]*random::ran(), len[2]*random::ran());
+  }
+  // A move into the well that wraps across a wall, or a move "out"
+  // that lands in the well, is simply rejected, which keeps the
+  // densities above honest.
+  if ((periodic_diff(center, pos, len, walls).normsquared() <= d2) != go_in) {
+    transitions(energy, 0) += 1;
+    end_move_updates();
+    return 0;
+  }
+  const double bias = (was_in ? in_density : out_density)/(go_in ? in_density : out_density);
+  if (!try_move(id, pos, bias, use_transition_matrix)) return 0;
+  moves.avb_working++;
+  if (moved) moved[0] = id;
+  return 1;
+}
+
+// find_cluster lists in cluster the balls that are linked to ball
+// start by chains of balls within each other's wells, and marks them
+// in in_cluster, which should start out all false.
+static void find_cluster(const sw_simulation &sw, int start, std::vector<int> &cluster,
+                         std::vector<bool> &in_cluster) {
+  const double d2 = sqr(sw.interaction_distance);
+  cluster.assign(1, start);
+  in_cluster[start] = true;
+  for (size_t k = 0; k < cluster.size(); k++) {
+    const ball &a = sw.balls[cluster[k]];
+    for (int i = 0; i < a.num_neighbors; i++) {
+      const int j = a.neighbors[i];
+      if (!in_cluster[j] &&
+          periodic_diff(a.pos, sw.balls[j].pos, sw.len, sw.walls).normsquared() <= d2) {
+        in_cluster[j] = true;
+        cluster.push_back(j);
+      }
+    }
+  }
+}
+
+int sw_simulation::move_cluster(bool use_transition_matrix, int *moved) {
+  moves.total++;
+  moves.cluster_total++;
+  // We translate the whole cluster of a random ball.  The reverse move
+  // picks the same cluster with the same probability only if the
+  // cluster is still the same after the move, so we reject any move
+  // that joins it to another ball or breaks it apart, as well as any
+  // move that overlaps.  It is easiest to move the balls one at a
+  // time, and move them back if it doesn't work out.
+  std::vector<int> cluster, moved_cluster;
+  std::vector<bool> in_cluster(N, false), in_moved_cluster(N, false);
+  find_cluster(*this, std::min(int(random::ran()*N), N-1), cluster, in_cluster);
+  const vector3d shift = vector3d::ran(translation_scale);
+  std::vector<vector3d> old_pos(cluster.size());
+  int energy_change = 0;
+  for (size_t k = 0; k < cluster.size(); k++) {
+    old_pos[k] = balls[cluster[k]].pos;
+    energy_change += relocate(cluster[k], sw_fix_periodic(old_pos[k] + shift, len));
+  }
+  bool ok = true;
+  for (size_t k = 0; k < cluster.size() && ok; k++) {
+    if (overlaps_with_any(balls[cluster[k]], balls, len, walls)) ok = false;
+  }
+  if (ok) {
+    find_cluster(*this, cluster[0], moved_cluster, in_moved_cluster);
+    ok = moved_cluster.size() == cluster.size();
+    for (size_t k = 0; k < moved_cluster.size() && ok; k++) {
+      if (!in_cluster[moved_cluster[k]]) ok = false;
+    }
+    if (!ok) transitions(energy, 0) += 1;
+  } else {
+    transitions(energy, 0) += 1;
+  }
+  if (!ok || !accept_move(energy_change, 1, use_transition_matrix)) {
+    // The neighbor tables hold every interacting pair, so putting each
+    // ball back where it was must undo the energy change exactly.
+    for (size_t k = 0; k < cluster.size(); k++) {
+      energy_change += relocate(cluster[k], old_pos[k]);
+    }
+    assert(energy_change == 0);
+    end_move_updates();
+    return 0;
+  }
+  moves.working++;
+  moves.cluster_working++;
+  energy += energy_change;
 
-  ball temp = balls[id];
-  temp.pos = sw_fix_periodic(temp.pos + vector3d::ran(translation_scale), len);
-  // If we overlap, this is a bad move! Because random_move always
-  // calls sw_fix_periodic, we need not worry about moving out of the
-  // cell.
-  if (overlaps_with_any(temp, balls, len, walls)){
+  if(energy_change != 0) energy_change_updates(energy_change);
+
+  end_move_updates();
+  if (moved) std::copy(cluster.begin(), cluster.end(), moved);
+  return int(cluster.size());
+}
+
+bool sw_simulation::try_move(int id, const vector3d &pos, double bias,
+                             bool use_transition_matrix) {
+  // We move the ball in place, and put it back if the move fails.
+  ball &b = balls[id];
+  const vector3d old_pos = b.pos;
+  b.pos = pos;
+  // If we overlap, this is a bad move!
+  if (overlaps_with_any(b, balls, len, walls)){
+    b.pos = old_pos;
     transitions(energy, 0) += 1; // update the transition histogram
     end_move_updates();
-    return;
+    return false;
   }
+  int *old_neighbors = b.neighbors;
+  const int old_num_neighbors = b.num_neighbors;
   const bool get_new_neighbors =
-    (periodic_diff(temp.pos, temp.neighbor_center, len, walls).normsquared()
-     > sqr(neighbor_R/2.0));
+    (periodic_diff(b.pos, b.neighbor_center, len, walls).normsquared()
+     > sqr(neighbor_drift()));
   if (get_new_neighbors){
     // If we've moved too far, then the overlap test may have given a false
     // negative. So we'll find our new neighbors, and check against them.
     // If we still don't overlap, then we'll have to update the tables
     // of our neighbors that have changed.
-    temp.neighbors = new int[max_neighbors];
-    update_neighbors(temp, id, balls, N, neighbor_R, len, walls, max_neighbors);
+    b.neighbors = spare_neighbors;
+    update_neighbors(b, id, balls, grid, neighbor_R, len, walls, max_neighbors);
     moves.updates++;
     // However, for this check (and this check only), we don't need to
     // look at all of our neighbors, only our new ones.
     // fixme: do this!
-    //int *new_neighbors = new int[max_neighbors];
 
-    if (overlaps_with_any(temp, balls, len, walls)) {
+    if (overlaps_with_any(b, balls, len, walls)) {
       // turns out we overlap after all.  :(
-      delete[] temp.neighbors;
+      b.pos = old_pos;
+      b.neighbors = old_neighbors;
+      b.num_neighbors = old_num_neighbors;
       transitions(energy, 0) += 1; // update the transition histogram
       end_move_updates();
-      return;
+      return false;
     }
   }
   // Now that we know that we are keeping the new move (unless the
   // weights say otherwise), and after we have updated the neighbor
   // tables if needed, we can compute the new interaction count.
-  ball pid = balls[id]; // save a copy
-  balls[id] = temp; // temporarily update the position
+  const int old_interaction_count = interactions[id];
   const int new_interaction_count =
     count_interactions(id, balls, interaction_distance, len, walls, sticky_wall);
-  balls[id] = pid;
   // Now we can check whether we actually want to do this move based on the
   // new energy.
   const int energy_change = new_interaction_count - old_interaction_count;
-  transitions(energy, energy_change) += 1; // update the transition histogram
+  if (!accept_move(energy_change, bias, use_transition_matrix)) {
+    b.pos = old_pos;
+    b.neighbors = old_neighbors;
+    b.num_neighbors = old_num_neighbors;
+    end_move_updates();
+    return false;
+  }
+  // Yay, we have a successful move!
+  commit_move(id, old_pos, old_neighbors, old_num_neighbors, get_new_neighbors,
+              new_interaction_count);
+  moves.working++;
+  energy += energy_change;
+
+  if(energy_change != 0) energy_change_updates(energy_change);
+
+  end_move_updates();
+  return true;
+}
+
+bool sw_simulation::accept_move(int energy_change, double bias, bool use_transition_matrix) {
+  // The transitions table counts the moves we would make at infinite
+  // temperature, which is where a biased move is only made with
+  // probability bias.
+  if (bias < 1 && random::ran() > bias) {
+    transitions(energy, 0) += 1;
+  } else {
+    transitions(energy, energy_change) += 1; // update the transition histogram
+  }
+  if (energy + energy_change < window_min || energy + energy_change > window_max) return false;
   double Pmove = 1;
   if (use_transition_matrix) {
     if (energy_change < 0) { // "Interactions" are decreasing, so energy is increasing.
@@ -336,40 +554,75 @@ void sw_simulation::move_a_ball(bool use_transition_matrix) {
         if (Pmove < Pmin) Pmove = Pmin;
       }
     }
+    if (bias != 1) Pmove = std::min(1.0, bias*Pmove);
   } else {
-    const double lnPmove =
-      ln_energy_weights[energy + energy_change] - ln_energy_weights[energy];
+    double lnPmove = ln_energy_weights[energy + energy_change] - ln_energy_weights[energy];
+    if (bias != 1) lnPmove += log(bias);
     if (lnPmove < 0) Pmove = exp(lnPmove);
   }
-  if (Pmove < 1) {
-    if (random::ran() > Pmove) {
-      // We want to reject this move because it is too improbable
-      // based on our weights.
-      if (get_new_neighbors) delete[] temp.neighbors;
-      end_move_updates();
-      return;
-    }
+  // We want to reject this move if it is too improbable based on our
+  // weights.
+  return !(Pmove < 1 && random::ran() > Pmove);
+}
+
+int sw_simulation::relocate(int id, const vector3d &pos) {
+  ball &b = balls[id];
+  const vector3d old_pos = b.pos;
+  int *old_neighbors = b.neighbors;
+  const int old_num_neighbors = b.num_neighbors;
+  b.pos = pos;
+  const bool get_new_neighbors =
+    (periodic_diff(b.pos, b.neighbor_center, len, walls).normsquared()
+     > sqr(neighbor_drift()));
+  if (get_new_neighbors) {
+    b.neighbors = spare_neighbors;
+    update_neighbors(b, id, balls, grid, neighbor_R, len, walls, max_neighbors);
+    moves.updates++;
   }
+  const int old_interaction_count = interactions[id];
+  const int new_interaction_count =
+    count_interactions(id, balls, interaction_distance, len, walls, sticky_wall);
+  commit_move(id, old_pos, old_neighbors, old_num_neighbors, get_new_neighbors,
+              new_interaction_count);
+  return new_interaction_count - old_interaction_count;
+}
+
+void sw_simulation::commit_move(int id, const vector3d &old_pos, int *old_neighbors,
+                                int old_num_neighbors, bool get_new_neighbors,
+                                int new_interaction_count) {
+  ball &b = balls[id];
+  // Each neighbor's interaction count changes if we have come into or
+  // gone out of its well.
+  const double d2 = sqr(interaction_distance);
+  for (int i = 0; i < old_num_neighbors; i++) {
+    const int j = old_neighbors[i];
+    if (periodic_diff(old_pos, balls[j].pos, len, walls).normsquared() <= d2)
+      interactions[j]--;
+  }
+  for (int i = 0; i < b.num_neighbors; i++) {
+    const int j = b.neighbors[i];
+    if (periodic_diff(b.pos, balls[j].pos, len, walls).normsquared() <= d2)
+      interactions[j]++;
+  }
+  interactions[id] = new_interaction_count;
   if (get_new_neighbors) {
     // Okay, we've checked twice, just like Santa Clause, so we're definitely
     // keeping this move and need to tell our neighbors where we are now.
-    temp.neighbor_center = temp.pos;
-    inform_neighbors(temp, balls[id], balls, id, max_neighbors);
+    b.neighbor_center = b.pos;
+    inform_neighbors(b.neighbors, b.num_neighbors, old_neighbors, old_num_neighbors,
+                     balls, id, max_neighbors);
+    grid.move(id, b.neighbor_center);
+    spare_neighbors = old_neighbors;
     moves.informs++;
-    delete[] balls[id].neighbors;
   }
-  balls[id] = temp; // Yay, we have a successful move!
-  moves.working++;
-  energy += energy_change;
-
-  if(energy_change != 0) energy_change_updates(energy_change);
-
-  end_move_updates();
 }
 
 void sw_simulation::end_move_updates(){
    // update iteration counter, energy histogram, and walker counters
-  if(moves.total % N == 0) iteration++;
+  if(moves.total % N == 0) {
+    iteration++;
+    if (iteration % 1000 == 0) trace_progress();
+  }
   energy_histogram[energy]++;
   if(pessimistic_observation[min_important_energy]) walkers_up[energy]++;
 }
@@ -410,6 +663,7 @@ int sw_simulation::simulate_energy_changes(int num_moves) {
 }
 
 void sw_simulation::flush_weight_array(){
+  trace_span trace("flush weights", "weights");
   // floor weights above state of max entropy
   for (int i = 0; i < max_entropy_state; i++)
     ln_energy_weights[i] = ln_energy_weights[max_entropy_state];
@@ -807,7 +1061,7 @@ bool sw_simulation::finished_initializing(bool be_verbose) {
 
   else if(end_condition == init_iter_limit) {
     if (be_verbose) {
-      static int last_percent = 0;
+      static thread_local int last_percent = 0;
       int percent = (100*iteration)/init_iters;
       if (percent > last_percent) {
         printf("%2d%% done (%ld/%ld iterations)\n",
@@ -857,6 +1111,7 @@ bool sw_simulation::reached_iteration_cap(){
 }
 
 int sw_simulation::initialize_max_entropy(double acceptance_goal) {
+  trace_span trace("initialize max entropy", "initialize");
   printf("Moving to most probable state.\n");
   int num_moves = 500;
   const double mean_allowance = 1.0;
@@ -899,10 +1154,15 @@ int sw_simulation::initialize_max_entropy(double acceptance_goal) {
 }
 
 void sw_simulation::initialize_translation_distance(double acceptance_goal) {
+  trace_span trace("initialize translation distance", "initialize");
   printf("Tuning translation distance.\n");
   const int max_tries = 5;
   const int num_moves = 100*N*N;
   const int starting_iterations = iteration;
+  // We tune using translations alone, so the acceptance rate isn't
+  // muddied by the other sorts of moves.
+  const double avb = avb_fraction, cluster = cluster_fraction;
+  avb_fraction = cluster_fraction = 0;
   double dscale = 0.1;
   double acceptance_rate = 0;
   for (int num_tries=0;
@@ -925,6 +1185,8 @@ void sw_simulation::initialize_translation_distance(double acceptance_goal) {
     if(closeness > 0.5) dscale *= 2;
     else if(closeness < dscale*2 && dscale > 0.01) dscale/=2;
   }
+  avb_fraction = avb;
+  cluster_fraction = cluster;
   printf("Took %ld iterations to find acceptance rate of %.2g with translation scale %.2g\n",
          iteration - starting_iterations,
          acceptance_rate, translation_scale);
@@ -941,6 +1203,7 @@ void sw_simulation::initialize_canonical(double T, int reference) {
 void sw_simulation::initialize_wang_landau(double wl_factor, double wl_fmod,
                                            double wl_threshold, double wl_cutoff,
                                            bool fixed_energy_range) {
+  trace_span trace("initialize Wang-Landau", "initialize");
   const double original_wl_factor = wl_factor;
   int weight_updates = 0;
   bool done = false;
@@ -1068,6 +1331,7 @@ void sw_simulation::initialize_wang_landau(double wl_factor, double wl_fmod,
 // initialize the weight array using the optimized ensemble method.
 void sw_simulation::initialize_optimized_ensemble(int first_update_iterations,
                                                   int oe_update_factor){
+  trace_span trace("initialize optimized ensemble", "initialize");
   int weight_updates = 0;
   long update_iters = first_update_iterations;
   double tiny = 1e-3;
@@ -1139,6 +1403,7 @@ void sw_simulation::initialize_optimized_ensemble(int first_update_iterations,
 }
 
 void sw_simulation::initialize_simple_flat(int flat_update_factor){
+  trace_span trace("initialize simple flat", "initialize");
   int weight_updates = 0;
   long num_moves = exp(1/min_T)*N*energy_levels;
   bool am_verbose;
@@ -1214,6 +1479,7 @@ void sw_simulation::initialize_simple_flat(int flat_update_factor){
    matrix information.  This should give a similar set of weights to
    the optimized_ensemble approach. */
 void sw_simulation::optimize_weights_using_transitions() {
+  trace_span trace("optimize weights", "weights");
   // Assume that we already *have* a reasonable set of weights (with
   // which to compute the diffusivity), and that we have already
   // defined the min_important_energy.
@@ -1260,6 +1526,7 @@ op       difference is that we compute the diffusivity here *directly*
 
 // update the weight array using transitions
 void sw_simulation::update_weights_using_transitions() {
+  trace_span trace("update weights", "weights");
   double *ln_dos = compute_ln_dos(transition_dos);
   for (int i = 0; i < max_entropy_state; i++) {
     ln_energy_weights[i] = -ln_dos[max_entropy_state];
@@ -1275,6 +1542,7 @@ void sw_simulation::update_weights_using_transitions() {
 
 // initialization with tmi
 void sw_simulation::initialize_tmi() {
+  trace_span trace("initialize TMI", "initialize");
   int check_how_often = biggest_energy_transition*energy_levels; // avoid wasting time if we are done
   bool verbose = false;
   do {
@@ -1294,6 +1562,7 @@ void sw_simulation::initialize_tmi() {
 
 // initialization with tmi
 void sw_simulation::initialize_toe() {
+  trace_span trace("initialize TOE", "initialize");
   int check_how_often = biggest_energy_transition*energy_levels; // avoid wasting time if we are done
   bool verbose = false;
   do {
@@ -1313,6 +1582,7 @@ void sw_simulation::initialize_toe() {
 
 // initialization with tmmc
 void sw_simulation::initialize_transitions() {
+  trace_span trace("initialize TMMC", "initialize");
   int check_how_often = biggest_energy_transition*energy_levels; // avoid wasting time if we are done
   bool verbose = false;
   do {
@@ -1330,6 +1600,245 @@ void sw_simulation::initialize_transitions() {
   set_min_important_energy();
 }
 
+// window_copy makes a copy of sw with its own balls, tables and
+// histograms, which is confined to energies from lo to hi.  The copy
+// starts with the same weights, but with empty histograms, and writes
+// no files.
+static sw_simulation *window_copy(const sw_simulation &sw, int lo, int hi) {
+  sw_simulation *w = new sw_simulation(sw);
+  w->balls = new ball[sw.N];
+  for (int i = 0; i < sw.N; i++) {
+    w->balls[i].pos = sw.balls[i].pos;
+    w->balls[i].R = sw.balls[i].R;
+  }
+  // The tables we copied belong to sw.
+  w->neighbor_arena = w->spare_neighbors = 0;
+  w->interactions = 0;
+  w->initialize_neighbor_tables();
+  w->energy = count_all_interactions(w->balls, w->N, w->interaction_distance, w->len,
+                                     w->walls, w->sticky_wall);
+  w->energy_histogram = new long[sw.energy_levels]();
+  w->ln_energy_weights = new double[sw.energy_levels];
+  for (int i = 0; i < sw.energy_levels; i++) w->ln_energy_weights[i] = sw.ln_energy_weights[i];
+  w->optimistic_samples = new long[sw.energy_levels]();
+  w->pessimistic_samples = new long[sw.energy_levels]();
+  w->pessimistic_observation = new bool[sw.energy_levels]();
+  w->walkers_up = new long[sw.energy_levels]();
+  w->transitions_table = new long[sw.energy_levels*(2*sw.biggest_energy_transition+1)]();
+  w->transitions_filename = 0;
+  w->transitions_movie_filename_format = 0;
+  w->dos_movie_filename_format = 0;
+  w->lnw_movie_filename_format = 0;
+  w->window_min = lo;
+  w->window_max = hi;
+  w->moves = move_info();
+  w->iteration = 0;
+  return w;
+}
+
+static void delete_window_copy(sw_simulation *w) {
+  delete[] w->balls;
+  w->free_neighbor_tables();
+  delete[] w->energy_histogram;
+  delete[] w->ln_energy_weights;
+  delete[] w->optimistic_samples;
+  delete[] w->pessimistic_samples;
+  delete[] w->pessimistic_observation;
+  delete[] w->walkers_up;
+  delete[] w->transitions_table;
+  delete w;
+}
+
+void sw_simulation::initialize_in_windows(int num_windows, double overlap,
+                                          const std::function<void(sw_simulation &)> &initialize) {
+  trace_span trace("initialize in windows", "initialize");
+  int bottom = min_important_energy;
+  if (bottom <= max_entropy_state) {
+    // We need a guess at the lowest important energy, which is about
+    // where a canonical simulation at min_T ends up.  We cool down
+    // until the mean energy stops dropping.
+    double *ln_weights = new double[energy_levels];
+    for (int i = 0; i < energy_levels; i++) ln_weights[i] = ln_energy_weights[i];
+    initialize_canonical(min_T, max_entropy_state);
+    double last_mean = -1;
+    while (!reached_iteration_cap()) {
+      const long num_moves = long(N)*energy_levels;
+      double mean = 0;
+      for (long i = 0; i < num_moves; i++) {
+        move_a_ball();
+        mean += energy;
+      }
+      mean /= num_moves;
+      if (mean <= last_mean) break;
+      last_mean = mean;
+    }
+    bottom = min_energy_state;
+    for (int i = 0; i < energy_levels; i++) ln_energy_weights[i] = ln_weights[i];
+    delete[] ln_weights;
+    reset_histograms();
+  }
+  // Each window needs to share at least a couple of energies with its
+  // neighbors.
+  num_windows = min(num_windows, (bottom - max_entropy_state)/2);
+  if (num_windows < 2) {
+    initialize(*this);
+    return;
+  }
+  const double width = (bottom - max_entropy_state)/(num_windows - (num_windows - 1)*overlap);
+  printf("Initializing in %d windows of %.3g energies from %d to %d\n",
+         num_windows, width, max_entropy_state, bottom);
+
+  std::vector<sw_simulation *> windows(num_windows);
+  for (int k = 0; k < num_windows; k++) {
+    const double lo = max_entropy_state + k*(1 - overlap)*width;
+    // The first window goes on up to every higher energy, and the last
+    // on down to every lower energy, in case we have yet to see them.
+    sw_simulation *w = window_copy(*this, k ? int(lo) : 0,
+                                   k < num_windows - 1 ? int(ceil(lo + width)) : energy_levels-1);
+    if (k) w->max_entropy_state = w->window_min;
+    w->min_important_energy = min(int(ceil(lo + width)), bottom);
+    if (init_iters > 0) w->init_iters = max(1, init_iters/num_windows);
+    windows[k] = w;
+  }
+
+  // Each window draws from its own stream of random numbers, and we
+  // use new streams each time we are called.
+  static int streams_used = 0;
+  const int first_stream = streams_used;
+  streams_used += num_windows;
+  // A walker that runs out of iterations before it gets into its
+  // window never initializes, and its weights mean nothing.  Each
+  // thread writes only its own entry, so this is not a vector<bool>.
+  std::vector<char> initialized(num_windows, 0);
+  std::vector<std::thread> threads;
+  for (int k = 0; k < num_windows; k++) {
+    threads.push_back(std::thread([&windows, &initialized, &initialize, first_stream, k]() {
+          random_stream stream(random::stream(first_stream + k));
+          random::use(&stream);
+          sw_simulation &w = *windows[k];
+          {
+            trace_span descend("descend into window", "initialize");
+            // Ratchet the walker into its window, never letting it lose
+            // interactions it has found if it has too few for the
+            // window, nor gain any if it has too many.  The latter is
+            // the usual case, since every walker starts where cooling
+            // down left off, which is in the last window.
+            const int lo = w.window_min, hi = w.window_max;
+            while ((w.energy < lo || w.energy > hi) && !w.reached_iteration_cap()) {
+              if (w.energy < lo) w.window_min = w.energy;
+              else w.window_max = w.energy;
+              w.move_a_ball();
+            }
+            w.window_min = lo;
+            w.window_max = hi;
+            w.reset_histograms();
+            for (int i = 0; i < w.energy_levels*(2*w.biggest_energy_transition+1); i++) {
+              w.transitions_table[i] = 0;
+            }
+            w.min_energy_state = w.energy;
+          }
+          if (w.energy >= w.window_min && w.energy <= w.window_max) {
+            trace_span window("initialize window", "initialize");
+            initialize(w);
+            initialized[k] = 1;
+          }
+          random::use(0);
+        }));
+  }
+  for (int k = 0; k < num_windows; k++) threads[k].join();
+  for (int k = 0; k < num_windows; k++) {
+    if (!initialized[k]) {
+      printf("Window %d (energies %d to %d) never got going, so we skip its weights\n",
+             k, windows[k]->window_min, windows[k]->window_max);
+    }
+  }
+
+  // The transitions table counts moves as if at infinite temperature,
+  // regardless of the weights, so the windows' tables just add up.
+  // Likewise for the histograms, which are only a record of the work
+  // done.
+  for (int k = 0; k < num_windows; k++) {
+    const sw_simulation &w = *windows[k];
+    for (int i = 0; i < energy_levels*(2*biggest_energy_transition+1); i++) {
+      transitions_table[i] += w.transitions_table[i];
+    }
+    for (int i = 0; i < energy_levels; i++) {
+      energy_histogram[i] += w.energy_histogram[i];
+      optimistic_samples[i] += w.optimistic_samples[i];
+      pessimistic_samples[i] += w.pessimistic_samples[i];
+      walkers_up[i] += w.walkers_up[i];
+    }
+    min_energy_state = max(min_energy_state, w.min_energy_state);
+    iteration += w.iteration;
+    moves.total += w.moves.total;
+    moves.working += w.moves.working;
+  }
+  set_max_entropy_energy();
+  set_min_important_energy();
+
+  bool stitched = false;
+  if (sim_dos_type == histogram_dos) {
+    // Each window's weights give its own density of states, up to a
+    // constant, between its max_entropy_state and its
+    // min_important_energy.  We shift each to match the one before
+    // where they overlap, and switch over in the middle of the
+    // overlap.  If there is no overlap after all, or a window never
+    // initialized, we bridge the gap with the combined transition
+    // matrix.
+    double *ln_dos = new double[energy_levels]();
+    double *tm_ln_dos = compute_ln_dos(transition_dos);
+    int top = -1, covered = -1;
+    for (int k = 0; k < num_windows; k++) {
+      if (!initialized[k]) continue;
+      const sw_simulation &w = *windows[k];
+      const int first = max(w.max_entropy_state, w.window_min);
+      const int last = min(w.min_important_energy, w.window_max);
+      if (last < first) continue;
+      if (top < 0) top = first;
+      int from = first;
+      double offset = 0;
+      if (covered >= 0) {
+        const int shared = min(covered, last) - first + 1;
+        if (shared > 0) {
+          for (int e = first; e < first + shared; e++) {
+            offset += ln_dos[e] + w.ln_energy_weights[e];
+          }
+          offset /= shared;
+          from = first + shared/2;
+        } else {
+          for (int e = covered + 1; e < first; e++) {
+            ln_dos[e] = ln_dos[covered] + tm_ln_dos[e] - tm_ln_dos[covered];
+          }
+          offset = ln_dos[covered] + tm_ln_dos[first] - tm_ln_dos[covered]
+            + w.ln_energy_weights[first];
+        }
+      }
+      for (int e = from; e <= last; e++) ln_dos[e] = offset - w.ln_energy_weights[e];
+      covered = max(covered, last);
+    }
+    stitched = covered >= max_entropy_state;
+    for (int e = top - 1; stitched && e >= max_entropy_state; e--) {
+      ln_dos[e] = ln_dos[top] + tm_ln_dos[e] - tm_ln_dos[top];
+    }
+    for (int e = covered + 1; stitched && e <= min_important_energy; e++) {
+      ln_dos[e] = ln_dos[covered] + tm_ln_dos[e] - tm_ln_dos[covered];
+    }
+    if (stitched) {
+      for (int e = max_entropy_state; e <= min_important_energy; e++) {
+        ln_energy_weights[e] = -ln_dos[e];
+      }
+      for (int e = 0; e < max_entropy_state; e++) {
+        ln_energy_weights[e] = ln_energy_weights[max_entropy_state];
+      }
+    }
+    delete[] ln_dos;
+    delete[] tm_ln_dos;
+  }
+  if (!stitched) update_weights_using_transitions();
+  initialize_canonical(min_T, min_important_energy);
+  for (int k = 0; k < num_windows; k++) delete_window_copy(windows[k]);
+}
+
 static void write_t_file(const sw_simulation &sw, const char *fname) {
   FILE *f = fopen(fname,"w");
   if (!f) {
@@ -1399,6 +1908,7 @@ static void write_lnw_file(const sw_simulation &sw, const char *fname) {
 }
 
 void sw_simulation::write_transitions_file() const {
+  trace_span trace("save transitions", "save");
   // silently do not save if there is not file name
   if (transitions_filename) write_t_file(*this, transitions_filename);
 
@@ -1449,6 +1959,8 @@ void sw_simulation::write_header(FILE *f) const {
   fprintf(f, "# walls: %d\n", walls);
   fprintf(f, "# cell dimensions: (%g, %g, %g)\n", len[0], len[1], len[2]);
   fprintf(f, "# translation_scale: %g\n", translation_scale);
+  fprintf(f, "# avb_fraction: %g\n", avb_fraction);
+  fprintf(f, "# cluster_fraction: %g\n", cluster_fraction);
   fprintf(f, "# energy_levels: %d\n", energy_levels);
   fprintf(f, "# min_T: %g\n", min_T);
   fprintf(f, "# max_entropy_state: %d\n", max_entropy_state);
@@ -1460,6 +1972,13 @@ void sw_simulation::write_header(FILE *f) const {
   fprintf(f, "# working moves: %ld\n", moves.working);
   fprintf(f, "# total moves: %ld\n", moves.total);
   fprintf(f, "# acceptance rate: %g\n", double(moves.working)/moves.total);
+  if (moves.avb_total) {
+    fprintf(f, "# avb acceptance rate: %g\n", double(moves.avb_working)/moves.avb_total);
+  }
+  if (moves.cluster_total) {
+    fprintf(f, "# cluster acceptance rate: %g\n",
+            double(moves.cluster_working)/moves.cluster_total);
+  }
 
   fprintf(f, "\n");
 
@@ -1609,10 +2128,30 @@ double sw_simulation::estimate_trip_time(int E1, int E2) {
   return rate;
 }
 
+void sw_simulation::trace_progress() {
+  if (!tracing_enabled()) return;
+  static thread_local long last_total = 0, last_working = 0;
+  static thread_local long long last_ns = trace_now_ns();
+  const long long now = trace_now_ns();
+  trace_counter("energy", -energy/double(N), "monte carlo");
+  if (moves.total > last_total) {
+    trace_counter("acceptance rate",
+                  double(moves.working - last_working)/(moves.total - last_total),
+                  "monte carlo");
+  }
+  if (now > last_ns) {
+    trace_counter("moves per second", 1e9*(moves.total - last_total)/(now - last_ns),
+                  "monte carlo");
+  }
+  last_total = moves.total;
+  last_working = moves.working;
+  last_ns = now;
+}
+
 bool sw_simulation::printing_allowed(){
   const double max_time_skip = 60*30; // 1/2 hour
-  static double time_skip = 30; // seconds
-  static int every_so_often = 0;
+  static thread_local double time_skip = 30; // seconds
+  static thread_local int every_so_often = 0;
   if (++every_so_often > time_skip/estimated_time_per_iteration) {
     every_so_often = 0;
     fflush(stdout); // flushing once a second will be no problem and can be helpful
@@ -1,4 +1,7 @@
+#include <limits.h>
+#include <functional>
 #include "vector3d.h"
+#include "Monte-Carlo/neighbor-grid.h"
 #pragma once
 
 struct ball {
@@ -22,6 +25,8 @@ struct move_info {
   long working;
   int updates;
   int informs;
+  long avb_total, avb_working; // the aggregation-volume-bias moves among them
+  long cluster_total, cluster_working; // the cluster moves among them
   move_info();
 };
 
@@ -64,7 +69,32 @@ struct sw_simulation {
   // move_a_ball.
   int max_neighbors;
   double neighbor_R; // radius of our neighbor sphere
+  neighbor_grid grid; // where the balls' neighbor centers are
+
+  // The neighbor tables of all the balls live in one arena with room
+  // for N+1 tables of max_neighbors each.  The spare one is where we
+  // build the new table of a ball that has moved far, and whichever
+  // table that ball gives up becomes the new spare.
+  int *neighbor_arena;
+  int *spare_neighbors;
+  // interactions[i] is always what count_interactions would give for
+  // ball i, so we never need to count the interactions before a move.
+  int *interactions;
   double translation_scale; // scale for how far to move balls
+  // At low temperatures the balls stick together, and moving them one
+  // at a time by translation_scale is a very slow way to either break
+  // up or form a cluster.  So move_a_ball makes avb_fraction of its
+  // moves aggregation-volume-bias moves (Chen and Siepmann 2000),
+  // which move a ball into or out of the well of another, and
+  // cluster_fraction of them moves of a whole cluster of balls that
+  // are within each other's wells.  Both default to zero.
+  double avb_fraction;
+  double cluster_fraction;
+  // Moves to energies outside of [window_min, window_max] are
+  // rejected (but still counted in the transitions table), which is
+  // how initialize_in_windows confines each walker to its window.
+  // The window is normally every energy.
+  int window_min, window_max;
   int energy_levels; // total number of energy levels
 
   /* The following accumulate results of the simulation. Although
@@ -153,7 +183,47 @@ struct sw_simulation {
   long *walkers_up;
 
   void reset_histograms();
-  void move_a_ball(bool use_transition_matrix = false); // attempt to move one ball
+  // Create and initialize the neighbor tables and interaction counts
+  // for the current positions of the balls.  Returns the maximum
+  // number of neighbors that any ball has, or -1 if that number is
+  // larger than max_neighbors.
+  int initialize_neighbor_tables();
+  // free_neighbor_tables releases the neighbor arena and interaction
+  // counts, which the simulation owns from initialize_neighbor_tables
+  // on.  It must be called before the simulation goes away (the
+  // struct has no destructor, since copies of it share these arrays).
+  void free_neighbor_tables();
+  // How far a ball may stray from its neighbor_center before we must
+  // find it new neighbors.  Two balls that are not neighbors had
+  // centers at least 2R + neighbor_R apart, so as long as neither has
+  // strayed this far they are still outside each other's well, and
+  // the neighbor tables hold every interacting pair.
+  double neighbor_drift() const {
+    return 0.5*(2*balls[0].R + neighbor_R - interaction_distance);
+  }
+  // The move functions each return how many balls they moved, which
+  // is zero if the move was rejected.  If moved is not null, it must
+  // have room for N ids, and the ids of the balls that moved are
+  // stored there.
+  int move_a_ball(bool use_transition_matrix = false, int *moved = 0); // attempt to move one ball
+  int move_avb(bool use_transition_matrix = false, int *moved = 0); // attempt an aggregation-volume-bias move
+  int move_cluster(bool use_transition_matrix = false, int *moved = 0); // attempt to move a cluster
+  // try_move attempts to put ball id at pos, and returns whether it did.
+  // bias is the ratio of the probability of proposing the reverse move
+  // to that of proposing this one, which is one for a translation.
+  bool try_move(int id, const vector3d &pos, double bias, bool use_transition_matrix);
+  // accept_move records a move that would change the energy by
+  // energy_change in the transitions table, and decides whether to
+  // make it.
+  bool accept_move(int energy_change, double bias, bool use_transition_matrix);
+  // relocate puts ball id at pos, whether or not it overlaps there,
+  // updating the neighbor tables and interaction counts, and returns
+  // the change in energy.
+  int relocate(int id, const vector3d &pos);
+  // commit_move updates the tables of ball id, which has just moved
+  // from old_pos, to go with its new position.
+  void commit_move(int id, const vector3d &old_pos, int *old_neighbors, int old_num_neighbors,
+                   bool get_new_neighbors, int new_interaction_count);
   void end_move_updates(); // updates to run at the end of every move
   void energy_change_updates(int energy_change); // updates to run if we've changed energy
 
@@ -192,6 +262,18 @@ struct sw_simulation {
   void initialize_toe();
   void initialize_transitions();
 
+  // initialize_in_windows splits the energies from max_entropy_state
+  // down to the min_important_energy (or a guess at it) into
+  // num_windows windows that overlap by a fraction overlap, and runs
+  // initialize (one of the methods above) on a copy of the simulation
+  // confined to each window, each on its own thread.  It then adds up
+  // their transitions and histograms, and sets the weights from either
+  // the combined transition matrix or, for histogram_dos, the
+  // densities of states of the windows stitched together where they
+  // overlap.
+  void initialize_in_windows(int num_windows, double overlap,
+                             const std::function<void(sw_simulation &)> &initialize);
+
   void initialize_transitions_file(const char *transitions_input_filename);
   void write_transitions_file() const;
   void write_header(FILE *f) const;
@@ -223,6 +305,10 @@ struct sw_simulation {
   // check whether we may print, to prevent dumping obscene amounts of text into the console
   bool printing_allowed();
 
+  // record the energy, acceptance rate and speed in the trace (see
+  // tracing.h), if we are tracing
+  void trace_progress();
+
   // manual minimum important energies for Wang-Landau
   int default_min_e(){
     if(min_T == 0.2){
@@ -267,6 +353,13 @@ struct sw_simulation {
     transitions_movie_filename_format = 0; // default to NULL pointer here for safety.
     dos_movie_filename_format = 0; // default to NULL pointer here for safety.
     lnw_movie_filename_format = 0; // default to NULL pointer here for safety.
+    neighbor_arena = 0;
+    spare_neighbors = 0;
+    interactions = 0;
+    avb_fraction = 0;
+    cluster_fraction = 0;
+    window_min = 0;
+    window_max = INT_MAX;
     transitions_movie_count = 0;
     dos_movie_count = 0;
     lnw_movie_count = 0;
@@ -279,16 +372,22 @@ struct sw_simulation {
 vector3d periodic_diff(const vector3d &a, const vector3d  &b,
                           const double len[3], int walls);
 
-// Create and initialize the neighbor tables for all balls (p).
-// Returns the maximum number of neighbors that any ball has,
-// or -1 if that number is larger than max_neighbors.
+// Create and initialize the neighbor tables for all balls (p), and
+// the grid that update_neighbors uses to find them later.  The tables
+// are placed one after another in neighbor_arena, which must have
+// room for N*max_neighbors.  Returns the maximum number of neighbors
+// that any ball has, or -1 if that number is larger than
+// max_neighbors.
 int initialize_neighbor_tables(ball *p, int N, double neighborR, int max_neighbors,
-                               const double len[3], int walls);
+                               const double len[3], int walls, neighbor_grid *grid,
+                               int *neighbor_arena);
 
 // Find's the neighbors of a by comparing a's position to the center of
 // everyone else's neighborsphere, where id is the index of a in p.
-void update_neighbors(ball &a, int id, const ball *p, int N,
-                      double neighborR, const double len[3], int walls);
+// Only the balls in the grid cells around a are considered, and the
+// neighbors are kept sorted.
+void update_neighbors(ball &a, int id, const ball *p, const neighbor_grid &grid,
+                      double neighborR, const double len[3], int walls, int max_neighbors);
 
 // Add ball new_n to the neighbor table of ball id
 void add_neighbor(int new_n, ball *p, int id);
@@ -296,9 +395,12 @@ void add_neighbor(int new_n, ball *p, int id);
 // Remove ball old_n from the neighbor table of ball id
 void remove_neighbor(int old_n, ball *p, int id);
 
-// Removes p from the neighbor table of anyone neighboring old_p.
-// Adds p to the neighbor table of anyone neighboring new_p.
-void inform_neighbors(const ball &new_p, const ball &old_p, ball *p);
+// Removes ball n from the neighbor table of anyone in old_neighbors
+// but not new_neighbors, and adds it to the table of anyone in
+// new_neighbors but not old_neighbors.  Both lists must be sorted.
+void inform_neighbors(const int *new_neighbors, int new_num,
+                      const int *old_neighbors, int old_num,
+                      ball *p, int n, int max_neighbors);
 
 // Check whether two balls overlap
 bool overlap(const ball &a, const ball &b, const double len[3], int walls);
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <time.h>
 #include "Monte-Carlo/monte-carlo.h"
+#include "Monte-Carlo/event-chain.h"
+#include "Monte-Carlo/initial-packing.h"
 #include <cassert>
 #include <math.h>
 #include <stdlib.h>
@@ -60,6 +62,8 @@ Vector3d laty = Vector3d(0,leny,0);
 Vector3d latz = Vector3d(0,0,lenz);
 Vector3d lat[3] = {latx,laty,latz};
 bool flat_div = true; // the divisions will be equal and will divide from z wall to z wall
+bool use_event_chain = false; //move spheres with event chains rather than one at a time
+double chain_length = 0; //length of each event chain, or 0 for default_chain_length
 
 bool periodic[3] = {false, false, false};
 const double dxmin = 0.1;
@@ -133,12 +137,18 @@ int main(int argc, char *argv[]){
     } else if (strcmp(argv[a],"flatdiv") == 0) {
       flat_div = true; //otherwise will default to radial divisions
       a -= 1;
+    } else if (strcmp(argv[a],"eventchain") == 0) {
+      use_event_chain = true;
+      a -= 1;
+    } else if (strcmp(argv[a],"chainlength") == 0) {
+      chain_length = atof(argv[a+1]);
     } else {
       printf("Bad argument:  %s\n", argv[a]);
       return 1;
     }
   }
   printf("flatdiv = %s\n", flat_div ? "true" : "false");
+  printf("eventchain = %s\n", use_event_chain ? "true" : "false");
   printf("outerSphere = %s\n", spherical_outer_wall ? "true" : "false");
   printf("innerSphere = %s\n", spherical_inner_wall ? "true" : "false");
   latx = Vector3d(lenx,0,0);
@@ -188,78 +198,28 @@ int main(int argc, char *argv[]){
   printf("running with %ld spheres for %ld iterations.\n", N, iterations);
 
   //////////////////////////////////////////////////////////////////////////////////////////
-  // We start with randomly-placed spheres, and then gradually wiggle
-  // them around until they are all within bounds and are not
-  // overlapping.  We do this by creating an "overlap" value which we
-  // constrain to never increase.  Note that this may not work at all
-  // for high filling fractions, since we could get stuck in a local
-  // minimum.
-  for(long i=0; i<N; i++) {
-    spheres[i]=10*rad*ran3();
-    if (spherical_outer_wall) {
-      while (spheres[i].norm() > rad) {
-        spheres[i] *= 0.9;
-      }
-    }
-    if (spherical_inner_wall) {
-      while (spheres[i].norm() < innerRad) {
-        spheres[i] *= rad/innerRad;
-      }
-    }
-  }
+  // We start with an overlap-free packing (see initial-packing.h),
+  // which the moves below then equilibrate.
   clock_t start = clock();
   long num_to_time = 100*N;
   long num_timed = 0;
-  long i = 0;
   double scale = .005;
 
-  // Let's move each sphere once, so they'll all start within our
-  // periodic cell!
-  for (i=0;i<N;i++) spheres[i] = move(spheres[i], scale);
-
   clock_t starting_initial_state = clock();
-  printf("Initial countOverLaps is %g\n", countOverLaps(spheres, N, R));
-  while (countOverLaps(spheres, N, R)>0){
-    for (int movethis=0;movethis < 100*N; movethis++) {
-      if (num_timed++ > num_to_time) {
-        clock_t now = clock();
-        //printf("took %g seconds per initialising iteration\n",
-        //       (now - double(start))/CLOCKS_PER_SEC/num_to_time);
-        num_timed = 0;
-        start = now;
-      }
-      Vector3d old = spheres[i%N];
-      double oldoverlap = countOneOverLap(spheres, N, i%N, R);
-      spheres[i%N]=move(spheres[i%N],scale);
-      double newoverlap = countOneOverLap(spheres, N, i%N, R);
-      if(newoverlap>oldoverlap){
-        spheres[i%N]=old;
-      }
-      i++;
-      if (i%(100*N) == 0) {
-        if (i>iterations/4) {
-          for(long i=0; i<N; i++) {
-            printf("%g\t%g\t%g\n", spheres[i][0],spheres[i][1],spheres[i][2]);
-          }
-          printf("couldn't find good state\n");
-          exit(1);
-        }
-        char *debugname = new char[10000];
-        sprintf(debugname, "%s.debug", outfilename);
-        FILE *spheredebug = fopen(debugname, "w");
-        if (!spheredebug) {
-          printf("oops opening %s\n", debugname);
-          exit(1);
-        }
-        for(long i=0; i<N; i++) {
-          fprintf(spheredebug, "%g\t%g\t%g\n", spheres[i][0],spheres[i][1],spheres[i][2]);
-        }
-        fclose(spheredebug);
-        printf("numOverLaps=%g (debug file: %s)\n",countOverLaps(spheres,N,R), debugname);
-        delete[] debugname;
-        fflush(stdout);
-      }
+  {
+    const packing_cell cell = { {lenx, leny, lenz}, {periodic[0], periodic[1], periodic[2]},
+                                {has_x_wall, has_y_wall, has_z_wall},
+                                spherical_inner_wall ? innerRad : 0,
+                                spherical_outer_wall ? rad : 0 };
+    vector3d *packed = new vector3d[N];
+    const char *method = initial_packing(packed, N, R, cell);
+    if (!method) {
+      printf("couldn't find good state\n");
+      exit(1);
     }
+    printf("Initial state from %s\n", method);
+    for (long i=0; i<N; i++) spheres[i] = Vector3d(packed[i].x, packed[i].y, packed[i].z);
+    delete[] packed;
   }
   assert(countOverLaps(spheres, N, R) == 0);
   {
@@ -316,6 +276,22 @@ int main(int argc, char *argv[]){
     scale = 0.1;
   }
   printf("Using scale of %g\n", scale);
+  event_chain *ecmc = 0;
+  if (use_event_chain) {
+    const double len[3] = {lenx, leny, lenz};
+    const bool walls[3] = {has_x_wall, has_y_wall, has_z_wall};
+    for (int k=0; k<3; k++) {
+      if (!periodic[k] && !walls[k] && !spherical_outer_wall) {
+        printf("Event chains need every direction to be periodic or bounded by a wall.\n");
+        return 1;
+      }
+    }
+    ecmc = new event_chain(spheres, N, R, len, periodic, walls,
+                           spherical_inner_wall ? innerRad : 0,
+                           spherical_outer_wall ? rad : 0);
+    if (chain_length <= 0) chain_length = default_chain_length(R);
+    printf("Using event chains of length %g\n", chain_length);
+  }
   long count = 0;
   long *shells = new long[div];
   for (long l=0; l<div; l++) shells[l] = 0;
@@ -624,7 +600,12 @@ int main(int argc, char *argv[]){
       delete[] debugname;
       fflush(stdout);
     }
-    Vector3d temp = move(spheres[j%N],scale);
+    Vector3d temp = spheres[j%N];
+    if (ecmc) {
+      ecmc->chain(chain_length);
+    } else {
+      temp = move(spheres[j%N],scale);
+    }
     count++;
 
     // only write out the sphere positions after they've all had a
@@ -714,6 +695,11 @@ int main(int argc, char *argv[]){
         }
       }
     }
+    if (ecmc) {
+      // Every event chain is accepted, so there is nothing to reject.
+      workingmoves++;
+      continue;
+    }
     if(overlap(spheres, temp, N, R, j%N)){
       if (scale > 0.001 && false) {
         scale = scale/sqrt(1.02);
@@ -757,6 +743,10 @@ int main(int argc, char *argv[]){
   printf("Total number of attempted moves = %ld\n",count);
   printf("Total number of successful moves = %ld\n",workingmoves);
   printf("Acceptance rate = %g\n", workingmoves/double(count));
+  if (ecmc) {
+    printf("Collisions per event chain = %g\n", ecmc->collisions/double(ecmc->chains));
+    delete ecmc;
+  }
   fflush(stdout);
   delete[] spheres;
   delete[] max_move_counter;
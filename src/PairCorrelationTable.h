@@ -0,0 +1,276 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "simdmath.h"
+
+// A PairCorrelationTable holds the hard-sphere pair distribution
+// function g(r) from Monte Carlo, tabulated on a grid of packing
+// fractions eta and distances r, and interpolates it smoothly in both.
+// The table lives in a compact binary file, which we map into memory
+// rather than read, so that loading it is instant and several programs
+// running at once share a single copy.
+//
+// The r grid is that of the Monte Carlo histograms: the first point is
+// the contact value at r = 2R, and the rest are the centers of bins of
+// width r_step, starting at the contact value.  We interpolate with
+// Catmull-Rom cubics along both eta and r (i.e. bicubic convolution),
+// except within half a bin of contact, where we interpolate linearly
+// in r, as the Monte Carlo data gives us nothing closer.
+//
+// Besides looking up a single value, you can look up many at once with
+// lookup, which uses AVX2 or AVX-512 when available (see simdmath.h),
+// which is the way to go when computing g for every pair of points in
+// a plane.  Either way, g is zero inside the core, one beyond the end
+// of the table, and NaN for an eta outside of the table.
+
+struct PairCorrelationTableHeader {
+  char magic[8];
+  int num_eta, num_r; // there are num_eta + 1 rows, from eta = 0
+  double eta_step, r_contact, r_step;
+};
+
+static const char pair_correlation_table_magic[8] = "deft-gr";
+
+class PairCorrelationTable {
+public:
+  explicit PairCorrelationTable(const char *fname) {
+    const int fd = open(fname, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+      fprintf(stderr, "Unable to open file %s!\n", fname);
+      exit(1);
+    }
+    bytes = st.st_size;
+    mapping = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    const PairCorrelationTableHeader *h = (const PairCorrelationTableHeader *)mapping;
+    if (mapping == MAP_FAILED || bytes < sizeof(PairCorrelationTableHeader) ||
+        memcmp(h->magic, pair_correlation_table_magic, 8) ||
+        bytes != sizeof(PairCorrelationTableHeader) + (h->num_eta+1)*h->num_r*sizeof(double)) {
+      fprintf(stderr, "File %s is not a pair correlation table!\n", fname);
+      exit(1);
+    }
+    num_eta = h->num_eta;
+    num_r = h->num_r;
+    eta_step = h->eta_step;
+    r_contact = h->r_contact;
+    r_step = h->r_step;
+    g = (const double *)(h + 1);
+  }
+  ~PairCorrelationTable() {
+    munmap(mapping, bytes);
+  }
+
+  double operator()(double eta, double r) const {
+    return interpolate(eta, r);
+  }
+  void lookup(const double *eta, const double *r, double *out, long n) const {
+    long i = 0;
+#if defined(__AVX512F__)
+    for (; i+8 <= n; i += 8) {
+      interpolate(simdmath::simd8::load(eta+i), simdmath::simd8::load(r+i)).store(out+i);
+    }
+#elif defined(__AVX2__)
+    for (; i+4 <= n; i += 4) {
+      interpolate(simdmath::simd4::load(eta+i), simdmath::simd4::load(r+i)).store(out+i);
+    }
+#endif
+    for (; i < n; i++) out[i] = interpolate(eta[i], r[i]);
+  }
+
+  double max_eta() const { return num_eta*eta_step; }
+  double max_r() const { return r_contact + (num_r - 1.5)*r_step; }
+
+private:
+  void *mapping;
+  size_t bytes;
+  const double *g;
+  int num_eta, num_r;
+  double eta_step, r_contact, r_step;
+
+  // clamp maps NaN to lo, so that we never gather from outside the
+  // table.
+  template <typename D>
+  static D clamp(D x, double lo, double hi) {
+    x = simdmath::select(x > D(lo), x, D(lo));
+    return simdmath::select(x < D(hi), x, D(hi));
+  }
+  template <typename D>
+  static void catmull_rom(D t, D w[4]) {
+    w[0] = D(0.5)*t*((D(2) - t)*t - D(1));
+    w[1] = D(0.5)*((D(3)*t - D(5))*t*t + D(2));
+    w[2] = D(0.5)*t*((D(4) - D(3)*t)*t + D(1));
+    w[3] = D(0.5)*t*t*(t - D(1));
+  }
+  // extrapolate_ends replaces the values of a stencil starting at i-1
+  // that fall beyond the table (from lo to hi) with a quadratic
+  // extrapolation, so that we lose no accuracy at the edges.
+  template <typename D>
+  static void extrapolate_ends(D i, double lo, double hi, D v[4]) {
+    v[0] = simdmath::select(i < D(lo + 1), D(3)*(v[1] - v[2]) + v[3], v[0]);
+    v[3] = simdmath::select(i > D(hi - 2), D(3)*(v[2] - v[1]) + v[0], v[3]);
+  }
+  // contact_row and bulk_row interpolate along r within one row of
+  // the table, linearly near contact and with a Catmull-Rom cubic
+  // elsewhere.
+  template <typename D>
+  D contact_row(D row, D s) const {
+    const D fac = clamp(D(2)*s - D(1), 0, 1);
+    return (D(1) - fac)*simdmath::gather(g, row) + fac*simdmath::gather(g, row + D(1));
+  }
+  template <typename D>
+  D bulk_row(D row, D j, const D wr[4]) const {
+    D v[4];
+    for (int b=0; b<4; b++) v[b] = simdmath::gather(g, row + clamp(j + D(b - 1), 1, num_r - 1));
+    extrapolate_ends(j, 1, num_r - 1, v);
+    return wr[0]*v[0] + wr[1]*v[1] + wr[2]*v[2] + wr[3]*v[3];
+  }
+  // The packed interpolate must compute both the contact and the bulk
+  // stencils, and select between them.
+  template <typename D>
+  D interpolate(D eta, D r) const {
+    using simdmath::select;
+    const D u = eta*D(1/eta_step);
+    const D i = clamp(simdmath::vfloor(u), 0, num_eta - 1);
+    // Row j >= 1 is at r_contact + (j - 0.5)*r_step.
+    const D s = (r - D(r_contact))*D(1/r_step) + D(0.5);
+    const D j = clamp(simdmath::vfloor(s), 1, num_r - 2);
+    D we[4], wr[4];
+    catmull_rom(u - i, we);
+    catmull_rom(s - j, wr);
+    D bulk[4], contact[4];
+    for (int a=0; a<4; a++) {
+      const D row = clamp(i + D(a - 1), 0, num_eta)*D(num_r);
+      bulk[a] = bulk_row(row, j, wr);
+      contact[a] = contact_row(row, s);
+    }
+    extrapolate_ends(i, 0, num_eta, bulk);
+    extrapolate_ends(i, 0, num_eta, contact);
+    D out = select(s < D(1),
+                   we[0]*contact[0] + we[1]*contact[1] + we[2]*contact[2] + we[3]*contact[3],
+                   we[0]*bulk[0] + we[1]*bulk[1] + we[2]*bulk[2] + we[3]*bulk[3]);
+    out = select(r < D(r_contact), D(0.0), out);
+    // We allow for roundoff in r_step at the far end of the table.
+    out = select(s > D(num_r - 1 + 1e-9), D(1), out);
+    return select((eta < D(0.0)) | (eta > D(max_eta())) | (eta != eta), D(NAN), out);
+  }
+  // A single value is cheaper to compute with branches.
+  double interpolate(double eta, double r) const {
+    if (eta < 0 || eta > max_eta() || eta != eta) return NAN;
+    if (r < r_contact) return 0;
+    const double s = (r - r_contact)/r_step + 0.5;
+    // We allow for roundoff in r_step at the far end of the table.
+    if (s > num_r - 1 + 1e-9) return 1;
+    const double u = eta/eta_step;
+    const double i = clamp(floor(u), 0, num_eta - 1);
+    double we[4], along_r[4];
+    catmull_rom(u - i, we);
+    if (s < 1) {
+      for (int a=0; a<4; a++) along_r[a] = contact_row(clamp(i + (a - 1), 0, num_eta)*num_r, s);
+    } else {
+      const double j = clamp(floor(s), 1, num_r - 2);
+      double wr[4];
+      catmull_rom(s - j, wr);
+      for (int a=0; a<4; a++) along_r[a] = bulk_row(clamp(i + (a - 1), 0, num_eta)*num_r, j, wr);
+    }
+    extrapolate_ends(i, 0, num_eta, along_r);
+    return we[0]*along_r[0] + we[1]*along_r[1] + we[2]*along_r[2] + we[3]*along_r[3];
+  }
+
+  PairCorrelationTable(const PairCorrelationTable &);
+  void operator=(const PairCorrelationTable &);
+};
+
+// update_pair_correlation_table writes the table in fname from the
+// Monte Carlo files whose names are given by the printf pattern
+// mcpattern (e.g. "figs/gr-%04.2f.dat") for eta = eta_step, 2*eta_step
+// ... num_eta*eta_step, unless fname is already newer than all of
+// them.  Each file has lines of r and eta*g(r).  It returns false if
+// anything goes wrong, after saying what.
+inline bool update_pair_correlation_table(const char *fname, const char *mcpattern,
+                                          int num_eta, double eta_step) {
+  struct stat st;
+  const bool have_table = stat(fname, &st) == 0;
+  struct timespec table_time = { 0, 0 };
+  if (have_table) table_time = st.st_mtim;
+  bool stale = !have_table;
+  char mcname[4096];
+  for (int k=1; k<=num_eta; k++) {
+    snprintf(mcname, sizeof(mcname), mcpattern, k*eta_step);
+    if (stat(mcname, &st)) {
+      fprintf(stderr, "Unable to open file %s!\n", mcname);
+      return false;
+    }
+    if (have_table &&
+        (st.st_mtim.tv_sec > table_time.tv_sec ||
+         (st.st_mtim.tv_sec == table_time.tv_sec && st.st_mtim.tv_nsec >= table_time.tv_nsec))) {
+      stale = true;
+    }
+  }
+  if (!stale) return true;
+
+  PairCorrelationTableHeader h;
+  memcpy(h.magic, pair_correlation_table_magic, 8);
+  h.num_eta = num_eta;
+  h.num_r = 0;
+  h.eta_step = eta_step;
+  h.r_contact = h.r_step = 0;
+  std::vector<double> g;
+  for (int k=1; k<=num_eta; k++) {
+    const double eta = k*eta_step;
+    snprintf(mcname, sizeof(mcname), mcpattern, eta);
+    FILE *in = fopen(mcname, "r");
+    if (!in) {
+      fprintf(stderr, "Unable to open file %s!\n", mcname);
+      return false;
+    }
+    std::vector<double> row;
+    double r, etag;
+    while (fscanf(in, " %lg %lg", &r, &etag) == 2) {
+      if (k == 1 && row.size() == 0) h.r_contact = r;
+      if (k == 1 && row.size() == 1) h.r_step = 2*(r - h.r_contact);
+      row.push_back(etag/eta);
+    }
+    fclose(in);
+    if (k == 1) {
+      h.num_r = row.size();
+      if (h.num_r < 4) {
+        fprintf(stderr, "There are only %d lines in %s\n", h.num_r, mcname);
+        return false;
+      }
+      g.assign(h.num_r, 1.0); // the ideal gas, at eta = 0
+    } else if (int(row.size()) != h.num_r) {
+      fprintf(stderr, "There are %d lines in %s rather than %d\n", int(row.size()), mcname, h.num_r);
+      return false;
+    }
+    g.insert(g.end(), row.begin(), row.end());
+  }
+
+  // We write to a temporary file, and rename it when done, so that a
+  // program running at the same time never sees half a table.
+  char tmpname[4096];
+  snprintf(tmpname, sizeof(tmpname), "%s.%d", fname, int(getpid()));
+  FILE *out = fopen(tmpname, "wb");
+  if (!out) {
+    fprintf(stderr, "Unable to create file %s!\n", tmpname);
+    return false;
+  }
+  const bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+    fwrite(g.data(), sizeof(double), g.size(), out) == g.size();
+  if (fclose(out) || !ok || rename(tmpname, fname)) {
+    fprintf(stderr, "Unable to write file %s!\n", fname);
+    remove(tmpname);
+    return false;
+  }
+  return true;
+}
@@ -25,6 +25,7 @@ public:
 };
 
 bool QuadraticLineMinimizerType::improve_energy(bool verbose) {
+  trace_span trace("line search", "minimize");
   //if (verbose) printf("\t\tI am running QuadraticLineMinimizerType::improve_energy with verbose==%d\n", verbose);
   //fflush(stdout);
   // FIXME: The following probably double-computes the energy!
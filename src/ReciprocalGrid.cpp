@@ -1,5 +1,7 @@
 #include "ReciprocalGrid.h"
 #include <fftw3.h>
+#include "profiling.h"
+#include "tracing.h"
 
 complex ReciprocalGrid::operator()(const RelativeReciprocal &r) const {
   double rx = r(0)*gd.Nx, ry = r(1)*gd.Ny, rz = r(2)*gd.Nz;
@@ -50,21 +52,80 @@ Grid ifft(const GridDescription &gd, const VectorXcd &rg) {
 
 // This one is destructive, and has a type to match...
 Grid ifft(const GridDescription &gd, VectorXcd *rg) {
+  trace_span trace("ifft", "fft");
   Grid out(gd);
   const complex *mydata = rg->data();
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
   fftw_plan p = fftw_plan_dft_c2r_3d(gd.Nx, gd.Ny, gd.Nz, (fftw_complex *)mydata, out.data(), FFTW_MEASURE);
+  planning.unlock();
   fftw_execute(p);
+  profile_scope::count_ffts(1);
   // FFTW overwrites the input on a c2r transform, so let's throw it
   // away so we don't accidentally try to reuse an invalid array! An
   // alternative approach would be to copy it first into a scratch
   // array.  If we saved that scratch array, we could even keep
   // reusing the same plan.
   rg->resize(0);
+  planning.lock();
   fftw_destroy_plan(p);
+  planning.unlock();
   out *= 1.0/gd.Lat.volume();
   return out;
 }
 
+void ifft_many(const GridDescription &gd, int howmany,
+               const VectorXcd *const in[], VectorXd *const out[]) {
+  trace_span trace("ifft_many", "fft");
+  for (int j=0; j<howmany; j++) *out[j] = ifft(gd, *in[j]);
+}
+
+Grid mirror_z_ifft(const GridDescription &gd, const VectorXcd &rg, int parity) {
+  trace_span trace("mirror_z_ifft", "fft");
+  // This is mirror_z_fft backwards: c2r transforms in x and y, then a
+  // type-I cosine (or sine) transform along z, where the inverse
+  // transform of an odd field is i times the sine transform.
+  const int M = gd.Nz/2, NxNy = gd.Nx*gd.Ny, nxy[2] = { gd.Nx, gd.Ny };
+  fftw_complex *c = (fftw_complex *)fftw_malloc(rg.rows()*sizeof(fftw_complex));
+  double *r = (double *)fftw_malloc(NxNy*gd.NzOver2*sizeof(double));
+  // Plan before copying in the data, since FFTW_MEASURE trashes it
+  // (and so does the c2r transform itself, which is why we copy).
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+  fftw_plan pxy = fftw_plan_many_dft_c2r(2, nxy, gd.NzOver2, c, 0, gd.NzOver2, 1,
+                                         r, 0, gd.NzOver2, 1, FFTW_MEASURE);
+  planning.unlock();
+  const complex factor = ((parity > 0) ? complex(1, 0) : complex(0, 1))/gd.Lat.volume();
+  for (int i=0; i<rg.rows(); i++) {
+    const complex v = factor*rg[i];
+    c[i][0] = v.real();
+    c[i][1] = v.imag();
+  }
+  fftw_execute(pxy);
+  mirror_z_r2r(gd, r, parity);
+  profile_scope::count_ffts(1);
+  planning.lock();
+  fftw_destroy_plan(pxy);
+  planning.unlock();
+  Grid out(gd);
+  for (int xy=0; xy<NxNy; xy++) {
+    const double *half = r + xy*gd.NzOver2;
+    double *line = out.data() + xy*gd.Nz;
+    if (parity > 0) {
+      line[0] = half[0];
+      line[M] = half[M];
+      for (int z=1; z<M; z++) line[z] = line[gd.Nz-z] = half[z];
+    } else {
+      line[0] = line[M] = 0;
+      for (int z=1; z<M; z++) {
+        line[z] = half[z];
+        line[gd.Nz-z] = -half[z];
+      }
+    }
+  }
+  fftw_free(c);
+  fftw_free(r);
+  return out;
+}
+
 void ReciprocalGrid::MultiplyBy(double f(Reciprocal)) {
   for (int x=0; x<gd.Nx; x++) {
     for (int y=0; y<gd.Ny; y++) {
@@ -14,6 +14,12 @@ class Grid;
 
 Grid ifft(const GridDescription &gd, VectorXcd *rg);
 Grid ifft(const GridDescription &gd, const VectorXcd &rg);
+// ifft_many does several transforms of the same grid, one at a time
+// for the same reason as fft_many, and leaves its inputs untouched.
+void ifft_many(const GridDescription &gd, int howmany,
+               const VectorXcd *const in[], VectorXd *const out[]);
+// mirror_z_ifft undoes mirror_z_fft, given the parity of the result.
+Grid mirror_z_ifft(const GridDescription &gd, const VectorXcd &rg, int parity);
 
 class ReciprocalGrid : public VectorXcd {
 public:
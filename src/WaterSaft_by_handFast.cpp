@@ -3,6 +3,8 @@
 #include "MinimalFunctionals.h"
 #include "utilities.h"
 #include "handymath.h"
+#include <mutex>
+#include <memory>
 
 
 class WaterSaft_by_hand_type : public FunctionalInterface {
@@ -10,21 +12,26 @@ public:
 WaterSaft_by_hand_type(double R_arg, double epsilon_association_arg, double kappa_association_arg, double epsilon_dispersion_arg, double lambda_dispersion_arg, double length_scaling_arg, double mu_arg) : R(R_arg), epsilon_association(epsilon_association_arg), kappa_association(kappa_association_arg), epsilon_dispersion(epsilon_dispersion_arg), lambda_dispersion(lambda_dispersion_arg), length_scaling(length_scaling_arg), mu(mu_arg)  {
 	have_integral = true;
 	// TODO: code to evaluate Fourier transforms goes here
-	oldkT = sqrt(-1.0);  // initialize to NaN so we'll have to define transforms
-
-}
-~WaterSaft_by_hand_type() {
-
+	last_named = named_scalars();
 }
 
 bool I_have_analytic_grad() const {
 	return false;}
 
 double integral(const GridDescription &gd, double kT, const VectorXd &x) const {
-	if (oldkT != kT) {
-		oldkT = kT;
-
-	}
+	double FSAFT = 0;
+	double Fassoc = 0;
+	double Fdisp = 0;
+	double Fideal = 0;
+	double a1integrated = 0;
+	double a2integrated = 0;
+	double dV = 0;
+	double dr = 0;
+	double kTphi1 = 0;
+	double kTphi2 = 0;
+	double kTphi3 = 0;
+	double volume = 0;
+	double whitebear = 0;
 	double output=0;
 	VectorXcd ktemp0(gd.NxNyNzOver2);
 	ktemp0 = fft(gd, x);
@@ -358,6 +365,22 @@ double integral(const GridDescription &gd, double kT, const VectorXd &x) const {
 	output = FSAFT;
 	// 17 Fourier transform used.
 	// 16 temporaries made
+	{
+		std::lock_guard<std::mutex> lock(named_mutex);
+		last_named.FSAFT = FSAFT;
+		last_named.Fassoc = Fassoc;
+		last_named.Fdisp = Fdisp;
+		last_named.Fideal = Fideal;
+		last_named.a1integrated = a1integrated;
+		last_named.a2integrated = a2integrated;
+		last_named.dV = dV;
+		last_named.dr = dr;
+		last_named.kTphi1 = kTphi1;
+		last_named.kTphi2 = kTphi2;
+		last_named.kTphi3 = kTphi3;
+		last_named.volume = volume;
+		last_named.whitebear = whitebear;
+	}
 	return output;
 
 }
@@ -367,10 +390,6 @@ VectorXd transform(const GridDescription &gd, double kT, const VectorXd &x) cons
 }
 
 double transform(double kT, double x) const {
-	if (oldkT != kT) {
-		oldkT = kT;
-
-	}
 	double output = 0;
 		double 	n = x;
 	double 	boltz = -1.0*1.0 + exp(epsilon_association/kT);
@@ -429,10 +448,6 @@ bool append_to_name( std::string) const {
 	return false;}
 
 double derive(double kT, double x) const {
-	if (oldkT != kT) {
-		oldkT = kT;
-
-	}
 	double output = 0;
 	double 	boltz = -1.0*1.0 + exp(epsilon_association/kT);
 	double 	n = x;
@@ -521,10 +536,6 @@ Functional grad_T(const Functional &ingradT) const {
 	return ingradT;}
 
 void grad(const GridDescription &gd, double kT, const VectorXd &x, const VectorXd &ingrad, VectorXd *outgrad, VectorXd *outpgrad) const {
-	if (oldkT != kT) {
-		oldkT = kT;
-
-	}
 	VectorXcd ktemp0(gd.NxNyNzOver2);
 	ktemp0 = fft(gd, x);
 
@@ -2303,35 +2314,40 @@ void grad(const GridDescription &gd, double kT, const VectorXd &x, const VectorX
 }
 
 void print_summary(const char *prefix, double energy, std::string name) const {
+	named_scalars named;
+	{
+		std::lock_guard<std::mutex> lock(named_mutex);
+		named = last_named;
+	}
 	if (name != "") printf("%s%25s =", prefix, name.c_str());
 	else printf("%s%25s =", prefix, "UNKNOWN");
 	print_double("", energy);
 	printf("\n%s%25s =", prefix, "FSAFT");
-	print_double("", FSAFT);
+	print_double("", named.FSAFT);
 	printf("\n%s%25s =", prefix, "Fassoc");
-	print_double("", Fassoc);
+	print_double("", named.Fassoc);
 	printf("\n%s%25s =", prefix, "Fdisp");
-	print_double("", Fdisp);
+	print_double("", named.Fdisp);
 	printf("\n%s%25s =", prefix, "Fideal");
-	print_double("", Fideal);
+	print_double("", named.Fideal);
 	printf("\n%s%25s =", prefix, "a1integrated");
-	print_double("", a1integrated);
+	print_double("", named.a1integrated);
 	printf("\n%s%25s =", prefix, "a2integrated");
-	print_double("", a2integrated);
+	print_double("", named.a2integrated);
 	printf("\n%s%25s =", prefix, "dV");
-	print_double("", dV);
+	print_double("", named.dV);
 	printf("\n%s%25s =", prefix, "dr");
-	print_double("", dr);
+	print_double("", named.dr);
 	printf("\n%s%25s =", prefix, "kTphi1");
-	print_double("", kTphi1);
+	print_double("", named.kTphi1);
 	printf("\n%s%25s =", prefix, "kTphi2");
-	print_double("", kTphi2);
+	print_double("", named.kTphi2);
 	printf("\n%s%25s =", prefix, "kTphi3");
-	print_double("", kTphi3);
+	print_double("", named.kTphi3);
 	printf("\n%s%25s =", prefix, "volume");
-	print_double("", volume);
+	print_double("", named.volume);
 	printf("\n%s%25s =", prefix, "whitebear");
-	print_double("", whitebear);
+	print_double("", named.whitebear);
 	printf("\n");
 }
 
@@ -2343,21 +2359,25 @@ private:
 	double lambda_dispersion;
 	double length_scaling;
 	double mu;
-	mutable double FSAFT;
-	mutable double Fassoc;
-	mutable double Fdisp;
-	mutable double Fideal;
-	mutable double a1integrated;
-	mutable double a2integrated;
-	mutable double dV;
-	mutable double dr;
-	mutable double kTphi1;
-	mutable double kTphi2;
-	mutable double kTphi3;
-	mutable double volume;
-	mutable double whitebear;
+	struct named_scalars {
+		double FSAFT;
+		double Fassoc;
+		double Fdisp;
+		double Fideal;
+		double a1integrated;
+		double a2integrated;
+		double dV;
+		double dr;
+		double kTphi1;
+		double kTphi2;
+		double kTphi3;
+		double volume;
+		double whitebear;
+	};
+	mutable std::mutex named_mutex; // guards last_named
+	mutable named_scalars last_named;
 	// TODO: add declaration of spherical fourier transform data here
-	mutable double oldkT;}; // End of WaterSaft_by_hand_type class
+}; // End of WaterSaft_by_hand_type class
 	// Total 118 Fourier transform used.
 	// peak memory used: 43
 
@@ -0,0 +1,113 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <map>
+#include <set>
+#include <utility>
+#include <mutex>
+#include <fftw3.h>
+
+// FFTW is fastest for sizes whose only prime factors are small, and
+// can be several times slower for sizes with a large prime factor.
+// The functions here choose grid sizes accordingly.
+
+// FFTW's planner is not thread-safe, although executing a plan is, so
+// we hold this lock whenever we create or destroy a plan.
+inline std::mutex &fftw_planner_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+enum GridSizing {
+  exact_grid_sizes, // just round up to an even size
+  fft_friendly_grid_sizes, // round up to an even 2^a 3^b 5^c 7^d
+  timed_grid_sizes // time a few friendly sizes, and use the fastest
+};
+
+// grid_sizing determines how the generated functionals choose their
+// grid size for a given grid spacing.  By default they use just
+// enough points, so that existing calculations are reproducible, as
+// GridDescription does.  Set it to fft_friendly_grid_sizes (or
+// timed_grid_sizes) for a slightly finer grid with faster FFTs;
+// because the actual grid spacing can only get smaller, this never
+// costs accuracy.
+inline GridSizing &grid_sizing() {
+  static GridSizing sizing = exact_grid_sizes;
+  return sizing;
+}
+
+inline bool is_fft_friendly(int n) {
+  if (n < 1) return false;
+  const int factors[] = { 2, 3, 5, 7 };
+  for (int i=0; i<4; i++) {
+    while (n % factors[i] == 0) n /= factors[i];
+  }
+  return n == 1;
+}
+
+// fft_friendly_size returns the smallest even number that is at
+// least n and has no prime factors larger than 7.
+inline int fft_friendly_size(int n) {
+  if (n < 2) n = 2;
+  if (n & 1) n++;
+  while (!is_fft_friendly(n)) n += 2;
+  return n;
+}
+
+// timed_fft_size measures one-dimensional transforms of the friendly
+// sizes up to 25% larger than n, and returns the fastest.  The result
+// is cached, since measuring takes a moment.
+inline int timed_fft_size(int n) {
+  std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+  static std::map<int,int> known;
+  if (known.count(n)) return known[n];
+  const int howmany = 64;
+  int best = fft_friendly_size(n);
+  double besttime = HUGE_VAL;
+  for (int m = best; m <= best + n/4; m = fft_friendly_size(m+1)) {
+    double *r = (double *)fftw_malloc(howmany*(m+2)*sizeof(double));
+    fftw_complex *c = (fftw_complex *)fftw_malloc(howmany*(m/2+1)*sizeof(fftw_complex));
+    fftw_plan p = fftw_plan_many_dft_r2c(1, &m, howmany, r, 0, 1, m+2, c, 0, 1, m/2+1, FFTW_MEASURE);
+    for (int i=0; i<howmany*(m+2); i++) r[i] = 0;
+    int reps = 0;
+    const clock_t start = clock();
+    do {
+      fftw_execute(p);
+      reps++;
+    } while (clock() < start + CLOCKS_PER_SEC/100);
+    const double t = (clock() - double(start))/reps;
+    fftw_destroy_plan(p);
+    fftw_free(r);
+    fftw_free(c);
+    if (t < besttime) {
+      besttime = t;
+      best = m;
+    }
+  }
+  known[n] = best;
+  return best;
+}
+
+// fft_grid_size returns the number of grid points to use for a length
+// of "cells" grid spacings, according to grid_sizing().  It reports
+// when it rounds up beyond an even size, but only the first time for
+// each size, since functionals are often constructed over and over.
+inline int fft_grid_size(double cells, GridSizing sizing = grid_sizing()) {
+  const int n = int(ceil(cells/2))*2;
+  int m = n;
+  if (sizing == fft_friendly_grid_sizes) m = fft_friendly_size(n);
+  if (sizing == timed_grid_sizes) m = timed_fft_size(n);
+  if (m != n) {
+    static std::mutex reporting;
+    static std::set<std::pair<int,int> > reported;
+    std::lock_guard<std::mutex> lock(reporting);
+    if (reported.insert(std::make_pair(n, m)).second) {
+      printf("Using %d grid points rather than %d for faster FFTs\n", m, n);
+    }
+  }
+  return m;
+}
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "Faddeeva.hh"
+#include "simdmath.h"
 
 inline double erfi(double x) {
   return Faddeeva::erfi(x);
@@ -48,6 +49,49 @@ inline double ipow(double x, int n) {
   else return 1.0/uipow(x,-n);
 }
 
+// anderson_coefficients finds the gamma that minimizes |r - sum_j
+// gamma_j dr_j|, which is the heart of Anderson mixing.  On input
+// overlaps holds the m by m matrix dr_i.dr_j (which is destroyed) and
+// gamma holds dr_i.r.  A tiny bit of regularization keeps nearly
+// parallel dr_j from giving wild coefficients.  It returns false (with
+// gamma zeroed) if the system is hopelessly singular.
+inline bool anderson_coefficients(int m, double *overlaps, double *gamma) {
+  double biggest = 0;
+  for (int i=0; i<m; i++) biggest = max(biggest, overlaps[i*m+i]);
+  for (int i=0; i<m; i++) overlaps[i*m+i] += 1e-12*biggest;
+  // Gaussian elimination with partial pivoting, since m is small.
+  for (int k=0; k<m; k++) {
+    int pivot = k;
+    for (int i=k+1; i<m; i++) {
+      if (fabs(overlaps[i*m+k]) > fabs(overlaps[pivot*m+k])) pivot = i;
+    }
+    if (!(fabs(overlaps[pivot*m+k]) > 0)) {
+      for (int i=0; i<m; i++) gamma[i] = 0;
+      return false;
+    }
+    if (pivot != k) {
+      for (int j=0; j<m; j++) {
+        const double tmp = overlaps[k*m+j];
+        overlaps[k*m+j] = overlaps[pivot*m+j];
+        overlaps[pivot*m+j] = tmp;
+      }
+      const double tmp = gamma[k];
+      gamma[k] = gamma[pivot];
+      gamma[pivot] = tmp;
+    }
+    for (int i=k+1; i<m; i++) {
+      const double factor = overlaps[i*m+k]/overlaps[k*m+k];
+      for (int j=k; j<m; j++) overlaps[i*m+j] -= factor*overlaps[k*m+j];
+      gamma[i] -= factor*gamma[k];
+    }
+  }
+  for (int k=m-1; k>=0; k--) {
+    for (int j=k+1; j<m; j++) gamma[k] -= overlaps[k*m+j]*gamma[j];
+    gamma[k] /= overlaps[k*m+k];
+  }
+  return true;
+}
+
 inline void print_double(const char *prefix, double x, int width=26, int digits = 14, int min_digits = 11) {
   double max_f, min_f;
   if (min_digits == 0 || min_digits > digits) min_digits = digits;
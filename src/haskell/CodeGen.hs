@@ -18,18 +18,55 @@ functionCode "" "" (x:xs) "" = if xs == []
                                else fst x ++ " " ++ snd x ++ ", " ++ functionCode "" "" xs ""
 functionCode n t a b = t ++ " " ++ n ++ "(" ++ functionCode "" "" a "" ++ ") const {\n" ++ b ++ "}\n"
 
+-- The named scalars in a functional (the parts of the free energy
+-- that print_summary reports) are computed in local variables, so
+-- that integral can be called from several threads at once.  At the
+-- end integral saves them in last_named for print_summary.
+declareNamedScalars :: [String] -> [String]
+declareNamedScalars = map (\x -> "\tdouble " ++ x ++ " = 0;")
+
+publishNamedScalars :: [String] -> [String]
+publishNamedScalars [] = []
+publishNamedScalars ns = ["\t{", "\t\tstd::lock_guard<std::mutex> lock(named_mutex);"] ++
+                         map (\x -> "\t\tlast_named." ++ x ++ " = " ++ x ++ ";") ns ++
+                         ["\t}"]
+
+readNamedScalars :: [String] -> [String]
+readNamedScalars [] = []
+readNamedScalars _ = ["\tnamed_scalars named;",
+                      "\t{",
+                      "\t\tstd::lock_guard<std::mutex> lock(named_mutex);",
+                      "\t\tnamed = last_named;",
+                      "\t}"]
+
+initNamedScalars :: [String] -> [String]
+initNamedScalars [] = []
+initNamedScalars _ = ["\tlast_named = named_scalars();"]
+
+printNamedScalar :: String -> String
+printNamedScalar v = "\tprintf(\"\\n%s%25s =\", prefix, \"" ++ v ++ "\");\n" ++
+                     "\tprint_double(\"\", named." ++ v ++ ");"
+
+namedScalarData :: [String] -> String
+namedScalarData [] = ""
+namedScalarData ns = unlines $ ["\tstruct named_scalars {"] ++
+                               map (\x -> "\t\tdouble " ++ x ++ ";") ns ++
+                               ["\t};",
+                                "\tmutable std::mutex named_mutex; // guards last_named",
+                                "\tmutable named_scalars last_named;"]
+
 classCode :: Expression RealSpace -> [String] -> String -> String
 classCode ewithtransforms arg n = "class " ++ n ++ " : public FunctionalInterface {\npublic:\n" ++ n ++ codeA arg ++ "  {\n\thave_integral = true;" ++ definetransforms ++ "\n}\n" ++
                 functionCode "I_have_analytic_grad" "bool" [] "\treturn false;" ++
                 functionCode "integral" "double" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")] 
                     (unlines ["\tdouble output=0;",
                               codeStatements codeIntegrate ++ "\t// " ++ show (countFFT codeIntegrate) ++ " Fourier transform used.",
-                              "\t// " ++ show (peakMem codeIntegrate),
+                              "\t// " ++ show (fusedPeakMem codeIntegrate),
                               "\treturn output;\n"]) ++
                 functionCode "transform" "VectorXd" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")] 
                     (unlines ["\tVectorXd output(gd.NxNyNz);",
                               codeStatements codeVTransform  ++ "\t// " ++ show (countFFT codeVTransform) ++ " Fourier transform used.",
-                              "\t// " ++ show (peakMem codeVTransform), 
+                              "\t// " ++ show (fusedPeakMem codeVTransform), 
                               "\treturn output;\n"])  ++
                 functionCode "transform" "double" [("double", "kT"), ("double", "x")] 
                     (unlines ["\tdouble output = 0;",
@@ -43,9 +80,9 @@ classCode ewithtransforms arg n = "class " ++ n ++ " : public FunctionalInterfac
                 functionCode "d_by_dT" "double" [("double", ""), ("double", "")] "\tassert(0); // fail\n\treturn 0;\n" ++
                 functionCode "grad" "Functional" [("const Functional", "&ingrad"), ("const Functional", "&x"), ("bool", "")] "\treturn ingrad;" ++
                 functionCode "grad_T" "Functional" [("const Functional", "&ingradT")] "\treturn ingradT;" ++
-                functionCode "grad" "void" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x"), ("const VectorXd", "&ingrad"), ("VectorXd", "*outgrad"), ("VectorXd", "*outpgrad")] (codeStatements codeGrad ++ "\t// " ++ show (countFFT codeGrad) ++ " Fourier transform used.\n\t// " ++ show (peakMem codeGrad) ++ "\n") ++
+                functionCode "grad" "void" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x"), ("const VectorXd", "&ingrad"), ("VectorXd", "*outgrad"), ("VectorXd", "*outpgrad")] (codeStatements codeGrad ++ "\t// " ++ show (countFFT codeGrad) ++ " Fourier transform used.\n\t// " ++ show (fusedPeakMem codeGrad) ++ "\n") ++
                 functionCode "print_summary" "void" [("const char", "*prefix"), ("double", "energy"), ("std::string", "name")] "\tFunctionalInterface::print_summary(prefix, energy, name);" ++
-                "private:\n"++ codeArgInit arg ++ declaretransforms ++"}; // End of " ++ n ++ " class\n\t// Total " ++ (show $ (countFFT codeIntegrate + countFFT codeVTransform + countFFT codeGrad)) ++ " Fourier transform used.\n\t// peak memory used: " ++ (show $ maximum $ map peakMem [codeIntegrate, codeVTransform, codeGrad])
+                "private:\n"++ codeArgInit arg ++ declaretransforms ++"}; // End of " ++ n ++ " class\n\t// Total " ++ (show $ (countFFT codeIntegrate + countFFT codeVTransform + countFFT codeGrad)) ++ " Fourier transform used.\n\t// peak memory used: " ++ (show $ maximum $ map fusedPeakMem [codeIntegrate, codeVTransform, codeGrad])
     where
       defineGrid :: Type a => Expression a -> Expression a
       defineGrid = substitute dVscalar (s_var "gd.dvolume") .
@@ -114,38 +151,34 @@ generateHeader e arg n = "// -*- mode: C++; -*-\n\n#include \"MinimalFunctionals
 
 scalarClass :: Expression Scalar -> [String] -> String -> String
 scalarClass ewithtransforms arg n =
-  unlines
+  unlines $
   ["class " ++ n ++ " : public FunctionalInterface {",
    "public:",
    "" ++ n ++ codeA arg ++ "  {",
    "\thave_integral = true;",
-   "\t// TODO: code to evaluate Fourier transforms goes here",
-   "\toldkT = sqrt(-1.0);  // initialize to NaN so we'll have to define transforms",
-   -- insert code here to compute and store the spherical fourier transforms
-   initializetransforms,
-   "}",
-   "~" ++ n ++ "() {",
-   deletetransforms,
-   "}",
+   "\t// TODO: code to evaluate Fourier transforms goes here"] ++
+   initNamedScalars named ++
+  ["}",
    "",
    functionCode "I_have_analytic_grad" "bool" [] "\treturn false;",
    functionCode "integral" "double" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")]
-    (unlines [redefinetransforms,
-              "\tdouble output=0;",
+    (unlines $ usetransforms ++ declareNamedScalars named ++
+             ["\tdouble output=0;",
               codeStatements codeIntegrate ++ "\t// " ++ show (countFFT codeIntegrate) ++ " Fourier transform used.",
-              "\t// " ++ show (peakMem codeIntegrate) ++ " temporaries made",
-              "\treturn output;", ""]),
+              "\t// " ++ show (fusedPeakMem codeIntegrate) ++ " temporaries made"] ++
+             publishNamedScalars named ++
+             ["\treturn output;", ""]),
    functionCode "transform" "VectorXd" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")]
     (unlines ["\tassert(0);"]),
    functionCode "transform" "double" [("double", "kT"), ("double", "x")]
-    (unlines [redefinetransforms,
-              "\tdouble output = 0;",
+    (unlines $ usetransforms ++
+             ["\tdouble output = 0;",
               "\t" ++ codeStatements codeDTransform,
               "\treturn output;", ""]),
    functionCode "append_to_name" "bool" [("", "std::string")] "\treturn false;",
    functionCode "derive" "double" [("double", "kT"), ("double", "x")]
-    (unlines [redefinetransforms,
-              "\tdouble output = 0;",
+    (unlines $ usetransforms ++
+             ["\tdouble output = 0;",
               codeStatements codeDerive,
               "\treturn output;", ""]),
    functionCode "d_by_dT" "double" [("double", ""), ("double", "")]
@@ -160,31 +193,30 @@ scalarClass ewithtransforms arg n =
       ("const VectorXd", "&ingrad"),
       ("VectorXd", "*outgrad"),
       ("VectorXd", "*outpgrad")]
-     (unlines [redefinetransforms,
-               codeStatements codeGrad ++ "\t// " ++ show (countFFT codeGrad) ++ " Fourier transform used.",
-               "\t// " ++ show (peakMem codeGrad),
+     (unlines $ usetransforms ++
+              [codeStatements codeGrad ++ "\t// " ++ show (countFFT codeGrad) ++ " Fourier transform used.",
+               "\t// " ++ show (fusedPeakMem codeGrad),
                ""]),
    functionCode "print_summary" "void" [("const char", "*prefix"), ("double", "energy"), ("std::string", "name")]
-    (unlines $ ["\tif (name != \"\") printf(\"%s%25s =\", prefix, name.c_str());",
+    (unlines $ readNamedScalars named ++
+               ["\tif (name != \"\") printf(\"%s%25s =\", prefix, name.c_str());",
                 "\telse printf(\"%s%25s =\", prefix, \"UNKNOWN\");",
                 "\tprint_double(\"\", energy);"] ++
-               map printEnergy (Set.toList (findNamedScalars e)) ++
+               map printNamedScalar named ++
                ["\tprintf(\"\\n\");"]),
   "private:",
-  ""++ codeArgInit arg ++ codeMutableData (Set.toList $ findNamedScalars e)
+  ""++ codeArgInit arg ++ namedScalarData named
   ++ "\t// TODO: add declaration of spherical fourier transform data here\n"
   ++ declaretransforms
   ++"}; // End of " ++ n ++ " class",
   "\t// Total " ++ (show $ (countFFT codeIntegrate + countFFT codeGrad)) ++ " Fourier transform used.",
-  "\t// peak memory used: " ++ (show $ maximum $ map peakMem [codeIntegrate, codeGrad])
+  "\t// peak memory used: " ++ (show $ maximum $ map fusedPeakMem [codeIntegrate, codeGrad])
   ]
     where
       defineGrid = substitute dVscalar (s_var "gd.dvolume") .
                    substitute dr (s_var "gd.dvolume" ** (1.0/3))
       defineHomogeneousGrid = substitute dVscalar 1 .
                               substitute dr (s_var "gd.dvolume" ** (1.0/3))
-      printEnergy v = "\tprintf(\"\\n%s%25s =\", prefix, \"" ++ v ++ "\");\n" ++
-                      "\tprint_double(\"\", " ++ v ++ ");"
       codeIntegrate = reuseVar $ freeVectors (st ++ [Assign (ES (s_var "output")) e'])
           where (st0, [e']) = optimize [mkExprn $ factorize $ joinFFTs $ cleanvars $ defineGrid e]
                 st = filter (not . isns) st0
@@ -203,23 +235,40 @@ scalarClass ewithtransforms arg n =
       codeA [] = "()"
       codeA a = "(" ++ foldl1 (\x y -> x ++ ", " ++ y ) (map (\x -> "double " ++ x ++ "_arg") a) ++ ") : " ++ foldl1 (\x y -> x ++ ", " ++ y) (map (\x -> x ++ "(" ++ x ++ "_arg)") a)
       codeArgInit a = unlines $ map (\x -> "\tdouble " ++ x ++ ";") a
-      codeMutableData a = unlines $ map (\x -> "\tmutable double " ++ x ++ ";") a
+      named = Set.toList (findNamedScalars e)
       -- The following is needed to handle spherical fourier
-      -- transforms that we store on 1D grids.
-      declaretransforms = chomp $ unlines $ "\tmutable double oldkT;" : map (\(t,_,_) -> "\tmutable double *" ++ t ++ ";") transforms
+      -- transforms that we store on 1D grids.  These depend on kT, so
+      -- tables_at computes them afresh for each new kT, and each call
+      -- holds on to the tables it started with.  This way calls at
+      -- different temperatures can run at the same time.
+      usetransforms = case transforms of
+                        [] -> []
+                        _ -> "\tconst std::shared_ptr<const kT_tables> now = tables_at(kT);" :
+                             map (\(t,_,_) -> "\tconst double *" ++ t ++ " = &now->" ++ t ++ "[0];") transforms
+      declaretransforms = case transforms of
+        [] -> ""
+        _ -> unlines $ ["\tstruct kT_tables {", "\t\tdouble kT;"] ++
+                       map (\(t,_,_) -> "\t\tstd::vector<double> " ++ t ++ ";") transforms ++
+                       ["\t};",
+                        "\tmutable std::mutex tables_mutex; // guards tables",
+                        "\tmutable std::shared_ptr<const kT_tables> tables;",
+                        functionCode "tables_at" "std::shared_ptr<const kT_tables>" [("double", "kT")] computetables]
       chomp str = case reverse str of '\n':rstr -> reverse rstr
                                       _ -> str
-      initializetransforms = chomp $ unlines $ map initt transforms
-        where initt (t,_,_) = "\t" ++ t ++ " = 0;"
-      deletetransforms = chomp $ unlines $ map delt transforms
-        where delt (t,_,_) = "\tdelete[] " ++ t ++ ";"
-      redefinetransforms = chomp $ unlines $ [
-                         "\tif (oldkT != kT) {",
-                         "\t\toldkT = kT;",
-                         chomp $ concat $ map definet transforms,
-                         "\t}"]
+      computetables = unlines $ ["\t{",
+                                 "\t\tstd::lock_guard<std::mutex> lock(tables_mutex);",
+                                 "\t\tif (tables && tables->kT == kT) return tables;",
+                                 "\t}",
+                                 "\tstd::shared_ptr<kT_tables> fresh(new kT_tables);",
+                                 "\tfresh->kT = kT;"] ++
+                                map (chomp . definet) transforms ++
+                                ["\tstd::lock_guard<std::mutex> lock(tables_mutex);",
+                                 "\ttables = fresh;",
+                                 "\treturn fresh;"]
         where definet (t,s@(Spherical {}),r) =
-                unlines ["\t\tif (!"++t++") " ++ t ++ " = new double[" ++ nk ++ "];",
+                unlines ["\t{",
+                         "\t\tstd::vector<double> &" ++ t ++ " = fresh->" ++ t ++ ";",
+                         "\t\t" ++ t ++ ".resize(" ++ nk ++ ");",
                          "\t\t// first evaluate k=0 version of " ++ t ++ "...",
                          "\t\t" ++ t ++ "[0] = 0;",
                          "\t\tfor (double r="++halfdr++"; r<" ++ code (rmax s) ++"; r+=" ++ mydr ++ ") {",
@@ -232,7 +281,8 @@ scalarClass ewithtransforms arg n =
                          "\t\t\tfor (double r="++halfdr++"; r<" ++ code (rmax s) ++"; r+=" ++ mydr ++ ") {",
                          "\t\t\t\t" ++ t ++ "[i] += " ++ code (r*sin(kvar*rvar)/(kvar*rvar)*dvolume)  ++ ";",
                          "\t\t\t}",
-                         "\t\t}"]
+                         "\t\t}",
+                         "\t}"]
                   where nk = show (round (kmax s/dk s) :: Int)
                         mydr = code (rresolution s)
                         halfdr = code (rresolution s/2)
@@ -242,14 +292,17 @@ scalarClass ewithtransforms arg n =
                         rhi = "rhi" === rvar + rresolution s/2
                         rlo = "rlo" === rvar - rresolution s/2
               definet (t,s@(VectorS {}),r) =
-                unlines ["\t\tif (!"++t++") " ++ t ++ " = new double[" ++ nk ++ "];",
+                unlines ["\t{",
+                         "\t\tstd::vector<double> &" ++ t ++ " = fresh->" ++ t ++ ";",
+                         "\t\t" ++ t ++ ".resize(" ++ nk ++ ");",
                          "\t\tfor (int i=1; i<" ++ nk ++"; i++) {",
                          "\t\t\tconst double k = i*" ++ show (dk s) ++ ";",
                          "\t\t\t" ++ t ++ "[i] = 0;",
                          "\t\t\tfor (double r="++halfdr++"; r<" ++ code (rmax s) ++"; r+=" ++ mydr ++ ") {",
                          "\t\t\t\t" ++ t ++ "[i] += " ++ code (r*(cos kr - sin kr/kr)*dvolume/kvar**2) ++ ";",
                          "\t\t\t}",
-                         "\t\t}"]
+                         "\t\t}",
+                         "\t}"]
                   where nk = show (round (kmax s/dk s) :: Int)
                         mydr = code (rresolution s)
                         halfdr = code (rresolution s/2)
@@ -276,6 +329,8 @@ defineFunctional e arg n =
            "#include \"MinimalFunctionals.h\"",
            "#include \"utilities.h\"",
            "#include \"handymath.h\"",
+           "#include <mutex>",
+           "#include <memory>",
            "",
            "",
            scalarClass e arg (n ++ "_type"),
@@ -296,20 +351,23 @@ defineFunctional e arg n =
 
 scalarClassNoGradient :: Expression Scalar -> [String] -> String -> String
 scalarClassNoGradient ewithtransforms arg n =
-  unlines
+  unlines $
   ["class " ++ n ++ " : public FunctionalInterface {",
    "public:",
    "" ++ n ++ codeA arg ++ "  {",
    "\thave_integral = true;",
-   definetransforms,
-   "}",
+   definetransforms] ++
+   initNamedScalars named ++
+  ["}",
    "",
    functionCode "I_have_analytic_grad" "bool" [] "\treturn false;",
    functionCode "integral" "double" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")]
-    (unlines ["\tdouble output=0;",
+    (unlines $ declareNamedScalars named ++
+             ["\tdouble output=0;",
               codeStatements codeIntegrate ++ "\t// " ++ show (countFFT codeIntegrate) ++ " Fourier transform used.",
-              "\t// " ++ show (peakMem codeIntegrate) ++ " temporaries made",
-              "\treturn output;", ""]),
+              "\t// " ++ show (fusedPeakMem codeIntegrate) ++ " temporaries made"] ++
+             publishNamedScalars named ++
+             ["\treturn output;", ""]),
    functionCode "transform" "VectorXd" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")]
     (unlines ["\tassert(0);"]),
    functionCode "transform" "double" [("double", "kT"), ("double", "x")]
@@ -335,24 +393,23 @@ scalarClassNoGradient ewithtransforms arg n =
       ("VectorXd", "*outpgrad")]
      (unlines ["\tassert(0); // fail"]),
    functionCode "print_summary" "void" [("const char", "*prefix"), ("double", "energy"), ("std::string", "name")]
-    (unlines $ ["\tif (name != \"\") printf(\"%s%25s =\", prefix, name.c_str());",
+    (unlines $ readNamedScalars named ++
+               ["\tif (name != \"\") printf(\"%s%25s =\", prefix, name.c_str());",
                 "\telse printf(\"%s%25s =\", prefix, \"UNKNOWN\");",
                 "\tprint_double(\"\", energy);"] ++
-               map printEnergy (Set.toList (findNamedScalars e)) ++
+               map printNamedScalar named ++
                ["\tprintf(\"\\n\");"]),
   "private:",
-  ""++ codeArgInit arg ++ codeMutableData (Set.toList $ findNamedScalars e)
+  ""++ codeArgInit arg ++ namedScalarData named
     ++ "\t// TODO: add declaration of spherical fourier transform data here\n"
     ++ declaretransforms
   ++"}; // End of " ++ n ++ " class",
   "\t// Total " ++ (show $ countFFT codeIntegrate) ++ " Fourier transform used.",
-  "\t// peak memory used: " ++ (show $ maximum $ map peakMem [codeIntegrate])
+  "\t// peak memory used: " ++ (show $ maximum $ map fusedPeakMem [codeIntegrate])
   ]
     where
       defineGrid = substitute dVscalar (s_var "gd.dvolume") .
                    substitute dr (s_var "gd.dvolume" ** (1.0/3))
-      printEnergy v = "\tprintf(\"\\n%s%25s =\", prefix, \"" ++ v ++ "\");\n" ++
-                      "\tprint_double(\"\", " ++ v ++ ");"
       codeIntegrate = reuseVar $ freeVectors (st ++ [Assign (ES (s_var "output")) e'])
           where (st0, [e']) = optimize [mkExprn $ factorize $ joinFFTs $ cleanvars $ defineGrid e]
                 st = filter (not . isns) st0
@@ -366,7 +423,7 @@ scalarClassNoGradient ewithtransforms arg n =
       codeA [] = "()"
       codeA a = "(" ++ foldl1 (\x y -> x ++ ", " ++ y ) (map (\x -> "double " ++ x ++ "_arg") a) ++ ") : " ++ foldl1 (\x y -> x ++ ", " ++ y) (map (\x -> x ++ "(" ++ x ++ "_arg)") a)
       codeArgInit a = unlines $ map (\x -> "\tdouble " ++ x ++ ";") a
-      codeMutableData a = unlines $ map (\x -> "\tmutable double " ++ x ++ ";") a
+      named = Set.toList (findNamedScalars e)
       -- The following is needed to handle spherical fourier
       -- transforms that we store on 1D grids.
       declaretransforms = unlines $ map (\(t,_,_) -> "\tdouble *" ++ t ++ ";") transforms
@@ -405,6 +462,7 @@ defineFunctionalNoGradient e arg n =
            "#include \"MinimalFunctionals.h\"",
            "#include \"utilities.h\"",
            "#include \"handymath.h\"",
+           "#include <mutex>",
            "",
            "",
            scalarClassNoGradient e arg (n ++ "_type"),
@@ -438,7 +496,7 @@ transformationClass ewithtransforms arg n =
    functionCode "transform" "VectorXd" [("const GridDescription", "&gd"), ("double", "kT"), ("const VectorXd", "&x")] 
    (unlines ["\tVectorXd output(gd.NxNyNz);",
              codeStatements codeVTransform  ++ "\t// " ++ show (countFFT codeVTransform) ++ " Fourier transform used.",
-             "\t// " ++ show (peakMem codeVTransform),
+             "\t// " ++ show (fusedPeakMem codeVTransform),
              "\treturn output;\n"]),
    functionCode "transform" "double" [("double", "kT"), ("double", "x")]
     (unlines ["\tdouble output = 0;",
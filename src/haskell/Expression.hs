@@ -1054,12 +1054,15 @@ instance (Type a, Code a) => Code (Expression a) where
   codePrec p (Scalar x) = codePrec p x
   codePrec p (Expression x) = codePrec p x
   codePrec _ (F Heaviside x) = showString "heaviside(" . codePrec 0 x . showString ")"
-  codePrec _ (F Cos x) = showString "cos(" . codePrec 0 x . showString ")"
-  codePrec _ (F Sin x) = showString "sin(" . codePrec 0 x . showString ")"
+  -- The simd_ functions (from simdmath.h) only appear in code that
+  -- has been regenerated since they were added, which the checked-in
+  -- WaterSaft sources have not been.
+  codePrec _ (F Cos x) = showString "simd_cos(" . codePrec 0 x . showString ")"
+  codePrec _ (F Sin x) = showString "simd_sin(" . codePrec 0 x . showString ")"
   codePrec _ (F Erfi x) = showString "erfi(" . codePrec 0 x . showString ")"
-  codePrec _ (F Exp x) = showString "exp(" . codePrec 0 x . showString ")"
+  codePrec _ (F Exp x) = showString "simd_exp(" . codePrec 0 x . showString ")"
   codePrec _ (F Erf x) = showString "erf(" . codePrec 0 x . showString ")"
-  codePrec _ (F Log x) = showString "log(" . codePrec 0 x . showString ")"
+  codePrec _ (F Log x) = showString "simd_log(" . codePrec 0 x . showString ")"
   codePrec _ (F Abs x) = showString "fabs(" . codePrec 0 x . showString ")"
   codePrec _ (F Signum _) = undefined
   codePrec _ (Product p i) | Product p i == 1 = showString "1.0"
@@ -1084,7 +1087,7 @@ instance (Type a, Code a) => Code (Expression a) where
               showParen (nn/2>1) (codee x (nn / 2)) . showString "*" . showParen (nn/2>1) (codee x (nn / 2))
             where n2 = floor (2*nn)
                   n = floor nn
-          codee x n = showString "pow(" . codePrec 0 x . showString (", " ++ show n ++ ")")
+          codee x n = showString "simd_pow(" . codePrec 0 x . showString (", " ++ show n ++ ")")
   codePrec _ (Sum s i) | Sum s i == 0 = showString "0.0"
   codePrec p (Sum s _) = showParen (p > 6) (showString me)
     where me = foldl addup "" $ sum2pairs s
@@ -1101,12 +1104,12 @@ instance (Type a, Code a) => Code (Expression a) where
   newcodePrec p (Scalar x) = newcodePrec p x
   newcodePrec p (Expression x) = newcodePrec p x
   newcodePrec _ (F Heaviside x) = showString "heaviside(" . newcodePrec 0 x . showString ")"
-  newcodePrec _ (F Cos x) = showString "cos(" . newcodePrec 0 x . showString ")"
-  newcodePrec _ (F Sin x) = showString "sin(" . newcodePrec 0 x . showString ")"
+  newcodePrec _ (F Cos x) = showString "simd_cos(" . newcodePrec 0 x . showString ")"
+  newcodePrec _ (F Sin x) = showString "simd_sin(" . newcodePrec 0 x . showString ")"
   newcodePrec _ (F Erfi x) = showString "erfi(" . newcodePrec 0 x . showString ")"
-  newcodePrec _ (F Exp x) = showString "exp(" . newcodePrec 0 x . showString ")"
+  newcodePrec _ (F Exp x) = showString "simd_exp(" . newcodePrec 0 x . showString ")"
   newcodePrec _ (F Erf x) = showString "erf(" . newcodePrec 0 x . showString ")"
-  newcodePrec _ (F Log x) = showString "log(" . newcodePrec 0 x . showString ")"
+  newcodePrec _ (F Log x) = showString "simd_log(" . newcodePrec 0 x . showString ")"
   newcodePrec _ (F Abs x) = showString "fabs(" . newcodePrec 0 x . showString ")"
   newcodePrec _ (F Signum _) = undefined
   newcodePrec _ (Product p i) | Product p i == 1 = showString "1.0"
@@ -1131,7 +1134,7 @@ instance (Type a, Code a) => Code (Expression a) where
               showParen (nn/2>1) (newcodee x (nn / 2)) . showString "*" . showParen (nn/2>1) (newcodee x (nn / 2))
             where n2 = floor (2*nn)
                   n = floor nn
-          newcodee x n = showString "pow(" . newcodePrec 0 x . showString (", " ++ show n ++ ")")
+          newcodee x n = showString "simd_pow(" . newcodePrec 0 x . showString (", " ++ show n ++ ")")
   newcodePrec _ (Sum s i) | Sum s i == 0 = showString "0.0"
   newcodePrec p (Sum s _) = showParen (p > 6) (showString me)
     where me = foldl addup "" $ sum2pairs s
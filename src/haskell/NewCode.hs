@@ -162,9 +162,9 @@ create3dMethods e variables n =
      returnType = None,
      constness = "",
      args = [(Double, "ax"), (Double, "ay"), (Double, "az"), (Double, "dx")],
-     contents =["int myNx = int(ceil(ax/dx/2))*2;",
-                "int myNy = int(ceil(ay/dx/2))*2;",
-                "int myNz = int(ceil(az/dx/2))*2;",
+     contents =["int myNx = fft_grid_size(ax/dx);",
+                "int myNy = fft_grid_size(ay/dx);",
+                "int myNz = fft_grid_size(az/dx);",
                 "data = Vector(int(" ++ code (sum $ map actualsize $ findOrderedInputs e) ++ "));",
                 "Nx() = myNx;",
                 "Ny() = myNy;",
@@ -173,7 +173,7 @@ create3dMethods e variables n =
                 "a2() = ay;",
                 "a3() = az;"]
      }] ++ createAnydMethods e variables n
-        ++ map getIntermediate [("rx", ER rx), ("ry", ER ry), ("rz", ER rz), ("r", ER rmag),
+        ++ map (profiled . getIntermediate) [("rx", ER rx), ("ry", ER ry), ("rz", ER rz), ("r", ER rmag),
                                 ("kx", EK kx), ("ky", EK ky), ("kz", EK kz), ("k", EK k)]
     where
       actualsize (ES _) = 1 :: Expression Scalar
@@ -191,6 +191,11 @@ create3dMethods e variables n =
                      [newcodeStatements $ eval_named (""++rsname) a]
       }
 
+-- profiled times each call to the method under its own name, when
+-- profiling is turned on (see profiling.h).
+profiled :: CFunction -> CFunction
+profiled f = f { contents = ("profile_scope profile(\"" ++ name f ++ "\");") : contents f }
+
 createInput :: Exprn -> String
 createInput ee@(ES _) = "double " ++ nameE ee ++ " = data[sofar]; sofar += 1;"
 createInput ee@(ER _) = "Vector " ++ nameE ee ++ " = data.slice(sofar,Nx*Ny*Nz); sofar += Nx*Ny*Nz;"
@@ -198,7 +203,7 @@ createInput ee = error ("unhandled type in NewCode scalarClass: " ++ show ee)
 
 createAnydMethods :: Expression Scalar -> [(Exprn, Exprn)] -> String -> [CFunction]
 createAnydMethods e variables n =
-  [CFunction {
+  [profiled $ CFunction {
       name = n++"::energy",
       returnType = Double,
       constness = "const",
@@ -207,7 +212,7 @@ createAnydMethods e variables n =
                  map createInput (findOrderedInputs e) ++
                  [newcodeStatements (eval_scalar e)]
       },
-   CFunction {
+   profiled $ CFunction {
      name = n++"::grad",
      returnType = Vector,
      constness = "const",
@@ -225,7 +230,7 @@ createAnydMethods e variables n =
      args = [],
      contents = ["return true;"]
      },
-   CFunction {
+   profiled $ CFunction {
      name = n++"::energy_grad_and_precond",
      returnType = EnergyGradAndPrecond,
      constness = "const",
@@ -248,8 +253,8 @@ createAnydMethods e variables n =
       contents = concatMap printEnergy $
                  filter (`notElem` ["dV", "dr", "volume"]) $
                  (Set.toList (findNamedScalars e))
-      }] ++ map getIntermediate (Set.toList $ findNamed e)
-         ++ concatMap getScalarDerivative (findOrderedInputs e)
+      }] ++ map (profiled . getIntermediate) (Set.toList $ findNamed e)
+         ++ map profiled (concatMap getScalarDerivative (findOrderedInputs e))
   where
       maxlen = 1 + maximum (map length $ "total energy" : Set.toList (findNamedScalars e))
       pad nn s | nn <= length s = s
@@ -7,6 +7,7 @@ module Statement ( Statement(..),
                    countFFT,
                    checkDup,
                    peakMem,
+                   fusedPeakMem,
                    reuseVar,
                    freeVectors)
     where
@@ -50,16 +51,158 @@ latexStatements :: [Statement] -> String
 latexStatements x = unlines $ map (\e -> "\n\\begin{dmath}\n" ++ latex e ++ "\n\\end{dmath}") x
 
 codeStatements :: [Statement] -> String
-codeStatements (Initialize v : Assign v' (ES e) : ss)
-  | v == v' = "\tdouble " ++ code (Assign v (ES e)) ++ "\n" ++ codeStatements ss
-codeStatements (s:ss) = code s ++ "\n" ++ codeStatements ss
-codeStatements [] = ""
+codeStatements = codeLoops (Runtime code "for (int i=0; i<gd.NxNyNz; i++) {"
+                                    "gd" "VectorXd" "VectorXcd")
+                 . fuseLoops . gatherTransforms
 
 newcodeStatements :: [Statement] -> String
-newcodeStatements (Initialize v : Assign v' (ES e) : ss)
-  | v == v' = "\tdouble " ++ newcode (Assign v (ES e)) ++ "\n" ++ newcodeStatements ss
-newcodeStatements (s:ss) = newcode s ++ "\n" ++ newcodeStatements ss
-newcodeStatements [] = ""
+newcodeStatements = codeLoops (Runtime newcode "for (int i=0; i<Nx*Ny*Nz; i++) {"
+                                       "Nx,Ny,Nz,dV" "Vector" "ComplexVector")
+                    . fuseLoops . gatherTransforms
+
+-- Runtime describes the C++ that the old and new code differ in.
+data Runtime = Runtime { codeS :: Statement -> String,
+                         gridLoop :: String,
+                         fftArgs :: String,
+                         realVector :: String,
+                         complexVector :: String }
+
+-- A run of pointwise real-space assignments with no Fourier transform
+-- between them can be done in a single pass over the grid, which
+-- saves a trip through memory for each statement.  Better yet, a
+-- temporary that is both created and freed within such a run never
+-- needs to be stored as a grid at all, so we keep it in a local double.
+-- This only reaches the C++ when the code is regenerated: the build
+-- regenerates every functional it lists in SConstruct, but the
+-- checked-in src/WaterSaftFast.cpp and src/WaterSaft_by_handFast.cpp
+-- are not among them, and have no fused loops until someone
+-- regenerates them by hand.
+data Loop = Plain Statement
+          | Fused [Exprn] [Statement] -- local temporaries, and assignments
+          | Batched [Statement] -- transforms to do with a single plan
+
+data Transform = ForwardFFT | InverseFFT
+               deriving ( Eq )
+
+-- transformOf recognizes an assignment that is the Fourier transform
+-- of a variable, and tells us its output and input.
+transformOf :: Statement -> Maybe (Transform, Exprn, Exprn)
+transformOf (Assign a (ER e)) | Just v <- ifftOf e = Just (InverseFFT, a, v)
+    where ifftOf (Expression (IFFT v@(Var _ _ _ _ Nothing))) = Just (EK v)
+          ifftOf (Var _ _ _ _ (Just e')) = ifftOf e'
+          ifftOf _ = Nothing
+transformOf (Assign a (EK e)) | Just v <- fftOf e = Just (ForwardFFT, a, v)
+    where fftOf (Expression (FFT v@(Var _ _ _ _ Nothing))) = Just (ER v)
+          fftOf (Var _ _ _ _ (Just e')) = fftOf e'
+          fftOf _ = Nothing
+transformOf _ = Nothing
+
+isTransform :: Transform -> Statement -> Bool
+isTransform t s | Just (t', _, _) <- transformOf s = t == t'
+isTransform _ _ = False
+
+-- gatherTransforms moves Fourier transforms that don't depend on one
+-- another next to each other, so they can be done as a batch.  This
+-- is what happens for the components of vector and tensor weighted
+-- densities, which are each computed in reciprocal space and then
+-- transformed in turn.  A transform may be delayed past any statement
+-- that neither reads its output nor overwrites its input, and frees
+-- are delayed until after the batch.
+gatherTransforms :: [Statement] -> [Statement]
+gatherTransforms (s:ss)
+  | Just (t, _, _) <- transformOf s,
+    (ts@(_:_:_), ms, fs, rest) <- window t [s] [] [] ss = ms ++ ts ++ fs ++ gatherTransforms rest
+gatherTransforms (s:ss) = s : gatherTransforms ss
+gatherTransforms [] = []
+
+window :: Transform -> [Statement] -> [Statement] -> [Statement] -> [Statement]
+       -> ([Statement], [Statement], [Statement], [Statement])
+window t ts ms fs (x:xs)
+  | isTransform t x = window t (ts ++ [x]) ms fs xs
+  | Free _ <- x = window t ts ms (fs ++ [x]) xs
+  | Initialize (ES _) <- x = (ts, ms, fs, x:xs)
+  | Initialize _ <- x = window t ts (ms ++ [x]) fs xs
+  | Assign y e <- x, not (any (conflicts y e) ts) = window t ts (ms ++ [x]) fs xs
+    where conflicts y e tr | Just (_, o, i) <- transformOf tr = y == o || y == i || hasExprn o e
+          conflicts _ _ _ = True
+window _ ts ms fs xs = (ts, ms, fs, xs)
+
+varName :: Exprn -> String
+varName = mapExprn helper
+    where helper :: Type a => Expression a -> String
+          helper (Var _ _ n _ _) = n
+          helper e = error ("varName of non-variable " ++ show e)
+
+isPointwise :: Statement -> Bool
+isPointwise (Assign (ER _) (ER e)) = not (isIFFT e)
+    where isIFFT (Expression (IFFT _)) = True
+          isIFFT (Var _ _ _ _ (Just e')) = isIFFT e'
+          isIFFT _ = False
+isPointwise _ = False
+
+fuseLoops :: [Statement] -> [Loop]
+fuseLoops [] = []
+fuseLoops ss@(s:ss')
+  | Just (t, _, _) <- transformOf s,
+    (batch@(_:_:_), after) <- span (isTransform t) ss = Batched batch : fuseLoops after
+  | length assigns > 1 = map Plain (filter (not . isLocal) others) ++
+                         [Fused locals (map localize assigns)] ++
+                         map Plain (filter (not . isLocal) frees) ++ fuseLoops rest
+  | null run = Plain s : fuseLoops ss'
+  | otherwise = map Plain run ++ fuseLoops rest
+  where (run, rest) = span inRun ss
+        inRun x@(Assign _ _) = isPointwise x
+        inRun (Initialize (ER _)) = True
+        inRun (Free _) = True
+        inRun _ = False
+        (assigns, notassigns) = partition isPointwise run
+        (frees, others) = partition isFree notassigns
+        isFree (Free _) = True
+        isFree _ = False
+        locals = [v | Initialize v@(ER (Var IsTemp _ _ _ Nothing)) <- run, Free v `elem` run]
+        isLocal (Initialize v) = v `elem` locals
+        isLocal (Free v) = v `elem` locals
+        isLocal _ = False
+        localize (Assign x e) = Assign (foldr localizeE x locals) (foldr localizeE e locals)
+        localize x = x
+        localizeE (ER v) e = substituteE v (localVar v) e
+        localizeE _ e = e
+
+localVar :: Expression RealSpace -> Expression RealSpace
+localVar (Var t _ x l Nothing) = Var t ("fused_" ++ x) ("fused_" ++ x) l Nothing
+localVar v = v
+
+-- codeLoops turns each fused assignment's own loop into a block
+-- within the shared loop, so its local constants stay out of the way
+-- of the other statements.
+codeLoops :: Runtime -> [Loop] -> String
+codeLoops rt = helper
+    where c = codeS rt
+          helper (Plain (Initialize v) : Plain (Assign v' (ES e)) : ls)
+            | v == v' = "\tdouble " ++ c (Assign v (ES e)) ++ "\n" ++ helper ls
+          helper (Plain s : ls) = c s ++ "\n" ++ helper ls
+          helper (Fused vs as : ls) =
+            "\t" ++ gridLoop rt ++ "\n" ++ concatMap declare vs ++
+            concatMap (block . c) as ++ "\t}\n" ++ helper ls
+          helper (Batched ts@(tr:_) : ls) =
+            unlines ["\t{",
+                     "\t\tconst " ++ intype ++ " *batch_in[] = { " ++ pointers ins ++ " };",
+                     "\t\t" ++ outtype ++ " *batch_out[] = { " ++ pointers outs ++ " };",
+                     "\t\t" ++ fname ++ "(" ++ fftArgs rt ++ ", " ++ show (length ts) ++
+                     ", batch_in, batch_out);",
+                     "\t}"] ++ helper ls
+            where (outs, ins) = unzip [(o, i) | Just (_, o, i) <- map transformOf ts]
+                  pointers = commaSep . map (('&':) . varName)
+                  commaSep = foldr1 (\a b -> a ++ ", " ++ b)
+                  (fname, intype, outtype) =
+                    if isTransform InverseFFT tr
+                    then ("ifft_many", complexVector rt, realVector rt)
+                    else ("fft_many", realVector rt, complexVector rt)
+          helper (Batched [] : ls) = helper ls
+          helper [] = ""
+          declare (ER v) = "\t\tdouble " ++ code (localVar v) ++ ";\n"
+          declare _ = ""
+          block s = unlines $ map ('\t':) ("\t{" : drop 1 (lines s))
 
 substituteS :: Type a => Expression a -> Expression a -> Statement -> Statement
 substituteS x y (Assign s e) = Assign s (substituteE x y e)
@@ -84,6 +227,14 @@ peakMem = maximum . (helper 0) . freeVectors
                           | otherwise = n : helper n xs
           helper n [] = [n]
 
+-- fusedPeakMem is like peakMem, but does not count the temporaries
+-- that fuseLoops keeps out of memory.
+fusedPeakMem :: [Statement] -> Int
+fusedPeakMem = peakMem . concatMap unfuse . fuseLoops . gatherTransforms . freeVectors
+    where unfuse (Plain s) = [s]
+          unfuse (Fused _ as) = as
+          unfuse (Batched ts) = ts
+
 checkDup :: [Statement] -> [Statement]
 checkDup = nubBy sameInit
     where sameInit (Initialize x) (Initialize y) = x == y
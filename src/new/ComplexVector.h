@@ -6,6 +6,8 @@
 #include <cassert>
 #include <string.h>
 #include <math.h>
+#include "FieldStorage.h"
+#include "FieldExpression.h"
 
 
 // A ComplexVector is a reference-counted array of std::complex<double>s.
@@ -24,29 +26,29 @@
 // as an old one.  Once again, this allows shared data, hopefully
 // enabling nice code while avoiding bloated memory use.
 
-// Most arithmetic operators are defined on ComplexVectors.  If you come
-// across one that isn't defined, we could probably add its
-// definition.
+// Most arithmetic operators are defined on ComplexVectors, and are
+// evaluated lazily (see FieldExpression.h).  If you come across one
+// that isn't defined, we could probably add its definition.
 
 class Vector;
 
-class ComplexVector {
+class ComplexVector : public FieldExpression<ComplexVector> {
 public:
   ComplexVector() : size(0), offset(0), data(0), references_count(0) {}
-  explicit ComplexVector(int sz) : size(sz), offset(0), data(new std::complex<double>[size]),
+  explicit ComplexVector(int sz) : size(sz), offset(0), data((std::complex<double> *)allocate_field(size*sizeof(std::complex<double>))),
                                    references_count(new int) {
     *references_count = 1;
   }
   ComplexVector(const ComplexVector &a) : size(a.size), offset(a.offset),
                             data(a.data), references_count(a.references_count) {
-    *references_count += 1;
+    if (references_count) *references_count += 1;
   }
   ~ComplexVector() { free(); }
   void free() {
     if (references_count && *references_count) {
       *references_count -= 1;
       if (*references_count == 0) {
-        delete[] data;
+        free_field(data);
         delete references_count;
       }
       references_count = 0;
@@ -97,64 +99,36 @@ public:
     return out;
   }
 
-  // Below are the arithmetic operators.  These should be made fast.
-  ComplexVector operator+(const ComplexVector &a) const {
-    // operator+ treats an empty vector as a zero vector;
-    if (a.size == 0) return *this;
-    if (size == 0) return a;
-    assert(size == a.size);
-    ComplexVector out(size);
-    const std::complex<double> *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p1[i] + p2[i];
-    }
-    return out;
-  }
-  ComplexVector operator-(const ComplexVector &a) const {
-    // operator- treats an empty vector as a zero vector;
-    if (a.size == 0) return *this;
-    if (size == 0) return -a;
-    assert(size == a.size);
-    ComplexVector out(size);
-    const std::complex<double> *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p1[i] - p2[i];
-    }
-    return out;
-  }
-  ComplexVector operator-() const {
-    ComplexVector out(size);
-    const std::complex<double> *p1 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = -p1[i];
+  // Arithmetic on ComplexVectors builds a FieldExpression (see
+  // FieldExpression.h), which is evaluated here, in a single pass.
+  template <typename E>
+  ComplexVector(const FieldExpression<E> &e)
+    : size(0), offset(0), data(0), references_count(0) {
+    *this = e;
+  }
+  template <typename E>
+  void operator=(const FieldExpression<E> &e) {
+    const E &x = e.self();
+    if (!references_count && x.get_size()) {
+      ComplexVector out(x.get_size());
+      evaluate_field<field_assign>(out.data, x);
+      *this = out;
+    } else if (!references_count) {
+      size = 0;
+    } else {
+      assert(size == x.get_size());
+      update<field_assign>(x);
     }
-    return out;
   }
-  ComplexVector operator*(std::complex<double> a) const {
-    ComplexVector out(size);
-    const std::complex<double> *p2 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = a*p2[i];
-    }
-    return out;
+  template <typename E>
+  void operator+=(const FieldExpression<E> &e) {
+    assert(size == e.self().get_size());
+    update<field_add>(e.self());
   }
-  friend ComplexVector operator*(std::complex<double> a, const ComplexVector &b);
-
-  void operator+=(const ComplexVector &a) {
-    assert(size == a.size);
-    std::complex<double> *p1 = data + offset;
-    const std::complex<double> *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      p1[i] += p2[i];
-    }
-  }
-  void operator-=(const ComplexVector &a) {
-    assert(size == a.size);
-    std::complex<double> *p1 = data + offset;
-    const std::complex<double> *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      p1[i] -= p2[i];
-    }
+  template <typename E>
+  void operator-=(const FieldExpression<E> &e) {
+    assert(size == e.self().get_size());
+    update<field_subtract>(e.self());
   }
   void operator*=(std::complex<double> a) {
     std::complex<double> *p1 = data + offset;
@@ -162,30 +136,14 @@ public:
       p1[i] *= a;
     }
   }
-  std::complex<double> sum() const {
-    const std::complex<double> *p1 = data + offset;
-    std::complex<double> out = 0;
-    for (int i=0; i<size; i++) {
-      out += p1[i];
-    }
-    return out;
-  }
-  std::complex<double> dot(const ComplexVector &a) const {
-    assert(a.size == size);
-    std::complex<double> out = 0;
-    const std::complex<double> *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out += p1[i]*p2[i];
-    }
-    return out;
-  }
-  std::complex<double> norm() const {
-    std::complex<double> out = 0;
-    const std::complex<double> *p1 = data + offset;
-    for (int i=0; i<size; i++) {
-      out += p1[i]*p1[i];
-    }
-    return sqrt(out);
+
+  // The following are what make a ComplexVector a FieldExpression.
+  typedef std::complex<double> value_type;
+  std::complex<double> value(int i) const { return data[offset + i]; }
+  std::complex<double> value_or_zero(int i) const { return data[offset + i]; }
+  bool has_empty_operand() const { return size == 0; }
+  bool aliases(const std::complex<double> *d, int o, int sz) const {
+    return d == data && o != offset && o < offset + size && offset < o + sz;
   }
   int get_size() const {
     return size;
@@ -238,19 +196,22 @@ public:
   }
 
 private:
+  template <typename Op, typename E>
+  void update(const E &x) {
+    if (x.aliases(data, offset, size)) {
+      const ComplexVector result(x); // work from a copy, since x overlaps us
+      evaluate_field<Op>(data + offset, result);
+    } else {
+      evaluate_field<Op>(data + offset, x);
+    }
+  }
   int size, offset;
   std::complex<double> *data;
   int *references_count; // counts how many objects refer to the data.
   friend Vector ifft(int Nx, int Ny, int Nz, double dV, ComplexVector f);
   friend ComplexVector fft(int Nx, int Ny, int Nz, double dV, Vector f);
+  friend ComplexVector slab_fft(int Nx, int Ny, int Nz, double dV, const Vector &f);
+  friend Vector slab_ifft(int Nx, int Ny, int Nz, double dV, const ComplexVector &f);
+  friend void ifft_many(int Nx, int Ny, int Nz, double dV, int howmany,
+                        const ComplexVector *const in[], Vector *const out[]);
 };
-
-inline ComplexVector operator*(std::complex<double> a, const ComplexVector &b) {
-  const int sz = b.size;
-  ComplexVector out(sz);
-  const std::complex<double> *p2 = b.data + b.offset;
-  for (int i=0; i<sz; i++) {
-    out.data[i] = a*p2[i];
-  }
-  return out;
-}
@@ -0,0 +1,248 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <cassert>
+#include <complex>
+#include <math.h>
+#include <type_traits>
+
+// Arithmetic on a Vector or ComplexVector (e.g. -pg + beta*direction)
+// doesn't compute anything right away.  Instead it builds a small
+// FieldExpression object describing the computation, which is only
+// carried out when the expression is assigned to a Vector (or added
+// to one with +=), or reduced with sum, dot or norm.  Then the whole
+// chain of operations is done in a single loop, which streams through
+// memory once and needs no temporary arrays.  Each element is computed
+// with the same operations in the same order as when every operation
+// created its own array.  That doesn't make the results bitwise
+// identical, though: in one fused loop the compiler is free to
+// contract a multiply and an add into a single rounding (as it does
+// with -march=native), so elements and especially sums, dot products
+// and norms may differ in their last bits, about 1e-14 of the
+// magnitude of the terms in a reduction.
+//
+// An expression refers to the Vectors in it without adding to their
+// reference counts, so it must be used within the statement that
+// creates it.  Don't store one in an auto variable; assign it to a
+// Vector instead.
+//
+// As before, an empty vector in a sum or difference acts like a zero
+// vector.  Since that is rare (it happens in the first iteration of a
+// conjugate-gradient minimization), we check for empty operands once
+// up front, and only then use the slower value_or_zero.  One thing
+// has changed: assigning a + empty (or empty + a) to an empty Vector
+// now gives it a fresh copy of a, where it used to share a's storage,
+// so writing to the result no longer changes a.
+
+class Vector;
+class ComplexVector;
+
+template <typename E> struct empty_as_zero;
+
+// field_sum_of and field_dot_of do the loops for reductions.
+template <typename T, typename A>
+T field_sum_of(const A &a, int n) {
+  T out = 0;
+  for (int i=0; i<n; i++) out += a.value(i);
+  return out;
+}
+
+template <typename T, typename A, typename B>
+T field_dot_of(const A &a, const B &b, int n) {
+  T out = 0;
+  for (int i=0; i<n; i++) out += a.value(i)*b.value(i);
+  return out;
+}
+
+template <typename E>
+struct FieldExpression {
+  const E &self() const { return static_cast<const E &>(*this); }
+
+  // The default template arguments below are just to put off looking
+  // at E until it is complete.
+  template <typename G = E>
+  typename G::value_type operator[](int i) const {
+    assert(i >= 0 && i < self().get_size());
+    return self().has_empty_operand() ? self().value_or_zero(i) : self().value(i);
+  }
+  template <typename G = E>
+  typename G::value_type sum() const {
+    typedef typename G::value_type T;
+    const E &a = self();
+    if (a.has_empty_operand()) return field_sum_of<T>(empty_as_zero<E>(a), a.get_size());
+    return field_sum_of<T>(a, a.get_size());
+  }
+  template <typename F, typename G = E>
+  typename G::value_type dot(const FieldExpression<F> &other) const {
+    typedef typename G::value_type T;
+    const E &a = self();
+    const F &b = other.self();
+    assert(a.get_size() == b.get_size());
+    const int n = a.get_size();
+    if (a.has_empty_operand()) {
+      if (b.has_empty_operand()) {
+        return field_dot_of<T>(empty_as_zero<E>(a), empty_as_zero<F>(b), n);
+      }
+      return field_dot_of<T>(empty_as_zero<E>(a), b, n);
+    }
+    if (b.has_empty_operand()) return field_dot_of<T>(a, empty_as_zero<F>(b), n);
+    return field_dot_of<T>(a, b, n);
+  }
+  template <typename G = E>
+  typename G::value_type norm() const {
+    using std::sqrt;
+    typedef typename G::value_type T;
+    const E &a = self();
+    const int n = a.get_size();
+    if (a.has_empty_operand()) {
+      return sqrt(field_dot_of<T>(empty_as_zero<E>(a), empty_as_zero<E>(a), n));
+    }
+    return sqrt(field_dot_of<T>(a, a, n));
+  }
+};
+
+// empty_as_zero evaluates an expression that has an empty operand.
+template <typename E>
+struct empty_as_zero {
+  explicit empty_as_zero(const E &x) : e(x) {}
+  typename E::value_type value(int i) const { return e.value_or_zero(i); }
+  const E &e;
+};
+
+// Vectors are held by reference within an expression, and everything
+// else (which is small) by value.
+template <typename E> struct field_operand { typedef const E type; };
+template <> struct field_operand<Vector> { typedef const Vector &type; };
+template <> struct field_operand<ComplexVector> { typedef const ComplexVector &type; };
+
+template <typename A, typename B>
+struct field_sum : public FieldExpression< field_sum<A,B> > {
+  typedef typename A::value_type value_type;
+  field_sum(const A &x, const B &y) : a(x), b(y) {
+    assert(!a.get_size() || !b.get_size() || a.get_size() == b.get_size());
+  }
+  int get_size() const { return a.get_size() ? a.get_size() : b.get_size(); }
+  bool has_empty_operand() const { return a.has_empty_operand() || b.has_empty_operand(); }
+  bool aliases(const value_type *data, int offset, int size) const {
+    return a.aliases(data, offset, size) || b.aliases(data, offset, size);
+  }
+  value_type value(int i) const { return a.value(i) + b.value(i); }
+  value_type value_or_zero(int i) const {
+    if (!a.get_size()) return b.value_or_zero(i);
+    if (!b.get_size()) return a.value_or_zero(i);
+    return a.value_or_zero(i) + b.value_or_zero(i);
+  }
+  typename field_operand<A>::type a;
+  typename field_operand<B>::type b;
+};
+
+template <typename A, typename B>
+struct field_difference : public FieldExpression< field_difference<A,B> > {
+  typedef typename A::value_type value_type;
+  field_difference(const A &x, const B &y) : a(x), b(y) {
+    assert(!a.get_size() || !b.get_size() || a.get_size() == b.get_size());
+  }
+  int get_size() const { return a.get_size() ? a.get_size() : b.get_size(); }
+  bool has_empty_operand() const { return a.has_empty_operand() || b.has_empty_operand(); }
+  bool aliases(const value_type *data, int offset, int size) const {
+    return a.aliases(data, offset, size) || b.aliases(data, offset, size);
+  }
+  value_type value(int i) const { return a.value(i) - b.value(i); }
+  value_type value_or_zero(int i) const {
+    if (!a.get_size()) return -b.value_or_zero(i);
+    if (!b.get_size()) return a.value_or_zero(i);
+    return a.value_or_zero(i) - b.value_or_zero(i);
+  }
+  typename field_operand<A>::type a;
+  typename field_operand<B>::type b;
+};
+
+// FIELD_UNARY defines the operations that act on each element of a
+// single field, possibly along with a scalar.
+#define FIELD_UNARY(name, expression)                                   \
+  template <typename A>                                                 \
+  struct name : public FieldExpression< name<A> > {                     \
+    typedef typename A::value_type value_type;                          \
+    name(const A &x, value_type y) : a(x), s(y) {}                      \
+    int get_size() const { return a.get_size(); }                       \
+    bool has_empty_operand() const { return a.has_empty_operand(); }    \
+    bool aliases(const value_type *data, int offset, int size) const {  \
+      return a.aliases(data, offset, size);                             \
+    }                                                                   \
+    value_type value(int i) const {                                     \
+      const value_type x = a.value(i);                                  \
+      return expression;                                                \
+    }                                                                   \
+    value_type value_or_zero(int i) const {                             \
+      const value_type x = a.value_or_zero(i);                          \
+      return expression;                                                \
+    }                                                                   \
+    typename field_operand<A>::type a;                                  \
+    const value_type s;                                                 \
+  }
+
+FIELD_UNARY(field_negative, -x);
+FIELD_UNARY(field_scaled, s*x);
+FIELD_UNARY(field_divided, x/s);
+FIELD_UNARY(field_shifted, x + s);
+
+#undef FIELD_UNARY
+
+template <typename A, typename B>
+field_sum<A,B> operator+(const FieldExpression<A> &a, const FieldExpression<B> &b) {
+  static_assert(std::is_same<typename A::value_type, typename B::value_type>::value,
+                "cannot add a Vector to a ComplexVector");
+  return field_sum<A,B>(a.self(), b.self());
+}
+template <typename A, typename B>
+field_difference<A,B> operator-(const FieldExpression<A> &a, const FieldExpression<B> &b) {
+  static_assert(std::is_same<typename A::value_type, typename B::value_type>::value,
+                "cannot subtract a Vector from a ComplexVector");
+  return field_difference<A,B>(a.self(), b.self());
+}
+template <typename A>
+field_negative<A> operator-(const FieldExpression<A> &a) {
+  return field_negative<A>(a.self(), 0);
+}
+template <typename A>
+field_scaled<A> operator*(typename A::value_type s, const FieldExpression<A> &a) {
+  return field_scaled<A>(a.self(), s);
+}
+template <typename A>
+field_scaled<A> operator*(const FieldExpression<A> &a, typename A::value_type s) {
+  return field_scaled<A>(a.self(), s);
+}
+template <typename A>
+field_divided<A> operator/(const FieldExpression<A> &a, typename A::value_type s) {
+  return field_divided<A>(a.self(), s);
+}
+template <typename A>
+field_shifted<A> operator+(const FieldExpression<A> &a, typename A::value_type s) {
+  return field_shifted<A>(a.self(), s);
+}
+
+// field_assign and friends say what evaluate_field does with each
+// element of the expression.
+struct field_assign {
+  template <typename T> static void apply(T &x, const T &y) { x = y; }
+};
+struct field_add {
+  template <typename T> static void apply(T &x, const T &y) { x += y; }
+};
+struct field_subtract {
+  template <typename T> static void apply(T &x, const T &y) { x -= y; }
+};
+
+// evaluate_field does the actual work of an expression, putting the
+// results in out, which must not overlap with the data of any operand
+// (other than by being the very same elements).
+template <typename Op, typename E>
+void evaluate_field(typename E::value_type *out, const E &e) {
+  const int n = e.get_size();
+  if (e.has_empty_operand()) {
+    for (int i=0; i<n; i++) Op::apply(out[i], e.value_or_zero(i));
+  } else {
+    for (int i=0; i<n; i++) Op::apply(out[i], e.value(i));
+  }
+}
@@ -0,0 +1,165 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "profiling.h"
+
+// FieldStorage handles the memory allocation for Vector and
+// ComplexVector.  Ordinarily this just means the heap, but for grids
+// that are too large to fit in memory, we can instead back large
+// arrays by a scratch file, which the kernel pages in and out as
+// needed.  Our pointwise loops stream linearly through memory, so the
+// kernel's readahead (which we encourage with MADV_SEQUENTIAL) keeps
+// the slowdown predictable.  An FFT can't stream like that, so fft
+// and ifft transform file-backed fields a slab of planes at a time
+// (see FieldSlabs below, and slab_fft in Vector.h).
+
+// To enable file-backed storage, either set the environment variable
+// DEFT_SCRATCH_DIR, or call set_field_scratch_directory.  Only arrays
+// of at least field_scratch_min_bytes() are put in the scratch
+// directory, so small vectors stay fast.
+
+inline const char *&field_scratch_directory() {
+  static const char *dir = getenv("DEFT_SCRATCH_DIR");
+  return dir;
+}
+
+inline long &field_scratch_min_bytes() {
+  static long min_bytes = 16*1024*1024;
+  return min_bytes;
+}
+
+inline void set_field_scratch_directory(const char *dir, long min_bytes = 16*1024*1024) {
+  field_scratch_directory() = dir;
+  field_scratch_min_bytes() = min_bytes;
+}
+
+// Every allocation starts with a small header, which records how the
+// memory was obtained, so that whichever Vector (or slice) happens to
+// be last to let go of the data can free it properly.
+struct FieldStorageHeader {
+  size_t total_bytes;
+  bool is_mapped;
+};
+const size_t field_header_bytes = 64; // keeps the data nicely aligned
+
+inline void *allocate_field(size_t bytes) {
+  const size_t total = bytes + field_header_bytes;
+  char *mem = 0;
+  bool is_mapped = false;
+  const char *dir = field_scratch_directory();
+  if (dir && long(bytes) >= field_scratch_min_bytes()) {
+    const size_t len = strlen(dir) + 32;
+    char *fname = new char[len];
+    snprintf(fname, len, "%s/deft-field-XXXXXX", dir);
+    const int fd = mkstemp(fname);
+    if (fd >= 0) {
+      unlink(fname); // the file will vanish once we unmap it
+      if (ftruncate(fd, total) == 0) {
+        void *p = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+          madvise(p, total, MADV_SEQUENTIAL);
+          mem = (char *)p;
+          is_mapped = true;
+        }
+      }
+      close(fd);
+    }
+    if (!mem) printf("Unable to create scratch file in %s, using memory instead.\n", dir);
+    delete[] fname;
+  }
+  if (!mem) {
+    // calloc gives us fresh zeroed pages for large arrays, which is
+    // what new[] gave ComplexVector.
+    mem = (char *)calloc(total, 1);
+    assert(mem);
+  }
+  FieldStorageHeader *h = (FieldStorageHeader *)mem;
+  h->total_bytes = total;
+  h->is_mapped = is_mapped;
+  profile_scope::count_allocation(total);
+  return mem + field_header_bytes;
+}
+
+inline void free_field(void *data) {
+  if (!data) return;
+  char *mem = (char *)data - field_header_bytes;
+  FieldStorageHeader *h = (FieldStorageHeader *)mem;
+  profile_scope::count_free(h->total_bytes);
+  if (h->is_mapped) munmap(mem, h->total_bytes);
+  else ::free(mem);
+}
+
+// field_is_mapped tells whether data (as returned by allocate_field)
+// lives in a scratch file, in which case fft and ifft work through it
+// a slab at a time (see slab_fft in Vector.h).
+inline bool field_is_mapped(const void *data) {
+  if (!data) return false;
+  return ((const FieldStorageHeader *)((const char *)data - field_header_bytes))->is_mapped;
+}
+
+// field_slab_bytes is roughly how much of a file-backed field we want
+// to have in memory at once.
+inline long &field_slab_bytes() {
+  static long slab_bytes = 64*1024*1024;
+  return slab_bytes;
+}
+
+// FieldSlabs walks through an array of num_planes planes of
+// plane_bytes each (such as the Ny*Nz values at each x of a grid), a
+// slab of several planes at a time.  When the array is file-backed,
+// starting on a slab asks the kernel to read ahead the next one, and
+// finishing it lets the kernel write it back and drop it, so only a
+// couple of slabs need to be in memory at once.  For ordinary memory
+// this is just bookkeeping.
+class FieldSlabs {
+public:
+  // field is the start of the allocation (for Vector, its data rather
+  // than data + offset), which tells us whether it is file-backed.
+  // Pass planes_per_slab to split two arrays the same way.
+  FieldSlabs(const void *field, void *first, int num_planes, size_t plane_bytes,
+             int planes_per_slab = 0)
+    : start((char *)first), planes(num_planes), bytes_per_plane(plane_bytes),
+      is_mapped(field_is_mapped(field)) {
+    per_slab = planes_per_slab ? planes_per_slab : int(field_slab_bytes()/long(plane_bytes));
+    if (per_slab < 1) per_slab = 1;
+    if (per_slab > planes) per_slab = planes;
+  }
+  int planes_per_slab() const { return per_slab; }
+  int num_slabs() const { return (planes + per_slab - 1)/per_slab; }
+  int first_plane(int s) const { return s*per_slab; }
+  int planes_in(int s) const {
+    return (s == num_slabs() - 1) ? planes - first_plane(s) : per_slab;
+  }
+  char *begin(int s) const {
+    if (s + 1 < num_slabs()) advise(s + 1, MADV_WILLNEED);
+    return start + first_plane(s)*bytes_per_plane;
+  }
+  void finish(int s) const {
+    advise(s, MADV_DONTNEED);
+  }
+private:
+  // We can only advise the kernel about whole pages, so we stick to
+  // the pages that lie entirely within slab s.
+  void advise(int s, int advice) const {
+    if (!is_mapped) return;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t lo = size_t(start + first_plane(s)*bytes_per_plane);
+    size_t hi = lo + planes_in(s)*bytes_per_plane;
+    lo = (lo + page - 1)/page*page;
+    hi = hi/page*page;
+    // A shared file mapping keeps its contents when we drop its
+    // pages, so MADV_DONTNEED only costs us a later read.
+    if (hi > lo) madvise((void *)lo, hi - lo, advice);
+  }
+  char *start;
+  int planes, per_slab;
+  size_t bytes_per_plane;
+  bool is_mapped;
+};
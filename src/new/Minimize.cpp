@@ -7,6 +7,28 @@ inline bool better(double a, double b) {
 }
 
 bool Minimize::improve_energy(Verbosity v) {
+  profile_scope profile("Minimize::improve_energy");
+  trace_span trace("iteration", "minimize");
+  const bool keep_going = improve_energy_at_current_precision(v);
+  if (in_single_precision && (!keep_going || last_gradnorm < single_precision_gradnorm)) {
+    if (v >= verbose) {
+      printf("Switching to double precision FFTs with |grad| = %g\n", last_gradnorm);
+      fflush(stdout);
+    }
+    in_single_precision = false;
+    fft_in_single_precision() = false;
+    invalidate_cache();
+    // Restart the conjugate gradient and forget the last energy
+    // change, since both were computed with the less accurate FFTs.
+    oldgradsqr = 0;
+    deltaE = 0;
+    forget_anderson_history();
+    return true;
+  }
+  return keep_going;
+}
+
+bool Minimize::improve_energy_at_current_precision(Verbosity v) {
   iter++;
   if (iter >= maxiter) {
     if (v >= verbose) {
@@ -28,6 +50,9 @@ bool Minimize::improve_energy(Verbosity v) {
     }
     return false;
   }
+  if (anderson_depth > 0 && improve_energy_by_anderson_mixing(E0, v)) {
+    return keep_going(E0, old_deltaE, v);
+  }
   //f->run_finite_difference_test("functional");
   double gdotd;
   {
@@ -42,8 +67,9 @@ bool Minimize::improve_energy(Verbosity v) {
     // Note that we could save some memory by using Fletcher-Reeves, and
     // it seems worth implementing that as an option for
     // memory-constrained problems (then we wouldn't need to store oldgrad).
+    last_gradnorm = g.norm();
     if (v >= min_details) {
-      printf("\t\tnorm of gradient is %g\n", g.norm());
+      printf("\t\tnorm of gradient is %g\n", last_gradnorm);
       //printf("\t\toldgrad size is %d\n", oldgrad.get_size());
       //printf("\t\tnorm(g - oldgrad) is %g\n", (g-oldgrad).norm());
     }
@@ -65,6 +91,7 @@ bool Minimize::improve_energy(Verbosity v) {
     // Now we will do the line minimization... this is a bit
     // complicated.  We want to use as few steps as possible, but also
     // want to make sure we improve the energy at least a little bit.
+    trace_span trace("line search", "minimize");
     //if (v >= min_details) printf("\t\tInitial stepsize is %g\n", step);
   
     const double slope = -gdotd;
@@ -258,7 +285,79 @@ bool Minimize::improve_energy(Verbosity v) {
       printf("\t\tpgrad*direction = %g\n", pgrad().dot(direction)/gdotd);
     print_info("");
   }
+  return keep_going(E0, old_deltaE, v);
+}
+
+bool Minimize::improve_energy_by_anderson_mixing(double E0, Verbosity v) {
+  trace_span trace("anderson mixing", "minimize");
+  // The residual of the Euler-Lagrange equation is (up to a constant
+  // factor) just minus the preconditioned gradient.
+  const Vector r = -pgrad(v);
+  invalidate_cache();
+  if (anderson_residual.get_size()) {
+    anderson_dr.push_back(r - anderson_residual);
+    anderson_dx.push_back(anderson_last_step);
+    if (int(anderson_dr.size()) > anderson_depth) {
+      // We free each Vector before assigning it, so it will share the
+      // next one's data rather than copying it.
+      for (int j=0; j<anderson_depth; j++) {
+        anderson_dr[j].free();
+        anderson_dr[j] = anderson_dr[j+1];
+        anderson_dx[j].free();
+        anderson_dx[j] = anderson_dx[j+1];
+      }
+      anderson_dr.pop_back();
+      anderson_dx.pop_back();
+    }
+  }
+  anderson_residual.free();
+  anderson_residual = r;
+
+  // Find the combination of the recent changes in the residual that
+  // best cancels the current residual, and step as though we had
+  // taken those changes back.
+  const int m = anderson_dr.size();
+  std::vector<double> overlaps(m*m + 1), gamma(m + 1);
+  for (int i=0; i<m; i++) {
+    for (int j=0; j<=i; j++) {
+      overlaps[i*m+j] = overlaps[j*m+i] = anderson_dr[i].dot(anderson_dr[j]);
+    }
+    gamma[i] = anderson_dr[i].dot(r);
+  }
+  anderson_coefficients(m, &overlaps[0], &gamma[0]);
+  Vector step = anderson_mixing*r;
+  for (int j=0; j<m; j++) {
+    step -= gamma[j]*anderson_dx[j];
+    step -= (gamma[j]*anderson_mixing)*anderson_dr[j];
+  }
+  *f += step;
+  if (energy(v) <= E0) { // which is false for a NaN
+    if (v >= verbose) {
+      printf("\t\tAnderson step with %d previous steps lowered the energy by %g\n",
+             m, E0 - energy(v));
+    }
+    anderson_last_step.free();
+    anderson_last_step = step;
+    anderson_mixing = min(1.1*anderson_mixing, anderson_step);
+    return true;
+  }
+  if (v >= verbose) {
+    printf("\t\tAnderson step with %d previous steps raised the energy by %g, so trying conjugate gradient\n",
+           m, energy(v) - E0);
+  }
+  invalidate_cache();
+  *f -= step;
+  forget_anderson_history();
+  // If even a plain Picard step went uphill, it was too big.
+  // Otherwise the history was leading us astray, and forgetting it is
+  // enough.
+  if (m == 0) anderson_mixing *= 0.5;
+  anderson_fallbacks++;
+  oldgradsqr = 0; // any conjugate gradient direction we had is out of date
+  return false;
+}
 
+bool Minimize::keep_going(double E0, double old_deltaE, Verbosity v) {
   // At this point, we start work on estimating how close we are to
   // being adequately converged.
   const double newE = energy(v);
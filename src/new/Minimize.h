@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
+#include <vector>
 
 const Verbosity min_details = chatty;
 
@@ -38,16 +39,31 @@ public:
     dEdn = 0;
     log_dEdn_ratio_average = 0;
     error_estimate = 0;
+
+    single_precision_gradnorm = 0;
+    in_single_precision = false;
+    last_gradnorm = 0;
+
+    anderson_depth = 0;
+    anderson_step = 0;
+    anderson_mixing = 0;
+    anderson_fallbacks = 0;
   }
   ~Minimize() {
     invalidate_cache();
+    if (in_single_precision) fft_in_single_precision() = false;
   }
   void minimize(NewFunctional *newf) {
     f = newf;
     iter = 0;
     num_energy_calcs = 0;
     num_grad_calcs = 0;
+    in_single_precision = single_precision_gradnorm > 0;
+    fft_in_single_precision() = in_single_precision;
     invalidate_cache();
+    forget_anderson_history();
+    anderson_mixing = anderson_step;
+    anderson_fallbacks = 0;
   }
 
   // The following allow you to configure the algorithm used by the
@@ -79,6 +95,44 @@ public:
   void check_conjugacy(bool u) {
     do_check_conjugacy = u;
   }
+  // set_single_precision_until makes the minimizer do its FFTs in
+  // single precision until the norm of the gradient falls below
+  // gradnorm (or until it would otherwise stop), after which it
+  // switches to double precision for the rest of the minimization, so
+  // the final energy is unaffected.  A gradnorm of zero disables this.
+  void set_single_precision_until(double gradnorm) {
+    single_precision_gradnorm = gradnorm;
+    in_single_precision = gradnorm > 0;
+    fft_in_single_precision() = in_single_precision;
+    invalidate_cache();
+  }
+
+  // set_anderson_mixing makes the minimizer solve the Euler-Lagrange
+  // equation by Anderson-accelerated Picard iteration, rather than by
+  // conjugate gradient.  Each Picard step moves the data by -step
+  // times the preconditioned gradient (so you will want to turn on
+  // preconditioning), which for a functional of Veff (whose
+  // preconditioner is n) is -dV/kT times dF/dn, so a step of
+  // kT/dV would be undamped Picard iteration, and a tenth of that is a
+  // safe place to start.  The last depth steps are mixed to
+  // extrapolate towards the solution, at the cost of storing 2*depth
+  // extra copies of the data.  Whenever a step fails to lower the
+  // energy, we halve the step, forget the history and take a
+  // conjugate gradient step instead.  A depth of zero turns this off.
+  void set_anderson_mixing(int depth, double step) {
+    anderson_depth = depth;
+    anderson_step = step;
+    anderson_mixing = step;
+    forget_anderson_history();
+  }
+  // get_fallback_count tells how many times Anderson mixing has
+  // fallen back to conjugate gradient.
+  int get_fallback_count() const {
+    return anderson_fallbacks;
+  }
+  int get_grad_count() const {
+    return num_grad_calcs;
+  }
 
   // improve_energy returns false if the energy is fully converged
   // (i.e. it didn't improve), and there is no reason to call this
@@ -96,7 +150,11 @@ public:
     if (last_energy == 0) {
       const clock_t start = clock();
 
-      last_energy = new double(f->energy());
+      {
+        trace_span trace("energy", "minimize");
+        last_energy = new double(f->energy());
+      }
+      trace_counter("energy", *last_energy, "minimize");
       if (v >= louder(min_details)) { // we need to get really paranoid before we print each energy...
         const clock_t end = clock();
         if (end > start + 10) {
@@ -117,7 +175,10 @@ public:
     if (!last_grad.get_size()) {
       /* We need to compute the gradient because we don't already have its value cached. */
       const clock_t start = clock();
-      last_grad = f->grad();
+      {
+        trace_span trace("gradient", "minimize");
+        last_grad = f->grad();
+      }
       if (v >= louder(min_details)) { // we need to get really paranoid before we print each grad...
         const clock_t end = clock();
         if (end > start + 10) {
@@ -138,6 +199,7 @@ public:
       if (use_preconditioning && f->have_preconditioner()) {
         invalidate_cache();
         const clock_t start = clock();
+        trace_span trace("energy, gradient and preconditioner", "minimize");
         EnergyGradAndPrecond foo = f->energy_grad_and_precond();
         if (v >= louder(min_details)) { // we need to get really paranoid before we print each energy...
           const clock_t end = clock();
@@ -154,6 +216,7 @@ public:
         num_energy_calcs++;
         num_grad_calcs++;
         last_energy = new double(foo.energy);
+        trace_counter("energy", foo.energy, "minimize");
         last_grad = foo.grad;
         last_pgrad = foo.precond;
       } else {
@@ -177,6 +240,21 @@ public:
     return step;
   }
 private:
+  bool improve_energy_at_current_precision(Verbosity v);
+  // improve_energy_by_anderson_mixing takes one Anderson step from
+  // energy E0, and returns false (having undone it) if that didn't
+  // lower the energy.
+  bool improve_energy_by_anderson_mixing(double E0, Verbosity v);
+  void forget_anderson_history() {
+    anderson_residual.free();
+    anderson_last_step.free();
+    anderson_dr.clear();
+    anderson_dx.clear();
+  }
+  // keep_going decides whether we have converged, after an iteration
+  // that started with energy E0.
+  bool keep_going(double E0, double old_deltaE, Verbosity v);
+
   NewFunctional *f;
   int iter, maxiter, miniter;
 
@@ -196,4 +274,12 @@ private:
   double precision, relative_precision, deltaE, dEdn, log_dEdn_ratio_average;
   double error_estimate;
   double known_true_energy; // used for checking how well the minimization is working
+
+  double single_precision_gradnorm, last_gradnorm;
+  bool in_single_precision;
+
+  int anderson_depth, anderson_fallbacks;
+  double anderson_step, anderson_mixing; // the latter is halved on failure
+  Vector anderson_residual, anderson_last_step;
+  std::vector<Vector> anderson_dr, anderson_dx; // the changes in residual and data
 };
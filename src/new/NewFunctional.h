@@ -4,6 +4,7 @@
 
 #include "Vector.h"
 #include "Verbosity.h"
+#include "profiling.h"
 
 struct EnergyGradAndPrecond {
   double energy;
@@ -30,13 +31,16 @@ public:
     data = Vector();
   }
   NewFunctional(const NewFunctional &o) : data(o.data) {}
+  virtual ~NewFunctional() {}
   void operator=(const NewFunctional &o) {
     data = o.data;
   }
-  void operator+=(const Vector &o) {
+  template <typename E>
+  void operator+=(const FieldExpression<E> &o) {
     data += o;
   }
-  void operator-=(const Vector &o) {
+  template <typename E>
+  void operator-=(const FieldExpression<E> &o) {
     data -= o;
   }
   double operator*(const Vector &o) {
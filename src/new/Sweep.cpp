@@ -0,0 +1,216 @@
+#include "Sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdarg.h>
+#include <thread>
+
+// The mutex protecting a sweep's bookkeeping.  Vector reference
+// counts are not atomic, so every Vector that is seen by more than
+// one thread is copied rather than shared, and only while holding
+// this lock.
+static std::mutex sweep_mutex;
+
+static Vector copy_of(const Vector &v) {
+  Vector out(v.get_size());
+  out = v;
+  return out;
+}
+
+Sweep::Sweep(const char *pnames, const char *rnames)
+  : param_names(pnames), result_names(rnames), buffer_output(false) {}
+
+void Sweep::add_point(const std::vector<double> &p) {
+  params.push_back(p);
+  results.push_back(std::vector<double>());
+  started.push_back(false);
+  converged.push_back(Vector());
+  converged_Nx.push_back(0);
+  converged_Ny.push_back(0);
+  converged_Nz.push_back(0);
+}
+
+double Sweep::distance(int i, int j) const {
+  double dist = 0;
+  for (int k=0; k<int(params[i].size()); k++) {
+    const double d = (params[i][k] - params[j][k])/param_scale[k];
+    dist += d*d;
+  }
+  return sqrt(dist);
+}
+
+void Sweep::run(SweepWorker *(*make_worker)(), int num_threads) {
+  if (num_points() == 0) return;
+  const int num_params = params[0].size();
+  param_scale.resize(num_params);
+  for (int k=0; k<num_params; k++) {
+    double lo = params[0][k], hi = params[0][k];
+    for (int i=0; i<num_points(); i++) {
+      if (params[i][k] < lo) lo = params[i][k];
+      if (params[i][k] > hi) hi = params[i][k];
+    }
+    param_scale[k] = (hi > lo) ? hi - lo : 1;
+  }
+
+  if (num_threads <= 0) num_threads = std::thread::hardware_concurrency();
+  if (num_threads <= 0) num_threads = 1;
+  if (num_threads > num_points()) num_threads = num_points();
+  buffer_output = num_threads > 1;
+  printf("Running a sweep of %d state points on %d threads\n", num_points(), num_threads);
+  fflush(stdout);
+
+  std::vector<std::thread> threads;
+  for (int t=0; t<num_threads; t++) {
+    threads.push_back(std::thread([this, make_worker]() {
+          SweepWorker *w;
+          {
+            std::lock_guard<std::mutex> lock(sweep_mutex);
+            w = make_worker();
+            w->buffer_output = buffer_output;
+          }
+          work(w);
+          delete w;
+        }));
+  }
+  for (int t=0; t<num_threads; t++) threads[t].join();
+}
+
+void Sweep::work(SweepWorker *w) {
+  while (true) {
+    int i = -1;
+    std::vector<double> p;
+    {
+      std::lock_guard<std::mutex> lock(sweep_mutex);
+      // We prefer the point that is closest to one that has already
+      // converged, so that we get the best warm starts.
+      double best = HUGE_VAL;
+      for (int j=0; j<num_points(); j++) {
+        if (started[j]) continue;
+        if (i < 0) i = j;
+        for (int k=0; k<num_points(); k++) {
+          if (converged[k].get_size() && distance(j, k) < best) {
+            best = distance(j, k);
+            i = j;
+          }
+        }
+      }
+      if (i < 0) return; // we have nothing left to do!
+      started[i] = true;
+      p = params[i];
+    }
+
+    w->set_up(p);
+    {
+      std::lock_guard<std::mutex> lock(sweep_mutex);
+      Vector f = w->field();
+      int Nx, Ny, Nz;
+      w->get_grid(&Nx, &Ny, &Nz);
+      int nearest = -1;
+      for (int k=0; k<num_points(); k++) {
+        if (converged[k].get_size() &&
+            (nearest < 0 || distance(i, k) < distance(i, nearest))) {
+          nearest = k;
+        }
+      }
+      if (nearest >= 0) {
+        if (converged_Nx[nearest] == Nx && converged_Ny[nearest] == Ny &&
+            converged_Nz[nearest] == Nz) {
+          f = converged[nearest];
+        } else {
+          f = resample_periodic(converged[nearest], converged_Nx[nearest],
+                                converged_Ny[nearest], converged_Nz[nearest], Nx, Ny, Nz);
+        }
+      }
+    }
+    std::vector<double> r = w->solve(p);
+
+    std::lock_guard<std::mutex> lock(sweep_mutex);
+    converged[i] = copy_of(w->field());
+    w->get_grid(&converged_Nx[i], &converged_Ny[i], &converged_Nz[i]);
+    results[i] = r;
+    if (w->output.size()) {
+      fputs(w->output.c_str(), stdout);
+      fflush(stdout);
+      w->output.clear();
+    }
+  }
+}
+
+void Sweep::write_table(const char *fname) const {
+  FILE *o = fopen(fname, "w");
+  if (!o) {
+    fprintf(stderr, "error creating file %s\n", fname);
+    exit(1);
+  }
+  fprintf(o, "# %s %s\n", param_names, result_names);
+  for (int i=0; i<num_points(); i++) {
+    for (int k=0; k<int(params[i].size()); k++) fprintf(o, "%.15g\t", params[i][k]);
+    for (int k=0; k<int(results[i].size()); k++) fprintf(o, "\t%.15g", results[i][k]);
+    fprintf(o, "\n");
+  }
+  fclose(o);
+}
+
+void SweepWorker::report(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  char line[1024];
+  va_list again;
+  va_copy(again, args);
+  const int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  std::string message;
+  if (len < int(sizeof(line))) {
+    message = line;
+  } else {
+    std::vector<char> longer(len + 1);
+    vsnprintf(&longer[0], len + 1, format, again);
+    message = &longer[0];
+  }
+  va_end(again);
+  if (buffer_output) {
+    output += message;
+  } else {
+    fputs(message.c_str(), stdout);
+    fflush(stdout);
+  }
+}
+
+static double periodic_index(double x, int N, int *i0, int *i1) {
+  const double fl = floor(x);
+  *i0 = int(fl) % N;
+  if (*i0 < 0) *i0 += N;
+  *i1 = (*i0 + 1) % N;
+  return x - fl;
+}
+
+Vector resample_periodic(const Vector &f, int Nx, int Ny, int Nz,
+                         int newNx, int newNy, int newNz) {
+  assert(f.get_size() == Nx*Ny*Nz);
+  Vector out(newNx*newNy*newNz);
+  for (int x=0; x<newNx; x++) {
+    int x0, x1;
+    const double tx = periodic_index(x*double(Nx)/newNx, Nx, &x0, &x1);
+    for (int y=0; y<newNy; y++) {
+      int y0, y1;
+      const double ty = periodic_index(y*double(Ny)/newNy, Ny, &y0, &y1);
+      for (int z=0; z<newNz; z++) {
+        int z0, z1;
+        const double tz = periodic_index(z*double(Nz)/newNz, Nz, &z0, &z1);
+        // Trilinear interpolation between the eight surrounding points.
+        double v = 0;
+        for (int a=0; a<2; a++) {
+          const int xi = a ? x1 : x0;
+          const double wx = a ? tx : 1 - tx;
+          for (int b=0; b<2; b++) {
+            const int yi = b ? y1 : y0;
+            const double wy = b ? ty : 1 - ty;
+            v += wx*wy*((1 - tz)*f[xi*Ny*Nz + yi*Nz + z0] + tz*f[xi*Ny*Nz + yi*Nz + z1]);
+          }
+        }
+        out[x*newNy*newNz + y*newNz + z] = v;
+      }
+    }
+  }
+  return out;
+}
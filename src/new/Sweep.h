@@ -0,0 +1,93 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include "new/Vector.h"
+#include <string>
+#include <vector>
+
+// A Sweep runs a set of independent minimizations (e.g. a scan over
+// lattice constant, density and temperature) on a pool of threads.
+// Each thread has its own SweepWorker, which owns its functional, so
+// the only state that is shared between threads is the FFTW planner
+// (see fftw_planner_mutex) and the sweep's own bookkeeping.
+
+// Before each state point is solved, the sweep looks for the nearest
+// state point that has already converged, and uses its field as the
+// initial guess, resampled onto the new grid if the grid has changed
+// (as it does when scanning the lattice constant).  Distances are
+// measured in units of the range of each parameter over the whole
+// sweep.
+
+class SweepWorker {
+public:
+  SweepWorker() : buffer_output(false) {}
+  virtual ~SweepWorker() {}
+  // set_up prepares the functional for the given parameters, with
+  // some cold-start initial guess.
+  virtual void set_up(const std::vector<double> &params) = 0;
+  // field returns the part of the functional's input that is being
+  // minimized, which is what we copy when warm-starting.
+  virtual Vector field() = 0;
+  // get_grid gives the dimensions of field(), which is periodic.  The
+  // default is a one-dimensional field.
+  virtual void get_grid(int *Nx, int *Ny, int *Nz) {
+    *Nx = field().get_size();
+    *Ny = *Nz = 1;
+  }
+  // solve does the minimization, and returns the results to be put in
+  // the table.
+  virtual std::vector<double> solve(const std::vector<double> &params) = 0;
+
+  // report prints a message about the current state point.  When a
+  // sweep runs on several threads, each point's messages are saved up
+  // and printed together once it is solved, so they don't get
+  // interleaved with those of other points.
+  void report(const char *format, ...) __attribute__((format(printf, 2, 3)));
+private:
+  friend class Sweep;
+  bool buffer_output;
+  std::string output;
+};
+
+class Sweep {
+public:
+  // The names are whitespace-separated lists, which are used for the
+  // header of the table.
+  Sweep(const char *param_names, const char *result_names);
+
+  void add_point(const std::vector<double> &params);
+  int num_points() const {
+    return int(params.size());
+  }
+
+  // run solves every state point, using num_threads threads (or one
+  // per core if num_threads is zero), each of which gets its own
+  // worker from make_worker.
+  void run(SweepWorker *(*make_worker)(), int num_threads = 0);
+
+  // write_table writes a row for each state point, in the order they
+  // were added.
+  void write_table(const char *fname) const;
+
+private:
+  void work(SweepWorker *w);
+  double distance(int i, int j) const;
+
+  const char *param_names, *result_names;
+  std::vector<std::vector<double> > params, results;
+  std::vector<double> param_scale;
+  std::vector<bool> started;
+  // For each point that has converged, its field and the dimensions
+  // of its grid.
+  std::vector<Vector> converged;
+  std::vector<int> converged_Nx, converged_Ny, converged_Nz;
+  bool buffer_output;
+};
+
+// resample_periodic interpolates a periodic field on an Nx by Ny by
+// Nz grid onto a grid of a different size covering the same cell
+// (i.e. at the same fractional coordinates), which is how we
+// warm-start from a solution with a different lattice constant.
+Vector resample_periodic(const Vector &f, int Nx, int Ny, int Nz,
+                         int newNx, int newNy, int newNz);
@@ -9,6 +9,9 @@
 #include <stdio.h>
 
 #include "ComplexVector.h"
+#include "FieldStorage.h"
+#include "tracing.h"
+#include "fft-sizes.h"
 
 // A Vector is a reference-counted array of doubles.  You need to be
 // careful, because a copy of a Vector (or the use of assignment,
@@ -25,21 +28,21 @@
 // one.  Once again, this allows shared data, hopefully enabling nice
 // code while avoiding bloated memory use.
 
-// Most arithmetic operators are defined on Vectors.  If you come
-// across one that isn't defined, we could probably add its
-// definition.
+// Most arithmetic operators are defined on Vectors, and are evaluated
+// lazily (see FieldExpression.h).  If you come across one that isn't
+// defined, we could probably add its definition.
 
-class Vector {
+class Vector : public FieldExpression<Vector> {
 public:
   Vector() : size(0), offset(0), data(0), references_count(0) {}
-  explicit Vector(int sz) : size(sz), offset(0), data(new double[size]), references_count(new int) {
+  explicit Vector(int sz) : size(sz), offset(0), data((double *)allocate_field(size*sizeof(double))), references_count(new int) {
     *references_count = 1;
   }
   Vector(const Vector &a) : size(a.size), offset(a.offset),
                             data(a.data), references_count(a.references_count) {
-    *references_count += 1;
+    if (references_count) *references_count += 1;
   }
-  Vector(double x, double y, double z) : size(3), offset(0), data(new double[3]), references_count(new int) {
+  Vector(double x, double y, double z) : size(3), offset(0), data((double *)allocate_field(3*sizeof(double))), references_count(new int) {
     *references_count = 1;
     data[0] = x;
     data[1] = y;
@@ -50,7 +53,7 @@ public:
     if (references_count && *references_count) {
       *references_count -= 1;
       if (*references_count == 0) {
-        delete[] data;
+        free_field(data);
         delete references_count;
       }
       references_count = 0;
@@ -103,82 +106,37 @@ public:
     return out;
   }
 
-  // Below are the arithmetic operators.  These should be made fast.
-  Vector operator+(const Vector &a) const {
-    // operator+ treats an empty vector as a zero vector;
-    if (a.size == 0) return *this;
-    if (size == 0) return a;
-    assert(size == a.size);
-    Vector out(size);
-    const double *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p1[i] + p2[i];
-    }
-    return out;
-  }
-  Vector operator+(double a) const {
-    if (size == 0) return *this;
-    Vector out(size);
-    const double *p1 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p1[i] + a;
-    }
-    return out;
-  }
-  Vector operator-(const Vector &a) const {
-    // operator- treats an empty vector as a zero vector;
-    if (a.size == 0) return *this;
-    if (size == 0) return -a;
-    assert(size == a.size);
-    Vector out(size);
-    const double *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p1[i] - p2[i];
-    }
-    return out;
+  // Arithmetic on Vectors builds a FieldExpression (see
+  // FieldExpression.h), which is evaluated here, in a single pass.
+  template <typename E>
+  Vector(const FieldExpression<E> &e) : size(0), offset(0), data(0), references_count(0) {
+    *this = e;
   }
-  Vector operator-() const {
-    Vector out(size);
-    const double *p1 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = -p1[i];
-    }
-    return out;
-  }
-  Vector operator*(double a) const {
-    Vector out(size);
-    const double *p2 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = a*p2[i];
-    }
-    return out;
-  }
-  friend Vector operator*(double a, const Vector &b);
-
-  Vector operator/(double a) const {
-    Vector out(size);
-    const double *p2 = data + offset;
-    for (int i=0; i<size; i++) {
-      out.data[i] = p2[i]/a;
+  template <typename E>
+  void operator=(const FieldExpression<E> &e) {
+    // Like assigning a Vector, assigning an expression to a Vector that
+    // has no data yet gives it a new array holding the result.
+    const E &x = e.self();
+    if (!references_count && x.get_size()) {
+      Vector out(x.get_size());
+      evaluate_field<field_assign>(out.data, x);
+      *this = out;
+    } else if (!references_count) {
+      size = 0;
+    } else {
+      assert(size == x.get_size());
+      update<field_assign>(x);
     }
-    return out;
   }
-
-  void operator+=(const Vector &a) {
-    assert(size == a.size);
-    double *p1 = data + offset;
-    const double *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      p1[i] += p2[i];
-    }
+  template <typename E>
+  void operator+=(const FieldExpression<E> &e) {
+    assert(size == e.self().get_size());
+    update<field_add>(e.self());
   }
-  void operator-=(const Vector &a) {
-    assert(size == a.size);
-    double *p1 = data + offset;
-    const double *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      p1[i] -= p2[i];
-    }
+  template <typename E>
+  void operator-=(const FieldExpression<E> &e) {
+    assert(size == e.self().get_size());
+    update<field_subtract>(e.self());
   }
   void operator*=(double a) {
     double *p1 = data + offset;
@@ -192,30 +150,17 @@ public:
       p1[i] /= a;
     }
   }
-  double sum() const {
-    const double *p1 = data + offset;
-    double out = 0;
-    for (int i=0; i<size; i++) {
-      out += p1[i];
-    }
-    return out;
-  }
-  double dot(const Vector &a) const {
-    assert(a.size == size);
-    double out = 0;
-    const double *p1 = data + offset, *p2 = a.data + a.offset;
-    for (int i=0; i<size; i++) {
-      out += p1[i]*p2[i];
-    }
-    return out;
-  }
-  double norm() const {
-    double out = 0;
-    const double *p1 = data + offset;
-    for (int i=0; i<size; i++) {
-      out += p1[i]*p1[i];
-    }
-    return sqrt(out);
+
+  // The following are what make a Vector a FieldExpression.
+  typedef double value_type;
+  double value(int i) const { return data[offset + i]; }
+  double value_or_zero(int i) const { return data[offset + i]; }
+  bool has_empty_operand() const { return size == 0; }
+  // aliases tells whether we share some, but not exactly the same,
+  // elements as the given part of an array, in which case we can't
+  // be updated one element at a time in place.
+  bool aliases(const double *d, int o, int sz) const {
+    return d == data && o != offset && o < offset + size && offset < o + sz;
   }
   int get_size() const {
     return size;
@@ -307,28 +252,189 @@ public:
     fclose(f);
   }
 private:
+  template <typename Op, typename E>
+  void update(const E &x) {
+    if (x.aliases(data, offset, size)) {
+      const Vector result(x); // work from a copy, since x overlaps us
+      evaluate_field<Op>(data + offset, result);
+    } else {
+      evaluate_field<Op>(data + offset, x);
+    }
+  }
   int size, offset;
   double *data;
   int *references_count; // counts how many objects refer to the data.
   friend Vector ifft(int Nx, int Ny, int Nz, double dV, ComplexVector f);
   friend ComplexVector fft(int Nx, int Ny, int Nz, double dV, Vector f);
+  friend ComplexVector slab_fft(int Nx, int Ny, int Nz, double dV, const Vector &f);
+  friend Vector slab_ifft(int Nx, int Ny, int Nz, double dV, const ComplexVector &f);
+  friend void ifft_many(int Nx, int Ny, int Nz, double dV, int howmany,
+                        const ComplexVector *const in[], Vector *const out[]);
 };
 
-inline Vector operator*(double a, const Vector &b) {
-  const int sz = b.size;
-  Vector out(sz);
-  const double *p2 = b.data + b.offset;
-  for (int i=0; i<sz; i++) {
-    out.data[i] = a*p2[i];
+// When fft_in_single_precision() is true, fft and ifft convert their
+// input to single precision and use fftwf, which roughly halves the
+// time and memory bandwidth spent on FFTs.  The storage of Vector and
+// ComplexVector remains double precision.  This is intended for the
+// early iterations of a minimization, when we are far from the
+// minimum and 1e-7 relative accuracy is more than enough (see
+// Minimize::set_single_precision_until).  The flag is per-thread, so
+// concurrent minimizations (see Sweep.h) don't interfere.
+inline bool &fft_in_single_precision() {
+  static thread_local bool single = false;
+  return single;
+}
+
+// slab_fft and slab_ifft do the same transforms as fft and ifft, for
+// fields that live in a scratch file (see FieldStorage.h).  They
+// first do 2D transforms in y and z of each plane of constant x, a
+// slab of planes at a time, and then 1D transforms along x of blocks
+// of columns, which they gather into memory from every plane.
+// Either way, only about field_slab_bytes() of the field needs to be
+// in memory at once, and we never need an in-memory copy of the
+// whole grid.
+inline void slab_x_transforms(int Nx, int columns, std::complex<double> *in,
+                              std::complex<double> *out, int sign) {
+  trace_span trace("slab x transforms", "fft");
+  int block = int(field_slab_bytes()/(Nx*long(sizeof(fftw_complex))));
+  if (block < 1) block = 1;
+  if (block > columns) block = columns;
+  fftw_complex *buf = (fftw_complex *)fftw_malloc(Nx*block*sizeof(fftw_complex));
+  fftw_plan p = 0;
+  int planned = 0;
+  for (int j=0; j<columns; j+=block) {
+    const int b = std::min(block, columns - j);
+    if (b != planned) {
+      std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+      if (p) fftw_destroy_plan(p);
+      p = fftw_plan_many_dft(1, &Nx, b, buf, 0, b, 1, buf, 0, b, 1, sign, FFTW_MEASURE);
+      planned = b;
+    }
+    for (int x=0; x<Nx; x++) {
+      memcpy(buf + x*b, in + x*long(columns) + j, b*sizeof(fftw_complex));
+    }
+    fftw_execute(p);
+    for (int x=0; x<Nx; x++) {
+      memcpy(out + x*long(columns) + j, buf + x*b, b*sizeof(fftw_complex));
+    }
   }
+  std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+  fftw_destroy_plan(p);
+  fftw_free(buf);
+}
+
+inline ComplexVector slab_fft(int Nx, int Ny, int Nz, double dV, const Vector &f) {
+  trace_span trace("slab_fft", "fft");
+  const int NyNz = Ny*Nz, NyNzOver2 = Ny*(Nz/2 + 1), yz[2] = { Ny, Nz };
+  ComplexVector out(Nx*NyNzOver2);
+  FieldSlabs kslabs(out.data, out.data, Nx, NyNzOver2*sizeof(fftw_complex));
+  FieldSlabs rslabs(f.data, f.data + f.offset, Nx, NyNz*sizeof(double),
+                    kslabs.planes_per_slab());
+  double *r = (double *)fftw_malloc(rslabs.planes_per_slab()*NyNz*sizeof(double));
+  fftw_complex *c =
+    (fftw_complex *)fftw_malloc(kslabs.planes_per_slab()*NyNzOver2*sizeof(fftw_complex));
+  fftw_plan p = 0;
+  int planned = 0;
+  for (int s=0; s<rslabs.num_slabs(); s++) {
+    const int n = rslabs.planes_in(s);
+    if (n != planned) {
+      // Plan before copying in the data, since FFTW_MEASURE trashes it.
+      std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+      if (p) fftw_destroy_plan(p);
+      p = fftw_plan_many_dft_r2c(2, yz, n, r, 0, 1, NyNz, c, 0, 1, NyNzOver2, FFTW_MEASURE);
+      planned = n;
+    }
+    memcpy(r, rslabs.begin(s), n*NyNz*sizeof(double));
+    rslabs.finish(s);
+    fftw_execute(p);
+    memcpy(kslabs.begin(s), c, n*NyNzOver2*sizeof(fftw_complex));
+    kslabs.finish(s);
+  }
+  {
+    std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+    fftw_destroy_plan(p);
+  }
+  fftw_free(r);
+  fftw_free(c);
+  slab_x_transforms(Nx, NyNzOver2, out.data, out.data, FFTW_FORWARD);
+  profile_scope::count_ffts(1);
+  out *= dV;
+  return out;
+}
+
+inline Vector slab_ifft(int Nx, int Ny, int Nz, double dV, const ComplexVector &f) {
+  trace_span trace("slab_ifft", "fft");
+  const int NyNz = Ny*Nz, NyNzOver2 = Ny*(Nz/2 + 1), yz[2] = { Ny, Nz };
+  assert(f.size == Nx*NyNzOver2);
+  // We leave f alone, so the transforms along x go into a scratch
+  // array, which is itself file-backed.
+  ComplexVector k(f.size);
+  slab_x_transforms(Nx, NyNzOver2, f.data + f.offset, k.data, FFTW_BACKWARD);
+  Vector out(Nx*NyNz);
+  FieldSlabs kslabs(k.data, k.data, Nx, NyNzOver2*sizeof(fftw_complex));
+  FieldSlabs rslabs(out.data, out.data, Nx, NyNz*sizeof(double), kslabs.planes_per_slab());
+  fftw_complex *c =
+    (fftw_complex *)fftw_malloc(kslabs.planes_per_slab()*NyNzOver2*sizeof(fftw_complex));
+  double *r = (double *)fftw_malloc(rslabs.planes_per_slab()*NyNz*sizeof(double));
+  const double norm = 1.0/(Nx*NyNz*dV);
+  fftw_plan p = 0;
+  int planned = 0;
+  for (int s=0; s<kslabs.num_slabs(); s++) {
+    const int n = kslabs.planes_in(s);
+    if (n != planned) {
+      std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+      if (p) fftw_destroy_plan(p);
+      p = fftw_plan_many_dft_c2r(2, yz, n, c, 0, 1, NyNzOver2, r, 0, 1, NyNz, FFTW_MEASURE);
+      planned = n;
+    }
+    memcpy(c, kslabs.begin(s), n*NyNzOver2*sizeof(fftw_complex));
+    kslabs.finish(s);
+    fftw_execute(p);
+    double *o = (double *)rslabs.begin(s);
+    for (int i=0; i<n*NyNz; i++) o[i] = norm*r[i];
+    rslabs.finish(s);
+  }
+  {
+    std::lock_guard<std::mutex> planning(fftw_planner_mutex());
+    fftw_destroy_plan(p);
+  }
+  fftw_free(c);
+  fftw_free(r);
+  profile_scope::count_ffts(1);
   return out;
 }
 
 inline ComplexVector fft(int Nx, int Ny, int Nz, double dV, Vector f) {
+  trace_span trace("fft", "fft");
   assert(!(Nx&1)); // We want an even number of grid points in each direction.
   assert(!(Ny&1)); // We want an even number of grid points in each direction.
   assert(!(Nz&1)); // We want an even number of grid points in each direction.
+  if (field_is_mapped(f.data)) return slab_fft(Nx, Ny, Nz, dV, f);
   ComplexVector out(Nx*Ny*(int(Nz)/2 + 1));
+  if (fft_in_single_precision()) {
+    const int NxNyNz = Nx*Ny*Nz, Nk = Nx*Ny*(int(Nz)/2 + 1);
+    float *r = (float *)fftwf_malloc(NxNyNz*sizeof(float));
+    fftwf_complex *c = (fftwf_complex *)fftwf_malloc(Nk*sizeof(fftwf_complex));
+    // We plan before copying in the data, since FFTW_MEASURE trashes
+    // its input.  Our scratch arrays are always aligned the same way,
+    // so we only need to measure once.
+    std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+    fftwf_plan p = fftwf_plan_dft_r2c_3d(Nx, Ny, Nz, r, c, FFTW_WISDOM_ONLY);
+    if (!p) p = fftwf_plan_dft_r2c_3d(Nx, Ny, Nz, r, c, FFTW_MEASURE);
+    planning.unlock();
+    const double *in = f.data + f.offset;
+    for (int i=0; i<NxNyNz; i++) r[i] = in[i];
+    fftwf_execute(p);
+    profile_scope::count_ffts(1);
+    planning.lock();
+    fftwf_destroy_plan(p);
+    planning.unlock();
+    for (int i=0; i<Nk; i++) out.data[i] = std::complex<double>(dV*c[i][0], dV*c[i][1]);
+    fftwf_free(r);
+    fftwf_free(c);
+    return out;
+  }
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
   fftw_plan p = fftw_plan_dft_r2c_3d(Nx, Ny, Nz, (double *)f.data+f.offset, (fftw_complex *)out.data, FFTW_WISDOM_ONLY);
   if (!p) {
     // It seems that fftw has not yet done enough measurement to make
@@ -343,21 +449,54 @@ inline ComplexVector fft(int Nx, int Ny, int Nz, double dV, Vector f) {
     // Now we will create the plan we actually use.
     p = fftw_plan_dft_r2c_3d(Nx, Ny, Nz, (double *)f.data+f.offset, (fftw_complex *)out.data, FFTW_WISDOM_ONLY);
   }
+  planning.unlock();
   fftw_execute(p);
+  profile_scope::count_ffts(1);
+  planning.lock();
   fftw_destroy_plan(p);
+  planning.unlock();
   out *= dV;
   return out;
 }
 
 inline Vector ifft(int Nx, int Ny, int Nz, double dV, ComplexVector f) {
+  trace_span trace("ifft", "fft");
   assert(!(Nx&1)); // We want an even number of grid points in each direction.
   assert(!(Ny&1)); // We want an even number of grid points in each direction.
   assert(!(Nz&1)); // We want an even number of grid points in each direction.
+  if (field_is_mapped(f.data)) return slab_ifft(Nx, Ny, Nz, dV, f);
+  if (fft_in_single_precision()) {
+    const int NxNyNz = Nx*Ny*Nz, Nk = Nx*Ny*(int(Nz)/2 + 1);
+    assert(f.size == Nk);
+    float *r = (float *)fftwf_malloc(NxNyNz*sizeof(float));
+    fftwf_complex *c = (fftwf_complex *)fftwf_malloc(Nk*sizeof(fftwf_complex));
+    std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+    fftwf_plan p = fftwf_plan_dft_c2r_3d(Nx, Ny, Nz, c, r, FFTW_WISDOM_ONLY);
+    if (!p) p = fftwf_plan_dft_c2r_3d(Nx, Ny, Nz, c, r, FFTW_MEASURE);
+    planning.unlock();
+    const std::complex<double> *in = f.data + f.offset;
+    for (int i=0; i<Nk; i++) {
+      c[i][0] = in[i].real();
+      c[i][1] = in[i].imag();
+    }
+    fftwf_execute(p);
+    profile_scope::count_ffts(1);
+    planning.lock();
+    fftwf_destroy_plan(p);
+    planning.unlock();
+    Vector out(NxNyNz);
+    const double norm = 1.0/(NxNyNz*dV);
+    for (int i=0; i<NxNyNz; i++) out.data[i] = norm*r[i];
+    fftwf_free(r);
+    fftwf_free(c);
+    return out;
+  }
   // Allocate a scratch array, since FFTW always overwrites its input
   // when performing a c2r transform.
   fftw_complex *c = (fftw_complex *)fftw_malloc(Nx*Ny*(int(Nz)/2+2)*sizeof(fftw_complex));
   memcpy(c, f.data+f.offset, 2*f.size*sizeof(double)); // faster than manual loop?
   Vector out(Nx*Ny*Nz); // create output vector
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
   fftw_plan p = fftw_plan_dft_c2r_3d(Nx, Ny, Nz, c, (double *)out.data, FFTW_WISDOM_ONLY);
   if (!p) {
     // We need measurements!
@@ -365,9 +504,66 @@ inline Vector ifft(int Nx, int Ny, int Nz, double dV, ComplexVector f) {
     // Now recopy data, which was trashed above
     memcpy(c, f.data+f.offset, 2*f.size*sizeof(double)); // faster than manual loop?
   }
+  planning.unlock();
   fftw_execute(p);
+  profile_scope::count_ffts(1);
+  planning.lock();
   fftw_destroy_plan(p);
+  planning.unlock();
   fftw_free(c);
   out *= 1.0/(Nx*Ny*Nz*dV);
   return out;
 }
+
+// fft_many and ifft_many perform several transforms of the same size
+// at once.  The generated code uses these for vector and tensor
+// weighted densities, which need several independent transforms.
+// Each output is set as if by *out[i] = fft(Nx, Ny, Nz, dV, *in[i]).
+// A single FFTW plan can only batch inputs that are evenly spaced in
+// memory, and copying ours into one array costs more than the plan
+// saves (three 100x98x96 transforms took 1.1 times as long batched),
+// so fft_many does them one at a time.  ifft_many must copy its inputs
+// into scratch anyway, as ifft does, so it batches them (which
+// new-fftinverse times), and an output that has not yet been allocated
+// ends up as a slice of one shared array.
+inline void fft_many(int Nx, int Ny, int Nz, double dV, int howmany,
+                     const Vector *const in[], ComplexVector *const out[]) {
+  trace_span trace("fft_many", "fft");
+  for (int j=0; j<howmany; j++) *out[j] = fft(Nx, Ny, Nz, dV, *in[j]);
+}
+
+inline void ifft_many(int Nx, int Ny, int Nz, double dV, int howmany,
+                      const ComplexVector *const in[], Vector *const out[]) {
+  trace_span trace("ifft_many", "fft");
+  if (fft_in_single_precision() || howmany < 2) {
+    for (int j=0; j<howmany; j++) *out[j] = ifft(Nx, Ny, Nz, dV, *in[j]);
+    return;
+  }
+  assert(!(Nx&1)); // We want an even number of grid points in each direction.
+  assert(!(Ny&1)); // We want an even number of grid points in each direction.
+  assert(!(Nz&1)); // We want an even number of grid points in each direction.
+  const int NxNyNz = Nx*Ny*Nz, Nk = Nx*Ny*(int(Nz)/2 + 1);
+  const int n[3] = { Nx, Ny, Nz };
+  // As in ifft, we need a scratch array because FFTW always
+  // overwrites its input when performing a c2r transform.
+  fftw_complex *c = (fftw_complex *)fftw_malloc(howmany*Nk*sizeof(fftw_complex));
+  Vector r(howmany*NxNyNz);
+  std::unique_lock<std::mutex> planning(fftw_planner_mutex());
+  fftw_plan p = fftw_plan_many_dft_c2r(3, n, howmany, c, 0, 1, Nk,
+                                       r.data, 0, 1, NxNyNz, FFTW_WISDOM_ONLY);
+  if (!p) p = fftw_plan_many_dft_c2r(3, n, howmany, c, 0, 1, Nk,
+                                     r.data, 0, 1, NxNyNz, FFTW_MEASURE);
+  planning.unlock();
+  for (int j=0; j<howmany; j++) {
+    assert(in[j]->size == Nk);
+    memcpy(c + j*Nk, in[j]->data + in[j]->offset, Nk*sizeof(fftw_complex));
+  }
+  fftw_execute(p);
+  profile_scope::count_ffts(howmany);
+  planning.lock();
+  fftw_destroy_plan(p);
+  planning.unlock();
+  fftw_free(c);
+  r *= 1.0/(NxNyNz*dV);
+  for (int j=0; j<howmany; j++) *out[j] = r.slice(j*NxNyNz, NxNyNz);
+}
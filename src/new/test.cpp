@@ -132,6 +132,39 @@ int main() {
     }
   }
 
+  {
+    printf("\n*** Testing Anderson mixing ***\n");
+    Vector foo(N);
+    for (int i=0;i<N;i++) {
+      foo[i] = i*0.1;
+    }
+    SqrSum sqr(foo);
+    Minimize min(&sqr);
+    const double prec = 1e-9;
+    min.set_precision(prec);
+    min.set_miniter(0);
+    min.precondition(true);
+    // A Picard step of 0.5 only removes three quarters of the energy
+    // each iteration, so it is the mixing that has to get us there.
+    min.set_anderson_mixing(4, 0.5);
+    printf("Starting energy is %g\n\n", min.energy());
+    while (min.improve_energy(quiet)) {
+    }
+    min.print_info();
+    if (min.energy() > prec) {
+      printf("FAIL: Energy error is too big! %g vs %g\n", min.energy(), prec);
+      errors++;
+    }
+    const int max_iterations = 5;
+    printf("Took %d iterations with %d fallbacks, and I expected no more than %d\n",
+           min.get_iteration_count(), min.get_fallback_count(), max_iterations);
+    if (min.get_iteration_count() > max_iterations) {
+      printf("FAIL: Took too many iterations! %d vs %d\n",
+             min.get_iteration_count(), max_iterations);
+      errors++;
+    }
+  }
+
   if (errors == 1) {
     printf("There was %d error!\n", errors);
   } else if (errors > 1) {
@@ -0,0 +1,230 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <sys/resource.h>
+
+// The profiler keeps track of where the time goes in a computation,
+// broken down by named pieces: each named Functional term, each method
+// of a generated NewFunctional, and each step of a minimization.  For
+// each of these it records how many times it ran, the wall time spent
+// in it (both in total and outside of any other named piece it
+// contains), the number of FFTs done, the bytes of field storage (the
+// arrays behind Vector and ComplexVector) allocated, and the most
+// field storage in use at any one time while it ran.  The old
+// framework's Eigen vectors bypass field storage, so they only show up
+// in the peak resident set size that we print at the end.
+
+// To turn on profiling, either set the environment variable
+// DEFT_PROFILE to the name of a file, or call start_profiling.  When
+// the program exits, we print a summary sorted by total time, and save
+// the same data to that file.  When profiling is off, all that a
+// profile_scope costs is a check of a flag.
+
+struct profile_entry {
+  profile_entry() : calls(0), seconds(0), self_seconds(0), ffts(0),
+                    bytes_allocated(0), peak_bytes(0) {}
+  long calls;
+  double seconds, self_seconds;
+  long ffts;
+  long bytes_allocated, peak_bytes;
+};
+
+struct profiler_state {
+  profiler_state() : enabled(false), live_bytes(0), peak_bytes(0) {
+    const char *fname = getenv("DEFT_PROFILE");
+    if (fname && *fname) {
+      enabled = true;
+      filename = fname;
+    }
+  }
+  bool enabled;
+  std::string filename;
+  std::mutex mutex; // guards entries
+  std::map<std::string, profile_entry> entries;
+  std::atomic<long> live_bytes, peak_bytes; // of field storage
+};
+
+inline void print_profile(FILE *out = stdout);
+inline void save_profile(const char *fname);
+
+inline void profile_at_exit() {
+  print_profile();
+  save_profile(0);
+}
+
+inline profiler_state *new_profiler() {
+  profiler_state *p = new profiler_state();
+  if (p->enabled) atexit(profile_at_exit);
+  return p;
+}
+
+inline profiler_state &the_profiler() {
+  // We never delete the profiler, so that it is still around when we
+  // print it at exit.
+  static profiler_state *p = new_profiler();
+  return *p;
+}
+
+inline bool profiling_enabled() {
+  return the_profiler().enabled;
+}
+
+// start_profiling turns on the profiler, if it is not already on.  If
+// fname is given, the profile is saved there at exit.
+inline void start_profiling(const char *fname = 0) {
+  profiler_state &prof = the_profiler();
+  if (fname) prof.filename = fname;
+  if (!prof.enabled) {
+    prof.enabled = true;
+    atexit(profile_at_exit);
+  }
+}
+
+// A profile_scope times everything from its construction to its
+// destruction under the name given, with the optional suffix appended.
+// The name must outlive the profile_scope.  An empty or null name
+// means we don't profile this at all, so that its cost is counted in
+// whatever scope encloses it.  The same goes for a scope directly
+// inside one of the same name, such as a Minimizer wrapping another
+// (e.g. MaxIter(Precision(...))), so that each call is counted once.
+class profile_scope {
+public:
+  explicit profile_scope(const char *name, const char *suffix = "")
+    : myname(0), mysuffix(suffix), parent(0) {
+    if (!name || !*name || !profiling_enabled()) return;
+    const profile_scope *enclosing = innermost();
+    if (enclosing && !strcmp(enclosing->myname, name) && !strcmp(enclosing->mysuffix, suffix)) {
+      return;
+    }
+    myname = name;
+    parent = innermost();
+    innermost() = this;
+    ffts = 0;
+    bytes = 0;
+    peak = the_profiler().live_bytes;
+    child_seconds = 0;
+    start = std::chrono::steady_clock::now();
+  }
+  ~profile_scope() {
+    if (myname) finish();
+  }
+
+  // The following are called by the code that does FFTs and allocates
+  // field storage, respectively.
+  static void count_ffts(int howmany) {
+    profile_scope *s = innermost();
+    if (s) s->ffts += howmany;
+  }
+  static void count_allocation(long nbytes) {
+    profiler_state &prof = the_profiler();
+    const long live = (prof.live_bytes += nbytes);
+    long peak = prof.peak_bytes;
+    while (live > peak && !prof.peak_bytes.compare_exchange_weak(peak, live)) {
+    }
+    profile_scope *s = innermost();
+    if (s) s->bytes += nbytes;
+    for (; s; s = s->parent) s->peak = std::max(s->peak, live);
+  }
+  static void count_free(long nbytes) {
+    the_profiler().live_bytes -= nbytes;
+  }
+
+private:
+  static profile_scope *&innermost() {
+    static thread_local profile_scope *s = 0;
+    return s;
+  }
+  void finish() {
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                         - start).count();
+    innermost() = parent;
+    if (parent) {
+      parent->child_seconds += elapsed;
+      parent->ffts += ffts;
+      parent->bytes += bytes;
+    }
+    profiler_state &prof = the_profiler();
+    std::lock_guard<std::mutex> lock(prof.mutex);
+    profile_entry &e = prof.entries[std::string(myname) + mysuffix];
+    e.calls++;
+    e.seconds += elapsed;
+    e.self_seconds += elapsed - child_seconds;
+    e.ffts += ffts;
+    e.bytes_allocated += bytes;
+    e.peak_bytes = std::max(e.peak_bytes, peak);
+  }
+
+  const char *myname, *mysuffix;
+  profile_scope *parent;
+  long ffts, bytes, peak;
+  double child_seconds;
+  std::chrono::steady_clock::time_point start;
+
+  profile_scope(const profile_scope &);
+  void operator=(const profile_scope &);
+};
+
+inline bool profile_entry_takes_longer(const std::pair<std::string, profile_entry> &a,
+                                       const std::pair<std::string, profile_entry> &b) {
+  return a.second.seconds > b.second.seconds;
+}
+
+inline std::vector< std::pair<std::string, profile_entry> > sorted_profile() {
+  profiler_state &prof = the_profiler();
+  std::lock_guard<std::mutex> lock(prof.mutex);
+  std::vector< std::pair<std::string, profile_entry> > out(prof.entries.begin(),
+                                                           prof.entries.end());
+  std::sort(out.begin(), out.end(), profile_entry_takes_longer);
+  return out;
+}
+
+inline void print_profile(FILE *out) {
+  const std::vector< std::pair<std::string, profile_entry> > p = sorted_profile();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const double MB = 1024*1024;
+  fprintf(out, "\n=== Profile (peak field storage %.1f MB, peak resident set %.1f MB) ===\n",
+          the_profiler().peak_bytes/MB, usage.ru_maxrss/1024.0);
+  fprintf(out, "%10s %10s %8s %8s %10s %9s  %s\n",
+          "total (s)", "self (s)", "calls", "FFTs", "alloc (MB)", "peak (MB)", "name");
+  for (unsigned i=0; i<p.size(); i++) {
+    const profile_entry &e = p[i].second;
+    fprintf(out, "%10.3f %10.3f %8ld %8ld %10.1f %9.1f  %s\n",
+            e.seconds, e.self_seconds, e.calls, e.ffts,
+            e.bytes_allocated/MB, e.peak_bytes/MB, p[i].first.c_str());
+  }
+  fflush(out);
+}
+
+// save_profile writes one line per named scope, with the name last
+// so that names with spaces in them are still easy to read back in.
+// If fname is null, we use the file given to start_profiling or in
+// DEFT_PROFILE, if any.
+inline void save_profile(const char *fname) {
+  if (!fname) fname = the_profiler().filename.c_str();
+  if (!*fname) return;
+  FILE *f = fopen(fname, "w");
+  if (!f) {
+    printf("Unable to save profile to %s\n", fname);
+    return;
+  }
+  const std::vector< std::pair<std::string, profile_entry> > p = sorted_profile();
+  fprintf(f, "# seconds\tself_seconds\tcalls\tffts\tbytes_allocated\tpeak_bytes\tname\n");
+  for (unsigned i=0; i<p.size(); i++) {
+    const profile_entry &e = p[i].second;
+    fprintf(f, "%.9g\t%.9g\t%ld\t%ld\t%ld\t%ld\t%s\n", e.seconds, e.self_seconds,
+            e.calls, e.ffts, e.bytes_allocated, e.peak_bytes, p[i].first.c_str());
+  }
+  fclose(f);
+}
@@ -0,0 +1,374 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+// This file defines vectorized versions of the special functions
+// that dominate our generated functionals: exp, log, sin, cos, sincos
+// and pow.  The generated code calls these once per grid point, so
+// libm ends up being a surprisingly large fraction of the time spent
+// computing the SAFT and hard-sphere terms.
+//
+// Each function comes in two flavors.  The scalar version (e.g.
+// simd_exp(double)) is branch-free, so that gcc can inline it and
+// vectorize the per-grid-point loops in the generated code.  The
+// array version (e.g. simd_exp(const double *in, double *out, long n))
+// uses AVX-512 or AVX2 intrinsics explicitly when the compiler is told
+// that they are available (e.g. with -march=native), and falls back on
+// the scalar version otherwise.
+//
+// The algorithms are those of Cephes (range reduction followed by a
+// rational or polynomial approximation), and are written once as
+// templates over the "pack" type, so the scalar and SIMD code paths
+// compute exactly the same thing.  Accuracy is within a few ulp of
+// libm, which is checked in tests/simd-math.cpp.  The trigonometric
+// functions are only accurate for |x| < 1e9, and simd_pow(x,y) loses
+// about |y log x| ulp, since it is computed as exp(y log x).  Negative
+// x in simd_pow always gives NaN, so integer powers should use uipow.
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <complex>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace simdmath {
+
+// The following primitives are what the templated algorithms below
+// need from a "pack" of doubles.  For a plain double the mask type is
+// just bool.
+
+inline double select(bool m, double a, double b) { return m ? a : b; }
+
+inline double vround(double x) {
+  // Round to nearest integer without a function call, valid for |x| < 2^51.
+  const double magic = 6755399441055744.0; // 1.5*2^52
+  return (x + magic) - magic;
+}
+
+inline double vfloor(double x) {
+  const double r = vround(x);
+  return r - select(r > x, 1.0, 0.0);
+}
+
+// pow2i returns 2^n for integer-valued n in [-1022, 1023].
+inline double pow2i(double n) {
+  const double t = n + (1023.0 + 6755399441055744.0);
+  uint64_t bits;
+  memcpy(&bits, &t, sizeof(double));
+  bits <<= 52;
+  double out;
+  memcpy(&out, &bits, sizeof(double));
+  return out;
+}
+
+// frexp_pack sets e to the binary exponent of x, and returns the
+// mantissa in [0.5,1).  It does not handle zero, infinity, NaN or
+// subnormal numbers, which are special-cased in log_kernel.
+inline double frexp_pack(double x, double *e) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(double));
+  uint64_t ebits = (bits >> 52) | 0x4330000000000000ULL;
+  double eraw;
+  memcpy(&eraw, &ebits, sizeof(double));
+  *e = eraw - (4503599627370496.0 + 1022.0);
+  bits = (bits & 0x800fffffffffffffULL) | 0x3fe0000000000000ULL;
+  double m;
+  memcpy(&m, &bits, sizeof(double));
+  return m;
+}
+
+#if defined(__AVX2__)
+struct mask4 {
+  __m256d v;
+  mask4(__m256d x) : v(x) {}
+};
+struct simd4 {
+  __m256d v;
+  simd4() {}
+  simd4(__m256d x) : v(x) {}
+  simd4(double x) : v(_mm256_set1_pd(x)) {}
+  static simd4 load(const double *p) { return _mm256_loadu_pd(p); }
+  void store(double *p) const { _mm256_storeu_pd(p, v); }
+};
+inline simd4 operator+(simd4 a, simd4 b) { return _mm256_add_pd(a.v, b.v); }
+inline simd4 operator-(simd4 a, simd4 b) { return _mm256_sub_pd(a.v, b.v); }
+inline simd4 operator*(simd4 a, simd4 b) { return _mm256_mul_pd(a.v, b.v); }
+inline simd4 operator/(simd4 a, simd4 b) { return _mm256_div_pd(a.v, b.v); }
+inline simd4 operator-(simd4 a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline mask4 operator<(simd4 a, simd4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline mask4 operator>(simd4 a, simd4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+inline mask4 operator==(simd4 a, simd4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+inline mask4 operator!=(simd4 a, simd4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ); }
+inline mask4 operator|(mask4 a, mask4 b) { return _mm256_or_pd(a.v, b.v); }
+inline simd4 select(mask4 m, simd4 a, simd4 b) { return _mm256_blendv_pd(b.v, a.v, m.v); }
+inline simd4 vround(simd4 x) {
+  return _mm256_round_pd(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+inline simd4 vfloor(simd4 x) { return _mm256_floor_pd(x.v); }
+inline simd4 pow2i(simd4 n) {
+  const __m256d t = _mm256_add_pd(n.v, _mm256_set1_pd(1023.0 + 6755399441055744.0));
+  return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(t), 52));
+}
+inline simd4 frexp_pack(simd4 x, simd4 *e) {
+  const __m256i bits = _mm256_castpd_si256(x.v);
+  const __m256i ebits = _mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                        _mm256_set1_epi64x(0x4330000000000000LL));
+  *e = _mm256_sub_pd(_mm256_castsi256_pd(ebits), _mm256_set1_pd(4503599627370496.0 + 1022.0));
+  const __m256i m = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x800fffffffffffffLL)),
+                                    _mm256_set1_epi64x(0x3fe0000000000000LL));
+  return _mm256_castsi256_pd(m);
+}
+#endif
+
+#if defined(__AVX512F__)
+struct mask8 {
+  __mmask8 v;
+  mask8(__mmask8 x) : v(x) {}
+};
+struct simd8 {
+  __m512d v;
+  simd8() {}
+  simd8(__m512d x) : v(x) {}
+  simd8(double x) : v(_mm512_set1_pd(x)) {}
+  static simd8 load(const double *p) { return _mm512_loadu_pd(p); }
+  void store(double *p) const { _mm512_storeu_pd(p, v); }
+};
+inline simd8 operator+(simd8 a, simd8 b) { return _mm512_add_pd(a.v, b.v); }
+inline simd8 operator-(simd8 a, simd8 b) { return _mm512_sub_pd(a.v, b.v); }
+inline simd8 operator*(simd8 a, simd8 b) { return _mm512_mul_pd(a.v, b.v); }
+inline simd8 operator/(simd8 a, simd8 b) { return _mm512_div_pd(a.v, b.v); }
+inline simd8 operator-(simd8 a) { return _mm512_sub_pd(_mm512_set1_pd(-0.0), a.v); }
+inline mask8 operator<(simd8 a, simd8 b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ); }
+inline mask8 operator>(simd8 a, simd8 b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ); }
+inline mask8 operator==(simd8 a, simd8 b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ); }
+inline mask8 operator!=(simd8 a, simd8 b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_NEQ_UQ); }
+inline mask8 operator|(mask8 a, mask8 b) { return __mmask8(a.v | b.v); }
+inline simd8 select(mask8 m, simd8 a, simd8 b) { return _mm512_mask_blend_pd(m.v, b.v, a.v); }
+inline simd8 vround(simd8 x) {
+  return _mm512_mask_roundscale_pd(x.v, 0xff, x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+inline simd8 vfloor(simd8 x) {
+  return _mm512_mask_roundscale_pd(x.v, 0xff, x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+inline simd8 pow2i(simd8 n) {
+  const __m512d t = _mm512_add_pd(n.v, _mm512_set1_pd(1023.0 + 6755399441055744.0));
+  const __m512i bits = _mm512_castpd_si512(t);
+  return _mm512_castsi512_pd(_mm512_mask_slli_epi64(bits, 0xff, bits, 52));
+}
+inline simd8 frexp_pack(simd8 x, simd8 *e) {
+  const __m512i bits = _mm512_castpd_si512(x.v);
+  const __m512i ebits = _mm512_or_si512(_mm512_mask_srli_epi64(bits, 0xff, bits, 52),
+                                        _mm512_set1_epi64(0x4330000000000000LL));
+  *e = _mm512_sub_pd(_mm512_castsi512_pd(ebits), _mm512_set1_pd(4503599627370496.0 + 1022.0));
+  const __m512i m = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi64(0x800fffffffffffffLL)),
+                                    _mm512_set1_epi64(0x3fe0000000000000LL));
+  return _mm512_castsi512_pd(m);
+}
+#endif
+
+// gather loads base[index] for each element of index, which must hold
+// whole numbers.  It is used for table lookups rather than by the
+// special functions here.  We use the masked forms of the intrinsics,
+// since gcc warns that the unmasked ones read an uninitialized value.
+inline double gather(const double *base, double index) { return base[long(index)]; }
+#if defined(__AVX2__)
+inline simd4 gather(const double *base, simd4 index) {
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base,
+                                  _mm256_cvtpd_epi32(index.v), all, 8);
+}
+#endif
+#if defined(__AVX512F__)
+inline simd8 gather(const double *base, simd8 index) {
+  return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff,
+                                  _mm512_maskz_cvtpd_epi32(0xff, index.v), base, 8);
+}
+#endif
+
+// Below are the actual algorithms, which work for any of the above
+// pack types.
+
+template <typename D>
+inline D exp_kernel(D x) {
+  const double maxlog = 7.09782712893383996843e2, minlog = -7.45133219101941108420e2;
+  // x = n ln(2) + r, with |r| <= ln(2)/2, and ln(2) split into two
+  // parts so that n*C1 is exact.
+  const D n = vround(x*1.4426950408889634073599);
+  const D r = (x - n*6.93145751953125e-1) - n*1.42860682030941723212e-6;
+  const D rr = r*r;
+  const D px = r*((1.26177193074810590878e-4*rr + 3.02994407707441961300e-2)*rr
+                  + 9.99999999999999999910e-1);
+  const D qx = ((3.00198505138664455042e-6*rr + 2.52448340349684104192e-3)*rr
+                + 2.27265548208155028766e-1)*rr + 2.00000000000000000009e0;
+  const D e = 1.0 + 2.0*(px/(qx - px));
+  // We scale by 2^n in two steps for the extreme exponents, so that
+  // pow2i never sees an exponent out of range, and we get gradual
+  // underflow to subnormal numbers.
+  const auto small = n < D(-1000.0);
+  const auto big = n > D(1000.0);
+  const D n1 = select(small, n + 54.0, select(big, n - 1.0, n));
+  const D scale = select(small, D(5.551115123125783e-17), select(big, D(2.0), D(1.0)));
+  const D out = e*pow2i(n1)*scale;
+  return select(x > D(maxlog), D(HUGE_VAL), select(x < D(minlog), D(0.0), out));
+}
+
+template <typename D>
+inline D log_kernel(D x) {
+  // Scale subnormal inputs up so frexp_pack can handle them.
+  const auto tiny = x < D(2.2250738585072014e-308);
+  const D xs = select(tiny, x*18014398509481984.0, x); // 2^54
+  D e;
+  D m = frexp_pack(xs, &e);
+  e = select(tiny, e - 54.0, e);
+  // Shift m into [sqrt(1/2), sqrt(2)) and subtract one.
+  const auto low = m < D(0.70710678118654752440);
+  e = select(low, e - 1.0, e);
+  const D z = select(low, m + m - 1.0, m - 1.0);
+  const D zz = z*z;
+  const D p = ((((1.01875663804580931796e-4*z + 4.97494994976747001425e-1)*z
+                 + 4.70579119878881725854e0)*z + 1.44989225341610930846e1)*z
+               + 1.79368678507819816313e1)*z + 7.70838733755885391666e0;
+  const D q = ((((z + 1.12873587189167450590e1)*z + 4.52279145837532221105e1)*z
+                + 8.29875266912776603211e1)*z + 7.11544750618563894466e1)*z
+              + 2.31251620126765340583e1;
+  D y = z*(zz*p/q);
+  y = y - 2.121944400546905827679e-4*e;
+  y = y - 0.5*zz;
+  const D out = (z + y) + 0.693359375*e;
+  const D nan = D(NAN);
+  return select(x > D(0.0),
+                select(x == D(HUGE_VAL), x, out),
+                select(x == D(0.0), D(-HUGE_VAL), nan));
+}
+
+// sincos_kernel reduces x to z in [-pi/4, pi/4] and returns the
+// quadrant, along with sin(z) and cos(z).
+template <typename D>
+inline D sincos_reduce(D x, D *s, D *c) {
+  const D q = vround(x*0.63661977236758134308);
+  // pi/2 is split into three parts, the first two of which have
+  // enough trailing zeros that q*DP1 and q*DP2 are exact.
+  const D z = ((x - q*1.57079625129699707031e0) - q*7.54978941586159635336e-8)
+              - q*5.39030285815811905290e-15;
+  const D zz = z*z;
+  *s = z + z*zz*(((((1.58962301576546568060e-10*zz - 2.50507477628578072866e-8)*zz
+                    + 2.75573136213857245213e-6)*zz - 1.98412698295895385996e-4)*zz
+                  + 8.33333333332211858878e-3)*zz - 1.66666666666666307295e-1);
+  *c = (1.0 - 0.5*zz) + zz*zz*(((((-1.13585365213876817300e-11*zz + 2.08757008419747316778e-9)*zz
+                                  - 2.75573141792967388112e-7)*zz + 2.48015872888517045348e-5)*zz
+                                - 1.38888888888730564116e-3)*zz + 4.16666666666665929218e-2);
+  return q - 4.0*vfloor(0.25*q);
+}
+
+template <typename D>
+inline D sin_kernel(D x) {
+  D s, c;
+  const D quadrant = sincos_reduce(x, &s, &c);
+  const D r = select((quadrant == D(1.0)) | (quadrant == D(3.0)), c, s);
+  return select(quadrant > D(1.5), -r, r);
+}
+
+template <typename D>
+inline D cos_kernel(D x) {
+  D s, c;
+  const D quadrant = sincos_reduce(x, &s, &c);
+  const D r = select((quadrant == D(1.0)) | (quadrant == D(3.0)), s, c);
+  return select((quadrant == D(1.0)) | (quadrant == D(2.0)), -r, r);
+}
+
+template <typename D>
+inline void sincos_kernel(D x, D *sout, D *cout) {
+  D s, c;
+  const D quadrant = sincos_reduce(x, &s, &c);
+  const auto odd = (quadrant == D(1.0)) | (quadrant == D(3.0));
+  const D rs = select(odd, c, s), rc = select(odd, s, c);
+  *sout = select(quadrant > D(1.5), -rs, rs);
+  *cout = select((quadrant == D(1.0)) | (quadrant == D(2.0)), -rc, rc);
+}
+
+template <typename D>
+inline D pow_kernel(D x, D y) {
+  return exp_kernel(y*log_kernel(x));
+}
+
+// The following functors let us write the array loops just once.
+struct exp_op { template <typename D> D operator()(D x) const { return exp_kernel(x); } };
+struct log_op { template <typename D> D operator()(D x) const { return log_kernel(x); } };
+struct sin_op { template <typename D> D operator()(D x) const { return sin_kernel(x); } };
+struct cos_op { template <typename D> D operator()(D x) const { return cos_kernel(x); } };
+
+template <typename F>
+inline void apply(F f, const double *in, double *out, long n) {
+  long i = 0;
+#if defined(__AVX512F__)
+  for (; i+8 <= n; i += 8) f(simd8::load(in+i)).store(out+i);
+#elif defined(__AVX2__)
+  for (; i+4 <= n; i += 4) f(simd4::load(in+i)).store(out+i);
+#endif
+  for (; i < n; i++) out[i] = f(in[i]);
+}
+
+} // namespace simdmath
+
+inline double simd_exp(double x) { return simdmath::exp_kernel(x); }
+inline double simd_log(double x) { return simdmath::log_kernel(x); }
+inline double simd_sin(double x) { return simdmath::sin_kernel(x); }
+inline double simd_cos(double x) { return simdmath::cos_kernel(x); }
+inline void simd_sincos(double x, double *s, double *c) { simdmath::sincos_kernel(x, s, c); }
+inline double simd_pow(double x, double y) { return simdmath::pow_kernel(x, y); }
+
+// The old-style generated code does its reciprocal-space arithmetic
+// with std::complex, for which we just defer to the standard library.
+inline std::complex<double> simd_exp(const std::complex<double> &z) { return std::exp(z); }
+inline std::complex<double> simd_log(const std::complex<double> &z) { return std::log(z); }
+inline std::complex<double> simd_sin(const std::complex<double> &z) { return std::sin(z); }
+inline std::complex<double> simd_cos(const std::complex<double> &z) { return std::cos(z); }
+inline std::complex<double> simd_pow(const std::complex<double> &z, double y) { return std::pow(z, y); }
+
+inline void simd_exp(const double *in, double *out, long n) {
+  simdmath::apply(simdmath::exp_op(), in, out, n);
+}
+inline void simd_log(const double *in, double *out, long n) {
+  simdmath::apply(simdmath::log_op(), in, out, n);
+}
+inline void simd_sin(const double *in, double *out, long n) {
+  simdmath::apply(simdmath::sin_op(), in, out, n);
+}
+inline void simd_cos(const double *in, double *out, long n) {
+  simdmath::apply(simdmath::cos_op(), in, out, n);
+}
+inline void simd_sincos(const double *in, double *s, double *c, long n) {
+  long i = 0;
+#if defined(__AVX512F__)
+  for (; i+8 <= n; i += 8) {
+    simdmath::simd8 ss, cc;
+    simdmath::sincos_kernel(simdmath::simd8::load(in+i), &ss, &cc);
+    ss.store(s+i);
+    cc.store(c+i);
+  }
+#elif defined(__AVX2__)
+  for (; i+4 <= n; i += 4) {
+    simdmath::simd4 ss, cc;
+    simdmath::sincos_kernel(simdmath::simd4::load(in+i), &ss, &cc);
+    ss.store(s+i);
+    cc.store(c+i);
+  }
+#endif
+  for (; i < n; i++) simd_sincos(in[i], s+i, c+i);
+}
+inline void simd_pow(const double *x, double y, double *out, long n) {
+  long i = 0;
+#if defined(__AVX512F__)
+  for (; i+8 <= n; i += 8) {
+    simdmath::pow_kernel(simdmath::simd8::load(x+i), simdmath::simd8(y)).store(out+i);
+  }
+#elif defined(__AVX2__)
+  for (; i+4 <= n; i += 4) {
+    simdmath::pow_kernel(simdmath::simd4::load(x+i), simdmath::simd4(y)).store(out+i);
+  }
+#endif
+  for (; i < n; i++) out[i] = simd_pow(x[i], y);
+}
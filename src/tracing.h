@@ -0,0 +1,218 @@
+// -*- mode: C++; -*-
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// The tracer writes a timeline of a long run in the Chrome trace-event
+// format, which can be viewed in chrome://tracing or in Perfetto
+// (ui.perfetto.dev).  Spans show where the time goes (energy and
+// gradient calculations, line searches, FFTs, saving histograms,
+// updating weights), and counters show how things like the energy or
+// the acceptance rate evolve.  Where the profiler in profiling.h sums
+// everything up, the trace lets you see when things happened.
+
+// To turn on tracing, either set the environment variable DEFT_TRACE
+// to the name of a file, or call start_tracing.  Each thread collects
+// its events in a fixed-size buffer, which is only written out when it
+// fills up, when flush_trace is called, or at exit, so that recording
+// an event costs little more than reading the clock.  We write the
+// JSON array format, which the viewers accept even without its closing
+// bracket, so the trace of a run that is killed is still readable up
+// to the last flush.  When tracing is off, a trace_span costs a check
+// of a flag.
+
+struct trace_event {
+  const char *name, *category; // must be string literals
+  char phase; // 'X' for a span, 'C' for a counter
+  long long start_ns, duration_ns;
+  double value;
+};
+
+struct trace_buffer;
+
+struct tracer_state {
+  tracer_state() : enabled(false), file(0), wrote_any(false), next_tid(1),
+                   start(std::chrono::steady_clock::now()) {}
+  std::atomic<bool> enabled;
+  std::mutex mutex; // guards everything below
+  FILE *file;
+  bool wrote_any;
+  int next_tid;
+  std::vector<trace_buffer *> buffers;
+  const std::chrono::steady_clock::time_point start;
+};
+
+inline tracer_state &the_tracer();
+inline void finish_trace();
+
+// A trace_buffer holds the events of one thread that have not yet
+// been written out.
+struct trace_buffer {
+  static const int capacity = 1 << 14;
+  trace_buffer() : num(0) {
+    tracer_state &t = the_tracer();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    tid = t.next_tid++;
+    t.buffers.push_back(this);
+  }
+  ~trace_buffer() {
+    tracer_state &t = the_tracer();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    write();
+    t.buffers.erase(std::find(t.buffers.begin(), t.buffers.end(), this));
+  }
+  void add(const trace_event &e) {
+    if (num == capacity) {
+      std::lock_guard<std::mutex> lock(the_tracer().mutex);
+      write();
+    }
+    events[num++] = e;
+  }
+  // write must be called with the tracer's mutex held.
+  void write() {
+    tracer_state &t = the_tracer();
+    if (t.file) {
+      const int pid = getpid();
+      for (int i=0; i<num; i++) {
+        const trace_event &e = events[i];
+        fprintf(t.file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3f", t.wrote_any ? "," : "", e.name, e.category, e.phase, pid, tid,
+                1e-3*e.start_ns);
+        if (e.phase == 'X') fprintf(t.file, ",\"dur\":%.3f}", 1e-3*e.duration_ns);
+        else fprintf(t.file, ",\"args\":{\"value\":%.17g}}", e.value);
+        t.wrote_any = true;
+      }
+    }
+    num = 0;
+  }
+  int num, tid;
+  trace_event events[capacity];
+};
+
+inline tracer_state *new_tracer() {
+  tracer_state *t = new tracer_state();
+  const char *fname = getenv("DEFT_TRACE");
+  if (fname && *fname) {
+    t->file = fopen(fname, "w");
+    if (t->file) {
+      fprintf(t->file, "[");
+      t->enabled = true;
+      atexit(finish_trace);
+    } else {
+      printf("Unable to create trace file %s\n", fname);
+    }
+  }
+  return t;
+}
+
+inline tracer_state &the_tracer() {
+  // We never delete the tracer, so that it is still around when the
+  // buffers of any remaining threads are written at exit.
+  static tracer_state *t = new_tracer();
+  return *t;
+}
+
+inline bool tracing_enabled() {
+  return the_tracer().enabled.load(std::memory_order_relaxed);
+}
+
+inline long long trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now() - the_tracer().start).count();
+}
+
+inline trace_buffer &this_thread_trace_buffer() {
+  static thread_local trace_buffer b;
+  return b;
+}
+
+// start_tracing turns on the tracer, writing to fname, unless it is
+// already on.
+inline void start_tracing(const char *fname) {
+  tracer_state &t = the_tracer();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  if (t.enabled) return;
+  t.file = fopen(fname, "w");
+  if (!t.file) {
+    printf("Unable to create trace file %s\n", fname);
+    return;
+  }
+  fprintf(t.file, "[");
+  t.enabled = true;
+  atexit(finish_trace);
+}
+
+// flush_trace writes out the events recorded so far by every thread.
+// Long runs should call it whenever they save their own data, so that
+// the trace on disk keeps up with them.  The caller must make sure
+// that no other thread is recording events while we flush.
+inline void flush_trace() {
+  if (!tracing_enabled()) return;
+  tracer_state &t = the_tracer();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  for (unsigned i=0; i<t.buffers.size(); i++) t.buffers[i]->write();
+  fflush(t.file);
+}
+
+inline void finish_trace() {
+  flush_trace();
+  tracer_state &t = the_tracer();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  if (!t.file) return;
+  fprintf(t.file, "\n]\n");
+  fclose(t.file);
+  t.file = 0;
+  t.enabled = false;
+}
+
+// A trace_span records the time from its construction to its
+// destruction.  Spans nest, and show up in the viewer as a flame
+// graph for each thread.
+class trace_span {
+public:
+  explicit trace_span(const char *name, const char *category = "deft")
+    : myname(0), mycategory(category) {
+    if (!tracing_enabled()) return;
+    myname = name;
+    start = trace_now_ns();
+  }
+  ~trace_span() {
+    if (!myname) return;
+    trace_event e;
+    e.name = myname;
+    e.category = mycategory;
+    e.phase = 'X';
+    e.start_ns = start;
+    e.duration_ns = trace_now_ns() - start;
+    e.value = 0;
+    this_thread_trace_buffer().add(e);
+  }
+private:
+  const char *myname, *mycategory;
+  long long start;
+
+  trace_span(const trace_span &);
+  void operator=(const trace_span &);
+};
+
+// trace_counter records the value of a named quantity at this moment,
+// which the viewer plots against time.
+inline void trace_counter(const char *name, double value, const char *category = "deft") {
+  if (!tracing_enabled()) return;
+  trace_event e;
+  e.name = name;
+  e.category = category;
+  e.phase = 'C';
+  e.start_ns = trace_now_ns();
+  e.duration_ns = 0;
+  e.value = value;
+  this_thread_trace_buffer().add(e);
+}
@@ -1,33 +1,29 @@
 #include "vector3d.h"
 
-Rand random::my_rand = Rand(0);
+random_stream random::main_stream = random_stream(Rand(0));
+thread_local random_stream *random::current = &random::main_stream;
 unsigned long random::seedval = 0;
 
-vector3d vector3d::ran(double scale) {
-  double x, y, r2;
-  do {
-    x = 2*random::ran() - 1;
-    y = 2*random::ran() - 1;
-    r2 = x*x + y*y;
-  } while(r2 >= 1 || r2 == 0);
-  double fac = scale*sqrt(-2*log(r2)/r2);
-  vector3d out(x*fac, y*fac, 0);
-  static double extra_z = 0;
-  if (extra_z) {
-    // We have a z value left over from last time!
-    out[2] = extra_z;
-    extra_z = 0;
-  } else {
+void random_stream::make_gaussians() {
+  // We use the polar Box-Muller method, which gives two at a time.
+  for (int i=0; i<64; i+=2) {
+    double x, y, r2;
     do {
-      x = 2*random::ran() - 1;
-      y = 2*random::ran() - 1;
+      x = 2*rng.rand() - 1;
+      y = 2*rng.rand() - 1;
       r2 = x*x + y*y;
     } while(r2 >= 1 || r2 == 0);
-    fac = scale*sqrt(-2*log(r2)/r2);
-    extra_z = y*fac; // Save this one for later!
-    out[2]=x*fac;
+    const double fac = sqrt(-2*log(r2)/r2);
+    gaussians[i] = x*fac;
+    gaussians[i+1] = y*fac;
   }
-  return out;
+  num_gaussians = 64;
+}
+
+vector3d vector3d::ran(double scale) {
+  const double x = random::gaussian();
+  const double y = random::gaussian();
+  return vector3d(x*scale, y*scale, random::gaussian()*scale);
 }
 
 vector3d vector3d::expran() {
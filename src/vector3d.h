@@ -5,14 +5,54 @@
 
 #pragma once
 
+// A random_stream is one sequence of random numbers, which must only
+// be used by one thread at a time.  It makes its Gaussian variates in
+// batches, which is faster than making them a pair at a time, and
+// keeps any left over with the stream they came from.
+struct random_stream {
+  explicit random_stream(const Rand &r) : rng(r), gaussians(), num_gaussians(0) {}
+  double ran() {
+    return rng.rand();
+  }
+  double gaussian() {
+    if (num_gaussians == 0) make_gaussians();
+    return gaussians[--num_gaussians];
+  }
+  Rand rng;
+private:
+  void make_gaussians();
+  double gaussians[64];
+  int num_gaussians;
+};
+
 struct random {
   static unsigned long seedval;
   static void seed(unsigned long seedme) {
     seedval = seedme;
-    my_rand = Rand(seedval);
+    main_stream = random_stream(Rand(seedval));
   }
   static double ran() {
-    return my_rand.rand();
+    return current->ran();
+  }
+  // gaussian returns a normally distributed number with unit variance.
+  static double gaussian() {
+    return current->gaussian();
+  }
+  // stream(n) gives the nth of a family of generators that depend
+  // only on the seed, each starting 2^512 numbers past the one
+  // before, so a parallel simulation in which thread (or walker) n
+  // uses stream(n) is reproducible from a single seed.
+  static Rand stream(int n) {
+    Rand r(seedval);
+    for (int i=0; i<=n; i++) r.jump();
+    return r;
+  }
+  // use makes ran, gaussian and the random vectors and rotations on
+  // the calling thread draw from s, or from the main stream if s is
+  // null.  Every thread starts out using the main stream, which is
+  // not safe to use from more than one thread at once.
+  static void use(random_stream *s) {
+    current = s ? s : &main_stream;
   }
   static unsigned long seed_randomly() {
     seedval = clock(); // in case reading /dev/urandom fails?
@@ -27,7 +67,8 @@ struct random {
     return seedval;
   }
 private:
-  static Rand my_rand;
+  static random_stream main_stream;
+  static thread_local random_stream *current;
 };
 
 class vector3d {
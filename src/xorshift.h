@@ -44,7 +44,47 @@ public:
     return ( s[p] = s0 ^ s1 ) * 1181783497276652981ULL;
   }
   double rand() {
-    return ldexp(rand64(), -64);
+    // This is the same as ldexp(rand64(), -64), but multiplying by a
+    // power of two saves a function call.
+    return rand64()*(1.0/18446744073709551616.0);
+  }
+  // fill sets out[0] through out[n-1] to the same numbers that n
+  // calls to rand would give.
+  void fill(double *out, int n) {
+    for (int i=0; i<n; i++) out[i] = rand();
+  }
+
+  // jump advances the generator by 2^512 calls to rand64.  No
+  // simulation will ever use that many, so copies of one generator
+  // that have been jumped different numbers of times give streams
+  // that never overlap.
+  void jump() {
+    // x^(2^512) modulo the characteristic polynomial of the generator,
+    // as given by Vigna (arXiv:1402.6246).
+    static const uint64_t jump_polynomial[16] = {
+      0x84242f96eca9c41dULL, 0xa3c65b8776f96855ULL, 0x5b34a39f070b5837ULL,
+      0x4489affce4f31a1eULL, 0x2ffeeb0a48316f40ULL, 0xdc2d9891fe68c022ULL,
+      0x3659132bb12fea70ULL, 0xaac17d8efa43cab8ULL, 0xc4cb815590989b13ULL,
+      0x5ee975283d71c93bULL, 0x691548c86c1bd540ULL, 0x7910c41d10a1e6a5ULL,
+      0x0b5fc64563b3e2a8ULL, 0x047f7684e9fc949dULL, 0xb99181f2d8f685caULL,
+      0x284600e3f30e38c3ULL
+    };
+    jump(jump_polynomial);
+  }
+  // jump(poly) advances the generator by n calls to rand64, where
+  // poly holds the coefficients of x^n modulo the characteristic
+  // polynomial of the generator.  For n < 1024 that is just bit n.
+  void jump(const uint64_t poly[16]) {
+    uint64_t t[16] = {0};
+    for (int i=0; i<16; i++) {
+      for (int b=0; b<64; b++) {
+        if (poly[i] & (uint64_t(1) << b)) {
+          for (int j=0; j<16; j++) t[j] ^= s[(j+p) & 15];
+        }
+        rand64();
+      }
+    }
+    for (int j=0; j<16; j++) s[(j+p) & 15] = t[j];
   }
 
 	// Re-seeding functions with same behavior as initializers
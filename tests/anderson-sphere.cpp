@@ -0,0 +1,100 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <time.h>
+#include "Functionals.h"
+#include "LineMinimizer.h"
+#include "equation-of-state.h"
+
+// A hard-sphere fluid around a hard spherical solute, solved with
+// preconditioned conjugate gradient and with Anderson mixing, which
+// must reach the same minimum.  This is how we compare the cost of
+// the two solvers; newcode checks Anderson mixing in the new
+// framework.
+
+const double temperature = 1;
+const double R = 1;
+const double eta = 0.3;
+const double solute_radius = 1;
+const double bulk_density = eta/(4*M_PI/3*R*R*R);
+
+double in_solute(Cartesian r) {
+  return r.norm() < solute_radius + R;
+}
+
+struct solution {
+  double energy, seconds;
+  int iterations;
+};
+
+solution solve(const char *name, Minimizer min, Functional f, Grid *potential,
+               const Grid &initial, double precision, int maxiter) {
+  const clock_t start = clock();
+  *potential = initial;
+  min.minimize(f, potential->description(), potential);
+  Minimizer foo = MaxIter(maxiter, Precision(precision, min));
+  solution s;
+  s.iterations = 0;
+  while (foo.improve_energy(false)) s.iterations++;
+  foo.print_info();
+  s.energy = foo.energy();
+  s.seconds = (clock() - double(start))/CLOCKS_PER_SEC;
+  printf("%s took %d iterations and %g seconds to reach energy %.12g\n",
+         name, s.iterations, s.seconds, s.energy);
+  return s;
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  Lattice lat(Cartesian(8,0,0), Cartesian(0,8,0), Cartesian(0,0,8));
+  GridDescription gd(lat, 0.25);
+
+  Functional fhs = HardSpheresWBnotensor(R) + IdealGas();
+  const double mu = find_chemical_potential(OfEffectivePotential(fhs), temperature,
+                                            bulk_density);
+
+  Grid solute(gd);
+  solute.Set(in_solute);
+  Grid external_potential(gd, 10*temperature*solute); // this is "infinity" for our solute
+  Functional f = OfEffectivePotential(fhs + ChemicalPotential(mu)
+                                      + ExternalPotential(external_potential));
+
+  const Grid outside(gd, VectorXd::Ones(gd.NxNyNz) - solute);
+  Grid initial(gd, -temperature*(0.01*bulk_density*solute
+                                 + bulk_density*outside).cwise().log());
+  Grid potential(gd);
+  const double precision = 1e-9;
+
+  Minimizer pcg = PreconditionedConjugateGradient(f, gd, temperature, &potential,
+                                                  QuadraticLineMinimizer);
+  const solution cg = solve("PreconditionedConjugateGradient", pcg, f, &potential, initial,
+                            precision, 200);
+  Minimizer anderson = Anderson(f, gd, temperature, &potential, QuadraticLineMinimizer);
+  const solution am = solve("Anderson", anderson, f, &potential, initial, precision, 200);
+
+  int retval = 0;
+  printf("Anderson mixing took %.2g times the iterations and %.2g times the time\n",
+         am.iterations/double(cg.iterations), am.seconds/cg.seconds);
+  if (!(fabs(am.energy - cg.energy) < 1e-6)) { // double negatives handle NaNs correctly.
+    printf("FAIL: Anderson energy %.16g differs from conjugate gradient %.16g\n",
+           am.energy, cg.energy);
+    retval++;
+  }
+
+  if (retval == 0) printf("PASS\n");
+  return retval;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include "Monte-Carlo/square-well.h"
+#include "Monte-Carlo/contact-tracker.h"
+#include "handymath.h"
+
+// The contact_tracker keeps the smallest ratio of distance to contact
+// distance up to date as the balls move, which must agree with simply
+// looking at every pair, capped at the largest ratio it cares about.
+// We use cluster moves as well, so that some moves move many balls.
+
+int num_errors = 0;
+
+void setup(sw_simulation &sw, int N, double cell) {
+  sw.well_width = 1.3;
+  sw.walls = 0;
+  sw.sticky_wall = 0;
+  sw.N = N;
+  for (int i=0; i<3; i++) sw.len[i] = cell;
+  sw.translation_scale = 0.3;
+  sw.neighbor_R = 1.3;
+  sw.max_neighbors = std::min(N, 2*max_balls_within(2+sw.neighbor_R));
+  sw.interaction_distance = 2*sw.well_width;
+  sw.energy_levels = N*max_balls_within(sw.interaction_distance*1.1)/2 + 1;
+  sw.energy_histogram = new long[sw.energy_levels]();
+  sw.ln_energy_weights = new double[sw.energy_levels]();
+  sw.optimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_observation = new bool[sw.energy_levels]();
+  sw.biggest_energy_transition = max_balls_within(sw.interaction_distance + 1);
+  sw.transitions_table = new long[sw.energy_levels*(2*sw.biggest_energy_transition+1)]();
+  sw.walkers_up = new long[sw.energy_levels]();
+  sw.iteration = 0;
+  sw.min_important_energy = 0;
+  sw.max_entropy_state = 0;
+  sw.min_energy_state = 0;
+  sw.balls = new ball[sw.N];
+}
+
+void cleanup(sw_simulation &sw) {
+  sw.free_neighbor_tables();
+  delete[] sw.balls;
+  delete[] sw.energy_histogram;
+  delete[] sw.ln_energy_weights;
+  delete[] sw.optimistic_samples;
+  delete[] sw.pessimistic_samples;
+  delete[] sw.pessimistic_observation;
+  delete[] sw.transitions_table;
+  delete[] sw.walkers_up;
+}
+
+double brute_force_min_ratio(const sw_simulation &sw, double max_ratio) {
+  double smallest = max_ratio;
+  for (int i=0; i<sw.N; i++) {
+    for (int j=i+1; j<sw.N; j++) {
+      const double r = periodic_diff(sw.balls[i].pos, sw.balls[j].pos, sw.len, sw.walls).norm()
+        /(sw.balls[i].R + sw.balls[j].R);
+      smallest = min(smallest, r);
+    }
+  }
+  return smallest;
+}
+
+// A vapor at a low temperature, where the balls clump, so the
+// smallest ratio keeps changing hands.
+void run(double min_scaling_factor) {
+  const int cells_per_side = 3;
+  const double a = 4.5; // a packing fraction of 0.18
+  sw_simulation sw;
+  setup(sw, 4*cells_per_side*cells_per_side*cells_per_side, a*cells_per_side);
+  sw.min_T = 0.3;
+  sw.initialize_canonical(sw.min_T);
+  sw.cluster_fraction = 0.2;
+  const double basis[4][3] = {{0,0,0}, {0.5,0.5,0}, {0.5,0,0.5}, {0,0.5,0.5}};
+  int b = 0;
+  for (int i=0; i<cells_per_side; i++) {
+    for (int j=0; j<cells_per_side; j++) {
+      for (int k=0; k<cells_per_side; k++) {
+        for (int l=0; l<4; l++) {
+          sw.balls[b++].pos = vector3d(a*(i + basis[l][0]) + 0.25*a,
+                                       a*(j + basis[l][1]) + 0.25*a,
+                                       a*(k + basis[l][2]) + 0.25*a);
+        }
+      }
+    }
+  }
+  if (sw.initialize_neighbor_tables() < 0) {
+    printf("FAIL: too many neighbors\n");
+    num_errors++;
+    return;
+  }
+  sw.energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                     sw.len, sw.walls, sw.sticky_wall);
+
+  const double max_ratio = 1/min_scaling_factor;
+  contact_tracker contacts(sw.balls, sw.N, sw.len, sw.walls, min_scaling_factor);
+  std::vector<int> moved(sw.N);
+  int disagreements = 0, below_max = 0;
+  double smallest = max_ratio;
+  for (int i=0; i<100*sw.N; i++) {
+    const int num_moved = sw.move_a_ball(false, &moved[0]);
+    for (int k=0; k<num_moved; k++) contacts.moved(moved[k]);
+    const double expected = brute_force_min_ratio(sw, max_ratio);
+    const double tracked = contacts.min_ratio();
+    if (fabs(tracked - expected) > 1e-12*expected) {
+      if (disagreements++ < 5) {
+        printf("FAIL: after move %d, min_ratio is %.16g rather than %.16g\n",
+               i, tracked, expected);
+      }
+    }
+    below_max += expected < max_ratio;
+    smallest = min(smallest, expected);
+  }
+  printf("min scaling factor %g: %d of %d checks below %g, down to %g, with %ld cluster moves\n",
+         min_scaling_factor, below_max, 100*sw.N, max_ratio, smallest,
+         sw.moves.cluster_working);
+  if (disagreements) {
+    printf("FAIL: min_ratio disagreed %d times with min scaling factor %g\n",
+           disagreements, min_scaling_factor);
+    num_errors++;
+  }
+  if (below_max == 0 || below_max == 100*sw.N) {
+    printf("FAIL: the smallest ratio never crossed %g, so we have not tested much\n",
+           max_ratio);
+    num_errors++;
+  }
+  cleanup(sw);
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  random::seed(0);
+  run(0.8);
+  run(0.95);
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
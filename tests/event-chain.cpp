@@ -0,0 +1,146 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <math.h>
+#include "Monte-Carlo/event-chain.h"
+
+// Event chains must sample the same hard-sphere fluid as the usual
+// single-sphere Metropolis moves.  We compare the number of neighbors
+// near contact, which gives g(r) at contact and thus the pressure, for
+// a small periodic system at a packing fraction of 0.3.
+
+const double R = 1;
+const int n = 3, N = n*n*n;
+const double eta = 0.3;
+const double L = cbrt(N*(4*M_PI/3)*R*R*R/eta);
+const double shell_width = 0.2*R;
+
+double ran() {
+  static MTRand my_mtrand(0UL);
+  return my_mtrand.randExc();
+}
+
+Vector3d periodic_diff(const Vector3d &a, const Vector3d &b) {
+  Vector3d v = b - a;
+  for (int k=0; k<3; k++) v[k] -= L*floor(v[k]/L + 0.5);
+  return v;
+}
+
+int overlaps(const Vector3d *spheres) {
+  int num = 0;
+  for (int i=0; i<N; i++) {
+    for (int j=i+1; j<N; j++) {
+      if (periodic_diff(spheres[i], spheres[j]).norm() < 2*R*(1 - 1e-12)) num++;
+    }
+  }
+  return num;
+}
+
+// near_contact gives the mean number of neighbors within shell_width
+// of contact.
+double near_contact(const Vector3d *spheres) {
+  int num = 0;
+  for (int i=0; i<N; i++) {
+    for (int j=i+1; j<N; j++) {
+      if (periodic_diff(spheres[i], spheres[j]).norm() < 2*R + shell_width) num++;
+    }
+  }
+  return 2.0*num/N;
+}
+
+void metropolis_sweep(Vector3d *spheres) {
+  for (int m=0; m<N; m++) {
+    const int i = int(ran()*N) % N;
+    Vector3d v = spheres[i] + 0.3*R*Vector3d(2*ran() - 1, 2*ran() - 1, 2*ran() - 1);
+    for (int k=0; k<3; k++) v[k] -= L*floor(v[k]/L + 0.5);
+    bool ok = true;
+    for (int j=0; j<N && ok; j++) {
+      if (j != i && periodic_diff(v, spheres[j]).norm() < 2*R) ok = false;
+    }
+    if (ok) spheres[i] = v;
+  }
+}
+
+struct estimate {
+  double mean, error;
+};
+
+// sample averages near_contact in blocks, to estimate its error even
+// though successive samples are correlated.
+estimate sample(Vector3d *spheres, void sweep(Vector3d *)) {
+  const int blocks = 20, per_block = 1000;
+  for (int s=0; s<per_block; s++) sweep(spheres);
+  double sum = 0, sumsq = 0;
+  for (int b=0; b<blocks; b++) {
+    double block = 0;
+    for (int s=0; s<per_block; s++) {
+      sweep(spheres);
+      block += near_contact(spheres);
+    }
+    block /= per_block;
+    sum += block;
+    sumsq += block*block;
+  }
+  estimate e;
+  e.mean = sum/blocks;
+  e.error = sqrt((sumsq/blocks - e.mean*e.mean)/(blocks - 1));
+  return e;
+}
+
+event_chain *ecmc = 0;
+
+void chain_sweep(Vector3d *) {
+  // Chains of three diameters carry the motion through a dozen or so
+  // collisions, so a quarter as many chains as spheres moves about as
+  // many spheres as a sweep of single-sphere moves does.
+  for (int m=0; m<N/4; m++) ecmc->chain(default_chain_length(R));
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  int retval = 0;
+
+  Vector3d spheres[N], chained[N];
+  for (int i=0; i<N; i++) {
+    spheres[i] = (L/n)*Vector3d(i % n, (i/n) % n, i/(n*n)) - Vector3d(L/2, L/2, L/2);
+    chained[i] = spheres[i];
+  }
+  const double len[3] = {L, L, L};
+  const bool periodic[3] = {true, true, true};
+  const bool walls[3] = {false, false, false};
+  event_chain chains(chained, N, R, len, periodic, walls);
+  ecmc = &chains;
+
+  const estimate metropolis = sample(spheres, metropolis_sweep);
+  const estimate event = sample(chained, chain_sweep);
+  printf("neighbors near contact: metropolis %g +/- %g, event chains %g +/- %g\n",
+         metropolis.mean, metropolis.error, event.mean, event.error);
+  printf("%g collisions per event chain\n", chains.collisions/double(chains.chains));
+  const double tolerance = 4*sqrt(metropolis.error*metropolis.error + event.error*event.error);
+  if (!(fabs(metropolis.mean - event.mean) < tolerance)) {
+    printf("FAIL: event chains differ from metropolis by %g, more than %g\n",
+           fabs(metropolis.mean - event.mean), tolerance);
+    retval++;
+  }
+  if (overlaps(chained)) {
+    printf("FAIL: event chains left %d overlapping pairs\n", overlaps(chained));
+    retval++;
+  }
+
+  if (retval == 0) printf("PASS\n");
+  return retval;
+}
@@ -0,0 +1,60 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include "fft-sizes.h"
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  int errorcode = 0;
+  for (int n=1; n<5000; n++) {
+    const int m = fft_friendly_size(n);
+    if (m < n || m & 1 || !is_fft_friendly(m)) {
+      printf("FAIL: fft_friendly_size(%d) = %d is no good\n", n, m);
+      errorcode++;
+    }
+    for (int k=n+(n&1); k<m; k+=2) {
+      if (is_fft_friendly(k)) {
+        printf("FAIL: fft_friendly_size(%d) = %d skipped %d\n", n, m, k);
+        errorcode++;
+      }
+    }
+  }
+  if (fft_grid_size(1649.5, exact_grid_sizes) != 1650 ||
+      fft_grid_size(1649.5, fft_friendly_grid_sizes) != 1680) {
+    printf("FAIL: fft_grid_size is wrong\n");
+    errorcode++;
+  }
+  // Unless asked, the generated functionals keep the size they always
+  // had.
+  if (fft_grid_size(1649.5) != 1650) {
+    printf("FAIL: fft_grid_size rounds up by default\n");
+    errorcode++;
+  }
+  grid_sizing() = fft_friendly_grid_sizes;
+  if (fft_grid_size(1649.5) != 1680) {
+    printf("FAIL: fft_grid_size ignores grid_sizing()\n");
+    errorcode++;
+  }
+  grid_sizing() = exact_grid_sizes;
+  const int timed = fft_grid_size(1000.5, timed_grid_sizes);
+  printf("Timing chose %d for 1002\n", timed);
+  if (timed < 1002 || !is_fft_friendly(timed) || timed & 1) {
+    printf("FAIL: timed_fft_size gave %d\n", timed);
+    errorcode++;
+  }
+  return errorcode;
+}
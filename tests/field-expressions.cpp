@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include "new/Vector.h"
+
+int num_errors = 0;
+
+void check(const char *name, double got, double expected) {
+  if (got != expected) {
+    printf("FAIL: %s is %.17g rather than %.17g\n", name, got, expected);
+    num_errors++;
+  }
+}
+
+// Reductions may round differently from our loops (e.g. when the
+// compiler fuses a multiply and an add), so we only ask them to agree
+// to within a few rounding errors of the magnitude of their terms.
+void check_close(const char *name, double got, double expected, double magnitude) {
+  if (!(fabs(got - expected) <= 1e-14*magnitude)) { // double negatives handle NaNs correctly.
+    printf("FAIL: %s is %.17g rather than %.17g\n", name, got, expected);
+    num_errors++;
+  }
+}
+
+void check(const char *name, const Vector &got, const double *expected, int n) {
+  if (got.get_size() != n) {
+    printf("FAIL: %s has size %d rather than %d\n", name, got.get_size(), n);
+    num_errors++;
+    return;
+  }
+  int bad = 0;
+  for (int i=0; i<n; i++) if (got[i] != expected[i]) bad++;
+  if (bad) {
+    printf("FAIL: %s has %d wrong elements\n", name, bad);
+    num_errors++;
+  }
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  const int N = 1000;
+  Vector a(N), b(N), c(N), d(N);
+  for (int i=0; i<N; i++) {
+    a[i] = sin(i);
+    b[i] = cos(0.3*i);
+    c[i] = 1.0/(1 + i);
+  }
+  double expected[N];
+
+  // A chain of operations should give exactly what we got when each
+  // step made its own array, and should not need any temporary
+  // arrays.
+  {
+    const long live = the_profiler().live_bytes, peak = the_profiler().peak_bytes;
+    d = -a + 2.0*b - c/3.0 + 0.5;
+    if (the_profiler().live_bytes != live || the_profiler().peak_bytes != peak) {
+      printf("FAIL: evaluating an expression allocated %ld bytes\n",
+             the_profiler().peak_bytes - peak);
+      num_errors++;
+    }
+    for (int i=0; i<N; i++) expected[i] = ((-a[i] + 2.0*b[i]) - c[i]/3.0) + 0.5;
+    check("d", d, expected, N);
+  }
+  {
+    double dot = 0, sum = 0, dot_magnitude = 0, sum_magnitude = 0;
+    for (int i=0; i<N; i++) {
+      dot += a[i]*(b[i] - c[i]);
+      sum += a[i] - c[i];
+      dot_magnitude += fabs(a[i]*(b[i] - c[i]));
+      sum_magnitude += fabs(a[i] - c[i]);
+    }
+    check_close("a.dot(b - c)", a.dot(b - c), dot, dot_magnitude);
+    check_close("(b - c).dot(a)", (b - c).dot(a), dot, dot_magnitude);
+    check_close("(a - c).sum()", (a - c).sum(), sum, sum_magnitude);
+    double normsqr = 0;
+    for (int i=0; i<N; i++) normsqr += (a[i] + b[i])*(a[i] + b[i]);
+    check_close("(a + b).norm()", (a + b).norm(), sqrt(normsqr), sqrt(normsqr));
+    check("(a + b)[7]", (a + b)[7], a[7] + b[7]);
+  }
+
+  // Assigning to an empty Vector gives it a new array.
+  {
+    Vector e;
+    e = a - b;
+    for (int i=0; i<N; i++) expected[i] = a[i] - b[i];
+    check("e", e, expected, N);
+    e[0] = 137;
+    check("a[0]", a[0], sin(0));
+    Vector f = 3.0*e;
+    for (int i=0; i<N; i++) expected[i] = 3.0*e[i];
+    check("f", f, expected, N);
+  }
+
+  // An empty Vector in a sum or difference acts like zero, as in the
+  // first step of a conjugate gradient minimization.
+  {
+    Vector direction, oldgrad;
+    const double beta = 0;
+    direction = -a + beta*direction;
+    for (int i=0; i<N; i++) expected[i] = -a[i];
+    check("direction", direction, expected, N);
+    check("a.dot(b - oldgrad)", a.dot(b - oldgrad), a.dot(b));
+    Vector g = oldgrad - b;
+    for (int i=0; i<N; i++) expected[i] = -b[i];
+    check("oldgrad - b", g, expected, N);
+    Vector nothing;
+    nothing = oldgrad + 2.0*direction.slice(0, 0);
+    check("size of an empty sum", nothing.get_size(), 0);
+    // a + empty is a copy of a, not a itself.
+    Vector copy;
+    copy = a + oldgrad;
+    copy[0] = 137;
+    check("a[0] after writing to a + empty", a[0], sin(0));
+  }
+
+  // Updating a Vector in place from an expression involving itself
+  // works element by element, and an overlapping slice of the same
+  // array is handled by working from a copy.
+  {
+    Vector e(N);
+    e = a;
+    e = 0.5*e + b;
+    for (int i=0; i<N; i++) expected[i] = 0.5*a[i] + b[i];
+    check("e = 0.5*e + b", e, expected, N);
+
+    Vector whole(N);
+    whole = a;
+    Vector front = whole.slice(0, N-1), back = whole.slice(1, N-1);
+    front += 2.0*back;
+    for (int i=0; i<N-1; i++) expected[i] = a[i] + 2.0*a[i+1];
+    expected[N-1] = a[N-1];
+    check("front += 2*back", whole, expected, N);
+  }
+
+  // ComplexVector works the same way.
+  {
+    ComplexVector x(N), y(N), z(N);
+    for (int i=0; i<N; i++) {
+      x[i] = std::complex<double>(a[i], b[i]);
+      y[i] = std::complex<double>(c[i], -a[i]);
+    }
+    const std::complex<double> s(0.5, 2);
+    z = s*x - y;
+    int bad = 0;
+    std::complex<double> dot = 0;
+    double dot_magnitude = 0;
+    for (int i=0; i<N; i++) {
+      if (z[i] != s*x[i] - y[i]) bad++;
+      dot += x[i]*(x[i] + y[i]);
+      dot_magnitude += std::abs(x[i]*(x[i] + y[i]));
+    }
+    if (bad) {
+      printf("FAIL: complex expression has %d wrong elements\n", bad);
+      num_errors++;
+    }
+    if (!(std::abs(x.dot(x + y) - dot) <= 1e-14*dot_magnitude)) {
+      printf("FAIL: complex dot product is wrong\n");
+      num_errors++;
+    }
+  }
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
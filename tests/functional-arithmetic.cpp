@@ -123,6 +123,19 @@ int main(int, char **argv) {
   retval += test_functionals("Simple subtraction",
                              0 - x, -1*x, 0.1, 1e-12);
 
+  // The following tests that memoizing convolutions doesn't change anything...
+  {
+    const Functional nbar = StepConvolve(1)(x), n2 = ShellConvolve(1)(x);
+    const Functional f = nbar*n2 + sqr(nbar) + log(1 - nbar)*StepConvolve(1)(x);
+    retval += test_functionals("memoized convolutions", memoize(f), f, 0.01, 1e-12);
+    printf("The convolution cache had %ld hits and %ld misses.\n",
+           ConvolutionCache::hits, ConvolutionCache::misses);
+    if (ConvolutionCache::hits == 0) {
+      printf("FAIL: memoize never reused a convolution!\n");
+      retval++;
+    }
+  }
+
   if (retval == 0) {
     printf("\n%s passes!\n", argv[0]);
   } else {
@@ -0,0 +1,103 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <thread>
+#include "Functionals.h"
+
+// Several threads evaluate one functional at once, each at its own
+// temperature, and should get just what we get one at a time.
+
+const int num_temperatures = 4;
+const double temperatures[num_temperatures] = { 1e-3, 2e-3, 5e-3, 1e-2 };
+const int repeats = 5;
+
+double bumpy_density(Cartesian r) {
+  return 0.001*(1 + 0.5*exp(-(r*r)));
+}
+
+struct result {
+  double energy;
+  VectorXd grad;
+};
+
+result evaluate(Functional f, double kT, const Grid &n) {
+  result r;
+  r.energy = f.integral(kT, n);
+  r.grad = VectorXd::Zero(n.description().NxNyNz);
+  f.integralgrad(kT, n, &r.grad);
+  return r;
+}
+
+void worker(const Functional *f, int which, const Grid *n, const result *expected,
+            int *mismatches) {
+  for (int i=0; i<repeats; i++) {
+    // Copying the functional shares its counter with every other
+    // thread's copy.
+    Functional mine = *f;
+    const result r = evaluate(mine, temperatures[which], *n);
+    const double scale = fabs(expected->energy) + 1e-300;
+    if (fabs(r.energy - expected->energy) > 1e-12*scale ||
+        (r.grad - expected->grad).cwise().abs().maxCoeff() >
+        1e-12*expected->grad.cwise().abs().maxCoeff()) {
+      (*mismatches)++;
+    }
+  }
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  Lattice lat(Cartesian(4,0,0), Cartesian(0,4,0), Cartesian(0,0,4));
+  GridDescription gd(lat, 0.25);
+  Grid n(gd);
+  n.Set(bumpy_density);
+
+  const double R = 1.0;
+  Functional f = memoize(HardSpheresWBnotensor(R) + IdealGas() + ChemicalPotential(-0.01));
+
+  result expected[num_temperatures];
+  for (int i=0; i<num_temperatures; i++) {
+    expected[i] = evaluate(f, temperatures[i], n);
+    printf("energy at kT = %g is %.15g\n", temperatures[i], expected[i].energy);
+  }
+
+  int mismatches[num_temperatures] = { 0, 0, 0, 0 };
+  std::vector<std::thread> threads;
+  for (int i=0; i<num_temperatures; i++) {
+    threads.push_back(std::thread(worker, &f, i, &n, &expected[i], &mismatches[i]));
+  }
+  for (int i=0; i<num_temperatures; i++) threads[i].join();
+
+  int retval = 0;
+  for (int i=0; i<num_temperatures; i++) {
+    if (mismatches[i]) {
+      printf("FAIL: %d of %d evaluations at kT = %g differ\n",
+             mismatches[i], repeats, temperatures[i]);
+      retval++;
+    }
+  }
+
+  // The functional should still be intact now that every thread's
+  // copy is gone.
+  const result again = evaluate(f, temperatures[0], n);
+  if (again.energy != expected[0].energy) {
+    printf("FAIL: energy changed to %.15g after the threads finished\n", again.energy);
+    retval++;
+  }
+
+  if (retval == 0) printf("PASS\n");
+  return retval;
+}
@@ -0,0 +1,118 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "Monte-Carlo/InitBox.h"
+
+// INITBOX bins start out with room for a few atoms each and grow when
+// one fills up.  We crowd more atoms than that into a single bin, and
+// check that the bins still find every bond that a plain loop over
+// all pairs does, both right away and after the atoms have moved.
+
+int num_errors = 0;
+
+double wrap(double d, double L) {
+  return d - L*floor(d/L + 0.5);
+}
+
+double distance2(const INITBOX &box, int i, int j) {
+  const double dx = wrap(box.list[i].x - box.list[j].x, box.lx);
+  const double dy = wrap(box.list[i].y - box.list[j].y, box.ly);
+  const double dz = wrap(box.list[i].z - box.list[j].z, box.lz);
+  return dx*dx + dy*dy + dz*dz;
+}
+
+int bonds(const INITBOX &box, int i) {
+  const double well = box.sigma*box.lambda;
+  int num = 0;
+  for (int j=0; j<box.numAtoms; j++) {
+    if (j != i && distance2(box, i, j) < well*well) num++;
+  }
+  return num;
+}
+
+void check(INITBOX &box, const char *when) {
+  if (!box.testBinnedAtoms()) {
+    printf("FAIL: %s, some atoms are missing from their bins\n", when);
+    num_errors++;
+  }
+  int total = 0, wrong = 0;
+  for (int i=0; i<box.numAtoms; i++) {
+    total += bonds(box, i);
+    if (box.atomEnergy(i) != bonds(box, i)*box.wellDepth) wrong++;
+  }
+  printf("%s: %d atoms with %d bonds in bins holding up to %d atoms\n",
+         when, box.numAtoms, total/2, box.binCapacity);
+  if (wrong) {
+    printf("FAIL: %s, %d atoms have the wrong energy\n", when, wrong);
+    num_errors++;
+  }
+  if (box.totalEnergy() != 0.5*total*box.wellDepth) {
+    printf("FAIL: %s, total energy %g should be %g\n", when, box.totalEnergy(),
+           0.5*total*box.wellDepth);
+    num_errors++;
+  }
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  INITBOX box(12); // four bins of width 3 along each side
+  box.wellDepth = 1;
+  const int first_capacity = box.binCapacity;
+
+  // A slightly stretched fcc cell puts 14 atoms in the first bin.
+  // The rest go at random, well away from that bin.
+  const double a = 2.9, corner = 0.05;
+  const double sites[14][3] = {{0,0,0}, {1,0,0}, {0,1,0}, {0,0,1}, {1,1,0}, {1,0,1},
+                               {0,1,1}, {1,1,1}, {0.5,0.5,0}, {0.5,0,0.5}, {0,0.5,0.5},
+                               {1,0.5,0.5}, {0.5,1,0.5}, {0.5,0.5,1}};
+  std::vector<ATOM> atoms;
+  for (int s=0; s<14; s++) {
+    atoms.push_back(ATOM(corner + a*sites[s][0], corner + a*sites[s][1],
+                         corner + a*sites[s][2], box.sigma, box.lambda));
+  }
+  srand(0);
+  while (atoms.size() < 60) {
+    ATOM atom(5 + 5*(rand()/(RAND_MAX + 1.0)), box.ly*(rand()/(RAND_MAX + 1.0)),
+              box.lz*(rand()/(RAND_MAX + 1.0)), box.sigma, box.lambda);
+    bool overlaps = false;
+    for (unsigned j=0; j<atoms.size(); j++) {
+      const double dx = wrap(atom.x - atoms[j].x, box.lx);
+      const double dy = wrap(atom.y - atoms[j].y, box.ly);
+      const double dz = wrap(atom.z - atoms[j].z, box.lz);
+      if (dx*dx + dy*dy + dz*dz < box.sigma*box.sigma) overlaps = true;
+    }
+    if (!overlaps) atoms.push_back(atom);
+  }
+  for (unsigned i=0; i<atoms.size(); i++) box.addAtom(atoms[i].x, atoms[i].y, atoms[i].z);
+  if (box.binCapacity <= first_capacity) {
+    printf("FAIL: the bins never grew past %d atoms\n", first_capacity);
+    num_errors++;
+  }
+  check(box, "crowded");
+
+  box.temperature = 1000;
+  int accepted = 0;
+  for (int m=0; m<100*box.numAtoms; m++) accepted += box.randStep();
+  printf("accepted %d moves\n", accepted);
+  check(box, "moved");
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
@@ -0,0 +1,72 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Monte-Carlo/initial-packing.h"
+
+// initial_packing should find an overlap-free start by the method we
+// expect for the packing fraction, whatever the radius of the spheres.
+// A radius that isn't a power of two is the interesting case, since
+// growing the spheres towards it must reach it exactly.
+
+int num_errors = 0;
+
+void check(int N, double R, double eta, const char *expected) {
+  packing_cell cell;
+  const double len = cbrt(N*(4*M_PI/3)*R*R*R/eta);
+  for (int k=0; k<3; k++) {
+    cell.len[k] = len;
+    cell.periodic[k] = true;
+    cell.wall[k] = false;
+  }
+  cell.inner_radius = cell.outer_radius = 0;
+  std::vector<vector3d> spheres(N);
+  const char *method = initial_packing(&spheres[0], N, R, cell);
+  printf("N = %d, R = %g, eta = %g: %s\n", N, R, eta, method ? method : "nothing worked");
+  if (!method || strcmp(method, expected)) {
+    printf("FAIL: expected %s\n", expected);
+    num_errors++;
+  }
+  int overlaps = 0;
+  for (int i=0; i<N; i++) {
+    for (int j=i+1; j<N; j++) {
+      vector3d d = spheres[i] - spheres[j];
+      for (int k=0; k<3; k++) d[k] -= len*round(d[k]/len);
+      if (d.norm() < 2*R) overlaps++;
+    }
+  }
+  if (overlaps) {
+    printf("FAIL: %d overlapping pairs\n", overlaps);
+    num_errors++;
+  }
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  random::seed(0);
+  check(100, 1, 0.1, "random sequential addition");
+  check(100, 1.3, 0.1, "random sequential addition");
+  check(100, 1, 0.4, "sphere growth");
+  check(100, 1.3, 0.4, "sphere growth");
+  check(100, 0.7, 0.4, "sphere growth");
+  check(100, 1.3, 0.6, "fcc lattice");
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
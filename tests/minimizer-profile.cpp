@@ -0,0 +1,65 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include "Functionals.h"
+#include "LineMinimizer.h"
+#include "profiling.h"
+
+// A Minimizer wrapped in others (as MaxIter(Precision(...)) always
+// is) must be profiled once per iteration, not once per layer, and
+// likewise for any other scope nested in one of the same name.
+
+int num_errors = 0;
+
+void check_calls(const char *name, long calls) {
+  const long seen = the_profiler().entries[name].calls;
+  printf("%s: %ld calls\n", name, seen);
+  if (seen != calls) {
+    printf("FAIL: %s should have %ld calls, not %ld\n", name, calls, seen);
+    num_errors++;
+  }
+}
+
+void recurse(int depth) {
+  profile_scope profile("recurse");
+  if (depth > 1) recurse(depth - 1);
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  start_profiling();
+
+  recurse(3);
+  check_calls("recurse", 1);
+
+  Lattice lat(Cartesian(1,0,0), Cartesian(0,1,0), Cartesian(0,0,1));
+  GridDescription gd(lat, 0.25);
+  const double temperature = 1e-3, density = 1e-3;
+  Functional f = OfEffectivePotential(IdealGas()
+                                      + ChemicalPotential(temperature*log(density)));
+  Grid potential(gd);
+  potential = 0.5*temperature*VectorXd::Ones(gd.NxNyNz);
+  Minimizer min = MaxIter(20, Precision(1e-12,
+                                        ConjugateGradient(f, gd, temperature, &potential,
+                                                          QuadraticLineMinimizer)));
+  long iterations = 1; // the last call, which returns false, counts too
+  while (min.improve_energy(false)) iterations++;
+  check_calls("Minimizer::improve_energy", iterations);
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
@@ -0,0 +1,157 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <time.h>
+#include "Functionals.h"
+
+// On a mirror_z_boundary grid, convolutions of fields that are even or
+// odd in z use cosine and sine transforms, and should give just what
+// the full FFT gives on an ordinary grid.
+
+int retval = 0;
+
+// These fields are smooth across the edges of the cell, so it doesn't
+// matter which side Grid::Set puts points that are right on the edge.
+double even_density(Cartesian r) {
+  return 0.001*(1 + 0.5*exp(-(r*r)) + 0.2*exp(-2*r.z()*r.z())*cos(M_PI*r.x()/2)*
+                (1 + 0.5*sin(M_PI*r.y()/2)));
+}
+
+double odd_field(Cartesian r) {
+  return sin(M_PI*r.z()/3)*exp(-r.x()*r.x() - r.y()*r.y());
+}
+
+double lopsided_density(Cartesian r) {
+  return 0.001*(1 + 0.5*exp(-(r - Cartesian(0,0,0.5)).squaredNorm()));
+}
+
+void check_parity(const char *name, const GridDescription &gd, double f(Cartesian),
+                  int expected) {
+  Grid g(gd);
+  g.Set(f);
+  const int parity = mirror_z_parity(gd, g);
+  if (parity != expected) {
+    printf("FAIL: %s has parity %d rather than %d\n", name, parity, expected);
+    retval++;
+  }
+}
+
+void check_fft(const char *name, const GridDescription &gd, double f(Cartesian), int parity) {
+  Grid g(gd);
+  g.Set(f);
+  const ReciprocalGrid full = fft(gd, g);
+  const VectorXcd half = mirror_z_fft(gd, g, parity);
+  double err = 0;
+  for (int i=0; i<half.rows(); i++) {
+    err = std::max(err, std::abs(half[i] - full[mirror_z_index(gd, i)]));
+  }
+  const double scale = full.cwise().abs().maxCoeff();
+  printf("%s: mirror_z_fft differs from fft by %g out of %g\n", name, err, scale);
+  if (err > 1e-12*scale) {
+    printf("FAIL: mirror_z_fft of %s is wrong\n", name);
+    retval++;
+  }
+  const Grid back = mirror_z_ifft(gd, half, parity);
+  const double backerr = (back - g).cwise().abs().maxCoeff();
+  if (backerr > 1e-12*g.cwise().abs().maxCoeff()) {
+    printf("FAIL: mirror_z_ifft of %s is off by %g\n", name, backerr);
+    retval++;
+  }
+}
+
+void compare(const char *name, Functional f, double kT, double density(Cartesian),
+             const GridDescription &periodic, const GridDescription &mirrored) {
+  Grid n(periodic), m(mirrored);
+  n.Set(density);
+  m.Set(density);
+  const double e = f.integral(kT, n), em = f.integral(kT, m);
+  VectorXd grad = VectorXd::Zero(periodic.NxNyNz), gradm = VectorXd::Zero(mirrored.NxNyNz);
+  f.integralgrad(kT, n, &grad);
+  f.integralgrad(kT, m, &gradm);
+  const double graderr = (grad - gradm).cwise().abs().maxCoeff();
+  const double gradscale = grad.cwise().abs().maxCoeff();
+  printf("%s: energy %.15g vs %.15g, gradient off by %g out of %g\n",
+         name, e, em, graderr, gradscale);
+  if (fabs(e - em) > 1e-10*fabs(e) || graderr > 1e-10*gradscale) {
+    printf("FAIL: %s differs with mirror_z_boundary\n", name);
+    retval++;
+  }
+}
+
+// How long the energy and gradient take, which shows what the cosine
+// and sine transforms save.  Only the convolutions get faster, and
+// only their reciprocal-space scratch is halved, since fields are
+// still stored on the full grid.
+double seconds_per_gradient(Functional f, double kT, double density(Cartesian),
+                            const GridDescription &gd) {
+  Grid n(gd);
+  n.Set(density);
+  VectorXd grad = VectorXd::Zero(gd.NxNyNz);
+  f.integralgrad(kT, n, &grad); // so we don't time the FFTW planning
+  const int num_gradients = 10;
+  const clock_t start = clock();
+  for (int i=0; i<num_gradients; i++) {
+    f.integral(kT, n);
+    f.integralgrad(kT, n, &grad);
+  }
+  return (clock() - double(start))/CLOCKS_PER_SEC/num_gradients;
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  Lattice lat(Cartesian(4,0,0), Cartesian(0,4,0), Cartesian(0,0,6));
+  // This lattice would have 25 points along z, which mirror_z_boundary
+  // rounds up to a multiple of four.
+  const GridDescription mirrored(lat, 0.25, exact_grid_sizes, mirror_z_boundary);
+  const GridDescription periodic(lat, mirrored.Nx, mirrored.Ny, mirrored.Nz);
+  if (mirrored.Nz % 4) {
+    printf("FAIL: mirror_z_boundary grid has Nz = %d\n", mirrored.Nz);
+    retval++;
+  }
+
+  check_parity("even density", mirrored, even_density, 1);
+  check_parity("odd field", mirrored, odd_field, -1);
+  check_parity("lopsided density", mirrored, lopsided_density, 0);
+  check_parity("even density on a periodic grid", periodic, even_density, 0);
+
+  check_fft("even density", mirrored, even_density, 1);
+  check_fft("odd field", mirrored, odd_field, -1);
+
+  const double R = 1.0, kT = 1e-3;
+  // The white bear functional convolves with both even and odd
+  // kernels, giving even and odd fields along the way.
+  compare("white bear", HardSpheresWBnotensor(R) + IdealGas() + ChemicalPotential(-0.01),
+          kT, even_density, periodic, mirrored);
+  // A field that isn't symmetric just uses the full FFT.
+  compare("lopsided white bear", HardSpheresWBnotensor(R) + IdealGas(),
+          kT, lopsided_density, periodic, mirrored);
+
+  {
+    Lattice biglat(Cartesian(4,0,0), Cartesian(0,4,0), Cartesian(0,0,20));
+    const GridDescription bigmirrored(biglat, 0.1, exact_grid_sizes, mirror_z_boundary);
+    const GridDescription bigperiodic(biglat, bigmirrored.Nx, bigmirrored.Ny, bigmirrored.Nz);
+    Functional wb = HardSpheresWBnotensor(R) + IdealGas() + ChemicalPotential(-0.01);
+    const double full = seconds_per_gradient(wb, kT, even_density, bigperiodic);
+    const double mirror = seconds_per_gradient(wb, kT, even_density, bigmirrored);
+    printf("white bear on a %d x %d x %d grid takes %.3g seconds with the full FFT\n"
+           "    and %.3g seconds with mirror_z_boundary, %.2g times as long\n",
+           bigmirrored.Nx, bigmirrored.Ny, bigmirrored.Nz, full, mirror, mirror/full);
+  }
+
+  if (retval == 0) printf("PASS\n");
+  return retval;
+}
@@ -16,7 +16,9 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
 #include "new/Vector.h"
+#include "handymath.h"
 
 int main(int, char *argv[]) {
   printf("Working on %s\n", argv[0]);
@@ -40,5 +42,106 @@ int main(int, char *argv[]) {
       errorcode += 1;
     }
   }
+
+  // Now check that single precision FFTs agree to single precision.
+  fft_in_single_precision() = true;
+  ComplexVector ks_single = fft(Nx, Ny, Nz, dV, rs);
+  Vector rs_single = ifft(Nx, Ny, Nz, dV, ks_single);
+  fft_in_single_precision() = false;
+  double maxerr = 0;
+  for (int i=0;i<NxNyNz;i++) {
+    maxerr = max(maxerr, fabs(rs[i] - rs_single[i]));
+  }
+  printf("Maximum single precision error is %g\n", maxerr);
+  if (maxerr > 1e-6) {
+    printf("FAIL: single precision FFTs are too inaccurate!\n");
+    errorcode += 1;
+  }
+
+  // Batched transforms should agree with doing them one at a time.
+  Vector rs_squared(NxNyNz);
+  for (int i=0; i<NxNyNz; i++) rs_squared[i] = rs[i]*rs[i];
+  const Vector *rs_batch[] = { &rs, &rs_squared };
+  ComplexVector ks_many, ks_squared_many;
+  ComplexVector *ks_batch[] = { &ks_many, &ks_squared_many };
+  fft_many(Nx, Ny, Nz, dV, 2, rs_batch, ks_batch);
+  ComplexVector ks_squared = fft(Nx, Ny, Nz, dV, rs_squared);
+  for (int i=0;i<ks.get_size();i++) {
+    if (abs(ks[i] - ks_many[i]) > 1e-12 || abs(ks_squared[i] - ks_squared_many[i]) > 1e-12) {
+      printf("Error of %g in batched fft\n", abs(ks_squared[i] - ks_squared_many[i]));
+      errorcode += 1;
+      break;
+    }
+  }
+  Vector rs_many, rs_squared_many;
+  const ComplexVector *ks_inputs[] = { &ks_many, &ks_squared_many };
+  Vector *rs_outputs[] = { &rs_many, &rs_squared_many };
+  ifft_many(Nx, Ny, Nz, dV, 2, ks_inputs, rs_outputs);
+  for (int i=0;i<NxNyNz;i++) {
+    if (fabs(rs[i] - rs_many[i]) > 1e-15 || fabs(rs_squared[i] - rs_squared_many[i]) > 1e-15) {
+      printf("Error of %g in batched ifft\n", rs_squared[i] - rs_squared_many[i]);
+      errorcode += 1;
+      break;
+    }
+  }
+
+  // The generated code batches the inverse transforms of the three
+  // components of a vector weighted density, so that is what we time.
+  // This is a benchmark, not a test: how much batching gains depends
+  // on the FFTW build.
+  {
+    ComplexVector ks_three[] = { ks, ks_many, ks_squared_many };
+    const ComplexVector *ks_three_in[] = { &ks_three[0], &ks_three[1], &ks_three[2] };
+    Vector rs_three[3];
+    Vector *rs_three_out[] = { &rs_three[0], &rs_three[1], &rs_three[2] };
+    ifft_many(Nx, Ny, Nz, dV, 3, ks_three_in, rs_three_out); // plan once, untimed
+    const int repeats = 10;
+    clock_t start = clock();
+    for (int n=0; n<repeats; n++) {
+      for (int j=0; j<3; j++) {
+        rs_three[j].free();
+        rs_three[j] = ifft(Nx, Ny, Nz, dV, ks_three[j]);
+      }
+    }
+    const double separate = (clock() - double(start))/CLOCKS_PER_SEC/repeats;
+    start = clock();
+    for (int n=0; n<repeats; n++) {
+      for (int j=0; j<3; j++) rs_three[j].free();
+      ifft_many(Nx, Ny, Nz, dV, 3, ks_three_in, rs_three_out);
+    }
+    const double batched = (clock() - double(start))/CLOCKS_PER_SEC/repeats;
+    printf("three iffts of %d x %d x %d take %.3g seconds one at a time\n"
+           "    and %.3g seconds batched, %.2g times as long\n",
+           Nx, Ny, Nz, separate, batched, batched/separate);
+  }
+
+  // And that FFTs work on fields that live in a scratch file, which
+  // they transform a slab at a time.  We make the slabs small enough
+  // that neither the planes nor the columns divide evenly into them.
+  set_field_scratch_directory(".", 0);
+  const long slab_bytes = field_slab_bytes();
+  field_slab_bytes() = 7*Ny*(Nz/2 + 1)*sizeof(std::complex<double>);
+  Vector rs_mapped(NxNyNz);
+  rs_mapped = rs;
+  ComplexVector ks_mapped = fft(Nx, Ny, Nz, dV, rs_mapped);
+  for (int i=0;i<ks.get_size();i++) {
+    if (abs(ks[i] - ks_mapped[i]) > 1e-12) {
+      printf("Error of %g in slab fft\n", abs(ks[i] - ks_mapped[i]));
+      errorcode += 1;
+      break;
+    }
+  }
+  Vector rs_mapped_again = ifft(Nx, Ny, Nz, dV, ks_mapped);
+  Vector tail = rs_mapped_again.slice(NxNyNz/2, NxNyNz - NxNyNz/2);
+  rs_mapped_again.free(); // the slice should keep the mapping alive
+  field_slab_bytes() = slab_bytes;
+  set_field_scratch_directory(0);
+  for (int i=0;i<tail.get_size();i++) {
+    double e = rs[NxNyNz/2 + i] - tail[i];
+    if (fabs(e) > 1e-15) {
+      printf("Error of %g in scratch-backed field\n", e);
+      errorcode += 1;
+    }
+  }
   return errorcode;
 }
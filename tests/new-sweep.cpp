@@ -0,0 +1,143 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <math.h>
+#include "new/Sweep.h"
+
+// TestWorker "minimizes" by relaxing its field towards a target that
+// depends on the parameters, and counts the iterations it needs, so we
+// can see whether it was warm-started.  Its grid gets bigger with the
+// first parameter, like that of a crystal's unit cell, so it can only
+// be warm-started by resampling.
+class TestWorker : public SweepWorker {
+public:
+  void set_up(const std::vector<double> &p) {
+    N = 8 + int(100*(p[0] - 1));
+    x.free();
+    x = Vector(N*N*N);
+    x = 0;
+    report("Setting up a = %g, b = %g on a %d^3 grid\n", p[0], p[1], N);
+  }
+  Vector field() {
+    return x;
+  }
+  void get_grid(int *Nx, int *Ny, int *Nz) {
+    *Nx = *Ny = *Nz = N;
+  }
+  std::vector<double> solve(const std::vector<double> &p) {
+    const double target = p[0] + 10*p[1];
+    // The converged field is a smooth function of the fractional
+    // coordinates, whose average is the target.
+    Vector goal(N*N*N);
+    for (int i=0; i<N*N*N; i++) {
+      goal[i] = target*(1 + 0.01*cos(2*M_PI*(i/(N*N))/N)*cos(2*M_PI*(i % N)/N));
+    }
+    int iters = 0;
+    while ((x - goal).norm() > 1e-10*sqrt(N*N*N)) {
+      x = 0.5*(x + goal);
+      iters++;
+    }
+    report("Solved a = %g, b = %g in %d iterations\n", p[0], p[1], iters);
+    return {x.sum()/(N*N*N), double(iters)};
+  }
+private:
+  int N;
+  Vector x;
+};
+
+SweepWorker *make_test_worker() {
+  return new TestWorker();
+}
+
+// check_sweep runs a sweep over na values of a and nb values of b,
+// and checks the results and that most points were warm-started.
+int check_sweep(int na, int nb) {
+  int errorcode = 0;
+  Sweep sweep("a b", "target iterations");
+  for (int i=0; i<na; i++) {
+    for (int j=0; j<nb; j++) {
+      sweep.add_point({1 + 0.01*i, 2 + 0.01*j});
+    }
+  }
+  sweep.run(make_test_worker, 4);
+  sweep.write_table("new-sweep-test.dat");
+
+  FILE *f = fopen("new-sweep-test.dat", "r");
+  char header[1000];
+  if (!f || !fgets(header, 1000, f)) {
+    printf("FAIL: could not read the table!\n");
+    return 1;
+  }
+  int warm_starts = 0;
+  for (int n=0; n<sweep.num_points(); n++) {
+    double a, b, target, iters;
+    if (fscanf(f, "%lg %lg %lg %lg", &a, &b, &target, &iters) != 4) {
+      printf("FAIL: short table!\n");
+      return 1;
+    }
+    if (fabs(target - (a + 10*b)) > 1e-9) {
+      printf("FAIL: bad result %g for %g %g\n", target, a, b);
+      errorcode++;
+    }
+    // A cold start needs 38 iterations, a warm start fewer.
+    if (iters < 35) warm_starts++;
+  }
+  fclose(f);
+  remove("new-sweep-test.dat");
+  printf("%d of %d points were warm-started\n", warm_starts, sweep.num_points());
+  if (warm_starts < sweep.num_points()/2) {
+    printf("FAIL: not enough warm starts\n");
+    errorcode++;
+  }
+  return errorcode;
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  int errorcode = 0;
+
+  // Resampling a smooth periodic field onto another grid should give
+  // nearly the same function of the fractional coordinates, and
+  // resampling onto the same grid shouldn't change it at all.
+  {
+    const int N = 16, M = 23;
+    Vector f(N*N*N);
+    for (int i=0; i<N*N*N; i++) f[i] = sin(2*M_PI*(i/(N*N))/N) + cos(2*M_PI*(i % N)/N);
+    const Vector same = resample_periodic(f, N, N, N, N, N, N);
+    if ((same - f).norm() != 0) {
+      printf("FAIL: resampling onto the same grid changed the field by %g\n", (same - f).norm());
+      errorcode++;
+    }
+    const Vector g = resample_periodic(f, N, N, N, M, M, M);
+    double maxerr = 0;
+    for (int i=0; i<M*M*M; i++) {
+      const double exact = sin(2*M_PI*(i/(M*M))/M) + cos(2*M_PI*(i % M)/M);
+      maxerr = fmax(maxerr, fabs(g[i] - exact));
+    }
+    printf("Resampling from %d^3 to %d^3 is off by at most %g\n", N, M, maxerr);
+    if (maxerr > 0.05) {
+      printf("FAIL: resampling is not accurate\n");
+      errorcode++;
+    }
+  }
+
+  // With a single b, every point has its own grid, so every warm
+  // start has to be resampled.
+  errorcode += check_sweep(8, 1);
+  errorcode += check_sweep(8, 5);
+  return errorcode;
+}
@@ -0,0 +1,134 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include "PairCorrelationTable.h"
+
+// We make a table from fake Monte Carlo files holding a smooth g(r),
+// and check that we get it back, both one at a time and in batches.
+
+const int num_eta = 10, num_r = 400;
+const double eta_step = 0.05, r_step = 0.02;
+
+int retval = 0;
+
+double smooth_g(double eta, double r) {
+  return 1 + 4*eta*exp(-(r - 2))*cos(3*(r - 2));
+}
+
+// Row j of the Monte Carlo data is at bin_r(j).
+double bin_r(int j) {
+  return j ? 2 + (j - 0.5)*r_step : 2;
+}
+
+void check(const char *name, double got, double expected, double tolerance) {
+  const bool both_nan = got != got && expected != expected;
+  if (!both_nan && !(fabs(got - expected) <= tolerance)) {
+    printf("FAIL: %s is %.17g rather than %.17g\n", name, got, expected);
+    retval++;
+  }
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  char dir[] = "/tmp/deft-gr-XXXXXX";
+  if (!mkdtemp(dir)) {
+    printf("FAIL: unable to create a directory\n");
+    return 1;
+  }
+  char pattern[4096], fname[4096], table[4096];
+  snprintf(pattern, sizeof(pattern), "%s/gr-%%04.2f.dat", dir);
+  snprintf(table, sizeof(table), "%s/gr.table", dir);
+  for (int k=1; k<=num_eta; k++) {
+    const double eta = k*eta_step;
+    snprintf(fname, sizeof(fname), pattern, eta);
+    FILE *f = fopen(fname, "w");
+    for (int j=0; j<num_r; j++) fprintf(f, "%.17g\t%.17g\n", bin_r(j), eta*smooth_g(eta, bin_r(j)));
+    fclose(f);
+  }
+  if (!update_pair_correlation_table(table, pattern, num_eta, eta_step)) {
+    printf("FAIL: unable to make the table\n");
+    return 1;
+  }
+
+  {
+    PairCorrelationTable g(table);
+    // We should get back the data itself.
+    for (int k=0; k<=num_eta; k++) {
+      for (int j=0; j<num_r; j++) {
+        check("g at a data point", g(k*eta_step, bin_r(j)), smooth_g(k*eta_step, bin_r(j)), 1e-13);
+      }
+    }
+    // In between, cubic interpolation should be close to our smooth
+    // function, with an error of order r_step^3 times its third
+    // derivative.
+    double maxerr = 0;
+    for (double eta = 0.013; eta < 0.5; eta += 0.0371) {
+      for (double r = 2 + r_step; r < g.max_r(); r += 0.0137) {
+        maxerr = fmax(maxerr, fabs(g(eta, r) - smooth_g(eta, r)));
+      }
+    }
+    printf("Largest interpolation error is %g\n", maxerr);
+    if (maxerr > 1e-4) {
+      printf("FAIL: interpolation is not smooth enough\n");
+      retval++;
+    }
+    check("g inside the core", g(0.2, 1.5), 0, 0);
+    check("g beyond the table", g(0.2, g.max_r() + 0.1), 1, 0);
+    check("g at too high eta", g(0.6, 3), NAN, 0);
+    check("g at negative eta", g(-0.1, 3), NAN, 0);
+    check("g at NaN eta", g(NAN, 3), NAN, 0);
+    check("g inside the core at NaN eta", g(NAN, 1.5), NAN, 0);
+    check("g beyond the table at NaN eta", g(NAN, g.max_r() + 0.1), NAN, 0);
+
+    // A batch lookup should agree, apart from roundoff (the compiler
+    // may use fused multiply-adds in the scalar code).  We use an odd
+    // number, so the scalar tail gets exercised.
+    const int n = 1001;
+    std::vector<double> eta(n), r(n), out(n);
+    for (int i=0; i<n; i++) {
+      eta[i] = 0.52*i/(n - 1) - 0.01;
+      r[i] = 1.9 + 0.01*i;
+    }
+    // A NaN eta gives NaN even inside the core or beyond the table.
+    eta[5] = eta[17] = eta[n-3] = NAN;
+    g.lookup(eta.data(), r.data(), out.data(), n);
+    for (int i=0; i<n; i++) check("batch lookup", out[i], g(eta[i], r[i]), 1e-14);
+    check("batch lookup inside the core at NaN eta", out[5], NAN, 0);
+    check("batch lookup beyond the table at NaN eta", out[n-3], NAN, 0);
+  }
+
+  // The table shouldn't be rewritten when it is already up to date.
+  struct stat before, after;
+  stat(table, &before);
+  sleep(1);
+  update_pair_correlation_table(table, pattern, num_eta, eta_step);
+  stat(table, &after);
+  if (after.st_mtime != before.st_mtime) {
+    printf("FAIL: the table was rewritten needlessly\n");
+    retval++;
+  }
+
+  for (int k=1; k<=num_eta; k++) {
+    snprintf(fname, sizeof(fname), pattern, k*eta_step);
+    remove(fname);
+  }
+  remove(table);
+  rmdir(dir);
+
+  if (retval == 0) printf("PASS\n");
+  return retval;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include "new/Vector.h"
+
+int num_errors = 0;
+
+void check(const char *name, long calls, long ffts, long bytes) {
+  profiler_state &prof = the_profiler();
+  if (!prof.entries.count(name)) {
+    printf("FAIL: no profile for %s\n", name);
+    num_errors++;
+    return;
+  }
+  const profile_entry &e = prof.entries[name];
+  printf("%s: %ld calls, %ld FFTs, %ld bytes in %g s (%g s self)\n",
+         name, e.calls, e.ffts, e.bytes_allocated, e.seconds, e.self_seconds);
+  if (e.calls != calls) {
+    printf("FAIL: %s should have %ld calls, not %ld\n", name, calls, e.calls);
+    num_errors++;
+  }
+  if (e.ffts != ffts) {
+    printf("FAIL: %s should have %ld FFTs, not %ld\n", name, ffts, e.ffts);
+    num_errors++;
+  }
+  if (e.bytes_allocated != bytes) {
+    printf("FAIL: %s should allocate %ld bytes, not %ld\n", name, bytes, e.bytes_allocated);
+    num_errors++;
+  }
+  if (e.self_seconds > e.seconds || e.self_seconds < 0) {
+    printf("FAIL: %s has self time %g out of %g\n", name, e.self_seconds, e.seconds);
+    num_errors++;
+  }
+}
+
+// inner does one FFT and one inverse FFT of an N^3 grid.
+void inner(int N) {
+  profile_scope profile("inner");
+  Vector rs(N*N*N);
+  rs = 1.0;
+  ComplexVector ks = fft(N, N, N, 1.0, rs);
+  Vector again = ifft(N, N, N, 1.0, ks);
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  {
+    // Nothing is recorded before we turn on the profiler.
+    profile_scope profile("before");
+    Vector v(100);
+  }
+  start_profiling();
+  const int N = 8;
+  for (int i=0; i<3; i++) {
+    profile_scope profile("outer");
+    Vector scratch(1000);
+    inner(N);
+    {
+      // An unnamed scope is counted in whatever encloses it.
+      profile_scope unnamed("");
+      Vector more(10);
+    }
+  }
+  if (the_profiler().entries.count("before")) {
+    printf("FAIL: profiled before start_profiling\n");
+    num_errors++;
+  }
+  if (the_profiler().entries.count("")) {
+    printf("FAIL: profiled an unnamed scope\n");
+    num_errors++;
+  }
+
+  // Each field also carries a small header, so we just check that we
+  // see at least the bytes of the data itself.
+  const profile_entry &in = the_profiler().entries["inner"];
+  check("inner", 3, 6, in.bytes_allocated);
+  if (in.bytes_allocated < 3*long(N*N*N*sizeof(double) + (N*N*(N/2+1))*sizeof(std::complex<double>))) {
+    printf("FAIL: inner allocated too little: %ld\n", in.bytes_allocated);
+    num_errors++;
+  }
+  check("outer", 3, 6, the_profiler().entries["outer"].bytes_allocated);
+  const profile_entry &out = the_profiler().entries["outer"];
+  if (out.bytes_allocated < in.bytes_allocated + 3*long(1010*sizeof(double))) {
+    printf("FAIL: outer allocated too little: %ld\n", out.bytes_allocated);
+    num_errors++;
+  }
+  if (out.self_seconds > out.seconds - in.seconds + 1e-9) {
+    printf("FAIL: outer self time %g includes inner time\n", out.self_seconds);
+    num_errors++;
+  }
+  if (out.peak_bytes < in.peak_bytes) {
+    printf("FAIL: outer peak %ld is below inner peak %ld\n", out.peak_bytes, in.peak_bytes);
+    num_errors++;
+  }
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
@@ -0,0 +1,122 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include "vector3d.h"
+
+const int num_threads = 4;
+const int N = 100000;
+
+// walk sums up a random walk drawn from the stream the calling thread
+// is using.
+vector3d walk() {
+  vector3d sum;
+  for (int i=0; i<N; i++) sum += vector3d::ran(1.0);
+  return sum;
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  int errorcode = 0;
+
+  // A jump by n < 1024 steps should agree with calling rand64 n times.
+  const int steps[] = { 0, 1, 5, 63, 64, 100, 1000, 1023 };
+  for (unsigned k=0; k<sizeof(steps)/sizeof(steps[0]); k++) {
+    Rand jumped(42), stepped(42);
+    uint64_t poly[16] = {0};
+    poly[steps[k]/64] = uint64_t(1) << (steps[k] % 64);
+    jumped.jump(poly);
+    for (int i=0; i<steps[k]; i++) stepped.rand64();
+    for (int i=0; i<20; i++) {
+      if (jumped.rand64() != stepped.rand64()) {
+        printf("FAIL: a jump of %d steps went somewhere else!\n", steps[k]);
+        errorcode++;
+        break;
+      }
+    }
+  }
+
+  // fill should give the same numbers as rand.
+  {
+    Rand a(7), b(7);
+    double filled[37];
+    a.fill(filled, 37);
+    for (int i=0; i<37; i++) {
+      if (filled[i] != b.rand()) {
+        printf("FAIL: fill disagrees with rand at %d\n", i);
+        errorcode++;
+        break;
+      }
+    }
+  }
+
+  // The streams should depend only on the seed, and differ from one
+  // another.
+  random::seed(1);
+  Rand s0 = random::stream(0), s1 = random::stream(1), s1again = random::stream(1);
+  if (s1.rand64() != s1again.rand64()) {
+    printf("FAIL: stream(1) is not reproducible!\n");
+    errorcode++;
+  }
+  if (s0.rand64() == s1.rand64()) {
+    printf("FAIL: streams 0 and 1 agree!\n");
+    errorcode++;
+  }
+
+  // Walks on several threads should agree exactly with the same walks
+  // done one after another.
+  std::vector<vector3d> serial(num_threads), parallel(num_threads);
+  for (int t=0; t<num_threads; t++) {
+    random_stream mine(random::stream(t));
+    random::use(&mine);
+    serial[t] = walk();
+    random::use(0);
+  }
+  std::vector<std::thread> threads;
+  for (int t=0; t<num_threads; t++) {
+    threads.push_back(std::thread([t, &parallel]() {
+          random_stream mine(random::stream(t));
+          random::use(&mine);
+          parallel[t] = walk();
+        }));
+  }
+  for (int t=0; t<num_threads; t++) threads[t].join();
+  for (int t=0; t<num_threads; t++) {
+    printf("walk %d ends at (%g, %g, %g)\n", t, serial[t].x, serial[t].y, serial[t].z);
+    if (parallel[t] != serial[t]) {
+      printf("FAIL: walk %d differs on its own thread!\n", t);
+      errorcode++;
+    }
+  }
+
+  // And the Gaussian variates should have zero mean and unit variance.
+  double sum = 0, sumsq = 0;
+  for (int i=0; i<N; i++) {
+    const double g = random::gaussian();
+    sum += g;
+    sumsq += g*g;
+  }
+  const double mean = sum/N, variance = sumsq/N - mean*mean;
+  printf("gaussian mean %g and variance %g\n", mean, variance);
+  if (fabs(mean) > 5/sqrt(N) || fabs(variance - 1) > 5*sqrt(2.0/N)) {
+    printf("FAIL: the gaussian variates are not distributed right!\n");
+    errorcode++;
+  }
+  return errorcode;
+}
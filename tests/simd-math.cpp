@@ -0,0 +1,132 @@
+// Deft is a density functional package developed by the research
+// group of Professor David Roundy
+//
+// Copyright 2010 The Deft Authors
+//
+// Deft is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// You should have received a copy of the GNU General Public License
+// along with deft; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Please see the file AUTHORS for a list of authors.
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include "simdmath.h"
+
+const int N = 100003; // odd, so we exercise the scalar tail of the array code
+
+// relerr returns the error in units of DBL_EPSILON relative to the
+// libm answer.  When the answer is tiny compared with "scale" we
+// measure the error relative to scale instead, since the
+// trigonometric functions cannot do better than that.
+double relerr(double mine, double libm, double scale = 0) {
+  if (mine == libm) return 0;
+  if (libm != libm) return (mine != mine) ? 0 : HUGE_VAL;
+  const double denom = fabs(libm) > scale ? fabs(libm) : scale;
+  return fabs(mine - libm)/denom/DBL_EPSILON;
+}
+
+int check(const char *name, double maxerr, double allowed) {
+  printf("%8s: max error %6.3g ulp (allowed %g)\n", name, maxerr, allowed);
+  if (maxerr > allowed) {
+    printf("FAIL: %s is not accurate enough!\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  int retval = 0;
+  double *x = new double[N], *out = new double[N], *out2 = new double[N];
+
+  {
+    for (int i=0; i<N; i++) x[i] = -745 + 1455.0*i/(N-1);
+    simd_exp(x, out, N);
+    double maxerr = 0, maxsubnormal = 0;
+    for (int i=0; i<N; i++) {
+      if (exp(x[i]) > DBL_MIN) {
+        maxerr = fmax(maxerr, relerr(simd_exp(x[i]), exp(x[i])));
+        maxerr = fmax(maxerr, relerr(out[i], exp(x[i])));
+      } else {
+        // subnormal results only have a few bits to get right, so we
+        // measure their error in units of the smallest subnormal.
+        maxsubnormal = fmax(maxsubnormal, fabs(out[i] - exp(x[i]))/4.9406564584124654e-324);
+      }
+    }
+    retval += check("exp", maxerr, 2);
+    retval += check("tiny exp", maxsubnormal, 1);
+  }
+  {
+    double maxerr = 0;
+    for (int i=0; i<N; i++) {
+      const double y = exp(-740 + 1450.0*i/(N-1)) * (1 + 0.37*sin(i));
+      maxerr = fmax(maxerr, relerr(simd_log(y), log(y)));
+    }
+    for (int i=0; i<N; i++) x[i] = 0.5 + 1.5*i/(N-1); // near 1 is the hard part
+    simd_log(x, out, N);
+    for (int i=0; i<N; i++) maxerr = fmax(maxerr, relerr(out[i], log(x[i]), 1e-16));
+    retval += check("log", maxerr, 2);
+  }
+  {
+    double maxerr = 0;
+    for (int i=0; i<N; i++) x[i] = -1e3 + 2e3*i/(N-1) + 1e-3*sin(i);
+    simd_sin(x, out, N);
+    simd_cos(x, out2, N);
+    for (int i=0; i<N; i++) {
+      maxerr = fmax(maxerr, relerr(out[i], sin(x[i]), 1));
+      maxerr = fmax(maxerr, relerr(out2[i], cos(x[i]), 1));
+      double s, c;
+      simd_sincos(x[i], &s, &c);
+      maxerr = fmax(maxerr, relerr(s, sin(x[i]), 1));
+      maxerr = fmax(maxerr, relerr(c, cos(x[i]), 1));
+    }
+    for (int i=0; i<N; i++) {
+      const double y = 1e9*(2.0*i/(N-1) - 1);
+      maxerr = fmax(maxerr, relerr(simd_sin(y), sin(y), 1));
+      maxerr = fmax(maxerr, relerr(simd_cos(y), cos(y), 1));
+    }
+    retval += check("sin/cos", maxerr, 2);
+  }
+  {
+    double maxerr = 0;
+    for (int i=0; i<N; i++) x[i] = 1e-5 + 10.0*i/(N-1);
+    simd_pow(x, 1.0/3, out, N);
+    for (int i=0; i<N; i++) {
+      maxerr = fmax(maxerr, relerr(out[i], pow(x[i], 1.0/3)));
+      maxerr = fmax(maxerr, relerr(simd_pow(x[i], -2.5), pow(x[i], -2.5)));
+    }
+    retval += check("pow", maxerr, 40);
+  }
+
+  // Finally, the special cases that libm handles for us.
+  if (simd_exp(-HUGE_VAL) != 0 || simd_exp(HUGE_VAL) != HUGE_VAL || simd_exp(1000) != HUGE_VAL ||
+      simd_exp(-1000) != 0 || simd_exp(0) != 1 || !isnan(simd_exp(NAN))) {
+    printf("FAIL: special cases of exp\n");
+    retval++;
+  }
+  if (simd_log(0) != -HUGE_VAL || !isnan(simd_log(-1)) || simd_log(HUGE_VAL) != HUGE_VAL ||
+      simd_log(1) != 0 || !isnan(simd_log(NAN)) || relerr(simd_log(1e-320), log(1e-320)) > 2) {
+    printf("FAIL: special cases of log\n");
+    retval++;
+  }
+  if (simd_sin(0) != 0 || simd_cos(0) != 1 || !isnan(simd_sin(NAN)) || !isnan(simd_cos(HUGE_VAL))) {
+    printf("FAIL: special cases of sin/cos\n");
+    retval++;
+  }
+  if (simd_pow(0, 1.5) != 0 || simd_pow(0, -1.5) != HUGE_VAL || simd_pow(1, 0.3) != 1) {
+    printf("FAIL: special cases of pow\n");
+    retval++;
+  }
+
+  delete[] x;
+  delete[] out;
+  delete[] out2;
+  return retval;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include "Monte-Carlo/square-well.h"
+#include "handymath.h"
+
+// Aggregation-volume-bias and cluster moves should keep the neighbor
+// tables and interaction counts up to date, and should sample the
+// same distribution as plain translations, which we can check exactly
+// with two balls.
+
+int num_errors = 0;
+
+void setup(sw_simulation &sw, int N, double cell, double neighbor_R) {
+  sw.well_width = 1.3;
+  sw.walls = 0;
+  sw.sticky_wall = 0;
+  sw.N = N;
+  for (int i=0; i<3; i++) sw.len[i] = cell;
+  sw.translation_scale = 0.3;
+  sw.neighbor_R = neighbor_R;
+  sw.max_neighbors = std::min(N, 2*max_balls_within(2+neighbor_R));
+  sw.interaction_distance = 2*sw.well_width;
+  sw.energy_levels = N*max_balls_within(sw.interaction_distance*1.1)/2 + 1;
+  sw.energy_histogram = new long[sw.energy_levels]();
+  sw.ln_energy_weights = new double[sw.energy_levels]();
+  sw.optimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_observation = new bool[sw.energy_levels]();
+  sw.biggest_energy_transition = max_balls_within(sw.interaction_distance + 1);
+  sw.transitions_table = new long[sw.energy_levels*(2*sw.biggest_energy_transition+1)]();
+  sw.walkers_up = new long[sw.energy_levels]();
+  sw.iteration = 0;
+  sw.min_important_energy = 0;
+  sw.max_entropy_state = 0;
+  sw.min_energy_state = 0;
+  sw.balls = new ball[sw.N];
+}
+
+bool initialize(sw_simulation &sw) {
+  if (sw.initialize_neighbor_tables() < 0) {
+    printf("FAIL: too many neighbors\n");
+    num_errors++;
+    return false;
+  }
+  sw.energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                     sw.len, sw.walls, sw.sticky_wall);
+  return true;
+}
+
+void cleanup(sw_simulation &sw) {
+  sw.free_neighbor_tables();
+  delete[] sw.balls;
+  delete[] sw.energy_histogram;
+  delete[] sw.ln_energy_weights;
+  delete[] sw.optimistic_samples;
+  delete[] sw.pessimistic_samples;
+  delete[] sw.pessimistic_observation;
+  delete[] sw.transitions_table;
+  delete[] sw.walkers_up;
+}
+
+void check_tables(const sw_simulation &sw, const char *name) {
+  int bad_counts = 0, overlaps = 0;
+  for (int i=0; i<sw.N; i++) {
+    if (sw.interactions[i] != count_interactions(i, sw.balls, sw.interaction_distance,
+                                                 (double *)sw.len, sw.walls, sw.sticky_wall)) {
+      bad_counts++;
+    }
+    for (int j=i+1; j<sw.N; j++) {
+      if (overlap(sw.balls[i], sw.balls[j], sw.len, sw.walls)) overlaps++;
+    }
+  }
+  if (bad_counts) {
+    printf("FAIL: %s has %d bad interaction counts\n", name, bad_counts);
+    num_errors++;
+  }
+  if (overlaps) {
+    printf("FAIL: %s has %d overlapping pairs\n", name, overlaps);
+    num_errors++;
+  }
+  const int energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                            (double *)sw.len, sw.walls, sw.sticky_wall);
+  if (energy != sw.energy) {
+    printf("FAIL: %s has energy %d rather than %d\n", name, sw.energy, energy);
+    num_errors++;
+  }
+}
+
+// A vapor at a low temperature, where the balls clump.
+void run_bookkeeping(bool use_transition_matrix) {
+  const int cells_per_side = 3;
+  const double a = 4.5; // a packing fraction of 0.18
+  sw_simulation sw;
+  setup(sw, 4*cells_per_side*cells_per_side*cells_per_side, a*cells_per_side, 1.3);
+  sw.min_T = 0.3;
+  sw.initialize_canonical(sw.min_T);
+  sw.avb_fraction = 0.3;
+  sw.cluster_fraction = 0.2;
+  const double basis[4][3] = {{0,0,0}, {0.5,0.5,0}, {0.5,0,0.5}, {0,0.5,0.5}};
+  int b = 0;
+  for (int i=0; i<cells_per_side; i++) {
+    for (int j=0; j<cells_per_side; j++) {
+      for (int k=0; k<cells_per_side; k++) {
+        for (int l=0; l<4; l++) {
+          sw.balls[b++].pos = vector3d(a*(i + basis[l][0]) + 0.25*a,
+                                       a*(j + basis[l][1]) + 0.25*a,
+                                       a*(k + basis[l][2]) + 0.25*a);
+        }
+      }
+    }
+  }
+  if (!initialize(sw)) return;
+  const char *name = use_transition_matrix ? "transition matrix" : "canonical weights";
+  // Every move must report exactly the balls that it moved.
+  std::vector<vector3d> old_pos(sw.N);
+  std::vector<int> moved(sw.N);
+  int misreported = 0;
+  for (int i=0; i<200*sw.N; i++) {
+    for (int j=0; j<sw.N; j++) old_pos[j] = sw.balls[j].pos;
+    const int num_moved = sw.move_a_ball(use_transition_matrix, &moved[0]);
+    std::vector<bool> reported(sw.N, false);
+    for (int k=0; k<num_moved; k++) reported[moved[k]] = true;
+    for (int j=0; j<sw.N; j++) {
+      if (reported[j] != ((sw.balls[j].pos - old_pos[j]).normsquared() > 0)) misreported++;
+    }
+  }
+  if (misreported) {
+    printf("FAIL: %s misreported which balls moved %d times\n", name, misreported);
+    num_errors++;
+  }
+  printf("%s: %ld of %ld avb moves and %ld of %ld cluster moves accepted, energy %d\n",
+         name, sw.moves.avb_working, sw.moves.avb_total,
+         sw.moves.cluster_working, sw.moves.cluster_total, sw.energy);
+  if (sw.moves.avb_working == 0 || sw.moves.cluster_working == 0) {
+    printf("FAIL: %s never made an avb or cluster move\n", name);
+    num_errors++;
+  }
+  check_tables(sw, name);
+  cleanup(sw);
+}
+
+// Two balls in a periodic cell are within each other's well with a
+// probability given by the volume of the well.  The avb moves propose
+// going into the well far more often than that, so any mistake in the
+// bias would show up here.
+void run_two_balls(double T, double avb_fraction, double cluster_fraction) {
+  const double cell = 6;
+  sw_simulation sw;
+  setup(sw, 2, cell, 4); // every ball is always in every neighbor table
+  if (T) sw.initialize_canonical(T);
+  sw.avb_fraction = avb_fraction;
+  sw.cluster_fraction = cluster_fraction;
+  sw.balls[0].pos = vector3d(1, 1, 1);
+  sw.balls[1].pos = vector3d(4, 4, 4);
+  if (!initialize(sw)) return;
+  const int num_moves = 2000000;
+  for (int i=0; i<num_moves; i++) sw.move_a_ball();
+  char name[1024];
+  sprintf(name, "two balls at T=%g with %g avb and %g cluster moves", T, avb_fraction,
+          cluster_fraction);
+  check_tables(sw, name);
+
+  const double d = sw.interaction_distance;
+  const double core = 4*M_PI/3*8, well = 4*M_PI/3*d*d*d - core;
+  const double boltzmann = T ? exp(1/T) : 1;
+  const double expected = well*boltzmann/(well*boltzmann + cell*cell*cell - core - well);
+  const double bonded = sw.energy_histogram[1]/double(num_moves);
+  printf("%s: bonded %g of the time rather than %g\n", name, bonded, expected);
+  if (fabs(bonded - expected) > 0.02*expected) {
+    printf("FAIL: %s samples the wrong distribution\n", name);
+    num_errors++;
+  }
+  // The transitions table counts moves as if at infinite temperature,
+  // so it should be in detailed balance with the ideal distribution.
+  const double infinite_T = well/(cell*cell*cell - core - well);
+  const double ratio = sw.transition_matrix(1, 0)/sw.transition_matrix(0, 1);
+  printf("%s: transitions give a ratio of %g rather than %g\n", name, ratio, infinite_T);
+  if (fabs(ratio - infinite_T) > 0.03*infinite_T) {
+    printf("FAIL: %s has a biased transitions table\n", name);
+    num_errors++;
+  }
+  cleanup(sw);
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  random::seed(0);
+  run_bookkeeping(false);
+  run_bookkeeping(true);
+
+  run_two_balls(0, 0, 0);
+  run_two_balls(0, 0.5, 0.2);
+  run_two_balls(0.5, 0.5, 0.2);
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
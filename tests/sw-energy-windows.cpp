@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <mutex>
+#include <chrono>
+#include "Monte-Carlo/square-well.h"
+#include "handymath.h"
+
+// A walker confined to an energy window should never leave it, and
+// initializing in several windows at once should give the same
+// density of states as a single walker, whether we combine the
+// windows' transition matrices or stitch together their weights.
+// Every window's walker must get into its window, from whichever side
+// it starts out on, and make moves there.  A window whose walker runs
+// out of iterations before it gets in must not spoil the weights.  We
+// also print how much faster the windows are on the wall clock.
+
+int num_errors = 0;
+
+void setup(sw_simulation &sw) {
+  sw.well_width = 1.3;
+  sw.walls = 0;
+  sw.sticky_wall = 0;
+  sw.N = 8;
+  for (int i=0; i<3; i++) sw.len[i] = 6;
+  sw.translation_scale = 0.5;
+  sw.neighbor_R = 2*sw.well_width;
+  sw.max_neighbors = sw.N;
+  sw.interaction_distance = 2*sw.well_width;
+  sw.energy_levels = sw.N*max_balls_within(sw.interaction_distance*1.1)/2 + 1;
+  sw.energy_histogram = new long[sw.energy_levels]();
+  sw.ln_energy_weights = new double[sw.energy_levels]();
+  sw.optimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_observation = new bool[sw.energy_levels]();
+  sw.biggest_energy_transition = max_balls_within(sw.interaction_distance + 1);
+  sw.transitions_table = new long[sw.energy_levels*(2*sw.biggest_energy_transition+1)]();
+  sw.walkers_up = new long[sw.energy_levels]();
+  sw.iteration = 0;
+  sw.min_T = 0.5;
+  sw.min_important_energy = 0;
+  sw.max_entropy_state = 0;
+  sw.min_energy_state = 0;
+  sw.end_condition = init_iter_limit;
+  sw.sim_dos_type = transition_dos;
+  sw.init_iters = 200000;
+
+  sw.balls = new ball[sw.N];
+  for (int i=0; i<sw.N; i++) {
+    sw.balls[i].pos = vector3d(3*(i % 2) + 1, 3*((i/2) % 2) + 1, 3*(i/4) + 1);
+  }
+  sw.initialize_neighbor_tables();
+  sw.energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                     sw.len, sw.walls, sw.sticky_wall);
+  sw.max_entropy_state = sw.initialize_max_entropy();
+  sw.reset_histograms();
+  sw.iteration = 0;
+}
+
+void cleanup(sw_simulation &sw) {
+  sw.free_neighbor_tables();
+  delete[] sw.balls;
+  delete[] sw.energy_histogram;
+  delete[] sw.ln_energy_weights;
+  delete[] sw.optimistic_samples;
+  delete[] sw.pessimistic_samples;
+  delete[] sw.pessimistic_observation;
+  delete[] sw.transitions_table;
+  delete[] sw.walkers_up;
+}
+
+void check_confinement() {
+  sw_simulation sw;
+  setup(sw);
+  sw.window_min = sw.energy;
+  sw.window_max = sw.energy + 2;
+  for (int i=0; i<1000*sw.N; i++) sw.move_a_ball();
+  long outside = 0, leaving = 0;
+  for (int e=0; e<sw.energy_levels; e++) {
+    if (e < sw.window_min || e > sw.window_max) outside += sw.energy_histogram[e];
+  }
+  for (int de=1; de<=sw.biggest_energy_transition; de++) {
+    if (sw.window_max + de < sw.energy_levels) leaving += sw.transitions(sw.window_max, de);
+    if (sw.window_min - de >= 0) leaving += sw.transitions(sw.window_min, -de);
+  }
+  if (outside) {
+    printf("FAIL: the walker spent %ld moves outside of its window\n", outside);
+    num_errors++;
+  }
+  if (!leaving) {
+    printf("FAIL: moves out of the window are missing from the transitions table\n");
+    num_errors++;
+  }
+  cleanup(sw);
+}
+
+// ln_dos gives the density of states implied by the weights, relative
+// to the max_entropy_state.
+double ln_dos(const sw_simulation &sw, int e) {
+  return sw.ln_energy_weights[sw.max_entropy_state] - sw.ln_energy_weights[e];
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void compare(const char *name, dos_types dos_type,
+             void initialize(sw_simulation &)) {
+  random::seed(1);
+  sw_simulation single;
+  setup(single);
+  single.sim_dos_type = dos_type;
+  single.init_iters *= 2;
+  const std::chrono::steady_clock::time_point single_start = std::chrono::steady_clock::now();
+  initialize(single);
+  const double single_seconds = seconds_since(single_start);
+
+  random::seed(1);
+  sw_simulation windowed;
+  setup(windowed);
+  windowed.sim_dos_type = dos_type;
+  windowed.init_iters *= 2;
+  std::mutex record;
+  std::vector<long> accepted;
+  int started_outside = 0;
+  const std::chrono::steady_clock::time_point windowed_start = std::chrono::steady_clock::now();
+  windowed.initialize_in_windows(3, 0.5, [&](sw_simulation &w) {
+      const bool outside = w.energy < w.window_min || w.energy > w.window_max;
+      initialize(w);
+      std::lock_guard<std::mutex> lock(record);
+      accepted.push_back(w.moves.working);
+      started_outside += outside;
+    });
+  const double windowed_seconds = seconds_since(windowed_start);
+  printf("%s: %.3g seconds in one walker, %.3g seconds in windows, %.2g times faster\n",
+         name, single_seconds, windowed_seconds, single_seconds/windowed_seconds);
+  if (started_outside) {
+    printf("FAIL: %s had %d walkers start outside of their windows\n", name, started_outside);
+    num_errors++;
+  }
+  if (accepted.size() != 3) {
+    printf("FAIL: %s initialized %d of 3 windows\n", name, int(accepted.size()));
+    num_errors++;
+  }
+  for (size_t k=0; k<accepted.size(); k++) {
+    printf("%s: a window accepted %ld moves\n", name, accepted[k]);
+    if (accepted[k] == 0) {
+      printf("FAIL: %s has a window that never accepted a move\n", name);
+      num_errors++;
+    }
+  }
+
+  printf("%s: max entropy state %d vs %d, min important energy %d vs %d\n", name,
+         single.max_entropy_state, windowed.max_entropy_state,
+         single.min_important_energy, windowed.min_important_energy);
+  const int lo = max(single.max_entropy_state, windowed.max_entropy_state);
+  const int hi = min(single.min_important_energy, windowed.min_important_energy);
+  if (hi - lo < 4) {
+    printf("FAIL: %s covers too few energies\n", name);
+    num_errors++;
+  }
+  double maxerr = 0;
+  for (int e=lo; e<=hi; e++) {
+    const double err = fabs((ln_dos(windowed, e) - ln_dos(windowed, lo))
+                            - (ln_dos(single, e) - ln_dos(single, lo)));
+    maxerr = max(maxerr, err);
+  }
+  printf("%s: ln_dos differs by at most %g over energies %d to %d\n", name, maxerr, lo, hi);
+  if (maxerr > 0.3) {
+    printf("FAIL: %s in windows gives a different density of states\n", name);
+    num_errors++;
+  }
+  cleanup(single);
+  cleanup(windowed);
+}
+
+// With too few iterations for the walkers to reach every window, the
+// windows that never initialize must be left out, and their energies
+// bridged with the transition matrix.
+void check_unreached_windows() {
+  random::seed(2);
+  sw_simulation sw;
+  setup(sw);
+  sw.sim_dos_type = histogram_dos;
+  sw.init_iters = 5;
+  std::mutex record;
+  int initialized = 0;
+  sw.initialize_in_windows(5, 0.5, [&](sw_simulation &w) {
+      w.initialize_wang_landau(1, 2, 1/0.95 - 1, 1e-8, false);
+      std::lock_guard<std::mutex> lock(record);
+      initialized++;
+    });
+  printf("unreached windows: %d of 5 windows initialized\n", initialized);
+  if (initialized == 5) {
+    printf("FAIL: every window initialized, so we have not checked skipping them\n");
+    num_errors++;
+  }
+  for (int e=sw.max_entropy_state; e<=sw.min_important_energy; e++) {
+    if (!(fabs(ln_dos(sw, e)) < 1e3)) { // double negatives handle NaNs correctly.
+      printf("FAIL: ln_dos at energy %d is %g\n", e, ln_dos(sw, e));
+      num_errors++;
+    }
+  }
+  cleanup(sw);
+}
+
+void tmmc(sw_simulation &sw) {
+  sw.initialize_transitions();
+}
+
+void wang_landau(sw_simulation &sw) {
+  sw.initialize_wang_landau(1, 2, 1/0.95 - 1, 1e-8, false);
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  random::seed(0);
+  check_confinement();
+  compare("tmmc", transition_dos, tmmc);
+  compare("wang-landau", histogram_dos, wang_landau);
+  check_unreached_windows();
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
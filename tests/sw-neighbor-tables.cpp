@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include "Monte-Carlo/square-well.h"
+#include "handymath.h"
+
+int num_errors = 0;
+
+// Every ball's neighbor table should hold exactly the balls whose
+// neighbor centers are within reach of its own, in order, and its
+// cached interaction count should be up to date.
+void check_tables(const sw_simulation &sw, const char *name) {
+  int bad = 0;
+  for (int i=0; i<sw.N; i++) {
+    const ball &a = sw.balls[i];
+    int n = 0;
+    for (int j=0; j<sw.N; j++) {
+      const ball &b = sw.balls[j];
+      const bool should_be = (i != j) &&
+        (periodic_diff(a.neighbor_center, b.neighbor_center, sw.len, sw.walls).normsquared()
+         < sqr(a.R + b.R + sw.neighbor_R));
+      if (should_be) {
+        if (n >= a.num_neighbors || a.neighbors[n] != j) bad++;
+        else n++;
+      }
+    }
+    if (n != a.num_neighbors) bad++;
+  }
+  if (bad) {
+    printf("FAIL: %s has %d bad neighbor tables\n", name, bad);
+    num_errors++;
+  }
+  int bad_counts = 0;
+  for (int i=0; i<sw.N; i++) {
+    if (sw.interactions[i] != count_interactions(i, sw.balls, sw.interaction_distance,
+                                                 (double *)sw.len, sw.walls, sw.sticky_wall)) {
+      bad_counts++;
+    }
+  }
+  if (bad_counts) {
+    printf("FAIL: %s has %d bad interaction counts\n", name, bad_counts);
+    num_errors++;
+  }
+  const int energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                            (double *)sw.len, sw.walls, sw.sticky_wall);
+  if (energy != sw.energy) {
+    printf("FAIL: %s has energy %d rather than %d\n", name, sw.energy, energy);
+    num_errors++;
+  }
+}
+
+void run(int cells_per_side, int walls) {
+  sw_simulation sw;
+  sw.well_width = 1.3;
+  sw.walls = walls;
+  sw.sticky_wall = 0;
+  sw.N = 4*cells_per_side*cells_per_side*cells_per_side;
+  const double a = 3.6; // a liquid-like packing fraction of 0.36
+  for (int i=0; i<3; i++) sw.len[i] = a*cells_per_side;
+  sw.translation_scale = 0.3;
+  sw.neighbor_R = 0.5*sw.well_width;
+  sw.max_neighbors = 2*max_balls_within(2+0.5*sw.well_width);
+  sw.interaction_distance = 2*sw.well_width;
+  sw.energy_levels = sw.N*max_balls_within(sw.interaction_distance*1.1)/2 + 1;
+  sw.energy_histogram = new long[sw.energy_levels]();
+  sw.ln_energy_weights = new double[sw.energy_levels]();
+  sw.optimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_samples = new long[sw.energy_levels]();
+  sw.pessimistic_observation = new bool[sw.energy_levels]();
+  sw.biggest_energy_transition = max_balls_within(sw.interaction_distance + 1);
+  sw.transitions_table = new long[sw.energy_levels*(2*sw.biggest_energy_transition+1)]();
+  sw.walkers_up = new long[sw.energy_levels]();
+  sw.iteration = 0;
+  sw.min_important_energy = 0;
+  sw.max_entropy_state = 0;
+  sw.min_energy_state = 0;
+
+  sw.balls = new ball[sw.N];
+  const double basis[4][3] = {{0,0,0}, {0.5,0.5,0}, {0.5,0,0.5}, {0,0.5,0.5}};
+  int b = 0;
+  for (int i=0; i<cells_per_side; i++) {
+    for (int j=0; j<cells_per_side; j++) {
+      for (int k=0; k<cells_per_side; k++) {
+        for (int l=0; l<4; l++) {
+          sw.balls[b++].pos = vector3d(a*(i + basis[l][0]) + 0.25*a,
+                                       a*(j + basis[l][1]) + 0.25*a,
+                                       a*(k + basis[l][2]) + 0.25*a);
+        }
+      }
+    }
+  }
+  if (sw.initialize_neighbor_tables() < 0) {
+    printf("FAIL: too many neighbors\n");
+    num_errors++;
+    return;
+  }
+  sw.energy = count_all_interactions(sw.balls, sw.N, sw.interaction_distance,
+                                     sw.len, sw.walls, sw.sticky_wall);
+  char name[1024];
+  sprintf(name, "N=%d with %d walls", sw.N, walls);
+  check_tables(sw, name);
+
+  const clock_t start = clock();
+  for (int i=0; i<200*sw.N; i++) sw.move_a_ball();
+  const double seconds = double(clock() - start)/CLOCKS_PER_SEC;
+  printf("%s: %ld moves (%ld accepted) with %d updates took %g seconds\n",
+         name, sw.moves.total, sw.moves.working, sw.moves.updates, seconds);
+  check_tables(sw, name);
+
+  sw.free_neighbor_tables();
+  delete[] sw.balls;
+  delete[] sw.energy_histogram;
+  delete[] sw.ln_energy_weights;
+  delete[] sw.optimistic_samples;
+  delete[] sw.pessimistic_samples;
+  delete[] sw.pessimistic_observation;
+  delete[] sw.transitions_table;
+  delete[] sw.walkers_up;
+}
+
+int main(int argc, char **argv) {
+  random::seed(0);
+  run(2, 0); // few enough cells that the grid wraps onto itself
+  run(3, 0);
+  run(6, 0);
+  run(6, 1);
+  run(6, 3);
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "tracing.h"
+
+int num_errors = 0;
+
+struct span_seen {
+  int count;
+  double ts, dur;
+};
+
+// read_span finds the span (or counter) called name in a line of the
+// trace, if it is there.
+bool read_span(const char *line, const char *name, span_seen *s) {
+  char pattern[128];
+  sprintf(pattern, "{\"name\":\"%s\",", name);
+  if (!strstr(line, pattern)) return false;
+  s->count++;
+  const char *ts = strstr(line, "\"ts\":");
+  const char *dur = strstr(line, "\"dur\":");
+  if (ts) s->ts = atof(ts + 5);
+  if (dur) s->dur = atof(dur + 6);
+  return true;
+}
+
+void worker(int n) {
+  for (int i=0; i<n; i++) trace_span trace("worker");
+}
+
+int main(int, char *argv[]) {
+  printf("Working on %s\n", argv[0]);
+  char fname[] = "/tmp/deft-trace-XXXXXX";
+  close(mkstemp(fname));
+  {
+    trace_span trace("before");
+  }
+  start_tracing(fname);
+  if (!tracing_enabled()) {
+    printf("FAIL: tracing did not start\n");
+    return 1;
+  }
+  // The worker records more events than fit in its buffer, so some
+  // are written while it is still running.
+  const int num_worker = 3*trace_buffer::capacity/2;
+  std::thread t(worker, num_worker);
+  {
+    trace_span trace("outer");
+    for (int i=0; i<2; i++) {
+      trace_span trace("inner");
+      trace_counter("count", i);
+    }
+  }
+  t.join();
+  finish_trace();
+
+  FILE *f = fopen(fname, "r");
+  if (!f) {
+    printf("FAIL: no trace written to %s\n", fname);
+    return 1;
+  }
+  span_seen before = {0,0,0}, outer = {0,0,0}, inner = {0,0,0}, count = {0,0,0};
+  span_seen worker = {0,0,0};
+  char line[1024];
+  int lines = 0;
+  bool inner_within_outer = true;
+  std::vector<double> inner_ts, inner_end;
+  while (fgets(line, sizeof(line), f)) {
+    lines++;
+    if (lines == 1 && strcmp(line, "[\n")) {
+      printf("FAIL: trace starts with %s", line);
+      num_errors++;
+    }
+    read_span(line, "before", &before);
+    read_span(line, "outer", &outer);
+    read_span(line, "count", &count);
+    read_span(line, "worker", &worker);
+    if (read_span(line, "inner", &inner)) {
+      inner_ts.push_back(inner.ts);
+      inner_end.push_back(inner.ts + inner.dur);
+    }
+  }
+  fclose(f);
+  remove(fname);
+  if (strcmp(line, "]\n")) {
+    printf("FAIL: trace ends with %s", line);
+    num_errors++;
+  }
+  for (unsigned i=0; i<inner_ts.size(); i++) {
+    if (inner_ts[i] < outer.ts || inner_end[i] > outer.ts + outer.dur) inner_within_outer = false;
+  }
+  printf("Found %d outer, %d inner, %d counter and %d worker events in %d lines\n",
+         outer.count, inner.count, count.count, worker.count, lines);
+  if (before.count) {
+    printf("FAIL: traced before start_tracing\n");
+    num_errors++;
+  }
+  if (outer.count != 1 || inner.count != 2 || count.count != 2 || worker.count != num_worker) {
+    printf("FAIL: wrong number of events\n");
+    num_errors++;
+  }
+  if (!inner_within_outer) {
+    printf("FAIL: inner spans are not within the outer span\n");
+    num_errors++;
+  }
+
+  if (num_errors == 0) printf("PASS\n");
+  return num_errors;
+}